@@ -0,0 +1,674 @@
+#include <cjson/cJSON.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "addon.h"
+#include "appstate.h"
+#include "bench_gen.h"
+#include "ini.h"
+#include "list.h"
+#include "osapi.h"
+#include "osstring.h"
+#include "wowpkg.h"
+#include "zipper.h"
+
+/**
+ * Every case is run at least BENCH_MIN_ITERATIONS times and then until it has
+ * spent the target time in the timed part or BENCH_MAX_ITERATIONS was reached.
+ * Untimed setup between iterations counts towards a separate, larger limit so
+ * that cases with expensive setup still finish.
+ */
+#define BENCH_MIN_ITERATIONS 3
+#define BENCH_MAX_ITERATIONS 1000
+#define BENCH_TARGET_SECONDS 0.2
+#define BENCH_QUICK_TARGET_SECONDS 0.02
+#define BENCH_SETUP_FACTOR 10.0
+
+/**
+ * The catalog is looked up relative to the working directory, see
+ * bench/CMakeLists.txt.
+ */
+#define BENCH_CATALOG_DIR WOWPKG_CATALOG_PATH
+
+#define BENCH_USAGE                                                                   \
+    "usage: wowpkg_bench [--quick] [--keep] [--filter <name>] [--out <file>] [--dir <dir>]\n" \
+    "\n"                                                                              \
+    "Runs the benchmarks and writes one JSON object per case to stdout or <file>.\n" \
+    "\n"                                                                              \
+    "  --quick          run smaller inputs for fewer iterations\n"                   \
+    "  --keep           do not remove the generated inputs\n"                        \
+    "  --filter <name>  only run cases whose name contains <name>\n"                 \
+    "  --out <file>     append results to <file> instead of stdout\n"                \
+    "  --dir <dir>      generate inputs in <dir>, it shall not exist\n"
+
+typedef struct Bench {
+    bool quick;
+    const char *filter;
+    FILE *out;
+    char timestamp[32];
+} Bench;
+
+/**
+ * Runs one iteration of a case. Returns 0 on success, -1 on error.
+ */
+typedef int (*BenchFn)(void *ctx);
+
+typedef struct BenchCase {
+    const char *name;
+    const char *variant;
+    size_t items;
+
+    // Called before every iteration, not timed. May be NULL.
+    BenchFn prepare;
+    BenchFn run;
+    void *ctx;
+} BenchCase;
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static bool bench_enabled(const Bench *b, const char *name)
+{
+    return b->filter == NULL || strstr(name, b->filter) != NULL;
+}
+
+static int bench_report(const Bench *b, const BenchCase *c, double *samples, size_t n)
+{
+    qsort(samples, n, sizeof(*samples), cmp_double);
+
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += samples[i];
+    }
+
+    double median = n % 2 == 1 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+
+    cJSON *json = cJSON_CreateObject();
+    if (json == NULL) {
+        return -1;
+    }
+
+    cJSON_AddStringToObject(json, "name", c->name);
+    cJSON_AddStringToObject(json, "variant", c->variant);
+    cJSON_AddNumberToObject(json, "items", (double)c->items);
+    cJSON_AddNumberToObject(json, "iterations", (double)n);
+    cJSON_AddNumberToObject(json, "min_s", samples[0]);
+    cJSON_AddNumberToObject(json, "median_s", median);
+    cJSON_AddNumberToObject(json, "mean_s", sum / (double)n);
+    cJSON_AddStringToObject(json, "version", WOWPKG_VERSION);
+    cJSON_AddStringToObject(json, "timestamp", b->timestamp);
+
+    char *line = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+    if (line == NULL) {
+        return -1;
+    }
+
+    fprintf(b->out, "%s\n", line);
+    fflush(b->out);
+    free(line);
+
+    fprintf(stderr, "%-24s %-16s %8zu items %10.6fs median\n", c->name, c->variant, c->items, median);
+
+    return 0;
+}
+
+/**
+ * Runs a case and writes its result.
+ *
+ * Returns 0 on success, -1 if any iteration failed.
+ */
+static int bench_run(const Bench *b, const BenchCase *c)
+{
+    static double samples[BENCH_MAX_ITERATIONS];
+
+    double target = b->quick ? BENCH_QUICK_TARGET_SECONDS : BENCH_TARGET_SECONDS;
+    double timed = 0;
+    double start = os_monotonic();
+
+    size_t n = 0;
+    while (n < BENCH_MIN_ITERATIONS
+        || (n < BENCH_MAX_ITERATIONS
+            && timed < target
+            && os_monotonic() - start < target * BENCH_SETUP_FACTOR)) {
+
+        if (c->prepare != NULL && c->prepare(c->ctx) != 0) {
+            PRINT_ERROR("%s/%s: failed to prepare iteration\n", c->name, c->variant);
+            return -1;
+        }
+
+        double t = os_monotonic();
+        int err = c->run(c->ctx);
+        samples[n] = os_monotonic() - t;
+
+        if (err != 0) {
+            PRINT_ERROR("%s/%s: iteration failed\n", c->name, c->variant);
+            return -1;
+        }
+
+        timed += samples[n];
+        n++;
+    }
+
+    return bench_report(b, c, samples, n);
+}
+
+/**
+ * ini_readkey
+ */
+
+typedef struct IniCtx {
+    const char *path;
+    size_t nkeys;
+} IniCtx;
+
+static int run_ini_readkey(void *ctx)
+{
+    IniCtx *c = ctx;
+
+    INI *ini = ini_open(c->path);
+    if (ini == NULL) {
+        return -1;
+    }
+
+    size_t n = 0;
+    while (ini_readkey(ini) != NULL) {
+        n++;
+    }
+
+    int err = ini_last_error(ini) == INI_EEOF && n == c->nkeys ? 0 : -1;
+    ini_close(ini);
+
+    return err;
+}
+
+static int bench_ini(const Bench *b)
+{
+    static const size_t sizes[] = { 10, 1000, 100000 };
+
+    if (!bench_enabled(b, "ini_readkey")) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+        if (b->quick && sizes[i] > 1000) {
+            continue;
+        }
+
+        char variant[32];
+        snprintf(variant, ARRAY_SIZE(variant), "keys_%zu", sizes[i]);
+
+        char path[64];
+        snprintf(path, ARRAY_SIZE(path), "ini_%zu.ini", sizes[i]);
+
+        if (bench_gen_ini(path, sizes[i]) != 0) {
+            PRINT_ERROR("failed to generate %s\n", path);
+            return -1;
+        }
+
+        IniCtx ctx = { path, sizes[i] };
+        BenchCase c = { "ini_readkey", variant, sizes[i], NULL, run_ini_readkey, &ctx };
+
+        int err = bench_run(b, &c);
+        remove(path);
+        if (err != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * snfind_catalog_path through addon_fetch_catalog_meta
+ */
+
+static int run_catalog_hit(void *ctx)
+{
+    Addon *a = addon_create();
+    int err = addon_fetch_catalog_meta(a, ctx) == ADDON_OK ? 0 : -1;
+    addon_free(a);
+
+    return err;
+}
+
+static int run_catalog_miss(void *ctx)
+{
+    Addon *a = addon_create();
+    int err = addon_fetch_catalog_meta(a, ctx) == ADDON_ENOTFOUND ? 0 : -1;
+    addon_free(a);
+
+    return err;
+}
+
+static int bench_catalog(const Bench *b)
+{
+    static const size_t sizes[] = { 10, 1000, 100000 };
+
+    if (!bench_enabled(b, "catalog_lookup")) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+        if (b->quick && sizes[i] > 1000) {
+            continue;
+        }
+
+        if (bench_gen_catalog(BENCH_CATALOG_DIR, sizes[i]) != 0) {
+            PRINT_ERROR("failed to generate catalog with %zu addons\n", sizes[i]);
+            return -1;
+        }
+
+        char hit[64];
+        snbench_addon_name(hit, ARRAY_SIZE(hit), sizes[i] / 2);
+
+        char miss[] = "NotInTheCatalog";
+
+        char hit_variant[32];
+        snprintf(hit_variant, ARRAY_SIZE(hit_variant), "hit_%zu", sizes[i]);
+
+        char miss_variant[32];
+        snprintf(miss_variant, ARRAY_SIZE(miss_variant), "miss_%zu", sizes[i]);
+
+        BenchCase cases[] = {
+            { "catalog_lookup", hit_variant, sizes[i], NULL, run_catalog_hit, hit },
+            { "catalog_lookup", miss_variant, sizes[i], NULL, run_catalog_miss, miss },
+        };
+
+        int err = 0;
+        for (size_t j = 0; j < ARRAY_SIZE(cases) && err == 0; j++) {
+            err = bench_run(b, &cases[j]);
+        }
+
+        os_remove_all(BENCH_CATALOG_DIR);
+        if (err != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * appstate_save and appstate_load
+ */
+
+typedef struct AppStateCtx {
+    AppState *state;
+    const char *path;
+} AppStateCtx;
+
+static int run_appstate_save(void *ctx)
+{
+    AppStateCtx *c = ctx;
+    return appstate_save(c->state, c->path) == APPSTATE_OK ? 0 : -1;
+}
+
+static int prepare_appstate_load(void *ctx)
+{
+    AppStateCtx *c = ctx;
+
+    appstate_free(c->state);
+    c->state = appstate_create();
+
+    return c->state != NULL ? 0 : -1;
+}
+
+static int run_appstate_load(void *ctx)
+{
+    AppStateCtx *c = ctx;
+    return appstate_load(c->state, c->path) == APPSTATE_OK ? 0 : -1;
+}
+
+static int bench_appstate(const Bench *b)
+{
+    static const size_t sizes[] = { 10, 1000, 10000 };
+
+    bool save = bench_enabled(b, "appstate_save");
+    bool load = bench_enabled(b, "appstate_load");
+    if (!save && !load) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+        if (b->quick && sizes[i] > 1000) {
+            continue;
+        }
+
+        char variant[32];
+        snprintf(variant, ARRAY_SIZE(variant), "addons_%zu", sizes[i]);
+
+        AppStateCtx ctx = { appstate_create(), "saved.wowpkg" };
+        if (ctx.state == NULL || bench_gen_appstate(ctx.state, sizes[i]) != 0) {
+            PRINT_ERROR("failed to generate state with %zu addons\n", sizes[i]);
+            appstate_free(ctx.state);
+            return -1;
+        }
+
+        BenchCase save_case = { "appstate_save", variant, sizes[i], NULL, run_appstate_save, &ctx };
+        BenchCase load_case = { "appstate_load", variant, sizes[i], prepare_appstate_load, run_appstate_load, &ctx };
+
+        // Loading needs the saved file so save always runs at least once.
+        int err = save ? bench_run(b, &save_case) : run_appstate_save(&ctx);
+        if (err == 0 && load) {
+            err = bench_run(b, &load_case);
+        }
+
+        appstate_free(ctx.state);
+        remove(ctx.path);
+        if (err != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * list_sort
+ */
+
+typedef struct ListCtx {
+    List *list;
+    char **names;
+    size_t n;
+    uint32_t seed;
+} ListCtx;
+
+static int prepare_list_sort(void *ctx)
+{
+    ListCtx *c = ctx;
+
+    list_free(c->list);
+    c->list = list_create();
+    if (c->list == NULL) {
+        return -1;
+    }
+
+    // Fisher-Yates shuffle so every iteration sorts a different order.
+    for (size_t i = c->n - 1; i > 0; i--) {
+        c->seed ^= c->seed << 13;
+        c->seed ^= c->seed >> 17;
+        c->seed ^= c->seed << 5;
+
+        size_t j = c->seed % (i + 1);
+        char *tmp = c->names[i];
+        c->names[i] = c->names[j];
+        c->names[j] = tmp;
+    }
+
+    for (size_t i = 0; i < c->n; i++) {
+        if (list_insert(c->list, c->names[i]) == NULL) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int run_list_sort(void *ctx)
+{
+    ListCtx *c = ctx;
+    list_sort(c->list, (ListCompareFn)strcmp);
+
+    return 0;
+}
+
+static int bench_list(const Bench *b)
+{
+    static const size_t sizes[] = { 10, 1000, 10000, 100000 };
+
+    if (!bench_enabled(b, "list_sort")) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+        if (b->quick && sizes[i] > 1000) {
+            continue;
+        }
+
+        char variant[32];
+        snprintf(variant, ARRAY_SIZE(variant), "names_%zu", sizes[i]);
+
+        ListCtx ctx = { NULL, calloc(sizes[i], sizeof(char *)), sizes[i], 2463534242U };
+        if (ctx.names == NULL) {
+            return -1;
+        }
+
+        int err = 0;
+        for (size_t j = 0; j < sizes[i] && err == 0; j++) {
+            char name[64];
+            snbench_addon_name(name, ARRAY_SIZE(name), j);
+            ctx.names[j] = strdup(name);
+            err = ctx.names[j] == NULL ? -1 : 0;
+        }
+
+        if (err == 0) {
+            BenchCase c = { "list_sort", variant, sizes[i], prepare_list_sort, run_list_sort, &ctx };
+            err = bench_run(b, &c);
+        }
+
+        list_free(ctx.list);
+        for (size_t j = 0; j < sizes[i]; j++) {
+            free(ctx.names[j]);
+        }
+        free(ctx.names);
+
+        if (err != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * zipper_unzip, os_remove_all, and os_rename
+ */
+
+typedef struct FilesCtx {
+    const char *src;
+    const char *dest;
+    size_t nfiles;
+    size_t file_size;
+} FilesCtx;
+
+static int prepare_unzip(void *ctx)
+{
+    FilesCtx *c = ctx;
+
+    struct os_stat s;
+    if (os_stat(c->dest, &s) == 0 && os_remove_all(c->dest) != 0) {
+        return -1;
+    }
+
+    return os_mkdir(c->dest, 0755);
+}
+
+static int run_unzip(void *ctx)
+{
+    FilesCtx *c = ctx;
+    return zipper_unzip(c->src, c->dest) == ZIPPER_OK ? 0 : -1;
+}
+
+static int prepare_remove_all(void *ctx)
+{
+    FilesCtx *c = ctx;
+    return bench_gen_tree(c->dest, c->nfiles, c->file_size);
+}
+
+static int run_remove_all(void *ctx)
+{
+    FilesCtx *c = ctx;
+    return os_remove_all(c->dest);
+}
+
+static int run_rename(void *ctx)
+{
+    // Swap the paths so that every iteration moves the tree back and forth.
+    FilesCtx *c = ctx;
+    const char *tmp = c->src;
+    c->src = c->dest;
+    c->dest = tmp;
+
+    return os_rename(c->dest, c->src);
+}
+
+static int bench_files(const Bench *b)
+{
+    typedef struct Shape {
+        const char *variant;
+        size_t nfiles;
+        size_t file_size;
+    } Shape;
+
+    static const Shape shapes[] = {
+        { "few_big", 4, 16 * 1024 * 1024 },
+        { "many_small", 5000, 1024 },
+    };
+
+    static const Shape quick_shapes[] = {
+        { "few_big", 2, 1024 * 1024 },
+        { "many_small", 500, 1024 },
+    };
+
+    bool unzip = bench_enabled(b, "zipper_unzip");
+    bool remove_all = bench_enabled(b, "os_remove_all");
+    bool rename_tree = bench_enabled(b, "os_rename");
+
+    for (size_t i = 0; i < ARRAY_SIZE(shapes); i++) {
+        const Shape *shape = b->quick ? &quick_shapes[i] : &shapes[i];
+        size_t items = shape->nfiles;
+        int err = 0;
+
+        if (unzip) {
+            FilesCtx ctx = { "archive.zip", "unzipped", shape->nfiles, shape->file_size };
+            err = bench_gen_zip(ctx.src, shape->nfiles, shape->file_size);
+            if (err != 0) {
+                PRINT_ERROR("failed to generate %s archive\n", shape->variant);
+            } else {
+                BenchCase c = { "zipper_unzip", shape->variant, items, prepare_unzip, run_unzip, &ctx };
+                err = bench_run(b, &c);
+            }
+
+            remove(ctx.src);
+            os_remove_all(ctx.dest);
+        }
+
+        if (err == 0 && remove_all) {
+            FilesCtx ctx = { NULL, "tree", shape->nfiles, shape->file_size };
+            BenchCase c = { "os_remove_all", shape->variant, items, prepare_remove_all, run_remove_all, &ctx };
+            err = bench_run(b, &c);
+        }
+
+        if (err == 0 && rename_tree) {
+            FilesCtx ctx = { "tree_a", "tree_b", shape->nfiles, shape->file_size };
+            err = bench_gen_tree(ctx.src, shape->nfiles, shape->file_size);
+            if (err == 0) {
+                BenchCase c = { "os_rename", shape->variant, items, NULL, run_rename, &ctx };
+                err = bench_run(b, &c);
+            }
+
+            os_remove_all(ctx.src);
+            os_remove_all(ctx.dest);
+        }
+
+        if (err != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int err = 0;
+
+    Bench b = { false, NULL, stdout, "" };
+    bool keep = false;
+    const char *out_path = NULL;
+    char dir[OS_MAX_PATH] = "";
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+
+        if (strcmp(argv[i], "--quick") == 0) {
+            b.quick = true;
+        } else if (strcmp(argv[i], "--keep") == 0) {
+            keep = true;
+        } else if (strcmp(argv[i], "--filter") == 0 && has_value) {
+            b.filter = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && has_value) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--dir") == 0 && has_value) {
+            snprintf(dir, ARRAY_SIZE(dir), "%s", argv[++i]);
+        } else {
+            fprintf(stderr, BENCH_USAGE);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    if (dir[0] == '\0') {
+        int n = snprintf(dir, ARRAY_SIZE(dir), "%s%cwowpkg_bench_XXXXXX", os_tempdir(), OS_SEPARATOR);
+        if (n < 0 || (size_t)n >= ARRAY_SIZE(dir) || os_mkdtemp(dir) == NULL) {
+            PRINT_ERROR("failed to create a temporary directory\n");
+            return 1;
+        }
+    } else if (os_mkdir(dir, 0755) != 0) {
+        PRINT_ERROR("failed to create %s\n", dir);
+        return 1;
+    }
+
+    if (out_path != NULL) {
+        b.out = fopen(out_path, "a");
+        if (b.out == NULL) {
+            PRINT_ERROR("failed to open %s\n", out_path);
+            err = 1;
+            goto cleanup;
+        }
+    }
+
+    time_t now = time(NULL);
+    strftime(b.timestamp, ARRAY_SIZE(b.timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    char cwd[OS_MAX_PATH];
+    if (os_getcwd(cwd, ARRAY_SIZE(cwd)) == NULL || os_chdir(dir) != 0) {
+        PRINT_ERROR("failed to change directory to %s\n", dir);
+        err = 1;
+        goto cleanup;
+    }
+
+    fprintf(stderr, "generating inputs in %s\n", dir);
+
+    if (bench_ini(&b) != 0
+        || bench_catalog(&b) != 0
+        || bench_appstate(&b) != 0
+        || bench_list(&b) != 0
+        || bench_files(&b) != 0) {
+
+        err = 1;
+    }
+
+    if (os_chdir(cwd) != 0) {
+        err = 1;
+    }
+
+cleanup:
+    if (b.out != NULL && b.out != stdout) {
+        fclose(b.out);
+    }
+
+    if (!keep) {
+        os_remove_all(dir);
+    }
+
+    return err;
+}
@@ -0,0 +1,244 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <minizip/zip.h>
+
+#include "addon.h"
+#include "bench_gen.h"
+#include "list.h"
+#include "osapi.h"
+#include "osstring.h"
+#include "wowpkg.h"
+
+/**
+ * Amount of files that are put in one directory of generated archives and
+ * trees.
+ */
+#define BENCH_FILES_PER_DIR 100
+
+/**
+ * Name of the top level directory in generated archives and trees.
+ */
+#define BENCH_TREE_ROOT "BenchAddon"
+
+/**
+ * Fills buf with text that compresses about as well as addon source files.
+ * The same seed always gives the same text.
+ */
+static void fill_text(unsigned char *buf, size_t n, uint32_t seed)
+{
+    static const char words[][8] = { "local ", "end\n", "if ", "then ", "self:", "return ", "= ", "nil ", "\t", "frame" };
+
+    uint32_t x = seed * 2654435761U + 1;
+    size_t i = 0;
+    while (i < n) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        const char *word = words[x % ARRAY_SIZE(words)];
+        for (size_t j = 0; word[j] != '\0' && i < n; j++) {
+            buf[i++] = (unsigned char)word[j];
+        }
+
+        if (i < n && (x & 0x30) == 0) {
+            buf[i++] = (unsigned char)('a' + (x >> 8) % 26);
+        }
+    }
+}
+
+/**
+ * Creates the relative path of the i'th file of a generated archive or tree.
+ */
+static int snfile_path(char *s, size_t n, size_t i, char sep)
+{
+    return snprintf(s, n, "%s%cdir%03zu%cfile%06zu.lua", BENCH_TREE_ROOT, sep, i / BENCH_FILES_PER_DIR, sep, i);
+}
+
+static int write_file(const char *path, const void *data, size_t size)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        return -1;
+    }
+
+    int err = fwrite(data, 1, size, f) == size ? 0 : -1;
+    if (fclose(f) != 0) {
+        err = -1;
+    }
+
+    return err;
+}
+
+int snbench_addon_name(char *s, size_t n, size_t i)
+{
+    return snprintf(s, n, "BenchAddon%06zu", i);
+}
+
+int bench_gen_catalog(const char *path, size_t n)
+{
+    if (os_mkdir(path, 0755) != 0) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        char name[64];
+        snbench_addon_name(name, ARRAY_SIZE(name), i);
+
+        char ini_path[OS_MAX_PATH];
+        int nwrote = snprintf(ini_path, ARRAY_SIZE(ini_path), "%s%c%s.ini", path, OS_SEPARATOR, name);
+        if (nwrote < 0 || (size_t)nwrote >= ARRAY_SIZE(ini_path)) {
+            return -1;
+        }
+
+        char ini[512];
+        nwrote = snprintf(ini, ARRAY_SIZE(ini),
+            "[Addon]\n"
+            "\n"
+            "name = %s\n"
+            "desc = Synthetic addon used by benchmarks.\n"
+            "url = https://api.github.com/repos/bench/%s/releases/latest\n",
+            name, name);
+
+        if (nwrote < 0 || write_file(ini_path, ini, (size_t)nwrote) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int bench_gen_ini(const char *path, size_t nkeys)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        return -1;
+    }
+
+    fprintf(f, "; Generated by wowpkg_bench\n[Section]\n");
+    for (size_t i = 0; i < nkeys; i++) {
+        fprintf(f, "name%zu = some value that is about as long as a description %zu\n", i, i);
+    }
+
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static Addon *gen_addon(size_t i, const char *version)
+{
+    Addon *a = addon_create();
+    if (a == NULL) {
+        return NULL;
+    }
+
+    char name[64];
+    snbench_addon_name(name, ARRAY_SIZE(name), i);
+
+    char url[256];
+    snprintf(url, ARRAY_SIZE(url), "https://github.com/bench/%s/releases/download/%s/%s-%s.zip", name, version, name, version);
+
+    a->name = strdup(name);
+    a->desc = strdup("Synthetic addon used by benchmarks.");
+    a->url = strdup(url);
+    a->version = strdup(version);
+
+    for (int d = 0; d < 3; d++) {
+        char dir[96];
+        snprintf(dir, ARRAY_SIZE(dir), "%s_Module%d", name, d);
+        list_insert(a->dirs, strdup(dir));
+    }
+
+    return a;
+}
+
+int bench_gen_appstate(AppState *state, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        Addon *installed = gen_addon(i, "v1.0.0");
+        Addon *latest = gen_addon(i, "v1.1.0");
+        if (installed == NULL || latest == NULL) {
+            addon_free(installed);
+            addon_free(latest);
+            return -1;
+        }
+
+        list_insert(state->installed, installed);
+        list_insert(state->latest, latest);
+    }
+
+    return 0;
+}
+
+int bench_gen_zip(const char *path, size_t nfiles, size_t file_size)
+{
+    int err = 0;
+
+    unsigned char *data = malloc(file_size > 0 ? file_size : 1);
+    if (data == NULL) {
+        return -1;
+    }
+
+    zipFile zf = zipOpen64(path, APPEND_STATUS_CREATE);
+    if (zf == NULL) {
+        free(data);
+        return -1;
+    }
+
+    for (size_t i = 0; i < nfiles && err == 0; i++) {
+        char name[OS_MAX_FILENAME];
+        snfile_path(name, ARRAY_SIZE(name), i, '/');
+
+        zip_fileinfo zi;
+        memset(&zi, 0, sizeof(zi));
+
+        fill_text(data, file_size, (uint32_t)i);
+
+        if (zipOpenNewFileInZip64(zf, name, &zi, NULL, 0, NULL, 0, NULL, Z_DEFLATED, Z_DEFAULT_COMPRESSION, file_size >= 0xffffffff) != ZIP_OK
+            || zipWriteInFileInZip(zf, data, (unsigned)file_size) != ZIP_OK
+            || zipCloseFileInZip(zf) != ZIP_OK) {
+
+            err = -1;
+        }
+    }
+
+    if (zipClose(zf, NULL) != ZIP_OK) {
+        err = -1;
+    }
+
+    free(data);
+
+    return err;
+}
+
+int bench_gen_tree(const char *path, size_t nfiles, size_t file_size)
+{
+    int err = 0;
+
+    unsigned char *data = malloc(file_size > 0 ? file_size : 1);
+    if (data == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < nfiles && err == 0; i++) {
+        char rel_path[OS_MAX_FILENAME];
+        snfile_path(rel_path, ARRAY_SIZE(rel_path), i, OS_SEPARATOR);
+
+        char file_path[OS_MAX_PATH];
+        int n = snprintf(file_path, ARRAY_SIZE(file_path), "%s%c%s", path, OS_SEPARATOR, rel_path);
+        if (n < 0 || (size_t)n >= ARRAY_SIZE(file_path)) {
+            err = -1;
+            break;
+        }
+
+        fill_text(data, file_size, (uint32_t)i);
+
+        if (os_mkdir_all(file_path, 0755) != 0 || write_file(file_path, data, file_size) != 0) {
+            err = -1;
+        }
+    }
+
+    free(data);
+
+    return err;
+}
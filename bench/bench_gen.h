@@ -0,0 +1,56 @@
+/**
+ * Generators for the synthetic inputs that the benchmarks run against. All
+ * output is deterministic so that results from different runs are comparable.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include "appstate.h"
+
+/**
+ * Writes the name of the i'th generated addon into s. Has similar semantics as
+ * snprintf(3).
+ */
+int snbench_addon_name(char *s, size_t n, size_t i);
+
+/**
+ * Creates a catalog directory at path with n addon .ini files in the same
+ * format as the real catalog. The directory shall not exist.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int bench_gen_catalog(const char *path, size_t n);
+
+/**
+ * Creates a .ini file at path with one section that has nkeys keys.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int bench_gen_ini(const char *path, size_t nkeys);
+
+/**
+ * Fills state with n installed addons, each with a couple of directories, and
+ * a newer latest version for every addon.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int bench_gen_appstate(AppState *state, size_t n);
+
+/**
+ * Creates a deflated .zip archive at path with nfiles files of file_size bytes
+ * each. Files are spread over directories of at most 100 files, similar to
+ * the layout of addon archives.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int bench_gen_zip(const char *path, size_t nfiles, size_t file_size);
+
+/**
+ * Creates a directory tree at path with the same layout as bench_gen_zip
+ * would extract to.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int bench_gen_tree(const char *path, size_t nfiles, size_t file_size);
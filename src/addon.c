@@ -1,38 +1,24 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 
 #include <curl/curl.h>
 
 #include "addon.h"
+#include "github.h"
 #include "ini.h"
+#include "manifest.h"
+#include "net.h"
 #include "osapi.h"
 #include "osstring.h"
+#include "sha256.h"
+#include "stats.h"
+#include "store.h"
 #include "wowpkg.h"
 #include "zipper.h"
 
-typedef struct Response {
-    size_t size;
-    char *data;
-} Response;
-
-static size_t write_str_cb(void *restrict data, size_t size, size_t nmemb, void *restrict userdata)
-{
-    size_t realsize = size * nmemb;
-    Response *res = userdata;
-
-    char *ptr = realloc(res->data, res->size + realsize + 1);
-    if (ptr == NULL) {
-        return 0;
-    }
-
-    res->data = ptr;
-    memcpy(&(res->data[res->size]), data, realsize);
-    res->size += realsize;
-    res->data[res->size] = '\0';
-
-    return realsize;
-}
-
 static int json_check_string(const cJSON *value)
 {
     return cJSON_IsString(value) && value->valuestring != NULL;
@@ -54,14 +40,70 @@ static char *create_str_from_property(const cJSON *json, const char *property)
     return NULL;
 }
 
+/**
+ * Token that requests to GitHub are authenticated with, NULL if requests are
+ * anonymous. Not owned by this file.
+ */
+static const char *github_token = NULL;
+
+/**
+ * Replaces the API part of catalog urls, NULL to use the urls as they are. Not
+ * owned by this file.
+ */
+static const char *github_api_url = NULL;
+
+/**
+ * Content store that staged files go through, NULL if it is disabled. Not
+ * owned by this file.
+ */
+static const char *store_path = NULL;
+
+/**
+ * Directory that archives are downloaded to, NULL to use one in the temp
+ * directory. Not owned by this file.
+ */
+static const char *download_path = NULL;
+
 static struct curl_slist *set_github_headers(struct curl_slist *list)
 {
     list = curl_slist_append(list, "Accept: application/vnd.github+json");
     list = curl_slist_append(list, "X-GitHub-Api-Version: 2022-11-28");
 
+    if (github_token != NULL) {
+        // libcurl does not pass this header on when a redirect leads to
+        // another host, so the token is only sent to the API itself.
+        char auth[GITHUB_MAX_AUTH_HEADER];
+        int n = sngithub_auth_header(auth, ARRAY_SIZE(auth), github_token);
+        if (n >= 0 && (size_t)n < ARRAY_SIZE(auth)) {
+            list = curl_slist_append(list, auth);
+        }
+
+        memset(auth, 0, sizeof(auth));
+    }
+
     return list;
 }
 
+void addon_set_github_token(const char *token)
+{
+    github_token = token != NULL && token[0] != '\0' ? token : NULL;
+}
+
+void addon_set_github_api_url(const char *url)
+{
+    github_api_url = url != NULL && url[0] != '\0' ? url : NULL;
+}
+
+void addon_set_store_path(const char *path)
+{
+    store_path = path != NULL && path[0] != '\0' ? path : NULL;
+}
+
+void addon_set_download_path(const char *path)
+{
+    download_path = path != NULL && path[0] != '\0' ? path : NULL;
+}
+
 Addon *addon_create(void)
 {
     Addon *result = malloc(sizeof(*result));
@@ -90,6 +132,8 @@ void addon_free(Addon *a)
     free(a->url);
     free(a->version);
     list_free(a->dirs);
+    list_free(a->files);
+    list_free(a->deps);
     addon_cleanup_files(a);
 
     free(a);
@@ -318,6 +362,52 @@ void addon_set_str(char **restrict oldstr, char *restrict newstr)
     *oldstr = newstr;
 }
 
+/**
+ * Replaces the dependencies of a with the catalog names in value, which are
+ * separated by commas or whitespace.
+ *
+ * Returns ADDON_OK on success, otherwise ADDON_EINTERNAL.
+ */
+static int addon_parse_deps(Addon *a, const char *value)
+{
+    list_free(a->deps);
+    a->deps = list_create();
+    if (a->deps == NULL) {
+        return ADDON_EINTERNAL;
+    }
+    list_set_free_fn(a->deps, free);
+
+    // Read from the end since each one goes to the front of the list.
+    const char *sep = ", \t";
+    size_t end = strlen(value);
+    for (;;) {
+        while (end > 0 && strchr(sep, value[end - 1]) != NULL) {
+            end--;
+        }
+
+        size_t start = end;
+        while (start > 0 && strchr(sep, value[start - 1]) == NULL) {
+            start--;
+        }
+
+        if (start == end) {
+            break;
+        }
+
+        char *dep = malloc(end - start + 1);
+        if (dep == NULL || list_insert(a->deps, dep) == NULL) {
+            free(dep);
+            return ADDON_EINTERNAL;
+        }
+
+        memcpy(dep, &value[start], end - start);
+        dep[end - start] = '\0';
+        end = start;
+    }
+
+    return ADDON_OK;
+}
+
 int addon_fetch_catalog_meta(Addon *a, const char *name)
 {
     int err = ADDON_OK;
@@ -343,6 +433,10 @@ int addon_fetch_catalog_meta(Addon *a, const char *name)
             addon_set_str(&a->desc, strdup(key->value));
         } else if (strcasecmp(key->name, ADDON_URL) == 0) {
             addon_set_str(&a->url, strdup(key->value));
+        } else if (strcasecmp(key->name, ADDON_DEPS) == 0) {
+            if ((err = addon_parse_deps(a, key->value)) != ADDON_OK) {
+                goto cleanup;
+            }
         }
     }
 
@@ -355,45 +449,37 @@ int addon_fetch_catalog_meta(Addon *a, const char *name)
         goto cleanup;
     }
 
+    if (github_api_url != NULL) {
+        char url[OS_MAX_PATH];
+        n = sngithub_rebase_url(url, ARRAY_SIZE(url), a->url, github_api_url);
+        if (n < 0 || (size_t)n >= ARRAY_SIZE(url)) {
+            err = ADDON_ECONFIG;
+            goto cleanup;
+        }
+
+        addon_set_str(&a->url, strdup(url));
+    }
+
 cleanup:
     ini_close(ini);
 
     return err;
 }
 
-cJSON *addon_fetch_github_meta(const char *url, int *out_err)
+/**
+ * Converts the response of a GitHub latest release request into the metadata
+ * JSON returned by addon_fetch_github_meta.
+ *
+ * Returns NULL on error and sets out_err.
+ */
+static cJSON *gh_meta_from_response(const NetResponse *res, int *out_err)
 {
     int err = ADDON_OK;
-    Response res = { .data = NULL, .size = 0 };
     cJSON *resp = NULL;
     cJSON *result = NULL;
-    struct curl_slist *headers = NULL;
-
-    CURL *curl = curl_easy_init();
-    if (curl == NULL) {
-        err = ADDON_EINTERNAL;
-        goto cleanup;
-    }
-
-    headers = set_github_headers(headers);
-
-    // curl_easy_setopt(curl, CURLOPT_VERBOSE, true);
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, WOWPKG_USER_AGENT);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_str_cb);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&res);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-
-    CURLcode status = curl_easy_perform(curl);
-    if (status != CURLE_OK) {
-        err = ADDON_EINTERNAL;
-        goto cleanup;
-    }
 
-    long http_code;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-    if (http_code != 200) {
-        if (http_code == 403) {
+    if (res->status != 200) {
+        if (res->status == 403) {
             err = ADDON_ERATE_LIMIT;
         } else {
             err = ADDON_EINTERNAL;
@@ -401,7 +487,7 @@ cJSON *addon_fetch_github_meta(const char *url, int *out_err)
         goto cleanup;
     }
 
-    resp = cJSON_Parse(res.data);
+    resp = cJSON_Parse(res->data);
     if (resp == NULL) {
         err = ADDON_EINTERNAL;
         goto cleanup;
@@ -436,9 +522,6 @@ cJSON *addon_fetch_github_meta(const char *url, int *out_err)
     }
 
 cleanup:
-    curl_easy_cleanup(curl);
-    curl_slist_free_all(headers);
-    free(res.data);
     cJSON_Delete(resp);
 
     if (out_err != NULL) {
@@ -453,6 +536,35 @@ cleanup:
     return result;
 }
 
+cJSON *addon_fetch_github_meta(const char *url, int *out_err)
+{
+    int err = ADDON_OK;
+    cJSON *result = NULL;
+    struct curl_slist *headers = set_github_headers(NULL);
+
+    NetRequest req;
+    memset(&req, 0, sizeof(req));
+    req.url = url;
+    req.headers = headers;
+
+    if (net_get(&req) != NET_OK) {
+        err = req.err == NET_ERATE_LIMIT ? ADDON_ERATE_LIMIT : ADDON_EINTERNAL;
+        goto cleanup;
+    }
+
+    result = gh_meta_from_response(&req.res, &err);
+
+cleanup:
+    net_request_reset(&req);
+    curl_slist_free_all(headers);
+
+    if (out_err != NULL) {
+        *out_err = err;
+    }
+
+    return result;
+}
+
 int addon_fetch_all_meta(Addon *a, const char *name)
 {
     int err = ADDON_OK;
@@ -464,7 +576,11 @@ int addon_fetch_all_meta(Addon *a, const char *name)
         goto cleanup;
     }
 
+    StatsTimer timer;
+    stats_start(&timer, STATS_META, a->name);
     gh_json = addon_fetch_github_meta(a->url, &err);
+    stats_stop(&timer);
+
     if (err != ADDON_OK) {
         goto cleanup;
     }
@@ -480,84 +596,626 @@ cleanup:
     return err;
 }
 
-int addon_fetch_zip(Addon *a)
+/**
+ * Fetches the latest release of up to GITHUB_GRAPHQL_MAX_BATCH addons with a
+ * single GraphQL request. Addons that could be resolved have done set to true,
+ * all others are left untouched so they can be fetched another way.
+ */
+static void fetch_meta_graphql(Addon **addons, size_t n, int *errs, bool *done)
 {
-    int err = ADDON_OK;
-    FILE *fzip = NULL;
-    Response res = { .data = NULL, .size = 0 };
-    struct curl_slist *headers = NULL;
-
-    CURL *curl = curl_easy_init();
-    if (curl == NULL) {
-        return ADDON_EINTERNAL;
+    // GitHub only answers GraphQL requests that are authenticated.
+    if (github_token == NULL) {
+        return;
     }
 
-    headers = set_github_headers(headers);
+    GitHubRepo *repos = calloc(GITHUB_GRAPHQL_MAX_BATCH, sizeof(*repos));
+    size_t *repo_addon = calloc(GITHUB_GRAPHQL_MAX_BATCH, sizeof(*repo_addon));
+    cJSON **metas = calloc(GITHUB_GRAPHQL_MAX_BATCH, sizeof(*metas));
+    char *body = NULL;
+    struct curl_slist *headers = NULL;
+    size_t nrepos = 0;
 
-    curl_easy_setopt(curl, CURLOPT_URL, a->url);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, WOWPKG_USER_AGENT);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_str_cb);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&res);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    NetRequest req;
+    memset(&req, 0, sizeof(req));
 
-    CURLcode status = curl_easy_perform(curl);
-    if (status != CURLE_OK) {
-        err = ADDON_EINTERNAL;
+    if (repos == NULL || repo_addon == NULL || metas == NULL) {
         goto cleanup;
     }
 
-    long http_code;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-    if (http_code != 200) {
-        if (http_code == 403) {
-            err = ADDON_ERATE_LIMIT;
-        } else {
-            err = ADDON_EINTERNAL;
+    // Every addon in a batch shall use the same API. Addons that do not match
+    // the first addon's API are left for the REST fallback.
+    char graphql_url[OS_MAX_PATH] = { 0 };
+    for (size_t i = 0; i < n && nrepos < GITHUB_GRAPHQL_MAX_BATCH; i++) {
+        if (done[i]) {
+            continue;
         }
+
+        char url[OS_MAX_PATH];
+        int nwrote = sngithub_graphql_url(url, ARRAY_SIZE(url), addons[i]->url);
+        if (nwrote < 0 || (size_t)nwrote >= ARRAY_SIZE(url)) {
+            continue;
+        }
+
+        if (graphql_url[0] == '\0') {
+            strcpy(graphql_url, url);
+        } else if (strcmp(graphql_url, url) != 0) {
+            continue;
+        }
+
+        if (github_repo_from_url(&repos[nrepos], addons[i]->url) != 0) {
+            continue;
+        }
+
+        repo_addon[nrepos] = i;
+        nrepos++;
+    }
+
+    // A single addon is cheaper to fetch with the REST request.
+    if (nrepos < 2) {
         goto cleanup;
     }
 
-    if (res.size > 0) {
-        res.size--; // Remove terminating null since this should be raw data.
+    body = github_graphql_latest_releases_body(repos, nrepos);
+    if (body == NULL) {
+        goto cleanup;
     }
 
-    const char *zip_ext = ".zip";
-    char zippath[OS_MAX_PATH];
+    headers = set_github_headers(NULL);
+    headers = curl_slist_append(headers, "Content-Type: application/json");
+
+    req.url = graphql_url;
+    req.headers = headers;
+    req.body = body;
 
-    // Creates a string with a value 'path/to/temp/wowpkg_<addon_name>_<addon_version>_XXXXXX.zip'.
-    int nwrote = snprintf(zippath, ARRAY_SIZE(zippath), "%s%c%s_%s_%s_XXXXXX%s", os_tempdir(), OS_SEPARATOR, WOWPKG_NAME, a->name, a->version, zip_ext);
-    if (nwrote < 0 || (size_t)nwrote >= ARRAY_SIZE(zippath)) {
-        err = ADDON_ENAMETOOLONG;
+    if (net_get(&req) != NET_OK || req.res.status != 200) {
         goto cleanup;
     }
 
-    fzip = os_mkstemps(zippath, (int)strlen(zip_ext));
-    if (fzip == NULL) {
-        err = ADDON_EINTERNAL;
+    if (github_graphql_parse_latest_releases(req.res.data, metas, nrepos) != 0) {
         goto cleanup;
     }
 
-    if (fwrite(res.data, sizeof(*res.data), res.size, fzip) != res.size) {
+    for (size_t i = 0; i < nrepos; i++) {
+        if (metas[i] == NULL) {
+            continue;
+        }
+
+        size_t ai = repo_addon[i];
+        errs[ai] = addon_from_json(addons[ai], metas[i]);
+        done[ai] = true;
+
+        cJSON_Delete(metas[i]);
+    }
+
+cleanup:
+    net_request_reset(&req);
+    curl_slist_free_all(headers);
+    free(body);
+    free(metas);
+    free(repo_addon);
+    free(repos);
+}
+
+/**
+ * Fetches the latest release of every addon that is not done with one REST
+ * request each. All requests are made concurrently.
+ */
+static int fetch_meta_rest(Addon **addons, size_t n, int *errs, bool *done)
+{
+    int err = ADDON_OK;
+    struct curl_slist *headers = set_github_headers(NULL);
+
+    // Keep track of which addon each request belongs to.
+    NetRequest *reqs = calloc(n, sizeof(*reqs));
+    size_t *req_addon = calloc(n, sizeof(*req_addon));
+    size_t nreqs = 0;
+
+    if (n > 0 && (reqs == NULL || req_addon == NULL)) {
         err = ADDON_EINTERNAL;
         goto cleanup;
     }
 
-    addon_set_str(&a->_zip_path, strdup(zippath));
+    for (size_t i = 0; i < n; i++) {
+        if (done[i]) {
+            continue;
+        }
+
+        reqs[nreqs].url = addons[i]->url;
+        reqs[nreqs].headers = headers;
+        reqs[nreqs].priority = (int)(n - i);
+        req_addon[nreqs] = i;
+        nreqs++;
+    }
+
+    if (net_get_many(reqs, nreqs) != NET_OK) {
+        err = ADDON_EINTERNAL;
+    }
+
+    for (size_t i = 0; i < nreqs; i++) {
+        size_t ai = req_addon[i];
+        done[ai] = true;
+
+        if (reqs[i].err == NET_ERATE_LIMIT) {
+            errs[ai] = ADDON_ERATE_LIMIT;
+            continue;
+        } else if (reqs[i].err != NET_OK) {
+            errs[ai] = ADDON_EINTERNAL;
+            continue;
+        }
+
+        cJSON *gh_json = gh_meta_from_response(&reqs[i].res, &errs[ai]);
+        if (gh_json != NULL) {
+            errs[ai] = addon_from_json(addons[ai], gh_json);
+            cJSON_Delete(gh_json);
+        }
+    }
 
 cleanup:
-    if (fzip != NULL) {
-        fclose(fzip);
+    for (size_t i = 0; i < nreqs; i++) {
+        net_request_reset(&reqs[i]);
     }
 
+    free(reqs);
+    free(req_addon);
     curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    free(res.data);
 
     return err;
 }
 
+int addon_fetch_all_meta_many(Addon **addons, size_t n, int *errs)
+{
+    bool *done = calloc(n, sizeof(*done));
+    if (n > 0 && done == NULL) {
+        return ADDON_EINTERNAL;
+    }
+
+    // Requests are shared by all addons so the time can not be split up.
+    StatsTimer timer;
+    stats_start(&timer, STATS_META, NULL);
+
+    size_t remaining = 0;
+    for (size_t i = 0; i < n; i++) {
+        errs[i] = addon_fetch_catalog_meta(addons[i], addons[i]->name);
+        done[i] = errs[i] != ADDON_OK;
+        if (!done[i]) {
+            remaining++;
+        }
+    }
+
+    // Each GraphQL request resolves up to GITHUB_GRAPHQL_MAX_BATCH addons.
+    // Stop as soon as a request makes no progress, whatever is left is
+    // fetched with REST.
+    while (remaining > 1) {
+        fetch_meta_graphql(addons, n, errs, done);
+
+        size_t left = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (!done[i]) {
+                left++;
+            }
+        }
+
+        if (left == remaining) {
+            break;
+        }
+
+        remaining = left;
+    }
+
+    int err = fetch_meta_rest(addons, n, errs, done);
+
+    stats_stop(&timer);
+    free(done);
+
+    return err;
+}
+
+void addon_keep_archive(Addon *a)
+{
+    free(a->_zip_path);
+    a->_zip_path = NULL;
+}
+
+/**
+ * Creates the path that the zip of the addon is downloaded to. The path only
+ * depends on the name and version so that an interrupted download can be
+ * resumed by a later run.
+ *
+ * Archives that are found in the download directory are used as they are, so
+ * it has to be one that only the user can write to, see os_mkdir_private.
+ *
+ * Has similar semantics as snprintf(3). Returns -1 if the download directory
+ * could not be created or is not private.
+ */
+static int snaddon_zip_path(char *s, size_t n, const Addon *a)
+{
+    char dir[OS_MAX_PATH];
+
+    // Creates a string with a value 'path/to/temp/wowpkg_downloads' unless
+    // another directory was set.
+    int nwrote = download_path != NULL ? snprintf(dir, ARRAY_SIZE(dir), "%s", download_path) : snprintf(dir, ARRAY_SIZE(dir), "%s%c%s_downloads", os_tempdir(), OS_SEPARATOR, WOWPKG_NAME);
+    if (nwrote < 0 || (size_t)nwrote >= ARRAY_SIZE(dir)) {
+        return -1;
+    }
+
+    if (os_mkdir_private(dir) != 0) {
+        return -1;
+    }
+
+    return snprintf(s, n, "%s%c%s_%s.zip", dir, OS_SEPARATOR, a->name, a->version);
+}
+
+void addon_remove_archive(const Addon *a)
+{
+    if (a->name == NULL || a->version == NULL) {
+        return;
+    }
+
+    char zippath[OS_MAX_PATH];
+    int n = snaddon_zip_path(zippath, ARRAY_SIZE(zippath), a);
+    if (n >= 0 && (size_t)n < ARRAY_SIZE(zippath)) {
+        remove(zippath);
+    }
+}
+
+/**
+ * Downloads the zip of the addon to path, hashing it with sha256 if it is not
+ * NULL, see net_download.
+ *
+ * Returns ADDON_OK on success, otherwise one of the ADDON_E values.
+ */
+static int download_zip(const Addon *a, const char *path, Sha256 *sha256)
+{
+    int err = ADDON_OK;
+    struct curl_slist *headers = set_github_headers(NULL);
+
+    NetRequest req;
+    memset(&req, 0, sizeof(req));
+    req.url = a->url;
+    req.headers = headers;
+    req.sha256 = sha256;
+
+    StatsTimer timer;
+    stats_start(&timer, STATS_DOWNLOAD, a->name);
+    int net_err = net_download(&req, path);
+    stats_stop(&timer);
+
+    if (net_err != NET_OK) {
+        err = req.err == NET_ERATE_LIMIT ? ADDON_ERATE_LIMIT : ADDON_EINTERNAL;
+    } else if (req.res.status != 200 && req.res.status != 206) {
+        err = req.res.status == 403 ? ADDON_ERATE_LIMIT : ADDON_EINTERNAL;
+    }
+
+    net_request_reset(&req);
+    curl_slist_free_all(headers);
+
+    return err;
+}
+
+static int count_zip_entry(const ZipperEntry *entry, void *arg)
+{
+    UNUSED(entry);
+    (*(size_t *)arg)++;
+    return 0;
+}
+
+/**
+ * Checks that the file at path is an archive that can be used: a regular file,
+ * not a link, whose central directory can be read and lists at least one file.
+ * Only the end of the archive is read.
+ */
+static bool zip_ok(const char *path)
+{
+    struct os_stat s;
+    if (os_lstat(path, &s) != 0 || !S_ISREG(s.st_mode)) {
+        return false;
+    }
+
+    size_t nentries = 0;
+    return zipper_list(path, count_zip_entry, &nentries) == ZIPPER_OK && nentries > 0;
+}
+
+int addon_fetch_zip(Addon *a)
+{
+    char zippath[OS_MAX_PATH];
+    int nwrote = snaddon_zip_path(zippath, ARRAY_SIZE(zippath), a);
+    if (nwrote < 0) {
+        return ADDON_EINTERNAL;
+    } else if ((size_t)nwrote >= ARRAY_SIZE(zippath)) {
+        return ADDON_ENAMETOOLONG;
+    }
+
+    // Downloads are only renamed to their final path once complete, so a kept
+    // archive can be used as it is unless it can not be read.
+    if (!zip_ok(zippath)) {
+        remove(zippath);
+
+        int err = download_zip(a, zippath, NULL);
+        if (err != ADDON_OK) {
+            return err;
+        }
+    }
+
+    addon_set_str(&a->_zip_path, strdup(zippath));
+
+    return ADDON_OK;
+}
+
+int addon_prefetch_zip(const Addon *a)
+{
+    char zippath[OS_MAX_PATH];
+    int nwrote = snaddon_zip_path(zippath, ARRAY_SIZE(zippath), a);
+    if (nwrote < 0) {
+        return ADDON_EINTERNAL;
+    } else if ((size_t)nwrote >= ARRAY_SIZE(zippath)) {
+        return ADDON_ENAMETOOLONG;
+    }
+
+    if (zip_ok(zippath)) {
+        return ADDON_OK;
+    }
+
+    // An upgrade may download the same archive at the same time, so this
+    // downloads to a path of its own and only puts the archive in place once
+    // it is complete.
+    char prefetch_path[OS_MAX_PATH];
+    nwrote = snprintf(prefetch_path, ARRAY_SIZE(prefetch_path), "%s.prefetch", zippath);
+    if (nwrote < 0 || (size_t)nwrote >= ARRAY_SIZE(prefetch_path)) {
+        return ADDON_ENAMETOOLONG;
+    }
+
+    int err = download_zip(a, prefetch_path, NULL);
+    if (err != ADDON_OK) {
+        return err;
+    }
+
+    // What was downloaded is only put where installs look for it if it is an
+    // archive.
+    if (!zip_ok(prefetch_path)) {
+        remove(prefetch_path);
+        return ADDON_EUNZIP;
+    }
+
+    if (os_rename(prefetch_path, zippath) != 0) {
+        remove(prefetch_path);
+
+        // The upgrade got there first.
+        if (!zip_ok(zippath)) {
+            return ADDON_EINTERNAL;
+        }
+    }
+
+    return ADDON_OK;
+}
+
+/**
+ * Gets the size and hex SHA-256 hash of the archive at path. A link is not
+ * followed.
+ *
+ * Returns ADDON_OK on success, otherwise ADDON_ENOENT.
+ */
+static int hash_zip(const char *path, long long *size, char hex[SHA256_HEX_SIZE])
+{
+    struct os_stat s;
+    if (os_lstat(path, &s) != 0 || !S_ISREG(s.st_mode)) {
+        return ADDON_ENOENT;
+    }
+
+    FILE *f = os_fopen_nofollow(path, "rb");
+    if (f == NULL) {
+        return ADDON_ENOENT;
+    }
+
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    int hash_err = sha256_stream(f, digest);
+    fclose(f);
+    if (hash_err != 0) {
+        return ADDON_ENOENT;
+    }
+
+    *size = (long long)s.st_size;
+    sha256_hex(digest, hex);
+
+    return ADDON_OK;
+}
+
+int addon_fetch_zip_sha256(Addon *a, long long size, const char *sha256)
+{
+    char zippath[OS_MAX_PATH];
+    int nwrote = snaddon_zip_path(zippath, ARRAY_SIZE(zippath), a);
+    if (nwrote < 0) {
+        return ADDON_EINTERNAL;
+    } else if ((size_t)nwrote >= ARRAY_SIZE(zippath)) {
+        return ADDON_ENAMETOOLONG;
+    }
+
+    // The size is checked first so that an archive of another build of the
+    // same version is not read at all.
+    struct os_stat s;
+    if (os_lstat(zippath, &s) == 0 && S_ISREG(s.st_mode)) {
+        long long kept_size = 0;
+        char kept[SHA256_HEX_SIZE];
+        if ((long long)s.st_size != size || hash_zip(zippath, &kept_size, kept) != ADDON_OK || strcmp(kept, sha256) != 0) {
+            remove(zippath);
+        } else {
+            addon_set_str(&a->_zip_path, strdup(zippath));
+            return ADDON_OK;
+        }
+    }
+
+    Sha256 ctx;
+    int err = download_zip(a, zippath, &ctx);
+    if (err != ADDON_OK) {
+        return err;
+    }
+
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    char hex[SHA256_HEX_SIZE];
+    sha256_final(&ctx, digest);
+    sha256_hex(digest, hex);
+
+    if (strcmp(hex, sha256) != 0) {
+        remove(zippath);
+        return ADDON_EHASH;
+    }
+
+    addon_set_str(&a->_zip_path, strdup(zippath));
+
+    return ADDON_OK;
+}
+
+int addon_archive_sha256(const Addon *a, long long *size, char sha256[SHA256_HEX_SIZE])
+{
+    int err = addon_prefetch_zip(a);
+    if (err != ADDON_OK) {
+        return err;
+    }
+
+    char zippath[OS_MAX_PATH];
+    int nwrote = snaddon_zip_path(zippath, ARRAY_SIZE(zippath), a);
+    if (nwrote < 0) {
+        return ADDON_EINTERNAL;
+    } else if ((size_t)nwrote >= ARRAY_SIZE(zippath)) {
+        return ADDON_ENAMETOOLONG;
+    }
+
+    return hash_zip(zippath, size, sha256);
+}
+
+/**
+ * Files of the installed version of an addon that can be linked into the
+ * package of another version instead of being extracted again, see
+ * addon_package_reuse.
+ */
+typedef struct AddonReuse {
+    const char *package_path;
+    const char *installed_path; // Addons directory of the installed version.
+    const ManifestFile **installed; // Sorted with manifest_sort.
+    size_t ninstalled;
+    bool can_link; // False once a link failed because of the file system.
+
+    List *files; // ManifestFile of every file of the package.
+
+    char **linked; // Native paths of linked files, relative to the package.
+    size_t nlinked;
+    size_t cap;
+} AddonReuse;
+
+/**
+ * Links the file of the installed version that has the path of entry into the
+ * package if both have the same contents, and the installed file still has the
+ * size and time it was installed with.
+ *
+ * Returns true if it was linked.
+ */
+static bool addon_reuse_link(AddonReuse *r, const ZipperEntry *entry, const char *rel, long long *mtime)
+{
+    const ManifestFile *old = manifest_find(r->installed, r->ninstalled, rel);
+    if (old == NULL || old->size != entry->size || old->crc != entry->crc) {
+        return false;
+    }
+
+    char src[OS_MAX_PATH];
+    char dest[OS_MAX_PATH];
+    int n1 = snmanifest_path(src, ARRAY_SIZE(src), r->installed_path, rel);
+    int n2 = snmanifest_path(dest, ARRAY_SIZE(dest), r->package_path, rel);
+    if (n1 < 0 || (size_t)n1 >= ARRAY_SIZE(src) || n2 < 0 || (size_t)n2 >= ARRAY_SIZE(dest)) {
+        return false;
+    }
+
+    struct os_stat s;
+    if (os_stat(src, &s) != 0 || !S_ISREG(s.st_mode) || (unsigned long long)s.st_size != old->size || (long long)s.st_mtime != old->mtime) {
+        return false;
+    }
+
+    char dir[OS_MAX_PATH];
+    memcpy(dir, dest, (size_t)n2 + 1);
+    if (os_mkdir_all(dir, 0755) != 0) {
+        return false;
+    }
+
+    if (os_link(src, dest) != 0) {
+        // Most likely the temp directory is on another drive.
+        r->can_link = errno != EXDEV && errno != EPERM;
+        return false;
+    }
+
+    *mtime = old->mtime;
+
+    return true;
+}
+
+/**
+ * Adds entry to the files of the package, see ZipperEntryFn.
+ */
+static int addon_reuse_entry(const ZipperEntry *entry, void *arg)
+{
+    AddonReuse *r = arg;
+
+    // Manifest paths use '/' on every system.
+    char rel[OS_MAX_PATH];
+    int n = snprintf(rel, ARRAY_SIZE(rel), "%s", entry->path);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(rel)) {
+        return ZIPPER_ENAMETOOLONG;
+    }
+
+    for (char *c = rel; *c != '\0'; c++) {
+        if (*c == OS_SEPARATOR) {
+            *c = '/';
+        }
+    }
+
+    long long mtime = entry->mtime;
+    if (r->installed != NULL && r->can_link && addon_reuse_link(r, entry, rel, &mtime)) {
+        if (r->nlinked == r->cap) {
+            size_t cap = r->cap == 0 ? 64 : r->cap * 2;
+            char **grown = realloc(r->linked, cap * sizeof(*grown));
+            if (grown == NULL) {
+                return ZIPPER_EWRITE;
+            }
+
+            r->linked = grown;
+            r->cap = cap;
+        }
+
+        r->linked[r->nlinked] = strdup(entry->path);
+        if (r->linked[r->nlinked] == NULL) {
+            return ZIPPER_EWRITE;
+        }
+        r->nlinked++;
+    }
+
+    ManifestFile *f = manifest_file_create(rel, entry->size, entry->crc, mtime);
+    if (f == NULL) {
+        return ZIPPER_EWRITE;
+    }
+
+    list_insert(r->files, f);
+
+    return ZIPPER_OK;
+}
+
+static int cmp_str_ptr(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * Filter for zipper_unzip_filter that skips the files that were linked.
+ */
+static bool filter_not_linked(const char *path, void *arg)
+{
+    const AddonReuse *r = arg;
+
+    return bsearch(&path, r->linked, r->nlinked, sizeof(*r->linked), cmp_str_ptr) == NULL;
+}
+
 int addon_package(Addon *a)
+{
+    return addon_package_reuse(a, NULL, NULL);
+}
+
+int addon_package_reuse(Addon *a, const List *installed, const char *path)
 {
     char tmpdir[OS_MAX_PATH];
 
@@ -571,11 +1229,59 @@ int addon_package(Addon *a)
         return ADDON_EINTERNAL;
     }
 
-    if (zipper_unzip(a->_zip_path, tmpdir) != 0) {
+    addon_set_str(&a->_package_path, strdup(tmpdir));
+
+    AddonReuse r;
+    memset(&r, 0, sizeof(r));
+    r.package_path = tmpdir;
+    r.installed_path = path;
+    r.can_link = true;
+
+    if (installed != NULL && path != NULL) {
+        r.installed = manifest_sort(installed, &r.ninstalled);
+    }
+
+    r.files = list_create();
+    if (r.files == NULL) {
+        free(r.installed);
+        return ADDON_EINTERNAL;
+    }
+    list_set_free_fn(r.files, (ListFreeFn)manifest_file_free);
+
+    StatsTimer timer;
+    stats_start(&timer, STATS_PACKAGE, a->name);
+
+    // The central directory has everything the manifest needs, so nothing has
+    // to be read back after unzipping.
+    ZipperStats zstats;
+    memset(&zstats, 0, sizeof(zstats));
+    int err = zipper_list(a->_zip_path, addon_reuse_entry, &r);
+    if (err == ZIPPER_OK && r.nlinked > 0) {
+        qsort(r.linked, r.nlinked, sizeof(*r.linked), cmp_str_ptr);
+        err = zipper_unzip_filter(a->_zip_path, tmpdir, filter_not_linked, &r, &zstats);
+    } else if (err == ZIPPER_OK) {
+        err = zipper_unzip_stats(a->_zip_path, tmpdir, &zstats);
+    }
+
+    stats_stop(&timer);
+    stats_add_files(a->name, zstats.files, 0);
+
+    for (size_t i = 0; i < r.nlinked; i++) {
+        free(r.linked[i]);
+    }
+    free(r.linked);
+    free(r.installed);
+
+    if (err != ZIPPER_OK) {
+        // A kept archive may be the broken one, the next attempt downloads
+        // it again.
+        list_free(r.files);
+        remove(a->_zip_path);
         return ADDON_EUNZIP;
     }
 
-    addon_set_str(&a->_package_path, strdup(tmpdir));
+    list_free(a->files);
+    a->files = r.files;
 
     return ADDON_OK;
 }
@@ -589,6 +1295,10 @@ int addon_extract(Addon *a, const char *path)
         return ADDON_ENOENT;
     }
 
+    StatsTimer timer;
+    stats_start(&timer, STATS_EXTRACT, a->name);
+    size_t nmoved = 0;
+
     OsDirEnt *entry = NULL;
     while ((entry = os_readdir(dir)) != NULL) {
         if (strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0) {
@@ -600,10 +1310,212 @@ int addon_extract(Addon *a, const char *path)
         }
 
         list_insert(a->dirs, strdup(entry->name));
+        nmoved++;
     }
 
 cleanup:
     os_closedir(dir);
 
+    stats_stop(&timer);
+    stats_add_files(a->name, 0, nmoved);
+
+    return err;
+}
+
+static int addon_transaction_err(int err)
+{
+    if (err == TRANSACTION_OK) {
+        return ADDON_OK;
+    } else if (err == TRANSACTION_ENAMETOOLONG) {
+        return ADDON_ENAMETOOLONG;
+    }
+
+    return ADDON_EINTERNAL;
+}
+
+static int store_move(const char *src, const char *dest, void *unused)
+{
+    UNUSED(unused);
+
+    return store_import(store_path, src, dest) == STORE_OK ? 0 : -1;
+}
+
+int addon_stage(Addon *a, Transaction **txns, size_t n)
+{
+    if (a->_package_path == NULL) {
+        return ADDON_ENOENT;
+    }
+
+    StatsTimer timer;
+    stats_start(&timer, STATS_EXTRACT, a->name);
+
+    int err = TRANSACTION_OK;
+    Transaction *first = NULL;
+    for (size_t i = 0; i < n && err == TRANSACTION_OK; i++) {
+        if (txns[i] == NULL) {
+            continue;
+        }
+
+        if (first == NULL && store_path != NULL) {
+            err = transaction_stage_with(txns[i], a->name, a->_package_path, store_move, NULL);
+            first = txns[i];
+        } else if (first == NULL) {
+            err = transaction_stage(txns[i], a->name, a->_package_path);
+            first = txns[i];
+        } else {
+            err = transaction_stage_clone(txns[i], a->name, first);
+        }
+    }
+
+    stats_stop(&timer);
+
+    return addon_transaction_err(err);
+}
+
+int addon_swap(Addon *a, Transaction *t, const Addon *installed)
+{
+    StatsTimer timer;
+    stats_start(&timer, STATS_EXTRACT, a->name);
+    int err = transaction_swap(t, a->name, installed != NULL ? installed->dirs : NULL, a->dirs);
+    stats_stop(&timer);
+
+    if (err == TRANSACTION_OK) {
+        size_t nmoved = 0;
+        ListNode *node = NULL;
+        list_foreach(node, a->dirs)
+        {
+            nmoved++;
+        }
+
+        stats_add_files(a->name, 0, nmoved);
+    }
+
+    return addon_transaction_err(err);
+}
+
+/**
+ * Filter for zipper_unzip_filter that extracts the entries that are in the
+ * list of manifest files arg.
+ */
+static bool filter_manifest_files(const char *path, void *arg)
+{
+    const List *files = arg;
+
+    ListNode *node = NULL;
+    list_foreach(node, files)
+    {
+        const char *p = ((const ManifestFile *)node->value)->path;
+        const char *q = path;
+        while (*p != '\0' && (*p == *q || (*p == '/' && *q == OS_SEPARATOR))) {
+            p++;
+            q++;
+        }
+
+        if (*p == '\0' && *q == '\0') {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int addon_repair(Addon *a, const char *path, const List *files)
+{
+    int err = addon_fetch_zip(a);
+    if (err != ADDON_OK) {
+        return err;
+    }
+
+    char tmpdir[OS_MAX_PATH];
+    int n = snprintf(tmpdir, ARRAY_SIZE(tmpdir), "%s%c%s_%s_%s_XXXXXX", os_tempdir(), OS_SEPARATOR, WOWPKG_NAME, a->name, a->version);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(tmpdir)) {
+        return ADDON_ENAMETOOLONG;
+    }
+
+    if (os_mkdtemp(tmpdir) == NULL) {
+        return ADDON_EINTERNAL;
+    }
+
+    StatsTimer timer;
+    stats_start(&timer, STATS_PACKAGE, a->name);
+
+    ZipperStats zstats;
+    if (zipper_unzip_filter(a->_zip_path, tmpdir, filter_manifest_files, (void *)(uintptr_t)files, &zstats) != ZIPPER_OK) {
+        stats_stop(&timer);
+        err = ADDON_EUNZIP;
+        goto cleanup;
+    }
+
+    stats_stop(&timer);
+    stats_add_files(a->name, zstats.files, 0);
+
+    // Every file is checked before any is moved so that an archive of another
+    // build of the same version does not repair some of the files with
+    // different ones.
+    ListNode *node = NULL;
+    list_foreach(node, files)
+    {
+        const ManifestFile *f = node->value;
+        char src[OS_MAX_PATH];
+        int n1 = snmanifest_path(src, ARRAY_SIZE(src), tmpdir, f->path);
+        if (n1 < 0 || (size_t)n1 >= ARRAY_SIZE(src)) {
+            err = ADDON_ENAMETOOLONG;
+            goto cleanup;
+        }
+
+        // The file was in the manifest so it has to be in the archive.
+        unsigned long long size = 0;
+        unsigned long crc = 0;
+        if (manifest_crc_file(src, &size, &crc) != MANIFEST_OK) {
+            err = ADDON_ENOENT;
+            goto cleanup;
+        }
+
+        if (size != f->size || crc != f->crc) {
+            err = ADDON_EHASH;
+            goto cleanup;
+        }
+    }
+
+    stats_start(&timer, STATS_EXTRACT, a->name);
+
+    size_t nmoved = 0;
+    list_foreach(node, files)
+    {
+        const ManifestFile *f = node->value;
+        char src[OS_MAX_PATH];
+        char dest[OS_MAX_PATH];
+        int n1 = snmanifest_path(src, ARRAY_SIZE(src), tmpdir, f->path);
+        int n2 = snmanifest_path(dest, ARRAY_SIZE(dest), path, f->path);
+        if (n1 < 0 || (size_t)n1 >= ARRAY_SIZE(src) || n2 < 0 || (size_t)n2 >= ARRAY_SIZE(dest)) {
+            err = ADDON_ENAMETOOLONG;
+            break;
+        }
+
+        char dir[OS_MAX_PATH];
+        memcpy(dir, dest, (size_t)n2 + 1);
+        if (os_mkdir_all(dir, 0755) != 0) {
+            err = ADDON_EINTERNAL;
+            break;
+        }
+
+        // Renamed over the file instead of written into it, the file may be a
+        // link that other addons share.
+        int move_err = store_path != NULL ? store_repair(store_path, src, dest) : os_rename(src, dest);
+        if (move_err != 0) {
+            err = ADDON_EINTERNAL;
+            break;
+        }
+
+        nmoved++;
+    }
+
+    stats_stop(&timer);
+    stats_add_files(a->name, 0, nmoved);
+
+cleanup:
+    os_remove_all(tmpdir);
+    addon_keep_archive(a);
+
     return err;
 }
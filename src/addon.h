@@ -5,6 +5,8 @@
 #include <cjson/cJSON.h>
 
 #include "list.h"
+#include "sha256.h"
+#include "transaction.h"
 
 enum {
     ADDON_OK = 0,
@@ -18,6 +20,7 @@ enum {
     ADDON_EINTERNAL, // Internal error.
     ADDON_ERATE_LIMIT, // Failed because rate limit to external API exceeded.
     ADDON_ECONFIG, // Config file bad format.
+    ADDON_EHASH, // Archive does not have the hash it was locked or installed with.
 };
 
 typedef struct Addon {
@@ -27,6 +30,14 @@ typedef struct Addon {
     char *version;
     List *dirs;
 
+    // ManifestFile of every file that was installed, NULL if not known. Not
+    // saved with the addon, see manifest.h.
+    List *files;
+
+    // Catalog names of the addons that it needs, NULL if there are none. Read
+    // from the catalog, not saved with the addon.
+    List *deps;
+
     char *_zip_path;
     char *_package_path;
 } Addon;
@@ -36,9 +47,48 @@ typedef struct Addon {
 #define ADDON_URL "url"
 #define ADDON_VERSION "version"
 #define ADDON_DIRS "dirs"
+#define ADDON_DEPS "deps"
 
 Addon *addon_create(void);
 
+/**
+ * Sets the token that requests to the GitHub API are authenticated with. Raises
+ * the rate limit from 60 to 5000 requests per hour and allows the latest
+ * releases of many addons to be fetched with one GraphQL request. Passing NULL
+ * or an empty string makes requests anonymous.
+ *
+ * The string is not copied and shall stay valid while requests are made.
+ */
+void addon_set_github_token(const char *token);
+
+/**
+ * Sets the API that catalog urls are resolved against, for example
+ * 'http://127.0.0.1:8080' to use a local mock server. Passing NULL or an empty
+ * string uses the urls in the catalog as they are.
+ *
+ * The string is not copied and shall stay valid while requests are made.
+ */
+void addon_set_github_api_url(const char *url);
+
+/**
+ * Sets the content store that addon_stage moves files through so that files
+ * already in it are linked instead of copied, see store.h. Passing NULL or an
+ * empty string stages files without the store.
+ *
+ * The string is not copied and shall stay valid while addons are staged.
+ */
+void addon_set_store_path(const char *path);
+
+/**
+ * Sets the directory that archives are downloaded to and kept in. It is
+ * created if it does not exist and has to be private to the user, see
+ * os_mkdir_private. Passing NULL or an empty string uses wowpkg_downloads in
+ * the temp directory.
+ *
+ * The string is not copied and shall stay valid while archives are fetched.
+ */
+void addon_set_download_path(const char *path);
+
 /**
  * Frees all memory used by given addon. Also deletes any files that addon
  * currently has a handle to.
@@ -57,6 +107,19 @@ void addon_free(Addon *a);
  */
 void addon_cleanup_files(Addon *a);
 
+/**
+ * Leaves the downloaded archive of the addon in the download directory instead
+ * of deleting it with the other files, so that addon_repair and later installs
+ * of the same version do not have to download it again.
+ */
+void addon_keep_archive(Addon *a);
+
+/**
+ * Deletes the archive of the version of the addon from the download directory
+ * if it was kept.
+ */
+void addon_remove_archive(const Addon *a);
+
 /**
  * Creates and returns a new addon that was deep copied from the given addon.
  *
@@ -87,7 +150,8 @@ char *addon_to_json(Addon *a);
 void addon_set_str(char **restrict oldstr, char *restrict newstr);
 
 /**
- * Retrieves addon metadata from the catalog.
+ * Retrieves addon metadata from the catalog, including the addons that it
+ * depends on.
  *
  * Returns 0, non-zero on error.
  */
@@ -109,19 +173,86 @@ cJSON *addon_fetch_github_meta(const char *url, int *out_err);
  */
 int addon_fetch_all_meta(Addon *a, const char *name);
 
+/**
+ * Same as addon_fetch_all_meta but does so for n addons at once. Each addon
+ * shall have its name set.
+ *
+ * The latest releases are fetched with as few GitHub GraphQL requests as
+ * possible. Addons that could not be resolved that way fall back to one REST
+ * request each, which are all made concurrently. Addons earlier in the array
+ * are requested first, so they are the last to be affected by a rate limit.
+ *
+ * The result for each addon is stored in the matching index of errs, which
+ * shall have room for n values.
+ *
+ * Returns non-zero if the requests could not be made at all.
+ */
+int addon_fetch_all_meta_many(Addon **addons, size_t n, int *errs);
+
 /**
  * Downloads the .zip associated to Addon. Addon.url shall be a download link to
  * the .zip before calling this function.
+ *
+ * A download that was interrupted, in this or an earlier run, is resumed
+ * instead of started over. See net_download. An archive of the same version
+ * that was kept by addon_keep_archive is used without downloading it again,
+ * unless it is not a regular file or its list of files can not be read.
  */
 int addon_fetch_zip(Addon *a);
 
 /**
- * Prepares addon for extraction.
+ * Downloads the .zip of the addon into the download directory and keeps it
+ * there, so that addon_fetch_zip of the same version later does not have to
+ * download it. Does nothing if an archive that can be read is already there.
+ * Safe to call while another process calls addon_fetch_zip for the same
+ * version.
+ *
+ * Returns ADDON_OK on success, ADDON_EUNZIP if what was downloaded is not an
+ * archive, otherwise one of the ADDON_E values.
+ */
+int addon_prefetch_zip(const Addon *a);
+
+/**
+ * Same as addon_fetch_zip, but the archive shall be size bytes long and have
+ * the SHA-256 hash sha256, as a lower case hex string. A kept archive is only
+ * used if it matches, otherwise it is downloaded again. The download is hashed
+ * as it is written and deleted if it does not match.
+ *
+ * Returns ADDON_OK on success, ADDON_EHASH if the archive does not match,
+ * otherwise one of the ADDON_E values.
+ */
+int addon_fetch_zip_sha256(Addon *a, long long size, const char *sha256);
+
+/**
+ * Gets the size and the SHA-256 hash, as a lower case hex string, of the .zip
+ * of the addon. It is downloaded and kept first, see addon_prefetch_zip, if it
+ * was not kept already. Only an archive in the private download directory is
+ * hashed, never one that a link there points to, see addon_set_download_path.
+ *
+ * Returns ADDON_OK on success, otherwise one of the ADDON_E values.
+ */
+int addon_archive_sha256(const Addon *a, long long *size, char sha256[SHA256_HEX_SIZE]);
+
+/**
+ * Prepares addon for extraction and records the packaged files in
+ * Addon.files. The manifest is made from the central directory of the archive
+ * without reading the extracted files.
  *
  * Returns non zero on errors.
  */
 int addon_package(Addon *a);
 
+/**
+ * Same as addon_package, but files that are the same in the installed version
+ * of the addon, whose ManifestFile are installed, in the addons directory at
+ * path are hard linked into the package instead of extracted. Installed files
+ * whose size or time changed since they were installed are extracted again.
+ * installed may be NULL.
+ *
+ * Returns non zero on errors.
+ */
+int addon_package_reuse(Addon *a, const List *installed, const char *path);
+
 /**
  * Moves all packaged files from the package directory to the given path. First
  * checks and removes any files/directories from the given path before moving
@@ -130,3 +261,37 @@ int addon_package(Addon *a);
  * NOTE: addon_package shall be called before this function.
  */
 int addon_extract(Addon *a, const char *path);
+
+/**
+ * Stages the packaged files in each of the n transactions in txns, skipping
+ * NULL ones. The files are moved into the first transaction, through the
+ * content store if one is set, and cloned from there into the others, so the
+ * archive is only unzipped once no matter how many addons directories it goes
+ * to. Nothing in any addons directory is changed. May be called for different
+ * addons from multiple threads at the same time.
+ *
+ * NOTE: addon_package shall be called before this function.
+ */
+int addon_stage(Addon *a, Transaction **txns, size_t n);
+
+/**
+ * Replaces the directories of the installed version of the addon with the ones
+ * staged by addon_stage and adds them to Addon.dirs. installed may be NULL if
+ * the addon is not installed.
+ *
+ * If it fails the addons directory is left as it was.
+ */
+int addon_swap(Addon *a, Transaction *t, const Addon *installed);
+
+/**
+ * Replaces the files in files, a list of ManifestFile of the addons directory
+ * at path, with the ones from the archive of the installed version of the
+ * addon. Only those files are extracted. The archive is downloaded if it was
+ * not kept.
+ *
+ * Nothing is replaced unless every extracted file has the size and CRC-32 of
+ * its manifest entry, otherwise ADDON_EHASH is returned.
+ *
+ * Returns ADDON_OK on success, otherwise one of the ADDON_E values.
+ */
+int addon_repair(Addon *a, const char *path, const List *files);
@@ -9,6 +9,7 @@
 #include "appstate.h"
 #include "list.h"
 #include "osapi.h"
+#include "wowpkg.h"
 
 AppState *appstate_create(void)
 {
@@ -174,13 +175,13 @@ cleanup:
     return result;
 }
 
-int appstate_save(AppState *state, const char *path)
+int appstate_save_tmp(AppState *state, const char *tmp)
 {
     int err = APPSTATE_OK;
     FILE *f = NULL;
     char *json_str = NULL;
 
-    f = fopen(path, "wb");
+    f = fopen(tmp, "wb");
     if (f == NULL) {
         err = APPSTATE_ENOENT;
         goto cleanup;
@@ -193,14 +194,18 @@ int appstate_save(AppState *state, const char *path)
     }
 
     size_t json_strlen = strlen(json_str);
-    if (fwrite(json_str, sizeof(*json_str), json_strlen, f) != json_strlen) {
+    if (fwrite(json_str, sizeof(*json_str), json_strlen, f) != json_strlen || os_fsync(f) != 0) {
         err = APPSTATE_EINTERNAL;
         goto cleanup;
     }
 
 cleanup:
-    if (f != NULL) {
-        fclose(f);
+    if (f != NULL && fclose(f) != 0 && err == APPSTATE_OK) {
+        err = APPSTATE_EINTERNAL;
+    }
+
+    if (f != NULL && err != APPSTATE_OK) {
+        remove(tmp);
     }
 
     free(json_str);
@@ -208,6 +213,23 @@ cleanup:
     return err;
 }
 
+int appstate_save(AppState *state, const char *path)
+{
+    char tmp[OS_MAX_PATH];
+    int n = snprintf(tmp, ARRAY_SIZE(tmp), "%s" APPSTATE_TMP_EXT, path);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(tmp)) {
+        return APPSTATE_ENOENT;
+    }
+
+    int err = appstate_save_tmp(state, tmp);
+    if (err == APPSTATE_OK && os_rename(tmp, path) != 0) {
+        remove(tmp);
+        err = APPSTATE_EINTERNAL;
+    }
+
+    return err;
+}
+
 int appstate_load(AppState *state, const char *path)
 {
     int err = APPSTATE_OK;
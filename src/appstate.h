@@ -29,6 +29,10 @@ char *appstate_to_json(AppState *state);
 /**
  * Saves or loads the appstate to/from a given JSON file.
  *
+ * The state is saved to a temporary file that is written to disk and then
+ * renamed over path, so path has either the old or the new state even if the
+ * program stops part way through.
+ *
  * Returns APPSTATE_OK. On error returns one of the following:
  *   ADDON_ENOENT - failed to open path.
  *   ADDON_EPARSE - failed to parse the saved data.
@@ -36,3 +40,17 @@ char *appstate_to_json(AppState *state);
  */
 int appstate_save(AppState *state, const char *path);
 int appstate_load(AppState *state, const char *path);
+
+/**
+ * The first half of appstate_save: writes the state to the temporary file tmp
+ * and makes sure it is on disk. Renaming tmp over the state file finishes
+ * saving it, which may happen later, e.g. as the commit point of a
+ * transaction. tmp shall be the path of the state file with APPSTATE_TMP_EXT
+ * appended so that the rename stays on the same file system.
+ *
+ * Returns the same values as appstate_save. The temporary file is removed on
+ * error.
+ */
+int appstate_save_tmp(AppState *state, const char *tmp);
+
+#define APPSTATE_TMP_EXT ".tmp"
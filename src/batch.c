@@ -0,0 +1,233 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "osstring.h"
+#include "wowpkg.h"
+
+#define BATCH_SEPARATORS " \t\r"
+
+/**
+ * Commands that are merged with the same command on the line before.
+ */
+static const char *batch_merged[] = { "install", "remove", "update", "upgrade" };
+
+/**
+ * Reads all of f into a string that the caller shall free.
+ */
+static int batch_read_text(char **out, FILE *f)
+{
+    size_t len = 0;
+    size_t cap = 4096;
+    char *text = malloc(cap);
+    if (text == NULL) {
+        return BATCH_ENOMEM;
+    }
+
+    for (;;) {
+        if (cap - len < 2) {
+            char *grown = realloc(text, cap * 2);
+            if (grown == NULL) {
+                free(text);
+                return BATCH_ENOMEM;
+            }
+            text = grown;
+            cap *= 2;
+        }
+
+        size_t n = fread(&text[len], 1, cap - len - 1, f);
+        len += n;
+        if (n == 0) {
+            break;
+        }
+    }
+
+    if (ferror(f)) {
+        free(text);
+        return BATCH_EIO;
+    }
+
+    text[len] = '\0';
+    *out = text;
+
+    return BATCH_OK;
+}
+
+static bool batch_is_merged(const char *name)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(batch_merged); i++) {
+        if (strcasecmp(name, batch_merged[i]) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int batch_append_arg(BatchStep *step, const char *word)
+{
+    const char **argv = realloc(step->argv, sizeof(*argv) * ((size_t)step->argc + 1));
+    if (argv == NULL) {
+        return BATCH_ENOMEM;
+    }
+
+    argv[step->argc++] = word;
+    step->argv = argv;
+
+    return BATCH_OK;
+}
+
+/**
+ * Adds word to the arguments of step unless it has it already.
+ */
+static int batch_merge_arg(BatchStep *step, const char *word)
+{
+    for (int i = 1; i < step->argc; i++) {
+        if (strcasecmp(step->argv[i], word) == 0) {
+            return BATCH_OK;
+        }
+    }
+
+    return batch_append_arg(step, word);
+}
+
+/**
+ * Adds the command in words, which are nwords long, to b as a step of its own
+ * or by merging it with the last step.
+ */
+static int batch_add(Batch *b, size_t *cap, const char **words, size_t nwords, size_t line)
+{
+    BatchStep *last = b->nsteps > 0 ? &b->steps[b->nsteps - 1] : NULL;
+
+    if (last != NULL && strcasecmp(last->argv[0], words[0]) == 0 && batch_is_merged(words[0])) {
+        // Without addons it is all of them.
+        bool all = strcasecmp(words[0], "update") == 0 || strcasecmp(words[0], "upgrade") == 0;
+        if (all && (last->argc == 1 || nwords == 1)) {
+            last->argc = 1;
+            return BATCH_OK;
+        }
+
+        for (size_t i = 1; i < nwords; i++) {
+            int err = batch_merge_arg(last, words[i]);
+            if (err != BATCH_OK) {
+                return err;
+            }
+        }
+
+        return BATCH_OK;
+    }
+
+    if (b->nsteps == *cap) {
+        size_t grown_cap = *cap == 0 ? 16 : *cap * 2;
+        BatchStep *grown = realloc(b->steps, sizeof(*grown) * grown_cap);
+        if (grown == NULL) {
+            return BATCH_ENOMEM;
+        }
+        b->steps = grown;
+        *cap = grown_cap;
+    }
+
+    BatchStep *step = &b->steps[b->nsteps++];
+    step->argc = 0;
+    step->argv = NULL;
+    step->line = line;
+
+    // Other commands get their arguments as they are.
+    bool merged = batch_is_merged(words[0]);
+    int err = batch_append_arg(step, words[0]);
+    for (size_t i = 1; i < nwords && err == BATCH_OK; i++) {
+        err = merged ? batch_merge_arg(step, words[i]) : batch_append_arg(step, words[i]);
+    }
+
+    return err;
+}
+
+int batch_read(Batch **out, FILE *f, size_t *line)
+{
+    *line = 0;
+
+    Batch *b = calloc(1, sizeof(*b));
+    if (b == NULL) {
+        return BATCH_ENOMEM;
+    }
+
+    int err = batch_read_text(&b->text, f);
+    if (err != BATCH_OK) {
+        goto error;
+    }
+
+    size_t cap = 0;
+    const char **words = NULL;
+    size_t words_cap = 0;
+
+    char *next = b->text;
+    for (size_t n = 1; next != NULL && err == BATCH_OK; n++) {
+        char *p = next;
+        next = strchr(p, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+
+        size_t nwords = 0;
+        for (p += strspn(p, BATCH_SEPARATORS); *p != '\0' && *p != '#'; p += strspn(p, BATCH_SEPARATORS)) {
+            if (nwords == words_cap) {
+                words_cap = words_cap == 0 ? 16 : words_cap * 2;
+                const char **grown = realloc(words, sizeof(*grown) * words_cap);
+                if (grown == NULL) {
+                    err = BATCH_ENOMEM;
+                    break;
+                }
+                words = grown;
+            }
+
+            words[nwords++] = p;
+            p += strcspn(p, BATCH_SEPARATORS);
+            if (*p != '\0') {
+                *p++ = '\0';
+            }
+        }
+
+        if (err != BATCH_OK || nwords == 0) {
+            continue;
+        }
+
+        if (strncmp(words[0], "--", 2) == 0) {
+            *line = n;
+            err = BATCH_EOPTION;
+            break;
+        }
+
+        err = batch_add(b, &cap, words, nwords, n);
+    }
+
+    free(words);
+
+    if (err != BATCH_OK) {
+        goto error;
+    }
+
+    *out = b;
+
+    return BATCH_OK;
+
+error:
+    batch_free(b);
+
+    return err;
+}
+
+void batch_free(Batch *b)
+{
+    if (b == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < b->nsteps; i++) {
+        free(b->steps[i].argv);
+    }
+
+    free(b->steps);
+    free(b->text);
+    free(b);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Reads the commands that the batch command runs in a single session, one per
+ * line. Words are separated by spaces or tabs, a word that starts with '#'
+ * comments out the rest of the line, and empty lines are skipped. Options such
+ * as --flavor go before the batch command, not on its lines.
+ *
+ * Commands in a row that install, remove, update or upgrade are merged into
+ * one with every addon of them once, so that the addons are fetched and
+ * unzipped together. An update or upgrade without addons works on all of them,
+ * so it takes in the ones with addons.
+ */
+
+enum {
+    BATCH_OK = 0,
+
+    BATCH_EOPTION, // A line starts with an option.
+    BATCH_EIO,
+    BATCH_ENOMEM,
+};
+
+typedef struct BatchStep {
+    int argc;
+    const char **argv; // argv[0] is the command.
+    size_t line; // Line of the first command that was merged into it, from 1.
+} BatchStep;
+
+typedef struct Batch {
+    BatchStep *steps;
+    size_t nsteps;
+    char *text; // Contents that the words point into.
+} Batch;
+
+/**
+ * Reads the commands in f until the end of the file.
+ *
+ * On success returns BATCH_OK and stores the batch in out. On error returns one
+ * of the BATCH_E values and stores the line of the error in line, if known.
+ */
+int batch_read(Batch **out, FILE *f, size_t *line);
+
+/**
+ * Passing a NULL pointer will make this function return immediately with no
+ * action.
+ */
+void batch_free(Batch *b);
@@ -1,30 +1,54 @@
-#include <ctype.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 
-#include <curl/curl.h>
+#include <cjson/cJSON.h>
 
 #include "addon.h"
 #include "command.h"
 #include "context.h"
+#include "github.h"
 #include "list.h"
+#include "lockfile.h"
+#include "manifest.h"
+#include "net.h"
 #include "osapi.h"
 #include "osstring.h"
+#include "search.h"
+#include "stats.h"
+#include "store.h"
 #include "term.h"
+#include "threadpool.h"
+#include "toc.h"
+#include "transaction.h"
+#include "watch.h"
 #include "wowpkg.h"
 
 // #define CMD_ECREATE_TMP_DIR_STR "failed to create temp directory"
 // #define CMD_EMOVE_STR "failed to move file/directory"
 // #define CMD_EOPEN_DIR_STR "failed to open directory"
+#define CMD_EDEPENDENCY_STR "a dependency was not installed"
 #define CMD_EDOWNLOAD_STR "failed to make HTTP request"
 #define CMD_EEXTRACT_STR "failed to extract addon"
+#define CMD_EINTERRUPTED_STR "interrupted"
 #define CMD_EINVALID_ARGS_STR "invalid args"
+#define CMD_EMANIFEST_STR "failed to read manifest"
 #define CMD_EMETADATA_STR "failed to get metadata"
+#define CMD_ELOCKFILE_STR "failed to read lockfile"
+#define CMD_EMISMATCH_STR "archive does not match the lockfile"
 #define CMD_ENAMETOOLONG_STR "name too long"
 #define CMD_ENOT_FOUND_STR "could not find addon"
 #define CMD_ENO_MEM_STR "memory allocation failed"
 #define CMD_EPACKAGE_STR "failed to package addon"
 #define CMD_ERATE_LIMIT_STR "rate limit exceeded"
+#define CMD_ECATALOG_STR "failed to read catalog"
+#define CMD_EREAD_DIR_STR "failed to read directory"
+#define CMD_EREPAIR_STR "failed to repair addon"
+#define CMD_EREPAIR_MISMATCH_STR "archive does not have the installed files of addon"
+#define CMD_ESTORE_DISABLED_STR "the content store is not enabled in config.ini"
+#define CMD_ESTORE_STR "failed to read or write content store"
 #define CMD_EREMOVE_DIR_STR "failed to remove existing directory"
 
 #define PRINT_ERROR1(error_str) PRINT_ERROR("%s\n", error_str)
@@ -42,440 +66,2634 @@
         PRINT_WARNING("try running 'update' to fix this problem\n"); \
     } while (0)
 
-#define PRINT_STATUS(stream, ...) fprintf(stream, "==> " __VA_ARGS__)
-#define PRINT_STATUS_ADDON(stream, msg, addon) fprintf(stream, "==> " TERM_WRAP(TERM_BOLD, msg) " " TERM_WRAP(TERM_BOLD_BLUE, "%s") "\n", addon)
+// Status lines are left out when stream is NULL, which commands pass when they
+// print JSON instead.
+#define PRINT_STATUS(stream, ...) ((stream) != NULL ? fprintf(stream, "==> " __VA_ARGS__) : 0)
+#define PRINT_STATUS_ADDON(stream, msg, addon) PRINT_STATUS(stream, TERM_WRAP(TERM_BOLD, msg) " " TERM_WRAP(TERM_BOLD_BLUE, "%s") "\n", addon)
+
+static int cmp_addon(const void *a, const void *b)
+{
+    const Addon *aa = a;
+    const Addon *bb = b;
+
+    return strcmp(aa->name, bb->name);
+}
+
+/**
+ * Compares a string a to the Addon b's name.
+ */
+static int cmp_str_to_addon(const void *str, const void *addon)
+{
+    const char *s = str;
+    const Addon *a = addon;
+
+    return strcasecmp(s, a->name);
+}
+
+static int cmp_str_case(const void *a, const void *b)
+{
+    return strcasecmp(a, b);
+}
+
+/**
+ * An addon that is worked on by a task on the pool of a Context. Each step
+ * stores its result so that the calling thread can report errors in order.
+ */
+typedef struct CmdJob {
+    const char *name; // Name the addon was asked for by.
+    char *fixed_name; // Catalog name used instead of a typo, owned by the job.
+    char *dep_name; // Catalog name of a dependency that was added, owned by the job.
+    const char *needed_by; // Name of the job that a dependency was added for.
+    const LockEntry *lock; // Release that sync installs, NULL for other commands.
+    Addon *addon;
+    ThreadTask *task;
+
+    // Bit i is set if the addon goes into flavor i, see cmd_flavors.
+    unsigned flavors;
+    Transaction *txns[CONFIG_MAX_FLAVORS];
+
+    // Files of the installed version that unchanged files are linked from,
+    // NULL if there are none.
+    const List *reuse_files;
+    const char *reuse_path;
+
+    int meta_err;
+    int zip_err;
+    int package_err;
+    int stage_err;
+
+    // Jobs are installed in waves, each after the ones of the addons that it
+    // depends on.
+    size_t wave;
+
+    // Outcome for --json. Bit i of swapped is set once the addon is in flavor
+    // i. status is "not_found" or "skipped" if the addon was not looked for,
+    // error is the last CMD_E string of a failure, NULL if there was none.
+    unsigned swapped;
+    const char *status;
+    const char *error;
+    double fetch_time;
+    double package_time;
+    double swap_time;
+} CmdJob;
+
+/**
+ * An installed addon whose archive is hashed by a task on the pool of a
+ * Context for its lockfile entry.
+ */
+typedef struct CmdLockJob {
+    const Addon *addon;
+    ThreadTask *task;
+
+    int err;
+    long long size;
+    char sha256[SHA256_HEX_SIZE];
+} CmdLockJob;
+
+/**
+ * A directory that is removed by a task on the pool of a Context.
+ */
+typedef struct CmdRemoveJob {
+    const char *name;
+    const char *dirname;
+    char path[OS_MAX_PATH];
+    ThreadTask *task;
+
+    // Installed files of the addon, the directory is only read if NULL or
+    // it has files that are not in it.
+    const List *files;
+    const char *root;
+} CmdRemoveJob;
+
+/**
+ * Installed files that are checked against their manifest by a task on the
+ * pool of a Context.
+ */
+typedef struct CmdCheckJob {
+    const char *root; // Addons directory.
+    const ManifestFile **files;
+    int *results; // MANIFEST_OK or error of each file.
+    size_t n;
+    ThreadTask *task;
+} CmdCheckJob;
+
+/**
+ * An addon directory that the program did not install, read by a task on the
+ * pool of a Context so that it can be adopted.
+ */
+typedef struct CmdAdoptJob {
+    char *dirname;
+    const char *root; // Addons directory.
+    Toc *toc; // NULL if the directory has none.
+    List *files; // ManifestFile of every file in the directory.
+    ThreadTask *task;
+
+    int toc_err;
+    int scan_err;
+
+    // Catalog name of the addon the directory is a part of, NULL if none was
+    // found. Belongs to the search index.
+    const char *match;
+    bool primary; // Matched by itself, not by another directory.
+} CmdAdoptJob;
+
+/**
+ * Files checked by one task. Small enough that the files of one large addon
+ * are spread over all threads, large enough that most addons are one task.
+ */
+#define CMD_CHECK_FILES 64
+
+/**
+ * Fetches the metadata of the addon and then downloads it.
+ */
+static int cmd_job_fetch(void *arg)
+{
+    CmdJob *job = arg;
+    double start = os_monotonic();
+
+    job->meta_err = addon_fetch_all_meta(job->addon, job->name);
+    if (job->meta_err == ADDON_OK) {
+        job->zip_err = addon_fetch_zip(job->addon);
+    }
+
+    job->fetch_time = os_monotonic() - start;
+
+    return 0;
+}
+
+static int cmd_job_download(void *arg)
+{
+    CmdJob *job = arg;
+    double start = os_monotonic();
+
+    job->zip_err = addon_fetch_zip(job->addon);
+    job->fetch_time = os_monotonic() - start;
+
+    return 0;
+}
+
+/**
+ * Reads the catalog metadata of the addon of a lockfile entry and then
+ * downloads the archive that the entry pins, see addon_fetch_zip_sha256.
+ */
+static int cmd_job_sync(void *arg)
+{
+    CmdJob *job = arg;
+    double start = os_monotonic();
+
+    job->meta_err = addon_fetch_catalog_meta(job->addon, job->name);
+    if (job->meta_err == ADDON_OK) {
+        char *version = strdup(job->lock->version);
+        char *url = strdup(job->lock->url);
+        if (version == NULL || url == NULL) {
+            free(version);
+            free(url);
+            job->meta_err = ADDON_EINTERNAL;
+        } else {
+            addon_set_str(&job->addon->version, version);
+            addon_set_str(&job->addon->url, url);
+            job->zip_err = addon_fetch_zip_sha256(job->addon, job->lock->size, job->lock->sha256);
+        }
+    }
+
+    job->fetch_time = os_monotonic() - start;
+
+    return 0;
+}
+
+static int cmd_job_lock(void *arg)
+{
+    CmdLockJob *job = arg;
+
+    // An adopted addon that was never upgraded has the url of the catalog, not
+    // of an archive.
+    Addon *catalog = addon_create();
+    if (catalog == NULL) {
+        job->err = ADDON_EINTERNAL;
+        return 0;
+    }
+
+    if (addon_fetch_catalog_meta(catalog, job->addon->name) == ADDON_OK && catalog->url != NULL && job->addon->url != NULL
+        && strcmp(catalog->url, job->addon->url) == 0) {
+        job->err = ADDON_ENO_ZIP_ASSET;
+    } else if (job->addon->url == NULL || job->addon->version == NULL) {
+        job->err = ADDON_ENO_ZIP_ASSET;
+    } else {
+        job->err = addon_archive_sha256(job->addon, &job->size, job->sha256);
+    }
+
+    addon_free(catalog);
+
+    return 0;
+}
+
+static int cmd_job_prefetch(void *arg)
+{
+    CmdJob *job = arg;
+
+    job->zip_err = addon_prefetch_zip(job->addon);
+
+    return 0;
+}
+
+/**
+ * Packages the downloaded addon and stages it in the transaction of every
+ * flavor of the job.
+ */
+static int cmd_job_stage(void *arg)
+{
+    CmdJob *job = arg;
+    double start = os_monotonic();
+
+    job->package_err = addon_package_reuse(job->addon, job->reuse_files, job->reuse_path);
+    if (job->package_err == ADDON_OK) {
+        job->stage_err = addon_stage(job->addon, job->txns, ARRAY_SIZE(job->txns));
+    }
+
+    job->package_time = os_monotonic() - start;
+
+    return 0;
+}
+
+static int cmd_job_check(void *arg)
+{
+    CmdCheckJob *job = arg;
+
+    for (size_t i = 0; i < job->n; i++) {
+        job->results[i] = manifest_check(job->root, job->files[i]);
+    }
+
+    return 0;
+}
+
+/**
+ * Reads the .toc file of the directory and the files in it.
+ */
+static int cmd_job_adopt(void *arg)
+{
+    CmdAdoptJob *job = arg;
+
+    job->toc_err = toc_load(&job->toc, job->root, job->dirname);
+
+    job->files = list_create();
+    if (job->files == NULL) {
+        job->scan_err = MANIFEST_EIO;
+        return 0;
+    }
+
+    list_set_free_fn(job->files, (ListFreeFn)manifest_file_free);
+    job->scan_err = manifest_scan_dir(job->files, job->root, job->dirname);
+
+    return 0;
+}
+
+/**
+ * Returns 0 on success or the errno of the failure.
+ */
+static int cmd_job_remove(void *arg)
+{
+    CmdRemoveJob *job = arg;
+
+    StatsTimer timer;
+    stats_start(&timer, STATS_REMOVE, job->name);
+
+    int err = job->files != NULL ? manifest_remove(job->root, job->files, job->dirname) : MANIFEST_EIO;
+    if (err == MANIFEST_OK) {
+        err = 0;
+    } else if (err == MANIFEST_ENOENT) {
+        err = ENOENT;
+    } else {
+        err = os_remove_all(job->path) != 0 ? errno : 0;
+    }
+
+    stats_stop(&timer);
+
+    return err;
+}
+
+/**
+ * Waits for the task of job. Returns 0 if it ran, otherwise prints an error and
+ * returns -1.
+ */
+static int cmd_job_wait(ThreadTask **task, const char *proc_name)
+{
+    int result;
+    int err = threadpool_wait(*task, &result);
+    *task = NULL;
+
+    if (err == THREADPOOL_ENOMEM) {
+        PRINT_ERROR2(CMD_ENO_MEM_STR, proc_name);
+        return -1;
+    } else if (err != THREADPOOL_OK) {
+        PRINT_ERROR2(CMD_EINTERRUPTED_STR, proc_name);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Most catalog names suggested for a name that was not found.
+ */
+#define CMD_SUGGESTIONS 3
+
+typedef bool (*CmdAcceptFn)(const Context *ctx, const char *name);
+
+static bool cmd_is_installed(const Context *ctx, const char *name)
+{
+    return list_search(ctx->state->installed, name, cmp_str_to_addon) != NULL;
+}
+
+/**
+ * Reports that the addon name could not be found, along with the catalog names
+ * that it may be a typo of and that accept returns true for, if accept is not
+ * NULL.
+ *
+ * When ctx fixes typos and one name has fewer typos than the others, returns a
+ * copy of it for the command to go on with instead, which the caller shall
+ * free. Otherwise returns NULL.
+ */
+static char *cmd_not_found(const Context *ctx, const char *proc_name, const char *name, CmdAcceptFn accept)
+{
+    PRINT_WARNING3(CMD_ENOT_FOUND_STR, proc_name, name);
+
+    SearchIndex *idx = ctx != NULL ? ctx->search_index : NULL;
+    SearchIndex *opened = NULL;
+    if (idx == NULL) {
+        if (search_index_open(&opened, ctx != NULL ? ctx->search_index_path : NULL, WOWPKG_CATALOG_PATH) != SEARCH_OK) {
+            return NULL;
+        }
+        idx = opened;
+    }
+
+    // More than are shown since some may not be accepted.
+    SearchSuggestion found[CMD_SUGGESTIONS * 4];
+    size_t nfound = search_suggest(idx, name, found, ARRAY_SIZE(found));
+
+    SearchSuggestion suggestions[CMD_SUGGESTIONS];
+    size_t n = 0;
+    for (size_t i = 0; i < nfound && n < ARRAY_SIZE(suggestions); i++) {
+        if (strcasecmp(found[i].name, name) != 0 && (accept == NULL || accept(ctx, found[i].name))) {
+            suggestions[n++] = found[i];
+        }
+    }
+
+    char *result = NULL;
+
+    if (n > 0 && ctx != NULL && ctx->fix_typos && (n == 1 || suggestions[0].typos < suggestions[1].typos)) {
+        result = strdup(suggestions[0].name);
+        if (result != NULL) {
+            PRINT_WARNING("%s: using '%s' for '%s'\n", proc_name, suggestions[0].name, name);
+        }
+    } else if (n > 0) {
+        PRINT_WARNING("%s: did you mean", proc_name);
+        for (size_t i = 0; i < n; i++) {
+            fprintf(stderr, "%s '%s'", i == 0 ? "" : i + 1 == n ? " or" : ",", suggestions[i].name);
+        }
+        fprintf(stderr, "?\n");
+    }
+
+    search_index_free(opened);
+
+    return result;
+}
+
+/**
+ * Returns the flavors that install and upgrade work on and stores how many
+ * there are in n. If the context has none then single is filled in with the
+ * state and addons path of the context and returned.
+ */
+static ContextFlavor *cmd_flavors(Context *ctx, ContextFlavor *single, size_t *n)
+{
+    if (ctx->nflavors > 0) {
+        *n = ctx->nflavors;
+        return ctx->flavors;
+    }
+
+    single->name = NULL;
+    single->addons_path = ctx->config->addons_path;
+    single->state = ctx->state;
+    single->manifest_path = ctx->manifest_path;
+
+    *n = 1;
+    return single;
+}
+
+/**
+ * Prints a status line for an addon. The flavor is only named if there is more
+ * than one.
+ */
+static void cmd_print_status_flavor(FILE *stream, const char *msg, const char *name, const ContextFlavor *flavor, size_t nflavors)
+{
+    if (nflavors > 1) {
+        PRINT_STATUS(stream, TERM_WRAP(TERM_BOLD, "%s") " " TERM_WRAP(TERM_BOLD_BLUE, "%s") " (%s)\n", msg, name, flavor->name);
+    } else {
+        PRINT_STATUS(stream, TERM_WRAP(TERM_BOLD, "%s") " " TERM_WRAP(TERM_BOLD_BLUE, "%s") "\n", msg, name);
+    }
+}
+
+/**
+ * Adds value to object under key, or null if value is NULL.
+ *
+ * Returns false if out of memory.
+ */
+static bool cmd_json_add_str(cJSON *object, const char *key, const char *value)
+{
+    return (value != NULL ? cJSON_AddStringToObject(object, key, value) : cJSON_AddNullToObject(object, key)) != NULL;
+}
+
+/**
+ * Adds the strings in list to object as an array under key.
+ *
+ * Returns false if out of memory.
+ */
+static bool cmd_json_add_list(cJSON *object, const char *key, const List *list)
+{
+    cJSON *array = cJSON_AddArrayToObject(object, key);
+    if (array == NULL) {
+        return false;
+    } else if (list == NULL) {
+        return true;
+    }
+
+    ListNode *node = NULL;
+    list_foreach(node, list)
+    {
+        cJSON *item = cJSON_CreateString(node->value);
+        if (item == NULL) {
+            return false;
+        }
+        cJSON_AddItemToArray(array, item);
+    }
+
+    return true;
+}
+
+/**
+ * Adds a time in seconds to object under key in whole milliseconds.
+ *
+ * Returns false if out of memory.
+ */
+static bool cmd_json_add_ms(cJSON *object, const char *key, double seconds)
+{
+    return cJSON_AddNumberToObject(object, key, (double)(long long)(seconds * 1000.0 + 0.5)) != NULL;
+}
+
+/**
+ * Prints object to stream as a single line and frees it. ok is false if it
+ * could not be filled in.
+ *
+ * Returns 0 on success, otherwise prints an error and returns -1.
+ */
+static int cmd_print_json(FILE *stream, cJSON *object, bool ok, const char *proc_name)
+{
+    char *line = object != NULL && ok ? cJSON_PrintUnformatted(object) : NULL;
+    cJSON_Delete(object);
+
+    if (line == NULL) {
+        PRINT_ERROR2(CMD_ENO_MEM_STR, proc_name);
+        return -1;
+    }
+
+    fprintf(stream, "%s\n", line);
+    free(line);
+
+    return 0;
+}
+
+/**
+ * Prints the outcome of job as a JSON object: the addon, the flavors it went
+ * into and how long each step took. done is the status of an addon that went
+ * into all of its flavors.
+ *
+ * Returns 0 on success, otherwise prints an error and returns -1.
+ */
+static int cmd_job_print_json(FILE *stream, const CmdJob *job, const ContextFlavor *flavors, size_t nflavors, const char *done, const char *proc_name)
+{
+    const char *status = job->status != NULL ? job->status : "failed";
+    if (job->swapped != 0) {
+        status = job->swapped == job->flavors ? done : "partial";
+    }
+
+    const Addon *a = job->addon;
+    cJSON *object = cJSON_CreateObject();
+    bool ok = object != NULL && cmd_json_add_str(object, "name", a != NULL && a->name != NULL ? a->name : job->name)
+        && cmd_json_add_str(object, "status", status) && cmd_json_add_str(object, "version", a != NULL ? a->version : NULL)
+        && cmd_json_add_str(object, "error", job->swapped == job->flavors ? NULL : job->error)
+        && cmd_json_add_str(object, "needed_by", job->needed_by);
+
+    cJSON *array = ok ? cJSON_AddArrayToObject(object, "flavors") : NULL;
+    ok = array != NULL;
+    for (size_t f = 0; f < nflavors && ok; f++) {
+        if ((job->swapped & (1u << f)) != 0) {
+            cJSON *item = flavors[f].name != NULL ? cJSON_CreateString(flavors[f].name) : cJSON_CreateNull();
+            ok = item != NULL;
+            cJSON_AddItemToArray(array, item);
+        }
+    }
+
+    ok = ok && cmd_json_add_ms(object, "fetch_ms", job->fetch_time) && cmd_json_add_ms(object, "package_ms", job->package_time)
+        && cmd_json_add_ms(object, "swap_ms", job->swap_time);
+
+    return cmd_print_json(stream, object, ok, proc_name);
+}
+
+/**
+ * Replaces the installed and latest entries of addon in state. Takes ownership
+ * of addon.
+ */
+static void cmd_state_replace(AppState *state, Addon *addon)
+{
+    ListNode *n = NULL;
+
+    n = list_search(state->installed, addon, cmp_addon);
+    list_remove(state->installed, n);
+    list_insert(state->installed, addon);
+
+    n = list_search(state->latest, addon, cmp_addon);
+    list_remove(state->latest, n);
+    list_insert(state->latest, addon_dup(addon));
+}
+
+/**
+ * Removes addon, which is installed in state, from state, which frees it.
+ */
+static void cmd_state_remove(AppState *state, Addon *addon)
+{
+    ListNode *n = NULL;
+
+    // Order here is important. Addon should first be removed from latest
+    // because Addon is a reference to an addon in installed. Removing from
+    // installed first would cause a double free.
+    n = list_search(state->latest, addon, cmp_addon);
+    list_remove(state->latest, n);
+
+    n = list_search(state->installed, addon, cmp_addon);
+    list_remove(state->installed, n);
+}
+
+/**
+ * Returns the name that job was asked for by, or the name of its addon if it
+ * was not asked for by name.
+ */
+static const char *cmd_job_name(const CmdJob *job)
+{
+    return job->name != NULL ? job->name : job->addon->name;
+}
+
+/**
+ * Returns true if the addon of job depends on the addon of dep.
+ */
+static bool cmd_job_needs(const CmdJob *job, const CmdJob *dep)
+{
+    return job != dep && job->addon->deps != NULL && list_search(job->addon->deps, cmd_job_name(dep), cmp_str_case) != NULL;
+}
+
+/**
+ * Returns the first of the n jobs that the addon of job depends on, or NULL if
+ * there is none.
+ */
+static const CmdJob *cmd_job_find_dep(const CmdJob *job, const CmdJob *jobs, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (cmd_job_needs(job, &jobs[i])) {
+            return &jobs[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Adds a to the old archives of ctx, unless its version is already there.
+ */
+static void cmd_retire_archive(Context *ctx, Addon *a)
+{
+    if (ctx->old_archives == NULL) {
+        return;
+    }
+
+    ListNode *node = NULL;
+    list_foreach(node, ctx->old_archives)
+    {
+        const Addon *o = node->value;
+        if (strcmp(o->name, a->name) == 0 && strcmp(o->version, a->version) == 0) {
+            return;
+        }
+    }
+
+    Addon *copy = addon_dup(a);
+    if (copy != NULL && list_insert(ctx->old_archives, copy) == NULL) {
+        addon_free(copy);
+    }
+}
+
+/**
+ * Packages and stages the downloaded addons of jobs on the pool of ctx, then
+ * swaps them into the addons directory of each of their flavors one at a time
+ * in order. Every archive is unzipped once no matter how many flavors it goes
+ * to. The app state of a flavor is updated for every addon that was swapped
+ * into it. An addon that fails does not stop the ones after it, unless they
+ * depend on it and it is not installed in that flavor.
+ *
+ * If keep is not NULL, the installed addons that are not in it are removed in
+ * the same transactions before anything is swapped in.
+ *
+ * Returns 0 if all addons were installed and removed, otherwise -1.
+ */
+static int cmd_jobs_install(Context *ctx, CmdJob *jobs, size_t n, const Lockfile *keep, const char *proc_name, const char *done_msg, FILE *stream)
+{
+    int err = 0;
+
+    ContextFlavor single;
+    size_t nflavors = 0;
+    ContextFlavor *flavors = cmd_flavors(ctx, &single, &nflavors);
+
+    // A flavor only gets a transaction if an addon goes into it or out of it.
+    unsigned used = 0;
+    for (size_t i = 0; i < n; i++) {
+        used |= jobs[i].flavors;
+    }
+
+    for (size_t f = 0; keep != NULL && f < nflavors; f++) {
+        ListNode *node = NULL;
+        list_foreach(node, flavors[f].state->installed)
+        {
+            if (lockfile_find(keep, ((const Addon *)node->value)->name) == NULL) {
+                used |= 1u << f;
+            }
+        }
+    }
+
+    Transaction *txns[CONFIG_MAX_FLAVORS] = { NULL };
+    for (size_t f = 0; f < nflavors; f++) {
+        if ((used & (1u << f)) == 0) {
+            continue;
+        }
+
+        if (transaction_begin(&txns[f], flavors[f].addons_path) != TRANSACTION_OK) {
+            PRINT_ERROR("%s: failed to start transaction in %s\n", proc_name, flavors[f].addons_path);
+            PRINT_ERROR("an earlier install or upgrade may not have finished\n");
+
+            // Nothing was swapped yet.
+            for (size_t j = 0; j < f; j++) {
+                transaction_free(txns[j]);
+                if (txns[j] != NULL) {
+                    transaction_rollback(flavors[j].addons_path);
+                }
+            }
+
+            return -1;
+        }
+    }
+
+    // Removed first so that a directory that moved to an addon that is swapped
+    // in later is not backed up as part of the removed one.
+    for (size_t f = 0; keep != NULL && f < nflavors; f++) {
+        ListNode *node = flavors[f].state->installed->head;
+        while (node != NULL) {
+            Addon *installed = node->value;
+            node = node->next;
+
+            if (lockfile_find(keep, installed->name) != NULL) {
+                continue;
+            }
+
+            cmd_print_status_flavor(stream, "Removing", installed->name, &flavors[f], nflavors);
+            if (transaction_remove(txns[f], installed->name, installed->dirs) != TRANSACTION_OK) {
+                PRINT_ERROR3(CMD_EREMOVE_DIR_STR, proc_name, installed->name);
+                err = -1;
+                continue;
+            }
+
+            // Deleted once the transaction is committed, like the archives of
+            // replaced versions.
+            if (installed->version != NULL) {
+                cmd_retire_archive(ctx, installed);
+            }
+            cmd_state_remove(flavors[f].state, installed);
+        }
+    }
+
+    // Unchanged files are linked from the first flavor that has the addon
+    // installed, if it is known what was installed.
+    for (size_t f = 0; f < nflavors; f++) {
+        if ((used & (1u << f)) != 0 && flavors[f].manifest_path != NULL) {
+            manifest_load(flavors[f].state, flavors[f].manifest_path);
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t f = 0; f < nflavors; f++) {
+            jobs[i].txns[f] = (jobs[i].flavors & (1u << f)) != 0 ? txns[f] : NULL;
+
+            ListNode *found = jobs[i].txns[f] != NULL && jobs[i].reuse_files == NULL ? list_search(flavors[f].state->installed, jobs[i].addon, cmp_addon) : NULL;
+            if (found != NULL && ((Addon *)found->value)->files != NULL) {
+                jobs[i].reuse_files = ((Addon *)found->value)->files;
+                jobs[i].reuse_path = flavors[f].addons_path;
+            }
+        }
+
+        jobs[i].task = threadpool_submit(ctx->pool, cmd_job_stage, NULL, &jobs[i]);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        CmdJob *job = &jobs[i];
+
+        if (cmd_job_wait(&job->task, proc_name) != 0) {
+            job->error = CMD_EINTERRUPTED_STR;
+            err = -1;
+            continue;
+        }
+
+        PRINT_STATUS_ADDON(stream, "Packaging", job->addon->name);
+        if (job->package_err != ADDON_OK) {
+            PRINT_ERROR3(CMD_EPACKAGE_STR, proc_name, job->addon->name);
+            job->error = CMD_EPACKAGE_STR;
+            err = -1;
+            continue;
+        }
+
+        for (size_t f = 0; f < nflavors; f++) {
+            ContextFlavor *flavor = &flavors[f];
+
+            if (job->txns[f] == NULL) {
+                continue;
+            }
+
+            // Addons that were swapped before an interrupt are kept.
+            if (threadpool_canceled(ctx->pool)) {
+                PRINT_ERROR2(CMD_EINTERRUPTED_STR, proc_name);
+                job->error = CMD_EINTERRUPTED_STR;
+                err = -1;
+                break;
+            }
+
+            // An addon that was asked for along with the addons it depends on
+            // is not installed without them.
+            const CmdJob *dep = NULL;
+            for (size_t j = 0; j < i; j++) {
+                if ((jobs[j].flavors & (1u << f)) != 0 && cmd_job_needs(job, &jobs[j])
+                    && list_search(flavor->state->installed, cmd_job_name(&jobs[j]), cmp_str_to_addon) == NULL) {
+                    dep = &jobs[j];
+                    break;
+                }
+            }
+
+            if (dep != NULL) {
+                PRINT_ERROR("%s: skipping %s, it needs %s which was not installed\n", proc_name, job->addon->name, cmd_job_name(dep));
+                job->error = CMD_EDEPENDENCY_STR;
+                err = -1;
+                continue;
+            }
+
+            ListNode *found = list_search(flavor->state->installed, job->addon, cmp_addon);
+            if (found) {
+                cmd_print_status_flavor(stream, "Replacing existing addon", job->addon->name, flavor, nflavors);
+            }
+
+            cmd_print_status_flavor(stream, "Extracting", job->addon->name, flavor, nflavors);
+
+            // Each flavor owns its own copy, the dirs are filled in by the swap.
+            Addon *addon = addon_dup(job->addon);
+            if (addon != NULL) {
+                addon->files = manifest_files_dup(job->addon->files);
+            }
+
+            double start = os_monotonic();
+            int swap_err = addon == NULL || job->stage_err != ADDON_OK ? ADDON_EINTERNAL : addon_swap(addon, job->txns[f], found ? found->value : NULL);
+            job->swap_time += os_monotonic() - start;
+
+            if (swap_err != ADDON_OK) {
+                PRINT_ERROR3(CMD_EEXTRACT_STR, proc_name, job->addon->name);
+                job->error = CMD_EEXTRACT_STR;
+                addon_free(addon);
+                err = -1;
+                continue;
+            }
+
+            // The archive of the version that was replaced is no longer needed
+            // to repair it, but it is shared with every other flavor and the
+            // transaction may still be rolled back.
+            const Addon *old = found ? found->value : NULL;
+            if (old != NULL && old->version != NULL && addon->version != NULL && strcmp(old->version, addon->version) != 0) {
+                cmd_retire_archive(ctx, found->value);
+            }
+
+            cmd_print_status_flavor(stream, done_msg, addon->name, flavor, nflavors);
+            cmd_state_replace(flavor->state, addon);
+            job->swapped |= 1u << f;
+        }
+
+        // Kept in the download cache so that 'repair' does not have to download
+        // it again.
+        addon_keep_archive(job->addon);
+        addon_cleanup_files(job->addon);
+    }
+
+    for (size_t f = 0; f < nflavors; f++) {
+        transaction_free(txns[f]);
+    }
+
+    return err;
+}
+
+/**
+ * Returns true if none of the directories of a changed since the last time
+ * that they were checked, according to the watch of ctx.
+ */
+static bool cmd_addon_unchanged(const Context *ctx, const Addon *a)
+{
+    if (ctx->watch == NULL || a->dirs == NULL || a->dirs->head == NULL) {
+        return false;
+    }
+
+    ListNode *dir = NULL;
+    list_foreach(dir, a->dirs)
+    {
+        if (!watch_is_clean(ctx->watch, dir->value)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Checks the installed files of the addons named in argv, or of every
+ * installed addon if there are none, against the manifest of the flavor. The
+ * files are checked on the pool of ctx. Files that do not match are printed and
+ * extracted again from the archive if repair is true.
+ *
+ * Addons that the watch of ctx saw no changes in since they were last found to
+ * match are not checked again.
+ *
+ * Returns 0 if every file matches or was repaired, otherwise -1.
+ */
+static int cmd_check(Context *ctx, int argc, const char *argv[], FILE *stream, bool repair)
+{
+    int err = manifest_load(ctx->state, ctx->manifest_path);
+    if (err != MANIFEST_OK && err != MANIFEST_ENOENT) {
+        PRINT_ERROR3(CMD_EMANIFEST_STR, argv[0], ctx->manifest_path);
+        return -1;
+    }
+
+    int result = 0;
+
+    Addon **addons = NULL;
+    bool *unchanged = NULL;
+    size_t naddons = 0;
+    const ManifestFile **files = NULL;
+    int *results = NULL;
+    CmdCheckJob *jobs = NULL;
+
+    size_t ninstalled = 0;
+    ListNode *node = NULL;
+    list_foreach(node, ctx->state->installed)
+    {
+        ninstalled++;
+    }
+
+    addons = calloc(argc > 1 ? (size_t)argc : ninstalled + 1, sizeof(*addons));
+    if (addons == NULL) {
+        PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+        return -1;
+    }
+
+    if (argc == 1) {
+        list_sort(ctx->state->installed, cmp_addon);
+
+        node = NULL;
+        list_foreach(node, ctx->state->installed)
+        {
+            addons[naddons++] = node->value;
+        }
+    }
+
+    for (int i = 1; i < argc; i++) {
+        node = list_search(ctx->state->installed, argv[i], (ListCompareFn)cmp_str_to_addon);
+        if (node == NULL) {
+            PRINT_WARNING3(CMD_ENOT_FOUND_STR, argv[0], argv[i]);
+            continue;
+        }
+
+        addons[naddons++] = node->value;
+    }
+
+    unchanged = calloc(naddons + 1, sizeof(*unchanged));
+    if (unchanged == NULL) {
+        PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+        result = -1;
+        goto cleanup;
+    }
+
+    if (ctx->watch != NULL) {
+        watch_poll(ctx->watch);
+    }
+
+    size_t nfiles = 0;
+    size_t nunchanged = 0;
+    for (size_t i = 0; i < naddons; i++) {
+        if (addons[i]->files == NULL) {
+            continue;
+        }
+
+        unchanged[i] = cmd_addon_unchanged(ctx, addons[i]);
+
+        ListNode *file = NULL;
+        list_foreach(file, addons[i]->files)
+        {
+            if (unchanged[i]) {
+                nunchanged++;
+            } else {
+                nfiles++;
+            }
+        }
+    }
+
+    files = calloc(nfiles + 1, sizeof(*files));
+    results = calloc(nfiles + 1, sizeof(*results));
+    jobs = calloc(nfiles / CMD_CHECK_FILES + 1, sizeof(*jobs));
+    if (files == NULL || results == NULL || jobs == NULL) {
+        PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+        result = -1;
+        goto cleanup;
+    }
+
+    size_t nfile = 0;
+    for (size_t i = 0; i < naddons; i++) {
+        if (addons[i]->files == NULL || unchanged[i]) {
+            continue;
+        }
+
+        ListNode *file = NULL;
+        list_foreach(file, addons[i]->files)
+        {
+            files[nfile++] = file->value;
+        }
+    }
+
+    size_t njobs = 0;
+    for (size_t i = 0; i < nfiles; i += CMD_CHECK_FILES) {
+        CmdCheckJob *job = &jobs[njobs++];
+
+        job->root = ctx->config->addons_path;
+        job->files = &files[i];
+        job->results = &results[i];
+        job->n = nfiles - i < CMD_CHECK_FILES ? nfiles - i : CMD_CHECK_FILES;
+        job->task = threadpool_submit(ctx->pool, cmd_job_check, NULL, job);
+    }
+
+    for (size_t i = 0; i < njobs; i++) {
+        if (cmd_job_wait(&jobs[i].task, argv[0]) != 0) {
+            result = -1;
+        }
+    }
+
+    if (result != 0) {
+        goto cleanup;
+    }
+
+    size_t nbad = 0;
+    nfile = 0;
+    for (size_t i = 0; i < naddons; i++) {
+        Addon *addon = addons[i];
+
+        if (addon->files == NULL) {
+            PRINT_WARNING("%s: no manifest for '%s', install it again to check it\n", argv[0], addon->name);
+            continue;
+        }
+
+        if (unchanged[i]) {
+            PRINT_STATUS_ADDON(stream, "Verified", addon->name);
+            continue;
+        }
+
+        List *bad = list_create();
+        if (bad == NULL) {
+            PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+            result = -1;
+            goto cleanup;
+        }
+
+        ListNode *file = NULL;
+        list_foreach(file, addon->files)
+        {
+            const ManifestFile *f = file->value;
+            int check_err = results[nfile++];
+            if (check_err == MANIFEST_OK) {
+                continue;
+            }
+
+            char path[OS_MAX_PATH];
+            snmanifest_path(path, ARRAY_SIZE(path), ctx->config->addons_path, f->path);
+            fprintf(stream, "%s: %s\n", check_err == MANIFEST_ENOENT ? "Missing" : "Changed", path);
+
+            list_insert(bad, (void *)(uintptr_t)f);
+        }
+
+        if (bad->head == NULL) {
+            PRINT_STATUS_ADDON(stream, "Verified", addon->name);
+
+            // A repaired addon is not marked, the repair itself changed it.
+            if (ctx->watch != NULL && addon->dirs != NULL) {
+                ListNode *dir = NULL;
+                list_foreach(dir, addon->dirs)
+                {
+                    watch_mark_clean(ctx->watch, dir->value);
+                }
+            }
+        } else if (repair) {
+            PRINT_STATUS_ADDON(stream, "Repairing", addon->name);
+            int repair_err = addon_repair(addon, ctx->config->addons_path, bad);
+            if (repair_err == ADDON_OK) {
+                PRINT_STATUS_ADDON(stream, "Repaired", addon->name);
+            } else if (repair_err == ADDON_EHASH) {
+                PRINT_ERROR3(CMD_EREPAIR_MISMATCH_STR, argv[0], addon->name);
+                result = -1;
+            } else {
+                PRINT_ERROR3(CMD_EREPAIR_STR, argv[0], addon->name);
+                result = -1;
+            }
+        } else {
+            PRINT_STATUS_ADDON(stream, "Modified", addon->name);
+            result = -1;
+        }
+
+        ListNode *n = NULL;
+        list_foreach(n, bad)
+        {
+            nbad++;
+        }
+
+        list_free(bad);
+    }
+
+    if (nunchanged > 0) {
+        fprintf(stream, "Checked %zu files, %zu do not match, %zu unchanged since the last check\n", nfiles, nbad, nunchanged);
+    } else {
+        fprintf(stream, "Checked %zu files, %zu do not match\n", nfiles, nbad);
+    }
+
+cleanup:
+    free(jobs);
+    free(results);
+    free(files);
+    free(unchanged);
+    free(addons);
+
+    return result;
+}
+
+/**
+ * Most catalog entries that are compared against the GitHub repository that
+ * an addon directory links to.
+ */
+#define CMD_ADOPT_CANDIDATES 8
+
+/**
+ * Version of an adopted addon whose .toc file does not have one. Never the
+ * latest version, so upgrade replaces it.
+ */
+#define CMD_ADOPT_UNKNOWN_VERSION "unknown"
+
+static int cmp_str(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+static int cmp_adopt_job(const void *a, const void *b)
+{
+    const CmdAdoptJob *aa = a;
+    const CmdAdoptJob *bb = b;
+
+    return strcmp(aa->dirname, bb->dirname);
+}
+
+/**
+ * Returns true if the catalog entry called name installs the GitHub
+ * repository repo.
+ */
+static bool cmd_catalog_is_repo(const char *name, const GitHubRepo *repo)
+{
+    Addon *a = addon_create();
+    if (a == NULL) {
+        return false;
+    }
+
+    GitHubRepo catalog_repo;
+    bool result = addon_fetch_catalog_meta(a, name) == ADDON_OK && github_repo_from_url(&catalog_repo, a->url) == 0
+        && strcasecmp(catalog_repo.owner, repo->owner) == 0 && strcasecmp(catalog_repo.name, repo->name) == 0;
+
+    addon_free(a);
+
+    return result;
+}
+
+/**
+ * Returns the catalog entry named close to name that installs the GitHub
+ * repository repo, which belongs to idx, or NULL if there is none.
+ */
+static const char *cmd_adopt_match_repo(const SearchIndex *idx, const char *name, const GitHubRepo *repo)
+{
+    SearchSuggestion found[CMD_ADOPT_CANDIDATES];
+    size_t nfound = search_suggest(idx, name, found, ARRAY_SIZE(found));
+    for (size_t i = 0; i < nfound; i++) {
+        if (cmd_catalog_is_repo(found[i].name, repo)) {
+            return found[i].name;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Finds the catalog entry of the directory of job by itself, the entry with the
+ * same name or else the entry of the GitHub repository that its .toc file
+ * links to.
+ *
+ * Returns the catalog name, which belongs to idx, or NULL if there is none.
+ */
+static const char *cmd_adopt_match(const SearchIndex *idx, const CmdAdoptJob *job)
+{
+    SearchSuggestion same;
+    if (search_suggest(idx, job->dirname, &same, 1) == 1 && same.typos == 0) {
+        return same.name;
+    }
+
+    if (job->toc == NULL) {
+        return NULL;
+    }
+
+    // Addons link to their repository in fields of their own choosing.
+    GitHubRepo repo;
+    bool has_repo = false;
+    ListNode *node = NULL;
+    list_foreach(node, job->toc->fields)
+    {
+        const TocField *field = node->value;
+        if (github_repo_from_web_url(&repo, field->value) == 0) {
+            has_repo = true;
+            break;
+        }
+    }
+
+    if (!has_repo) {
+        return NULL;
+    }
+
+    // The entry is named close to the directory, to the repository or to a
+    // word of the repository name, such as 'Plater' for 'Plater-Nameplates'.
+    const char *match = cmd_adopt_match_repo(idx, job->dirname, &repo);
+    if (match == NULL) {
+        match = cmd_adopt_match_repo(idx, repo.name, &repo);
+    }
+
+    for (const char *p = repo.name; match == NULL && *p != '\0';) {
+        size_t len = strcspn(p, "-_.");
+        if (len > 0) {
+            char word[ARRAY_SIZE(repo.name)];
+            memcpy(word, p, len);
+            word[len] = '\0';
+            match = cmd_adopt_match_repo(idx, word, &repo);
+        }
+
+        p += p[len] != '\0' ? len + 1 : len;
+    }
+
+    return match;
+}
+
+/**
+ * Finds the directory that the directory of job was most likely packaged with,
+ * one that was matched by itself, whose name the name of job starts with and
+ * whose .toc file has the same version.
+ *
+ * Returns the job of that directory, or NULL if there is none.
+ */
+static const CmdAdoptJob *cmd_adopt_family(const CmdAdoptJob *jobs, size_t njobs, const CmdAdoptJob *job)
+{
+    if (job->toc == NULL || job->toc->version == NULL) {
+        return NULL;
+    }
+
+    const CmdAdoptJob *best = NULL;
+    size_t best_len = 0;
+    for (size_t i = 0; i < njobs; i++) {
+        const CmdAdoptJob *other = &jobs[i];
+        if (!other->primary || other->toc == NULL || other->toc->version == NULL || strcmp(other->toc->version, job->toc->version) != 0) {
+            continue;
+        }
+
+        size_t len = strlen(other->dirname);
+        if (len > best_len && strncmp(job->dirname, other->dirname, len) == 0 && job->dirname[len] != '\0') {
+            best = other;
+            best_len = len;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * Creates the installed addon match from the directories of jobs that were
+ * matched to it, taking their files. The version is the one in the .toc file of
+ * the directory named like the addon, or else of the first one with a version.
+ *
+ * Returns the addon, or NULL if memory could not be allocated or the catalog
+ * could not be read.
+ */
+static Addon *cmd_adopt_addon(CmdAdoptJob *jobs, size_t njobs, const char *match)
+{
+    Addon *a = addon_create();
+    if (a == NULL || addon_fetch_catalog_meta(a, match) != ADDON_OK) {
+        goto error;
+    }
+
+    a->files = list_create();
+    if (a->files == NULL) {
+        goto error;
+    }
+    list_set_free_fn(a->files, (ListFreeFn)manifest_file_free);
+
+    const char *version = NULL;
+    for (size_t i = 0; i < njobs; i++) {
+        CmdAdoptJob *job = &jobs[i];
+        if (job->match == NULL || strcmp(job->match, match) != 0) {
+            continue;
+        }
+
+        char *dirname = strdup(job->dirname);
+        if (dirname == NULL || list_insert(a->dirs, dirname) == NULL) {
+            free(dirname);
+            goto error;
+        }
+
+        ListNode *node = NULL;
+        while ((node = job->files->head) != NULL) {
+            if (list_insert(a->files, node->value) == NULL) {
+                goto error;
+            }
+
+            node->value = NULL;
+            list_remove(job->files, node);
+        }
+
+        const char *toc_version = job->toc != NULL ? job->toc->version : NULL;
+        if (toc_version != NULL && (version == NULL || strcasecmp(job->dirname, match) == 0)) {
+            version = toc_version;
+        }
+    }
+
+    a->version = strdup(version != NULL ? version : CMD_ADOPT_UNKNOWN_VERSION);
+    if (a->version == NULL) {
+        goto error;
+    }
+
+    return a;
+
+error:
+    addon_free(a);
+
+    return NULL;
+}
+
+int cmd_adopt(Context *ctx, int argc, const char *argv[], FILE *stream)
+{
+    if (argc != 1) {
+        PRINT_ERROR1(CMD_EINVALID_ARGS_STR);
+        return -1;
+    }
+
+    const char *root = ctx->config->addons_path;
+
+    int err = 0;
+    CmdAdoptJob *jobs = NULL;
+    size_t njobs = 0;
+    size_t cap = 0;
+    SearchIndex *opened = NULL;
+    SearchIndex *idx = ctx->search_index;
+
+    OsDir *dir = os_opendir(root);
+    if (dir == NULL) {
+        PRINT_ERROR3(CMD_EREAD_DIR_STR, argv[0], root);
+        return -1;
+    }
+
+    // Every directory that no installed addon has, read on the pool.
+    OsDirEnt *entry = NULL;
+    while ((entry = os_readdir(dir)) != NULL) {
+        if (entry->name[0] == '.') {
+            continue;
+        }
+
+        char path[OS_MAX_PATH];
+        int n = snprintf(path, ARRAY_SIZE(path), "%s%c%s", root, OS_SEPARATOR, entry->name);
+        struct os_stat s;
+        if (n < 0 || (size_t)n >= ARRAY_SIZE(path) || os_stat(path, &s) != 0 || !S_ISDIR(s.st_mode)) {
+            continue;
+        }
+
+        bool owned = false;
+        ListNode *node = NULL;
+        list_foreach(node, ctx->state->installed)
+        {
+            const Addon *a = node->value;
+            owned = owned || (a->dirs != NULL && list_search(a->dirs, entry->name, cmp_str) != NULL);
+        }
+
+        if (owned) {
+            continue;
+        }
+
+        if (njobs == cap) {
+            size_t new_cap = cap == 0 ? 64 : cap * 2;
+            CmdAdoptJob *new_jobs = realloc(jobs, new_cap * sizeof(*jobs));
+            if (new_jobs == NULL) {
+                PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+                err = -1;
+                break;
+            }
+            jobs = new_jobs;
+            cap = new_cap;
+        }
+
+        CmdAdoptJob *job = &jobs[njobs];
+        memset(job, 0, sizeof(*job));
+        job->root = root;
+        job->dirname = strdup(entry->name);
+        if (job->dirname == NULL) {
+            PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+            err = -1;
+            break;
+        }
+        njobs++;
+    }
+
+    os_closedir(dir);
+
+    if (err != 0) {
+        goto cleanup;
+    }
+
+    if (njobs > 1) {
+        qsort(jobs, njobs, sizeof(*jobs), cmp_adopt_job);
+    }
+
+    for (size_t i = 0; i < njobs; i++) {
+        jobs[i].task = threadpool_submit(ctx->pool, cmd_job_adopt, NULL, &jobs[i]);
+    }
+
+    for (size_t i = 0; i < njobs; i++) {
+        if (cmd_job_wait(&jobs[i].task, argv[0]) != 0) {
+            err = -1;
+        }
+    }
+
+    if (err != 0) {
+        goto cleanup;
+    }
+
+    // Adopting only some of the files of an addon would make verify and
+    // upgrade work with the wrong files, so nothing is adopted then.
+    for (size_t i = 0; i < njobs; i++) {
+        if (jobs[i].scan_err != MANIFEST_OK || (jobs[i].toc_err != TOC_OK && jobs[i].toc_err != TOC_ENOENT)) {
+            PRINT_ERROR3_FMT(CMD_EREAD_DIR_STR, argv[0], "%s%c%s", root, OS_SEPARATOR, jobs[i].dirname);
+            err = -1;
+        }
+    }
+
+    if (err != 0) {
+        goto cleanup;
+    }
+
+    if (idx == NULL && search_index_open(&opened, ctx->search_index_path, WOWPKG_CATALOG_PATH) != SEARCH_OK) {
+        PRINT_ERROR1(CMD_ECATALOG_STR);
+        err = -1;
+        goto cleanup;
+    } else if (idx == NULL) {
+        idx = opened;
+    }
+
+    for (size_t i = 0; i < njobs; i++) {
+        jobs[i].match = cmd_adopt_match(idx, &jobs[i]);
+        jobs[i].primary = jobs[i].match != NULL;
+    }
+
+    for (size_t i = 0; i < njobs; i++) {
+        const CmdAdoptJob *family = jobs[i].match == NULL ? cmd_adopt_family(jobs, njobs, &jobs[i]) : NULL;
+        if (family != NULL) {
+            jobs[i].match = family->match;
+        }
+    }
+
+    size_t nadopted = 0;
+    size_t nunknown = 0;
+    for (size_t i = 0; i < njobs; i++) {
+        CmdAdoptJob *job = &jobs[i];
+
+        if (job->match == NULL) {
+            const char *title = job->toc != NULL ? job->toc->title : NULL;
+            fprintf(stream, "Not in catalog: %s%s%s%s\n", job->dirname, title != NULL ? " (" : "", title != NULL ? title : "", title != NULL ? ")" : "");
+            nunknown++;
+            continue;
+        }
+
+        // Only the first directory of each addon adopts it.
+        bool seen = false;
+        for (size_t j = 0; j < i && !seen; j++) {
+            seen = jobs[j].match != NULL && strcmp(jobs[j].match, job->match) == 0;
+        }
+
+        if (seen) {
+            continue;
+        } else if (cmd_is_installed(ctx, job->match)) {
+            PRINT_WARNING("%s: skipping '%s', '%s' is already installed\n", argv[0], job->dirname, job->match);
+            continue;
+        }
+
+        Addon *addon = cmd_adopt_addon(jobs, njobs, job->match);
+        if (addon == NULL || list_insert(ctx->state->installed, addon) == NULL) {
+            PRINT_ERROR3(CMD_EMETADATA_STR, argv[0], job->match);
+            addon_free(addon);
+            err = -1;
+            goto cleanup;
+        }
+
+        PRINT_STATUS(stream, TERM_WRAP(TERM_BOLD, "Adopted") " " TERM_WRAP(TERM_BOLD_BLUE, "%s") " (%s)\n", addon->name, addon->version);
+        nadopted++;
+    }
+
+    fprintf(stream, "Adopted %zu addons, %zu directories are not in the catalog\n", nadopted, nunknown);
+
+cleanup:
+    for (size_t i = 0; i < njobs; i++) {
+        free(jobs[i].dirname);
+        toc_free(jobs[i].toc);
+        list_free(jobs[i].files);
+    }
+
+    free(jobs);
+    search_index_free(opened);
+
+    return err;
+}
+
+int cmd_dedupe(Context *ctx, int argc, const char *argv[], FILE *stream)
+{
+    if (argc != 1) {
+        PRINT_ERROR1(CMD_EINVALID_ARGS_STR);
+        return -1;
+    }
+
+    if (ctx->store_path == NULL) {
+        PRINT_ERROR2(CMD_ESTORE_DISABLED_STR, argv[0]);
+        return -1;
+    }
+
+    int err = 0;
+
+    list_sort(ctx->state->installed, cmp_addon);
+
+    ListNode *node = NULL;
+    list_foreach(node, ctx->state->installed)
+    {
+        Addon *addon = node->value;
+        PRINT_STATUS_ADDON(stream, "Deduplicating", addon->name);
+
+        ListNode *dir = NULL;
+        list_foreach(dir, addon->dirs)
+        {
+            char path[OS_MAX_PATH];
+            int n = snprintf(path, ARRAY_SIZE(path), "%s%c%s", ctx->config->addons_path, OS_SEPARATOR, (char *)dir->value);
+            if (n < 0 || (size_t)n >= ARRAY_SIZE(path)) {
+                PRINT_ERROR3(CMD_ENAMETOOLONG_STR, argv[0], (char *)dir->value);
+                err = -1;
+                continue;
+            }
+
+            if (store_dedupe(ctx->store_path, path) != STORE_OK) {
+                PRINT_ERROR3(CMD_ESTORE_STR, argv[0], path);
+                err = -1;
+            }
+        }
+    }
+
+    return err;
+}
+
+int cmd_help(Context *ctx, int argc, const char *argv[], FILE *stream)
+{
+    UNUSED(ctx);
+    UNUSED(argc);
+    UNUSED(argv);
+
+    fprintf(stream, "Example usage:\n");
+    fprintf(stream, "\t" WOWPKG_NAME " adopt\n");
+    fprintf(stream, "\t" WOWPKG_NAME " batch FILE|-\n");
+    fprintf(stream, "\t" WOWPKG_NAME " daemon\n");
+    fprintf(stream, "\t" WOWPKG_NAME " dedupe\n");
+    fprintf(stream, "\t" WOWPKG_NAME " info ADDON...\n");
+    fprintf(stream, "\t" WOWPKG_NAME " install ADDON...\n");
+    fprintf(stream, "\t" WOWPKG_NAME " list\n");
+    fprintf(stream, "\t" WOWPKG_NAME " lock FILE\n");
+    fprintf(stream, "\t" WOWPKG_NAME " outdated\n");
+    fprintf(stream, "\t" WOWPKG_NAME " prefetch\n");
+    fprintf(stream, "\t" WOWPKG_NAME " remove ADDON...\n");
+    fprintf(stream, "\t" WOWPKG_NAME " repair [ADDON...]\n");
+    fprintf(stream, "\t" WOWPKG_NAME " search TEXT...\n");
+    fprintf(stream, "\t" WOWPKG_NAME " stats\n");
+    fprintf(stream, "\t" WOWPKG_NAME " sync FILE\n");
+    fprintf(stream, "\t" WOWPKG_NAME " update [--prefetch] [ADDON...]\n");
+    fprintf(stream, "\t" WOWPKG_NAME " upgrade [ADDON...]\n");
+    fprintf(stream, "\t" WOWPKG_NAME " verify [ADDON...]\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Options:\n");
+    fprintf(stream, "\t--fix-typos     use the closest catalog name when an addon is not found by install, info and update\n");
+    fprintf(stream, "\t--flavor NAME   only work on the game flavor with this section name in config.ini, may be repeated\n");
+    fprintf(stream, "\t--jobs N        run at most N downloads and extractions at the same time\n");
+    fprintf(stream, "\t--json          print the results of list, outdated, info, install and upgrade as one JSON object per line\n");
+    fprintf(stream, "\t--no-daemon     run the command in this process even if a daemon is running\n");
+    fprintf(stream, "\t--stats         print the time spent in each phase and the bytes transferred\n");
+    fprintf(stream, "\t--trace FILE    write a Chrome trace event file with a span per addon and phase\n");
+
+    return 0;
+}
+
+/**
+ * Returns the job in jobs for the addon called name, or NULL if there is none.
+ */
+static CmdJob *cmd_job_find(CmdJob *jobs, size_t n, const char *name)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (strcasecmp(jobs[i].name, name) == 0) {
+            return &jobs[i];
+        }
+    }
+
+    return NULL;
+}
 
 /**
- * Searches haystack to see if needle appears in the string, ignoring case.
+ * Adds a job for every addon in the catalog that the addons of jobs depend on
+ * and that is not installed in all flavors yet, then for the ones that those
+ * depend on and so on. A dependency only goes into the flavors that do not
+ * have it. Names that are not in the catalog are left to the fetch to report.
  *
- * Returns the beginning of the first occurrence of needle in haystack. Returns
- * NULL if needle was not found.
+ * Returns 0 on success, otherwise prints an error and returns -1.
+ */
+static int cmd_install_add_deps(Context *ctx, CmdJob **jobs, size_t *njobs, size_t *cap, const char *proc_name, FILE *stream)
+{
+    ContextFlavor single;
+    size_t nflavors = 0;
+    ContextFlavor *flavors = cmd_flavors(ctx, &single, &nflavors);
+
+    int err = 0;
+    Addon *meta = NULL;
+
+    // Jobs that are added are looked at as well since they come after.
+    for (size_t i = 0; i < *njobs && err == 0; i++) {
+        addon_free(meta);
+        meta = addon_create();
+        if (meta == NULL) {
+            PRINT_ERROR2(CMD_ENO_MEM_STR, proc_name);
+            err = -1;
+            break;
+        }
+
+        if (addon_fetch_catalog_meta(meta, (*jobs)[i].name) != ADDON_OK || meta->deps == NULL) {
+            continue;
+        }
+
+        ListNode *node = NULL;
+        list_foreach(node, meta->deps)
+        {
+            const char *dep = node->value;
+            if (cmd_job_find(*jobs, *njobs, dep) != NULL) {
+                continue;
+            }
+
+            unsigned missing = 0;
+            for (size_t f = 0; f < nflavors; f++) {
+                if (list_search(flavors[f].state->installed, dep, cmp_str_to_addon) == NULL) {
+                    missing |= 1u << f;
+                }
+            }
+
+            if (missing == 0) {
+                continue;
+            }
+
+            if (*njobs == *cap) {
+                CmdJob *grown = realloc(*jobs, *cap * 2 * sizeof(**jobs));
+                if (grown == NULL) {
+                    PRINT_ERROR2(CMD_ENO_MEM_STR, proc_name);
+                    err = -1;
+                    break;
+                }
+                *jobs = grown;
+                *cap *= 2;
+            }
+
+            CmdJob *job = &(*jobs)[*njobs];
+            memset(job, 0, sizeof(*job));
+            job->dep_name = strdup(dep);
+            if (job->dep_name == NULL) {
+                PRINT_ERROR2(CMD_ENO_MEM_STR, proc_name);
+                err = -1;
+                break;
+            }
+
+            job->name = job->dep_name;
+            job->needed_by = (*jobs)[i].name;
+            job->flavors = missing;
+            (*njobs)++;
+
+            PRINT_STATUS(stream, TERM_WRAP(TERM_BOLD, "Adding dependency") " " TERM_WRAP(TERM_BOLD_BLUE, "%s") " (needed by %s)\n", dep, job->needed_by);
+        }
+    }
+
+    addon_free(meta);
+
+    return err;
+}
+
+/**
+ * Moves the jobs in jobs[0..*n) that depend on one of the jobs in jobs[*n..total),
+ * which failed, to the end of jobs[0..*n) and decrements *n for each, until
+ * none of them depends on one that failed.
+ */
+static void cmd_jobs_drop_failed_deps(CmdJob *jobs, size_t *n, size_t total, const char *proc_name)
+{
+    for (size_t i = 0; i < *n;) {
+        const CmdJob *failed = cmd_job_find_dep(&jobs[i], &jobs[*n], total - *n);
+        if (failed == NULL) {
+            i++;
+            continue;
+        }
+
+        PRINT_ERROR("%s: skipping %s, it needs %s which failed\n", proc_name, jobs[i].addon->name, failed->name);
+        jobs[i].status = "skipped";
+        jobs[i].error = CMD_EDEPENDENCY_STR;
+
+        (*n)--;
+        CmdJob tmp = jobs[i];
+        jobs[i] = jobs[*n];
+        jobs[*n] = tmp;
+
+        // The ones before may depend on the one that was dropped.
+        i = 0;
+    }
+}
+
+/**
+ * Numbers the waves of jobs, every addon is in a later wave than the addons in
+ * jobs that it depends on, and sorts jobs by wave while keeping their order
+ * within a wave. Addons that depend on each other in a cycle all go into the
+ * last wave.
  */
-static const char *cmd_strcasestr(const char *haystack, const char *needle)
+static void cmd_jobs_sort_waves(CmdJob *jobs, size_t n, const char *proc_name)
+{
+    for (size_t i = 0; i < n; i++) {
+        jobs[i].wave = SIZE_MAX;
+    }
+
+    size_t nwaves = 0;
+    for (size_t assigned = 0; assigned < n; nwaves++) {
+        size_t before = assigned;
+
+        // A job is ready once each of its dependencies is in an earlier wave.
+        for (size_t i = 0; i < n; i++) {
+            bool ready = jobs[i].wave == SIZE_MAX;
+            for (size_t j = 0; j < n && ready; j++) {
+                ready = !cmd_job_needs(&jobs[i], &jobs[j]) || jobs[j].wave < nwaves;
+            }
+
+            if (ready) {
+                jobs[i].wave = nwaves;
+                assigned++;
+            }
+        }
+
+        if (assigned == before) {
+            PRINT_WARNING("%s: addons depend on each other in a cycle:", proc_name);
+            for (size_t i = 0; i < n; i++) {
+                if (jobs[i].wave == SIZE_MAX) {
+                    fprintf(stderr, " %s", jobs[i].addon->name);
+                    jobs[i].wave = nwaves;
+                }
+            }
+            fprintf(stderr, "\n");
+            assigned = n;
+        }
+    }
+
+    // Insertion sort since it is stable and there are few jobs.
+    for (size_t i = 1; i < n; i++) {
+        CmdJob tmp = jobs[i];
+        size_t j = i;
+        for (; j > 0 && jobs[j - 1].wave > tmp.wave; j--) {
+            jobs[j] = jobs[j - 1];
+        }
+        jobs[j] = tmp;
+    }
+}
+
+int cmd_info(Context *ctx, int argc, const char *argv[], FILE *stream)
+{
+    if (argc < 2) {
+        PRINT_ERROR1(CMD_EINVALID_ARGS_STR);
+        return -1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        int err = 0;
+        Addon *addon = NULL;
+        const char *error = NULL;
+
+        addon = addon_create();
+        if (addon == NULL) {
+            PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+            err = -1;
+            goto cleanup;
+        }
+
+        err = addon_fetch_catalog_meta(addon, argv[i]);
+        if (err == ADDON_ENOTFOUND) {
+            char *fixed = cmd_not_found(ctx, argv[0], argv[i], NULL);
+            if (fixed == NULL) {
+                error = CMD_ENOT_FOUND_STR;
+                err = -1;
+                goto cleanup;
+            }
+
+            err = addon_fetch_catalog_meta(addon, fixed);
+            free(fixed);
+        }
+
+        if (err != ADDON_OK) {
+            PRINT_ERROR3(CMD_EMETADATA_STR, argv[0], argv[i]);
+            error = CMD_EMETADATA_STR;
+            err = -1;
+            goto cleanup;
+        }
+
+        ListNode *installed_node = list_search(ctx->state->installed, addon, cmp_addon);
+
+        if (ctx->json) {
+            const Addon *installed = installed_node != NULL ? installed_node->value : NULL;
+            cJSON *object = cJSON_CreateObject();
+            bool ok = object != NULL && cmd_json_add_str(object, "name", addon->name) && cmd_json_add_str(object, "desc", addon->desc)
+                && cmd_json_add_str(object, "url", addon->url) && cmd_json_add_list(object, "deps", addon->deps)
+                && cJSON_AddBoolToObject(object, "installed", installed != NULL) != NULL
+                && cmd_json_add_str(object, "version", installed != NULL ? installed->version : NULL)
+                && cmd_json_add_str(object, "zip", installed != NULL ? installed->url : NULL);
+            cmd_print_json(stream, object, ok, argv[0]);
+            goto cleanup;
+        }
+
+        int width = 16;
+        // \b removes an extra space.
+        PRINT_STATUS_ADDON(stream, "\b", addon->name);
+        fprintf(stream, TERM_WRAP(TERM_BOLD, "%-*s") " %s\n", width, "Description:", addon->desc);
+        fprintf(stream, TERM_WRAP(TERM_BOLD, "%-*s") " %s\n", width, "From:", addon->url);
+
+        if (addon->deps != NULL && !list_isempty(addon->deps)) {
+            fprintf(stream, TERM_WRAP(TERM_BOLD, "%-*s"), width, "Depends on:");
+            ListNode *dep = NULL;
+            list_foreach(dep, addon->deps)
+            {
+                fprintf(stream, "%s %s", dep == addon->deps->head ? "" : ",", (const char *)dep->value);
+            }
+            fprintf(stream, "\n");
+        }
+
+        fprintf(stream, TERM_WRAP(TERM_BOLD, "%-*s") " %s\n", width, "Installed:", installed_node ? "Yes" : "No");
+
+        if (installed_node) {
+            Addon *installed = installed_node->value;
+            fprintf(stream, TERM_WRAP(TERM_BOLD, "%-*s") " %s\n", width, "Version:", installed->version);
+            fprintf(stream, TERM_WRAP(TERM_BOLD, "%-*s") " %s\n", width, "ZIP:", installed->url);
+        }
+
+    cleanup:
+        // Names that were not found get an object as well, so that each name
+        // has one.
+        if (ctx->json && error != NULL) {
+            cJSON *object = cJSON_CreateObject();
+            bool ok = object != NULL && cmd_json_add_str(object, "name", argv[i]) && cmd_json_add_str(object, "error", error);
+            cmd_print_json(stream, object, ok, argv[0]);
+        }
+
+        addon_free(addon);
+    }
+
+    return 0;
+}
+
+int cmd_install(Context *ctx, int argc, const char *argv[], FILE *stream)
+{
+    if (argc < 2) {
+        PRINT_ERROR1(CMD_EINVALID_ARGS_STR);
+        return -1;
+    }
+
+    int err = 0;
+    size_t njobs = 0;
+    size_t ninstall = 0;
+
+    // With --json only the results go to stream.
+    FILE *status = ctx->json ? NULL : stream;
+
+    // Every addon goes into every flavor.
+    ContextFlavor single;
+    size_t nflavors = 0;
+    ContextFlavor *flavors = cmd_flavors(ctx, &single, &nflavors);
+
+    net_init();
+
+    size_t cap = (size_t)argc - 1;
+    CmdJob *jobs = calloc(cap, sizeof(*jobs));
+    if (jobs == NULL) {
+        PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+        err = -1;
+        goto cleanup;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        // An addon that was asked for twice is installed once.
+        if (cmd_job_find(jobs, njobs, argv[i]) != NULL) {
+            continue;
+        }
+
+        jobs[njobs].name = argv[i];
+        jobs[njobs].flavors = (1u << nflavors) - 1;
+        njobs++;
+    }
+
+    if (cmd_install_add_deps(ctx, &jobs, &njobs, &cap, argv[0], status) != 0) {
+        err = -1;
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < njobs; i++) {
+        jobs[i].addon = addon_create();
+        if (jobs[i].addon == NULL) {
+            PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+            err = -1;
+            goto cleanup;
+        }
+    }
+
+    // Every addon, dependencies included, is fetched and downloaded on the
+    // pool at once, the results are reported in the order the addons were
+    // asked for in.
+    for (size_t i = 0; i < njobs; i++) {
+        jobs[i].task = threadpool_submit(ctx->pool, cmd_job_fetch, NULL, &jobs[i]);
+    }
+
+    // An addon that fails is reported and skipped, the others are still
+    // installed so that only the failures need to be retried.
+    for (size_t i = 0; i < njobs; i++) {
+        CmdJob *job = &jobs[i];
+
+        if (cmd_job_wait(&job->task, argv[0]) != 0) {
+            job->error = CMD_EINTERRUPTED_STR;
+            err = -1;
+            continue;
+        }
+
+        PRINT_STATUS_ADDON(status, "Fetching", job->name);
+
+        if (job->meta_err == ADDON_ENOTFOUND) {
+            job->fixed_name = cmd_not_found(ctx, argv[0], job->name, NULL);
+            if (job->fixed_name == NULL) {
+                job->status = "not_found";
+                job->error = CMD_ENOT_FOUND_STR;
+                continue;
+            }
+
+            // Fetched again right here, only names with typos wait for it.
+            job->name = job->fixed_name;
+            addon_free(job->addon);
+            job->addon = addon_create();
+            if (job->addon == NULL) {
+                PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+                job->error = CMD_ENO_MEM_STR;
+                err = -1;
+                continue;
+            }
+
+            cmd_job_fetch(job);
+        }
+
+        if (job->meta_err == ADDON_ENOTFOUND) {
+            PRINT_WARNING3(CMD_ENOT_FOUND_STR, argv[0], job->name);
+            job->status = "not_found";
+            job->error = CMD_ENOT_FOUND_STR;
+            continue;
+        } else if (job->meta_err == ADDON_ERATE_LIMIT) {
+            PRINT_ERROR2(CMD_ERATE_LIMIT_STR, job->name);
+            job->error = CMD_ERATE_LIMIT_STR;
+            continue;
+        } else if (job->meta_err != ADDON_OK) {
+            PRINT_ERROR3(CMD_EMETADATA_STR, argv[0], job->name);
+            job->error = CMD_EMETADATA_STR;
+            err = -1;
+            continue;
+        }
+
+        PRINT_STATUS(status, TERM_WRAP(TERM_BOLD, "Downloading") " %s\n", job->addon->url);
+        if (job->zip_err != ADDON_OK) {
+            PRINT_ERROR3(CMD_EDOWNLOAD_STR, argv[0], job->addon->name);
+            job->error = CMD_EDOWNLOAD_STR;
+            err = -1;
+            continue;
+        }
+
+        // Dependencies of an addon that was only found by fixing a typo were
+        // not added.
+        if (job->addon->deps != NULL) {
+            ListNode *dep = NULL;
+            list_foreach(dep, job->addon->deps)
+            {
+                bool installed = true;
+                for (size_t f = 0; f < nflavors && installed; f++) {
+                    installed = list_search(flavors[f].state->installed, dep->value, cmp_str_to_addon) != NULL;
+                }
+
+                if (!installed && cmd_job_find(jobs, njobs, dep->value) == NULL) {
+                    PRINT_WARNING("%s: %s needs %s, which is not installed\n", argv[0], job->addon->name, (const char *)dep->value);
+                }
+            }
+        }
+
+        // Keep the downloaded addons at the front of jobs.
+        CmdJob tmp = jobs[ninstall];
+        jobs[ninstall] = *job;
+        *job = tmp;
+        ninstall++;
+    }
+
+    // The addons that depend on one that failed are not installed either. The
+    // rest are all packaged at once and swapped in wave by wave, so that each
+    // one goes in after the addons it needs.
+    size_t nfetched = ninstall;
+    cmd_jobs_drop_failed_deps(jobs, &ninstall, njobs, argv[0]);
+    if (ninstall < nfetched) {
+        err = -1;
+    }
+
+    cmd_jobs_sort_waves(jobs, ninstall, argv[0]);
+
+    if (cmd_jobs_install(ctx, jobs, ninstall, NULL, argv[0], "Installed addon", status) != 0) {
+        err = -1;
+    }
+
+    for (size_t i = 0; i < njobs && ctx->json; i++) {
+        if (cmd_job_print_json(stream, &jobs[i], flavors, nflavors, "installed", argv[0]) != 0) {
+            err = -1;
+            break;
+        }
+    }
+
+cleanup:
+    // Addons that were installed are owned by the app state, the rest are
+    // freed here.
+    for (size_t i = 0; i < njobs; i++) {
+        addon_free(jobs[i].addon);
+        free(jobs[i].fixed_name);
+        free(jobs[i].dep_name);
+    }
+    free(jobs);
+
+    net_cleanup();
+
+    return err;
+}
+
+int cmd_list(Context *ctx, int argc, const char *argv[], FILE *stream)
 {
-    const char *result = NULL;
-    const char *haystackp = haystack;
-    const char *needlep = needle;
-    bool isstart = true;
+    if (argc != 1) {
+        PRINT_ERROR1(CMD_EINVALID_ARGS_STR);
+        return -1;
+    }
+
+    list_sort(ctx->state->installed, cmp_addon);
+
+    ListNode *node = NULL;
+    list_foreach(node, ctx->state->installed)
+    {
+        Addon *addon = node->value;
 
-    while (*haystackp) {
-        if (*needlep == '\0') {
-            break;
+        if (!ctx->json) {
+            fprintf(stream, "%s (%s)\n", addon->name, addon->version);
+            continue;
         }
 
-        if (tolower(*haystackp) == tolower(*needlep)) {
-            if (isstart) {
-                result = haystackp;
-                isstart = false;
-            }
-            needlep++;
-        } else {
-            needlep = needle;
-            isstart = true;
+        cJSON *object = cJSON_CreateObject();
+        bool ok = object != NULL && cmd_json_add_str(object, "flavor", ctx->flavor) && cmd_json_add_str(object, "name", addon->name)
+            && cmd_json_add_str(object, "version", addon->version) && cmd_json_add_list(object, "dirs", addon->dirs);
+        if (cmd_print_json(stream, object, ok, argv[0]) != 0) {
+            return -1;
         }
+    }
+
+    return 0;
+}
 
-        haystackp++;
+int cmd_lock(Context *ctx, int argc, const char *argv[], FILE *stream)
+{
+    if (argc != 2) {
+        PRINT_ERROR1(CMD_EINVALID_ARGS_STR);
+        return -1;
     }
 
-    if (*needlep != '\0') {
-        result = NULL;
+    // The same addon may be another version in another flavor.
+    if (ctx->nflavors > 1) {
+        PRINT_ERROR("%s: a lockfile is for one flavor, pick it with --flavor\n", argv[0]);
+        return -1;
     }
 
-    return result;
-}
+    size_t njobs = 0;
+    ListNode *node = NULL;
+    list_foreach(node, ctx->state->installed)
+    {
+        njobs++;
+    }
 
-static int cmp_addon(const void *a, const void *b)
-{
-    const Addon *aa = a;
-    const Addon *bb = b;
+    CmdLockJob *jobs = calloc(njobs, sizeof(*jobs));
+    Lockfile *lock = lockfile_create();
+    if ((njobs > 0 && jobs == NULL) || lock == NULL) {
+        PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+        free(jobs);
+        lockfile_free(lock);
+        return -1;
+    }
 
-    return strcmp(aa->name, bb->name);
-}
+    net_init();
 
-/**
- * Compares a string a to the Addon b's name.
- */
-static int cmp_str_to_addon(const void *str, const void *addon)
-{
-    const char *s = str;
-    const Addon *a = addon;
+    // Archives of installed addons are kept, so most are only hashed. The ones
+    // that are not are downloaded at the same time.
+    size_t i = 0;
+    node = NULL;
+    list_foreach(node, ctx->state->installed)
+    {
+        jobs[i].addon = node->value;
+        jobs[i].task = threadpool_submit(ctx->pool, cmd_job_lock, NULL, &jobs[i]);
+        i++;
+    }
 
-    return strcasecmp(s, a->name);
-}
+    int err = 0;
+    for (i = 0; i < njobs; i++) {
+        CmdLockJob *job = &jobs[i];
 
-int cmd_help(Context *ctx, int argc, const char *argv[], FILE *stream)
-{
-    UNUSED(ctx);
-    UNUSED(argc);
-    UNUSED(argv);
+        if (cmd_job_wait(&job->task, argv[0]) != 0) {
+            err = -1;
+            continue;
+        }
 
-    fprintf(stream, "Example usage:\n");
-    fprintf(stream, "\t" WOWPKG_NAME " info ADDON...\n");
-    fprintf(stream, "\t" WOWPKG_NAME " install ADDON...\n");
-    fprintf(stream, "\t" WOWPKG_NAME " list\n");
-    fprintf(stream, "\t" WOWPKG_NAME " outdated\n");
-    fprintf(stream, "\t" WOWPKG_NAME " remove ADDON...\n");
-    fprintf(stream, "\t" WOWPKG_NAME " search TEXT\n");
-    fprintf(stream, "\t" WOWPKG_NAME " update [ADDON...]\n");
-    fprintf(stream, "\t" WOWPKG_NAME " upgrade [ADDON...]\n");
+        const Addon *a = job->addon;
+        if (job->err == ADDON_ENO_ZIP_ASSET) {
+            PRINT_ERROR("%s: %s was adopted and has no archive to lock, upgrade it first\n", argv[0], a->name);
+            err = -1;
+            continue;
+        } else if (job->err != ADDON_OK) {
+            PRINT_ERROR3(CMD_EDOWNLOAD_STR, argv[0], a->name);
+            err = -1;
+            continue;
+        }
 
-    return 0;
+        int lock_err = lockfile_add(lock, a->name, a->version, a->url, job->size, job->sha256);
+        if (lock_err != LOCKFILE_OK) {
+            PRINT_ERROR2(lock_err == LOCKFILE_ENOMEM ? CMD_ENO_MEM_STR : CMD_ELOCKFILE_STR, argv[0]);
+            err = -1;
+            continue;
+        }
+
+        PRINT_STATUS(stream, TERM_WRAP(TERM_BOLD, "Locked ") TERM_WRAP(TERM_BOLD_BLUE, "%s") TERM_WRAP(TERM_BOLD, " (%s)") "\n", a->name, a->version);
+    }
+
+    // A lockfile that leaves out an addon would have sync remove it.
+    if (err == 0 && lockfile_save(lock, argv[1]) != LOCKFILE_OK) {
+        PRINT_ERROR("%s: failed to write lockfile %s\n", argv[0], argv[1]);
+        err = -1;
+    } else if (err == 0) {
+        PRINT_STATUS(stream, TERM_WRAP(TERM_BOLD, "Wrote") " %s\n", argv[1]);
+    }
+
+    lockfile_free(lock);
+    free(jobs);
+
+    net_cleanup();
+
+    return err;
 }
 
-int cmd_info(Context *ctx, int argc, const char *argv[], FILE *stream)
+int cmd_outdated(Context *ctx, int argc, const char *argv[], FILE *stream)
 {
-    if (argc < 2) {
+    if (argc != 1) {
         PRINT_ERROR1(CMD_EINVALID_ARGS_STR);
         return -1;
     }
 
-    for (int i = 1; i < argc; i++) {
-        int err = 0;
-        Addon *addon = NULL;
+    list_sort(ctx->state->installed, cmp_addon);
 
-        addon = addon_create();
-        if (addon == NULL) {
-            PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
-            err = -1;
-            goto cleanup;
+    ListNode *node = NULL;
+    list_foreach(node, ctx->state->installed)
+    {
+        Addon *installed = node->value;
+
+        ListNode *found = list_search(ctx->state->latest, installed, cmp_addon);
+        if (!found) {
+            PRINT_NO_UPDATED_META_WARNING(argv[0], installed->name);
+            continue;
         }
 
-        err = addon_fetch_catalog_meta(addon, argv[i]);
-        if (err != ADDON_OK) {
-            if (err == ADDON_ENOTFOUND) {
-                PRINT_WARNING3(CMD_ENOT_FOUND_STR, argv[0], argv[i]);
-            } else {
-                PRINT_ERROR3(CMD_EMETADATA_STR, argv[0], argv[i]);
-            }
+        Addon *latest = found->value;
 
-            err = -1;
-            goto cleanup;
+        if (strcmp(installed->version, latest->version) == 0) {
+            continue;
         }
 
-        ListNode *installed_node = list_search(ctx->state->installed, addon, cmp_addon);
+        if (!ctx->json) {
+            fprintf(stream, "%s (%s) < (%s)\n", installed->name, installed->version, latest->version);
+            continue;
+        }
 
-        int width = 16;
-        // \b removes an extra space.
-        PRINT_STATUS_ADDON(stream, "\b", addon->name);
-        fprintf(stream, TERM_WRAP(TERM_BOLD, "%-*s") " %s\n", width, "Description:", addon->desc);
-        fprintf(stream, TERM_WRAP(TERM_BOLD, "%-*s") " %s\n", width, "From:", addon->url);
-        fprintf(stream, TERM_WRAP(TERM_BOLD, "%-*s") " %s\n", width, "Installed:", installed_node ? "Yes" : "No");
+        cJSON *object = cJSON_CreateObject();
+        bool ok = object != NULL && cmd_json_add_str(object, "flavor", ctx->flavor) && cmd_json_add_str(object, "name", installed->name)
+            && cmd_json_add_str(object, "installed", installed->version) && cmd_json_add_str(object, "latest", latest->version);
+        if (cmd_print_json(stream, object, ok, argv[0]) != 0) {
+            return -1;
+        }
+    }
 
-        if (installed_node) {
-            Addon *installed = installed_node->value;
-            fprintf(stream, TERM_WRAP(TERM_BOLD, "%-*s") " %s\n", width, "Version:", installed->version);
-            fprintf(stream, TERM_WRAP(TERM_BOLD, "%-*s") " %s\n", width, "ZIP:", installed->url);
+    return 0;
+}
+
+/**
+ * Adds flavor f to the job for the version of latest in jobs, creating the job
+ * if there is none yet, so that each version is downloaded once.
+ *
+ * Returns 0 on success, otherwise -1.
+ */
+static int cmd_upgrade_add(CmdJob *jobs, size_t *njobs, Addon *latest, size_t f)
+{
+    for (size_t i = 0; i < *njobs; i++) {
+        Addon *addon = jobs[i].addon;
+        if (strcmp(addon->name, latest->name) == 0 && strcmp(addon->version, latest->version) == 0) {
+            jobs[i].flavors |= 1u << f;
+            return 0;
         }
+    }
 
-    cleanup:
-        addon_free(addon);
+    jobs[*njobs].addon = addon_dup(latest);
+    if (jobs[*njobs].addon == NULL) {
+        return -1;
     }
 
+    jobs[*njobs].flavors = 1u << f;
+    (*njobs)++;
+
     return 0;
 }
 
-int cmd_install(Context *ctx, int argc, const char *argv[], FILE *stream)
+int cmd_prefetch(Context *ctx, int argc, const char *argv[], FILE *stream)
 {
-    // TODO: If an addon successfully installs/upgrades but another addon
-    // errors, the app state will not be saved for next session even though
-    // files may have already been deleted/moved from/to user's addon folder.
-
-    if (argc < 2) {
+    if (argc != 1) {
         PRINT_ERROR1(CMD_EINVALID_ARGS_STR);
         return -1;
     }
 
-    int err = 0;
+    ContextFlavor single;
+    size_t nflavors = 0;
+    ContextFlavor *flavors = cmd_flavors(ctx, &single, &nflavors);
 
-    curl_global_init(CURL_GLOBAL_DEFAULT);
+    size_t maxjobs = 0;
+    for (size_t f = 0; f < nflavors; f++) {
+        ListNode *node = NULL;
+        list_foreach(node, flavors[f].state->installed)
+        {
+            maxjobs++;
+        }
+    }
 
-    List *addons = list_create();
-    if (addons == NULL) {
+    CmdJob *jobs = calloc(maxjobs, sizeof(*jobs));
+    if (maxjobs > 0 && jobs == NULL) {
         PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
-        err = -1;
-        goto cleanup;
+        return -1;
     }
 
-    for (int i = 1; i < argc; i++) {
-        PRINT_STATUS_ADDON(stream, "Fetching", argv[i]);
+    net_init();
 
-        Addon *addon = addon_create();
-        if (addon == NULL) {
-            PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
-            err = -1;
-            goto cleanup;
+    int err = 0;
+    size_t njobs = 0;
+
+    // The versions that upgrade would download, each one once.
+    for (size_t f = 0; f < nflavors && err == 0; f++) {
+        AppState *state = flavors[f].state;
+
+        ListNode *node = NULL;
+        list_foreach(node, state->installed)
+        {
+            Addon *installed = node->value;
+
+            ListNode *found = list_search(state->latest, installed, cmp_addon);
+            if (found == NULL || strcmp(((Addon *)found->value)->version, installed->version) == 0) {
+                continue;
+            }
+
+            if (cmd_upgrade_add(jobs, &njobs, found->value, f) != 0) {
+                PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+                err = -1;
+                break;
+            }
         }
+    }
 
-        err = addon_fetch_all_meta(addon, argv[i]);
-        if (err == ADDON_ENOTFOUND) {
-            PRINT_WARNING3(CMD_ENOT_FOUND_STR, argv[0], argv[i]);
-            err = 0;
-            goto loop_error;
-        } else if (err == ADDON_ERATE_LIMIT) {
-            PRINT_ERROR2(CMD_ERATE_LIMIT_STR, argv[i]);
-            err = 0;
-            goto loop_error;
-        } else if (err != ADDON_OK) {
-            PRINT_ERROR3(CMD_EMETADATA_STR, argv[0], argv[i]);
+    if (err != 0) {
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < njobs; i++) {
+        jobs[i].task = threadpool_submit(ctx->pool, cmd_job_prefetch, NULL, &jobs[i]);
+    }
+
+    for (size_t i = 0; i < njobs; i++) {
+        CmdJob *job = &jobs[i];
+
+        if (cmd_job_wait(&job->task, argv[0]) != 0) {
             err = -1;
-            goto loop_error;
+            continue;
         }
 
-        PRINT_STATUS(stream, TERM_WRAP(TERM_BOLD, "Downloading") " %s\n", addon->url);
-        if (addon_fetch_zip(addon) != ADDON_OK) {
-            PRINT_ERROR3(CMD_EDOWNLOAD_STR, argv[0], addon->name);
+        if (job->zip_err != ADDON_OK) {
+            PRINT_ERROR3(CMD_EDOWNLOAD_STR, argv[0], job->addon->name);
             err = -1;
-            goto loop_error;
+            continue;
         }
 
-        list_insert(addons, addon);
+        PRINT_STATUS(stream, TERM_WRAP(TERM_BOLD, "Prefetched ") TERM_WRAP(TERM_BOLD_BLUE, "%s") TERM_WRAP(TERM_BOLD, " (%s)") "\n", job->addon->name, job->addon->version);
+    }
 
-        continue;
-    loop_error:
-        addon_free(addon);
-        if (err != 0) {
-            goto cleanup;
-        }
+cleanup:
+    for (size_t i = 0; i < njobs; i++) {
+        addon_free(jobs[i].addon);
     }
+    free(jobs);
 
-    ListNode *node = NULL;
-    list_foreach(node, addons)
+    net_cleanup();
+
+    return err;
+}
+
+/**
+ * Deletes the directories of addon, which is installed in state, from the
+ * addons directory root, each one by its own task on pool. Then removes it from
+ * state, which frees it.
+ *
+ * Returns 0 on success, otherwise prints an error and returns -1.
+ */
+static int cmd_remove_addon(ThreadPool *pool, AppState *state, const char *root, Addon *addon, const char *proc_name, FILE *stream)
+{
+    PRINT_STATUS_ADDON(stream, "Removing", addon->name);
+
+    size_t ndirs = 0;
+    ListNode *dirnode = NULL;
+    list_foreach(dirnode, addon->dirs)
     {
-        Addon *addon = node->value;
+        ndirs++;
+    }
+
+    CmdRemoveJob *jobs = calloc(ndirs, sizeof(*jobs));
+    if (ndirs > 0 && jobs == NULL) {
+        PRINT_ERROR2(CMD_ENO_MEM_STR, proc_name);
+        return -1;
+    }
+
+    size_t njobs = 0;
+    dirnode = NULL;
+    list_foreach(dirnode, addon->dirs)
+    {
+        const char *dirname = dirnode->value;
+        CmdRemoveJob *job = &jobs[njobs];
+
+        int n = snprintf(job->path, ARRAY_SIZE(job->path), "%s%c%s", root, OS_SEPARATOR, dirname);
+        if (n < 0 || (size_t)n >= ARRAY_SIZE(job->path)) {
+            PRINT_ERROR3_FMT(CMD_ENAMETOOLONG_STR, proc_name, "%s%c%s", root, OS_SEPARATOR, dirname);
+            free(jobs);
+            return -1;
+        }
 
-        ListNode *found = list_search(ctx->state->installed, addon, cmp_addon);
-        if (found) {
-            PRINT_STATUS_ADDON(stream, "Found existing addon", addon->name);
+        job->dirname = dirname;
+        job->files = addon->files;
+        job->root = root;
+        njobs++;
+    }
 
-            const char *args[2];
-            args[0] = argv[0];
-            args[1] = addon->name;
+    // Each directory is removed by its own task.
+    for (size_t j = 0; j < njobs; j++) {
+        fprintf(stream, "Remove: %s\n", jobs[j].path);
 
-            if (cmd_remove(ctx, ARRAY_SIZE(args), args, stream) != 0) {
-                PRINT_WARNING("failed to remove existing addon " TERM_WRAP(TERM_BOLD_BLUE, "%s") "\n", addon->name);
-                PRINT_WARNING("attempting to reinstall anyway...\n");
-            }
+        jobs[j].name = addon->name;
+        jobs[j].task = threadpool_submit(pool, cmd_job_remove, NULL, &jobs[j]);
+    }
+
+    int err = 0;
+    for (size_t j = 0; j < njobs; j++) {
+        int remove_err;
+        if (threadpool_wait(jobs[j].task, &remove_err) != THREADPOOL_OK) {
+            remove_err = EINTR;
         }
 
-        PRINT_STATUS_ADDON(stream, "Packaging", addon->name);
-        if (addon_package(addon) != ADDON_OK) {
-            PRINT_ERROR3(CMD_EPACKAGE_STR, argv[0], addon->name);
-            err = -1;
-            goto cleanup;
+        if (remove_err == 0 || err != 0) {
+            continue;
         }
 
-        PRINT_STATUS_ADDON(stream, "Extracting", addon->name);
-        if (addon_extract(addon, ctx->config->addons_path) != ADDON_OK) {
-            PRINT_ERROR3(CMD_EEXTRACT_STR, argv[0], addon->name);
+        if (remove_err == ENOENT) {
+            PRINT_WARNING("directory does not exist %s\n", jobs[j].path);
+        } else {
+            // TODO: What should the program do if this error occurs? If it
+            // was successful in removing one or more directories then the
+            // addon directory would now be corrupted. How can it be
+            // recovered? How should the user be notified? Should the
+            // program try to continue?
+            PRINT_ERROR3(CMD_EREMOVE_DIR_STR, proc_name, jobs[j].dirname);
             err = -1;
-            goto cleanup;
         }
+    }
+
+    free(jobs);
 
-        addon_cleanup_files(addon);
+    if (err != 0) {
+        return err;
     }
 
-    node = NULL;
-    list_foreach(node, addons)
-    {
-        Addon *addon = node->value;
+    addon_remove_archive(addon);
+    cmd_state_remove(state, addon);
+
+    return 0;
+}
+
+int cmd_remove(Context *ctx, int argc, const char *argv[], FILE *stream)
+{
+    if (argc <= 1) {
+        PRINT_ERROR1(CMD_EINVALID_ARGS_STR);
+        return -1;
+    }
+
+    // Without a manifest every directory is read to find what to delete.
+    if (ctx->manifest_path != NULL) {
+        manifest_load(ctx->state, ctx->manifest_path);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        ListNode *node = list_search(ctx->state->installed, argv[i], (ListCompareFn)cmp_str_to_addon);
+        if (node == NULL) {
+            PRINT_WARNING3(CMD_ENOT_FOUND_STR, argv[0], argv[i]);
+            continue;
+        }
+
+        if (cmd_remove_addon(ctx->pool, ctx->state, ctx->config->addons_path, node->value, argv[0], stream) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int cmd_repair(Context *ctx, int argc, const char *argv[], FILE *stream)
+{
+    return cmd_check(ctx, argc, argv, stream, true);
+}
+
+int cmd_search(Context *ctx, int argc, const char *argv[], FILE *stream)
+{
+    if (argc < 2) {
+        PRINT_ERROR1(CMD_EINVALID_ARGS_STR);
+        return -1;
+    }
 
-        PRINT_STATUS_ADDON(stream, "Installed addon", addon->name);
+    // The words are searched together, however they were quoted.
+    size_t len = 0;
+    for (int i = 1; i < argc; i++) {
+        len += strlen(argv[i]) + 1;
+    }
 
-        ListNode *n = NULL;
+    char *query = malloc(len);
+    if (query == NULL) {
+        PRINT_ERROR1(CMD_ENO_MEM_STR);
+        return -1;
+    }
 
-        // At this point no more errors can occur so we can transfer ownership
-        // of each addon without worry.
-        n = list_search(ctx->state->installed, addon, cmp_addon);
-        list_remove(ctx->state->installed, n);
-        list_insert(ctx->state->installed, addon);
+    len = 0;
+    for (int i = 1; i < argc; i++) {
+        size_t n = strlen(argv[i]);
+        memcpy(query + len, argv[i], n);
+        len += n;
+        query[len++] = ' ';
+    }
+    query[len - 1] = '\0';
 
-        n = list_search(ctx->state->latest, addon, cmp_addon);
-        list_remove(ctx->state->latest, n);
-        list_insert(ctx->state->latest, addon_dup(addon));
+    int err = 0;
+    SearchIndex *idx = ctx != NULL ? ctx->search_index : NULL;
+    SearchIndex *opened = NULL;
+    SearchResult *results = NULL;
+    size_t nresults = 0;
+
+    const char *index_path = ctx != NULL ? ctx->search_index_path : NULL;
+    if (idx == NULL && search_index_open(&opened, index_path, WOWPKG_CATALOG_PATH) != SEARCH_OK) {
+        PRINT_ERROR1(CMD_ECATALOG_STR);
+        err = -1;
+        goto cleanup;
+    } else if (idx == NULL) {
+        idx = opened;
     }
 
-cleanup:
-    // Addons list should only contain addons that have had their ownership
-    // transferred to appstate. However if there was an error then ownership may
-    // not have been transferred and need to be cleaned up.
-    if (err != 0) {
-        list_set_free_fn(addons, (ListFreeFn)addon_free);
+    if (search_query(idx, query, &results, &nresults) != SEARCH_OK) {
+        PRINT_ERROR1(CMD_ENO_MEM_STR);
+        err = -1;
+        goto cleanup;
     }
 
-    list_free(addons);
+    // Best match first.
+    for (size_t i = 0; i < nresults; i++) {
+        fprintf(stream, "%s\n", results[i].name);
+    }
 
-    curl_global_cleanup();
+cleanup:
+    free(results);
+    search_index_free(opened);
+    free(query);
 
     return err;
 }
 
-int cmd_list(Context *ctx, int argc, const char *argv[], FILE *stream)
+int cmd_stats(Context *ctx, int argc, const char *argv[], FILE *stream)
 {
-    UNUSED(argv);
-
     if (argc != 1) {
         PRINT_ERROR1(CMD_EINVALID_ARGS_STR);
         return -1;
     }
 
-    list_sort(ctx->state->installed, cmp_addon);
+    if (ctx->store_path == NULL) {
+        PRINT_ERROR2(CMD_ESTORE_DISABLED_STR, argv[0]);
+        return -1;
+    }
 
-    ListNode *node = NULL;
-    list_foreach(node, ctx->state->installed)
-    {
-        Addon *addon = node->value;
-        fprintf(stream, "%s (%s)\n", addon->name, addon->version);
+    StoreUsage usage;
+    if (store_usage(ctx->store_path, &usage) != STORE_OK) {
+        PRINT_ERROR3(CMD_ESTORE_STR, argv[0], ctx->store_path);
+        return -1;
+    }
+
+    PRINT_STATUS(stream, TERM_WRAP(TERM_BOLD, "Content store") " %s\n", ctx->store_path);
+    fprintf(stream, "Stored files   %zu (%.1f MiB)\n", usage.objects, (double)usage.bytes / (1024.0 * 1024.0));
+    fprintf(stream, "Addon files    %zu\n", usage.links);
+    fprintf(stream, "Space saved    %.1f MiB\n", (double)usage.saved / (1024.0 * 1024.0));
+    if (usage.unused > 0) {
+        fprintf(stream, "Unused files   %zu\n", usage.unused);
     }
 
     return 0;
 }
 
-int cmd_outdated(Context *ctx, int argc, const char *argv[], FILE *stream)
+int cmd_sync(Context *ctx, int argc, const char *argv[], FILE *stream)
 {
-    if (argc != 1) {
+    if (argc != 2) {
         PRINT_ERROR1(CMD_EINVALID_ARGS_STR);
         return -1;
     }
 
-    list_sort(ctx->state->installed, cmp_addon);
-
-    ListNode *node = NULL;
-    list_foreach(node, ctx->state->installed)
-    {
-        Addon *installed = node->value;
-
-        ListNode *found = list_search(ctx->state->latest, installed, cmp_addon);
-        if (!found) {
-            PRINT_NO_UPDATED_META_WARNING(argv[0], installed->name);
-            continue;
-        }
-
-        Addon *latest = found->value;
-
-        if (strcmp(installed->version, latest->version) != 0) {
-            fprintf(stream, "%s (%s) < (%s)\n", installed->name, installed->version, latest->version);
-        }
+    Lockfile *lock = NULL;
+    int lock_err = lockfile_load(&lock, argv[1]);
+    if (lock_err != LOCKFILE_OK) {
+        PRINT_ERROR3(lock_err == LOCKFILE_ENOMEM ? CMD_ENO_MEM_STR : CMD_ELOCKFILE_STR, argv[0], argv[1]);
+        return -1;
     }
 
-    return 0;
-}
+    ContextFlavor single;
+    size_t nflavors = 0;
+    ContextFlavor *flavors = cmd_flavors(ctx, &single, &nflavors);
 
-int cmd_remove(Context *ctx, int argc, const char *argv[], FILE *stream)
-{
-    if (argc <= 1) {
-        PRINT_ERROR1(CMD_EINVALID_ARGS_STR);
+    int err = 0;
+    size_t njobs = 0;
+    size_t ninstall = 0;
+
+    CmdJob *jobs = calloc(lock->n, sizeof(*jobs));
+    if (lock->n > 0 && jobs == NULL) {
+        PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+        lockfile_free(lock);
         return -1;
     }
 
-    for (int i = 1; i < argc; i++) {
-        ListNode *node = list_search(ctx->state->installed, argv[i], (ListCompareFn)cmp_str_to_addon);
-        if (node == NULL) {
-            PRINT_WARNING3(CMD_ENOT_FOUND_STR, argv[0], argv[i]);
-            continue;
-        }
-
-        Addon *addon = node->value;
+    net_init();
 
-        PRINT_STATUS_ADDON(stream, "Removing", addon->name);
+    // Each locked release goes into the flavors that do not have it already,
+    // and is downloaded once no matter how many that is.
+    for (size_t i = 0; i < lock->n; i++) {
+        const LockEntry *entry = &lock->entries[i];
 
-        ListNode *dirnode = NULL;
-        list_foreach(dirnode, addon->dirs)
-        {
-            const char *dirname = dirnode->value;
-
-            char remove_path[OS_MAX_PATH];
-            int n = snprintf(remove_path, ARRAY_SIZE(remove_path), "%s%c%s", ctx->config->addons_path, OS_SEPARATOR, dirname);
-            if (n < 0 || (size_t)n >= ARRAY_SIZE(remove_path)) {
-                PRINT_ERROR3_FMT(CMD_ENAMETOOLONG_STR, argv[0], "%s%c%s", ctx->config->addons_path, OS_SEPARATOR, dirname);
-                return -1;
-            }
-
-            fprintf(stream, "Remove: %s\n", remove_path);
-            if (os_remove_all(remove_path) != 0) {
-                if (errno == ENOENT) {
-                    PRINT_WARNING("directory does not exist %s\n", remove_path);
-                } else {
-                    // TODO: What should the program do if this error occurs? If it
-                    // was successful in removing one or more directories then the
-                    // addon directory would now be corrupted. How can it be
-                    // recovered? How should the user be notified? Should the
-                    // program try to continue?
-                    PRINT_ERROR3(CMD_EREMOVE_DIR_STR, argv[0], dirname);
-                    return -1;
-                }
+        unsigned missing = 0;
+        for (size_t f = 0; f < nflavors; f++) {
+            ListNode *found = list_search(flavors[f].state->installed, entry->name, cmp_str_to_addon);
+            const Addon *installed = found != NULL ? found->value : NULL;
+            if (installed == NULL || installed->version == NULL || strcmp(installed->version, entry->version) != 0) {
+                missing |= 1u << f;
             }
         }
 
-        ListNode *n = NULL;
-
-        // Order here is important. Addon should first be removed from latest
-        // because Addon is a reference to an addon in installed. Removing from
-        // installed first would cause a double free.
-        n = list_search(ctx->state->latest, addon, cmp_addon);
-        list_remove(ctx->state->latest, n);
+        if (missing == 0) {
+            continue;
+        }
 
-        n = list_search(ctx->state->installed, addon, cmp_addon);
-        list_remove(ctx->state->installed, n);
-        addon = NULL; // Do not use addon from this point. It should be destroyed.
+        jobs[njobs].name = entry->name;
+        jobs[njobs].lock = entry;
+        jobs[njobs].flavors = missing;
+        jobs[njobs].addon = addon_create();
+        if (jobs[njobs].addon == NULL) {
+            PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+            err = -1;
+            goto cleanup;
+        }
+        njobs++;
     }
 
-    return 0;
-}
+    for (size_t i = 0; i < njobs; i++) {
+        jobs[i].task = threadpool_submit(ctx->pool, cmd_job_sync, NULL, &jobs[i]);
+    }
 
-int cmd_search(Context *ctx, int argc, const char *argv[], FILE *stream)
-{
-    UNUSED(ctx);
+    for (size_t i = 0; i < njobs; i++) {
+        CmdJob *job = &jobs[i];
 
-    if (argc != 2) {
-        PRINT_ERROR1(CMD_EINVALID_ARGS_STR);
-        return -1;
-    }
+        if (cmd_job_wait(&job->task, argv[0]) != 0) {
+            err = -1;
+            continue;
+        }
 
-    int err = 0;
-    List *found = list_create();
-    list_set_free_fn(found, free);
-    OsDir *dir = os_opendir(WOWPKG_CATALOG_PATH);
-    if (dir == NULL) {
-        err = -1;
-        goto cleanup;
-    }
+        PRINT_STATUS_ADDON(stream, "Fetching", job->name);
 
-    OsDirEnt *entry = NULL;
-    while ((entry = os_readdir(dir)) != NULL) {
-        if (strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0) {
+        if (job->meta_err == ADDON_ENOTFOUND) {
+            PRINT_ERROR3(CMD_ENOT_FOUND_STR, argv[0], job->name);
+            err = -1;
+            continue;
+        } else if (job->meta_err != ADDON_OK) {
+            PRINT_ERROR3(CMD_EMETADATA_STR, argv[0], job->name);
+            err = -1;
             continue;
         }
 
-        if (cmd_strcasestr(entry->name, argv[1]) != NULL) {
-            char *basename = strdup(entry->name);
-            if (basename == NULL) {
-                err = -1;
-                goto cleanup;
-            }
+        PRINT_STATUS(stream, TERM_WRAP(TERM_BOLD, "Downloading") " %s\n", job->addon->url);
+        if (job->zip_err == ADDON_EHASH) {
+            PRINT_ERROR3(CMD_EMISMATCH_STR, argv[0], job->addon->name);
+            err = -1;
+            continue;
+        } else if (job->zip_err != ADDON_OK) {
+            PRINT_ERROR3(CMD_EDOWNLOAD_STR, argv[0], job->addon->name);
+            err = -1;
+            continue;
+        }
 
-            char *ext_start = strstr(basename, ".ini");
-            if (ext_start == NULL) {
-                continue;
-            }
+        // Keep the downloaded addons at the front of jobs.
+        CmdJob tmp = jobs[ninstall];
+        jobs[ninstall] = *job;
+        *job = tmp;
+        ninstall++;
+    }
 
-            *ext_start = '\0';
+    // The lockfile has every dependency, they only decide the order.
+    cmd_jobs_sort_waves(jobs, ninstall, argv[0]);
 
-            list_insert(found, basename);
+    // Addons that are not locked are only removed once every locked archive
+    // was downloaded and matched its hash, so a sync that can not finish does
+    // not leave the addons directory with less than it had.
+    const Lockfile *keep = err == 0 ? lock : NULL;
+    for (size_t f = 0; keep == NULL && f < nflavors; f++) {
+        ListNode *node = NULL;
+        list_foreach(node, flavors[f].state->installed)
+        {
+            const Addon *installed = node->value;
+            if (lockfile_find(lock, installed->name) == NULL) {
+                PRINT_WARNING("%s: not removing '%s', not every locked addon was downloaded\n", argv[0], installed->name);
+            }
         }
     }
 
-    list_sort(found, (ListCompareFn)strcmp);
-
-    ListNode *node = NULL;
-    list_foreach(node, found)
-    {
-        fprintf(stream, "%s\n", (char *)node->value);
+    if (cmd_jobs_install(ctx, jobs, ninstall, keep, argv[0], "Synced addon", stream) != 0) {
+        err = -1;
     }
 
 cleanup:
-    os_closedir(dir);
+    // Addons that were installed are owned by the app state, the rest are
+    // freed here.
+    for (size_t i = 0; i < njobs; i++) {
+        addon_free(jobs[i].addon);
+    }
+    free(jobs);
+    lockfile_free(lock);
 
-    list_free(found);
+    net_cleanup();
 
     return err;
 }
@@ -487,7 +2705,7 @@ int cmd_update(Context *ctx, int argc, const char *argv[], FILE *stream)
         return -1;
     }
 
-    curl_global_init(CURL_GLOBAL_DEFAULT);
+    net_init();
 
     int err = 0;
     List *addons = list_create();
@@ -496,7 +2714,14 @@ int cmd_update(Context *ctx, int argc, const char *argv[], FILE *stream)
         return -1;
     }
 
-    if (argc == 1) {
+    // --prefetch is handled once every flavor is updated, see
+    // cmd_update_prefetch.
+    int nnames = 0;
+    for (int i = 1; i < argc; i++) {
+        nnames += strcmp(argv[i], CMD_PREFETCH_OPTION) != 0;
+    }
+
+    if (nnames == 0) {
         // Update all installed addons.
         ListNode *node = NULL;
         list_foreach(node, ctx->state->installed)
@@ -505,12 +2730,23 @@ int cmd_update(Context *ctx, int argc, const char *argv[], FILE *stream)
             list_insert(addons, addon_dup(a));
         }
     } else {
-        // Only update the addons that are in args.
-        for (int i = 1; i < argc; i++) {
+        // Only update the addons that are in args. Inserted in reverse so the
+        // list keeps the order they were asked for in, which is also the order
+        // they are requested in.
+        for (int i = argc - 1; i >= 1; i--) {
+            if (strcmp(argv[i], CMD_PREFETCH_OPTION) == 0) {
+                continue;
+            }
+
             ListNode *found = list_search(ctx->state->installed, argv[i], cmp_str_to_addon);
             if (!found) {
-                PRINT_WARNING3(CMD_ENOT_FOUND_STR, argv[0], argv[i]);
-                continue;
+                char *fixed = cmd_not_found(ctx, argv[0], argv[i], cmd_is_installed);
+                found = fixed != NULL ? list_search(ctx->state->installed, fixed, cmp_str_to_addon) : NULL;
+                free(fixed);
+
+                if (!found) {
+                    continue;
+                }
             }
 
             Addon *found_addon = found->value;
@@ -518,194 +2754,271 @@ int cmd_update(Context *ctx, int argc, const char *argv[], FILE *stream)
         }
     }
 
+    size_t naddons = 0;
     ListNode *node = NULL;
     list_foreach(node, addons)
+    {
+        naddons++;
+    }
+
+    // Metadata for all addons is fetched at once so the requests can share a
+    // single connection.
+    Addon **batch = calloc(naddons, sizeof(*batch));
+    int *batch_errs = calloc(naddons, sizeof(*batch_errs));
+    if (naddons > 0 && (batch == NULL || batch_errs == NULL)) {
+        free(batch);
+        free(batch_errs);
+        PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+        err = -1;
+        goto cleanup;
+    }
+
+    size_t i = 0;
+    node = NULL;
+    list_foreach(node, addons)
     {
         Addon *addon = node->value;
 
         PRINT_STATUS_ADDON(stream, "Fetching", addon->name);
+        batch[i++] = addon;
+    }
 
-        err = addon_fetch_all_meta(addon, addon->name);
-        if (err == ADDON_ENOTFOUND) {
+    addon_fetch_all_meta_many(batch, naddons, batch_errs);
+
+    size_t nrate_limited = 0;
+    for (i = 0; i < naddons && err == 0; i++) {
+        Addon *addon = batch[i];
+
+        if (batch_errs[i] == ADDON_ENOTFOUND) {
             PRINT_WARNING3(CMD_ENOT_FOUND_STR, argv[0], addon->name);
-            err = 0;
-            continue;
-        } else if (err == ADDON_ERATE_LIMIT) {
-            PRINT_ERROR2(CMD_ERATE_LIMIT_STR, addon->name);
-            err = 0;
-            continue;
-        } else if (err != ADDON_OK) {
+        } else if (batch_errs[i] == ADDON_ERATE_LIMIT) {
+            nrate_limited++;
+        } else if (batch_errs[i] != ADDON_OK) {
             PRINT_ERROR3(CMD_EMETADATA_STR, argv[0], addon->name);
             err = -1;
-            goto cleanup;
         }
     }
 
-    list_foreach(node, addons)
-    {
-        Addon *addon = node->value;
+    if (err != 0) {
+        free(batch);
+        free(batch_errs);
+        goto cleanup;
+    }
 
-        ListNode *n = NULL;
+    NetStats stats;
+    net_get_stats(&stats);
+    if (stats.requests > 0) {
+        PRINT_STATUS(stream, "Transferred %.1f KiB (%.1f KiB decoded)\n", (double)stats.wire_bytes / 1024.0, (double)stats.decoded_bytes / 1024.0);
+    }
+
+    // Addons that were rate limited keep their previous metadata so that
+    // nothing is lost. They can be updated again once the limit resets.
+    for (i = 0; i < naddons; i++) {
+        Addon *addon = batch[i];
+
+        if (batch_errs[i] == ADDON_ERATE_LIMIT) {
+            ListNode *n = list_search_ptr(addons, addon);
+            list_set_free_fn(addons, (ListFreeFn)addon_free);
+            list_remove(addons, n);
+            list_set_free_fn(addons, NULL);
+            continue;
+        }
 
-        n = list_search(ctx->state->latest, addon, cmp_addon);
+        ListNode *n = list_search(ctx->state->latest, addon, cmp_addon);
         list_remove(ctx->state->latest, n);
         list_insert(ctx->state->latest, addon);
     }
 
+    free(batch);
+    free(batch_errs);
+
+    if (nrate_limited > 0) {
+        long remaining;
+        long long reset;
+        net_get_ratelimit(&remaining, &reset);
+
+        time_t reset_time = (time_t)reset;
+        struct tm *reset_tm = localtime(&reset_time);
+        char reset_str[16] = "later";
+        if (reset > 0 && reset_tm != NULL) {
+            strftime(reset_str, ARRAY_SIZE(reset_str), "%H:%M", reset_tm);
+        }
+
+        PRINT_WARNING("%s: %s, %zu addon(s) kept their previous metadata\n", argv[0], CMD_ERATE_LIMIT_STR, nrate_limited);
+        PRINT_WARNING("run '%s' again after %s to update them\n", argv[0], reset_str);
+        if (ctx->config == NULL || ctx->config->github_token == NULL) {
+            PRINT_WARNING("setting a GitHub token in config.ini raises the rate limit\n");
+        }
+    }
+
 cleanup:
     if (err != 0) {
         list_set_free_fn(addons, (ListFreeFn)addon_free);
     }
     list_free(addons);
 
-    curl_global_cleanup();
+    net_cleanup();
 
     return err;
 }
 
-int cmd_upgrade(Context *ctx, int argc, const char *argv[], FILE *stream)
+bool cmd_update_prefetch(const Context *ctx, int argc, const char *argv[])
 {
-    // TODO: If an addon successfully installs/upgrades but another addon
-    // errors, the app state will not be saved for next session even though
-    // files may have already been deleted/moved from/to user's addon folder.
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], CMD_PREFETCH_OPTION) == 0) {
+            return true;
+        }
+    }
 
+    return ctx->config != NULL && ctx->config->update_prefetch;
+}
+
+int cmd_upgrade(Context *ctx, int argc, const char *argv[], FILE *stream)
+{
     if (argc < 1) {
         PRINT_ERROR1(CMD_EINVALID_ARGS_STR);
         return -1;
     }
 
-    curl_global_init(CURL_GLOBAL_DEFAULT);
+    ContextFlavor single;
+    size_t nflavors = 0;
+    ContextFlavor *flavors = cmd_flavors(ctx, &single, &nflavors);
 
-    int err = 0;
-    List *addons = list_create();
-    if (addons == NULL) {
+    // With --json only the results go to stream.
+    FILE *status = ctx->json ? NULL : stream;
+
+    // At most one job per installed addon of each flavor.
+    size_t maxjobs = 0;
+    for (size_t f = 0; f < nflavors; f++) {
+        ListNode *node = NULL;
+        list_foreach(node, flavors[f].state->installed)
+        {
+            maxjobs++;
+        }
+    }
+
+    CmdJob *jobs = calloc(maxjobs, sizeof(*jobs));
+    if (maxjobs > 0 && jobs == NULL) {
         PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
         return -1;
     }
 
-    if (argc == 1) {
-        // Upgrade all outdated addons.
+    net_init();
+
+    int err = 0;
+    size_t njobs = 0;
+
+    // Addons in args that are not installed in any flavor.
+    for (int i = 1; i < argc; i++) {
+        bool found = false;
+        for (size_t f = 0; f < nflavors && !found; f++) {
+            found = list_search(flavors[f].state->installed, argv[i], cmp_str_to_addon) != NULL;
+        }
+
+        if (!found) {
+            PRINT_WARNING3(CMD_ENOT_FOUND_STR, argv[0], argv[i]);
+        }
+    }
+
+    for (size_t f = 0; f < nflavors && err == 0; f++) {
+        AppState *state = flavors[f].state;
+
         ListNode *node = NULL;
-        list_foreach(node, ctx->state->installed)
+        list_foreach(node, state->installed)
         {
             Addon *installed = node->value;
 
-            ListNode *found = list_search(ctx->state->latest, installed, cmp_addon);
-            if (found == NULL) {
-                PRINT_NO_UPDATED_META_WARNING(argv[0], installed->name);
-                continue;
+            // Without args every outdated addon is upgraded.
+            bool in_args = argc == 1;
+            for (int i = 1; i < argc && !in_args; i++) {
+                in_args = cmp_str_to_addon(argv[i], installed) == 0;
             }
 
-            Addon *latest = found->value;
-
-            if (strcmp(latest->version, installed->version) != 0) {
-                PRINT_STATUS(stream, TERM_WRAP(TERM_BOLD, "Upgrading ") TERM_WRAP(TERM_BOLD_BLUE, "%s") TERM_WRAP(TERM_BOLD, " (%s) -> (%s)") "\n", installed->name, installed->version, latest->version);
-                list_insert(addons, addon_dup(latest));
-            }
-        }
-    } else {
-        // Only upgrade the addons that are in args.
-        for (int i = 1; i < argc; i++) {
-            ListNode *found_installed = list_search(ctx->state->installed, argv[i], cmp_str_to_addon);
-            if (!found_installed) {
-                PRINT_WARNING3(CMD_ENOT_FOUND_STR, argv[0], argv[i]);
+            if (!in_args) {
                 continue;
             }
 
-            Addon *installed = found_installed->value;
-
-            ListNode *found_latest = list_search(ctx->state->latest, argv[i], cmp_str_to_addon);
-            if (found_latest == NULL) {
+            ListNode *found = list_search(state->latest, installed, cmp_addon);
+            if (found == NULL) {
                 PRINT_NO_UPDATED_META_WARNING(argv[0], installed->name);
                 continue;
             }
 
-            Addon *latest = found_latest->value;
+            Addon *latest = found->value;
 
-            if (strcmp(latest->version, installed->version) != 0) {
-                PRINT_STATUS(stream, TERM_WRAP(TERM_BOLD, "Upgrading ") TERM_WRAP(TERM_BOLD_BLUE, "%s") TERM_WRAP(TERM_BOLD, " (%s) -> (%s)") "\n", installed->name, installed->version, latest->version);
-                list_insert(addons, addon_dup(latest));
+            if (strcmp(latest->version, installed->version) == 0) {
+                if (argc > 1) {
+                    cmd_print_status_flavor(status, "Addon is up-to-date", installed->name, &flavors[f], nflavors);
+                }
+            } else if (cmd_upgrade_add(jobs, &njobs, latest, f) != 0) {
+                PRINT_ERROR2(CMD_ENO_MEM_STR, argv[0]);
+                err = -1;
+                break;
+            } else if (nflavors > 1) {
+                PRINT_STATUS(status, TERM_WRAP(TERM_BOLD, "Upgrading ") TERM_WRAP(TERM_BOLD_BLUE, "%s") TERM_WRAP(TERM_BOLD, " (%s) -> (%s)") " (%s)\n", installed->name, installed->version, latest->version, flavors[f].name);
             } else {
-                PRINT_STATUS_ADDON(stream, "Addon is up-to-date", installed->name);
+                PRINT_STATUS(status, TERM_WRAP(TERM_BOLD, "Upgrading ") TERM_WRAP(TERM_BOLD_BLUE, "%s") TERM_WRAP(TERM_BOLD, " (%s) -> (%s)") "\n", installed->name, installed->version, latest->version);
             }
         }
     }
 
-    ListNode *node = NULL;
-    list_foreach(node, addons)
-    {
-        Addon *addon = node->value;
-
-        PRINT_STATUS(stream, TERM_WRAP(TERM_BOLD, "Downloading") " %s\n", addon->url);
-
-        if (addon_fetch_zip(addon) != ADDON_OK) {
-            PRINT_ERROR3(CMD_EDOWNLOAD_STR, argv[0], addon->name);
-            err = -1;
-            goto cleanup;
-        }
+    if (err != 0) {
+        goto cleanup;
     }
 
-    node = NULL;
-    list_foreach(node, addons)
-    {
-        Addon *addon = node->value;
-
-        ListNode *found = list_search(ctx->state->installed, addon, cmp_addon);
-        if (found) {
-            PRINT_STATUS_ADDON(stream, "Cleaning up old addon", addon->name);
-
-            const char *args[2];
-            args[0] = argv[0];
-            args[1] = addon->name;
+    // Every version is downloaded once, even if it goes into many flavors.
+    for (size_t i = 0; i < njobs; i++) {
+        jobs[i].task = threadpool_submit(ctx->pool, cmd_job_download, NULL, &jobs[i]);
+    }
 
-            if (cmd_remove(ctx, ARRAY_SIZE(args), args, stream) != 0) {
-                PRINT_WARNING("failed to remove old addon " TERM_WRAP(TERM_BOLD_BLUE, "%s") "\n", addon->name);
-                PRINT_WARNING("attempting to upgrade anyway...\n");
-            }
-        }
+    size_t ninstall = 0;
+    for (size_t i = 0; i < njobs; i++) {
+        CmdJob *job = &jobs[i];
 
-        PRINT_STATUS_ADDON(stream, "Packaging", addon->name);
-        if (addon_package(addon) != ADDON_OK) {
-            PRINT_ERROR3(CMD_EPACKAGE_STR, argv[0], addon->name);
+        if (cmd_job_wait(&job->task, argv[0]) != 0) {
+            job->error = CMD_EINTERRUPTED_STR;
             err = -1;
-            goto cleanup;
+            continue;
         }
 
-        PRINT_STATUS_ADDON(stream, "Extracting", addon->name);
-        if (addon_extract(addon, ctx->config->addons_path) != ADDON_OK) {
-            PRINT_ERROR3(CMD_EEXTRACT_STR, argv[0], addon->name);
+        PRINT_STATUS(status, TERM_WRAP(TERM_BOLD, "Downloading") " %s\n", job->addon->url);
+        if (job->zip_err != ADDON_OK) {
+            PRINT_ERROR3(CMD_EDOWNLOAD_STR, argv[0], job->addon->name);
+            job->error = CMD_EDOWNLOAD_STR;
             err = -1;
-            goto cleanup;
+            continue;
         }
 
-        addon_cleanup_files(addon);
+        // Keep the downloaded addons at the front of jobs.
+        CmdJob tmp = jobs[ninstall];
+        jobs[ninstall] = *job;
+        *job = tmp;
+        ninstall++;
     }
 
-    list_foreach(node, addons)
-    {
-        Addon *addon = node->value;
-
-        PRINT_STATUS_ADDON(stream, "Upgraded addon", addon->name);
-
-        ListNode *n = NULL;
-
-        n = list_search(ctx->state->installed, addon, cmp_addon);
-        list_remove(ctx->state->installed, n);
-        list_insert(ctx->state->installed, addon);
+    if (cmd_jobs_install(ctx, jobs, ninstall, NULL, argv[0], "Upgraded addon", status) != 0) {
+        err = -1;
+    }
 
-        n = list_search(ctx->state->latest, addon, cmp_addon);
-        list_remove(ctx->state->latest, n);
-        list_insert(ctx->state->latest, addon_dup(addon));
+    for (size_t i = 0; i < njobs && ctx->json; i++) {
+        if (cmd_job_print_json(stream, &jobs[i], flavors, nflavors, "upgraded", argv[0]) != 0) {
+            err = -1;
+            break;
+        }
     }
 
 cleanup:
-    if (err != 0) {
-        list_set_free_fn(addons, (ListFreeFn)addon_free);
+    for (size_t i = 0; i < njobs; i++) {
+        addon_free(jobs[i].addon);
     }
+    free(jobs);
 
-    list_free(addons);
-
-    curl_global_cleanup();
+    net_cleanup();
 
     return err;
 }
+
+int cmd_verify(Context *ctx, int argc, const char *argv[], FILE *stream)
+{
+    return cmd_check(ctx, argc, argv, stream, false);
+}
@@ -1,9 +1,18 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdio.h>
 
 #include "context.h"
 
+/**
+ * Records the addon directories that the program did not install, but that
+ * are addons in the catalog, as installed without downloading them.
+ */
+int cmd_adopt(Context *ctx, int argc, const char *argv[], FILE *stream);
+
+int cmd_dedupe(Context *ctx, int argc, const char *argv[], FILE *stream);
+
 int cmd_help(Context *ctx, int argc, const char *argv[], FILE *stream);
 
 int cmd_info(Context *ctx, int argc, const char *argv[], FILE *stream);
@@ -12,12 +21,50 @@ int cmd_install(Context *ctx, int argc, const char *argv[], FILE *stream);
 
 int cmd_list(Context *ctx, int argc, const char *argv[], FILE *stream);
 
+/**
+ * Writes the release, archive size and SHA-256 hash of every installed addon of
+ * the only flavor of ctx to the lockfile argv[1], see lockfile.h.
+ */
+int cmd_lock(Context *ctx, int argc, const char *argv[], FILE *stream);
+
 int cmd_outdated(Context *ctx, int argc, const char *argv[], FILE *stream);
 
+/**
+ * Downloads the archives of the addons that upgrade would upgrade into the
+ * download directory, so that upgrade does not have to.
+ */
+int cmd_prefetch(Context *ctx, int argc, const char *argv[], FILE *stream);
+
 int cmd_remove(Context *ctx, int argc, const char *argv[], FILE *stream);
 
+int cmd_repair(Context *ctx, int argc, const char *argv[], FILE *stream);
+
 int cmd_search(Context *ctx, int argc, const char *argv[], FILE *stream);
 
+int cmd_stats(Context *ctx, int argc, const char *argv[], FILE *stream);
+
+/**
+ * Makes the addons of every flavor of ctx match the lockfile argv[1]: installs
+ * the locked release of each addon that is missing or another version, from
+ * the download directory if it has the archive, and removes the addons that
+ * are not in it. Archives that do not match their hash are not installed.
+ */
+int cmd_sync(Context *ctx, int argc, const char *argv[], FILE *stream);
+
+/**
+ * Option of update that runs prefetch in the background once every flavor is
+ * updated.
+ */
+#define CMD_PREFETCH_OPTION "--prefetch"
+
 int cmd_update(Context *ctx, int argc, const char *argv[], FILE *stream);
 
+/**
+ * Returns true if update with argv shall be followed by a prefetch, because of
+ * CMD_PREFETCH_OPTION or the config of ctx.
+ */
+bool cmd_update_prefetch(const Context *ctx, int argc, const char *argv[]);
+
 int cmd_upgrade(Context *ctx, int argc, const char *argv[], FILE *stream);
+
+int cmd_verify(Context *ctx, int argc, const char *argv[], FILE *stream);
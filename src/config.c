@@ -1,9 +1,21 @@
+#include <ctype.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include "config.h"
 #include "ini.h"
 #include "osstring.h"
 
+static void config_set_github_token(Config *cfg, const char *token)
+{
+    if (cfg->github_token != NULL) {
+        memset(cfg->github_token, 0, strlen(cfg->github_token));
+        free(cfg->github_token);
+    }
+
+    cfg->github_token = strdup(token);
+}
+
 Config *config_create(void)
 {
     Config *result = malloc(sizeof(*result));
@@ -21,9 +33,89 @@ void config_free(Config *cfg)
     }
 
     free(cfg->addons_path);
+    free(cfg->github_api_url);
+    free(cfg->store_path);
+
+    for (size_t i = 0; i < cfg->nflavors; i++) {
+        free(cfg->flavors[i].name);
+        free(cfg->flavors[i].addons_path);
+    }
+
+    if (cfg->github_token != NULL) {
+        memset(cfg->github_token, 0, strlen(cfg->github_token));
+        free(cfg->github_token);
+    }
+
     free(cfg);
 }
 
+/**
+ * Returns the index of the flavor called name, or -1 if there is none.
+ */
+static int config_flavor_index(const Config *cfg, const char *name)
+{
+    for (size_t i = 0; i < cfg->nflavors; i++) {
+        if (strcasecmp(cfg->flavors[i].name, name) == 0) {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+
+static bool config_valid_flavor_name(const char *name)
+{
+    if (name[0] == '\0') {
+        return false;
+    }
+
+    for (const char *s = name; *s; s++) {
+        if (!isalnum((unsigned char)*s) && *s != '-' && *s != '_') {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Sets the addons path of the flavor called name, adding the flavor if it is
+ * new.
+ *
+ * Returns 0 on success, otherwise -1.
+ */
+static int config_set_flavor(Config *cfg, const char *name, const char *addons_path)
+{
+    int index = config_flavor_index(cfg, name);
+
+    ConfigFlavor *flavor = index < 0 ? NULL : &cfg->flavors[index];
+    if (flavor == NULL) {
+        if (cfg->nflavors >= CONFIG_MAX_FLAVORS || !config_valid_flavor_name(name)) {
+            return -1;
+        }
+
+        flavor = &cfg->flavors[cfg->nflavors];
+        flavor->name = strdup(name);
+        if (flavor->name == NULL) {
+            return -1;
+        }
+        cfg->nflavors++;
+    }
+
+    free(flavor->addons_path);
+    flavor->addons_path = strdup(addons_path);
+
+    return flavor->addons_path == NULL ? -1 : 0;
+}
+
+/**
+ * Returns true if value turns an option on.
+ */
+static bool config_parse_bool(const char *value)
+{
+    return strcasecmp(value, "true") == 0 || strcasecmp(value, "yes") == 0 || strcmp(value, "1") == 0;
+}
+
 int config_load(Config *cfg, const char *path)
 {
     INI *ini = ini_open(path);
@@ -35,18 +127,92 @@ int config_load(Config *cfg, const char *path)
 
     INIKey *key = NULL;
     while ((key = ini_readkey(ini)) != NULL) {
-        if (strcasecmp(key->section, "retail") == 0
+        if (strcasecmp(key->section, "github") != 0
+            && strcasecmp(key->section, "store") != 0
+            && strcasecmp(key->section, "update") != 0
             && strcasecmp(key->name, "addons_path") == 0) {
 
-            cfg->addons_path = strdup(key->value);
+            if (config_set_flavor(cfg, key->section, key->value) != 0) {
+                err = -1;
+                break;
+            }
+        } else if (strcasecmp(key->section, "github") == 0
+            && strcasecmp(key->name, "token") == 0
+            && key->value[0] != '\0') {
+
+            config_set_github_token(cfg, key->value);
+        } else if (strcasecmp(key->section, "github") == 0
+            && strcasecmp(key->name, "api_url") == 0
+            && key->value[0] != '\0') {
+
+            free(cfg->github_api_url);
+            cfg->github_api_url = strdup(key->value);
+        } else if (strcasecmp(key->section, "store") == 0
+            && strcasecmp(key->name, "enabled") == 0) {
+
+            cfg->store_enabled = config_parse_bool(key->value);
+        } else if (strcasecmp(key->section, "store") == 0
+            && strcasecmp(key->name, "path") == 0
+            && key->value[0] != '\0') {
+
+            free(cfg->store_path);
+            cfg->store_path = strdup(key->value);
+        } else if (strcasecmp(key->section, "update") == 0
+            && strcasecmp(key->name, "prefetch") == 0) {
+
+            cfg->update_prefetch = config_parse_bool(key->value);
         }
     }
 
-    if (ini_last_error(ini) != INI_EEOF || cfg->addons_path == NULL) {
+    if (err != 0 || ini_last_error(ini) != INI_EEOF || cfg->nflavors == 0) {
         err = -1;
+    } else {
+        err = config_select_flavor(cfg, cfg->flavors[0].name);
     }
 
     ini_close(ini);
 
     return err;
 }
+
+const ConfigFlavor *config_find_flavor(const Config *cfg, const char *name)
+{
+    int index = config_flavor_index(cfg, name);
+    return index < 0 ? NULL : &cfg->flavors[index];
+}
+
+int config_select_flavor(Config *cfg, const char *name)
+{
+    const ConfigFlavor *flavor = config_find_flavor(cfg, name);
+    if (flavor == NULL) {
+        return -1;
+    }
+
+    char *addons_path = strdup(flavor->addons_path);
+    if (addons_path == NULL) {
+        return -1;
+    }
+
+    free(cfg->addons_path);
+    cfg->addons_path = addons_path;
+
+    return 0;
+}
+
+void config_load_env(Config *cfg)
+{
+    const char *token = getenv("WOWPKG_GITHUB_TOKEN");
+    if (token == NULL || token[0] == '\0') {
+        token = cfg->github_token == NULL ? getenv("GITHUB_TOKEN") : NULL;
+    }
+
+    if (token != NULL && token[0] != '\0') {
+        config_set_github_token(cfg, token);
+    }
+
+    const char *api_url = getenv("WOWPKG_GITHUB_API_URL");
+    if (api_url != NULL && api_url[0] != '\0') {
+        free(cfg->github_api_url);
+        cfg->github_api_url = strdup(api_url);
+    }
+}
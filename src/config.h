@@ -1,7 +1,48 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Upper limit on the amount of game flavors in a config file.
+ */
+#define CONFIG_MAX_FLAVORS 16
+
+/**
+ * An installation of the game, such as retail, classic or the PTR. Each one is
+ * a section of the config file with an addons_path, the section is its name.
+ */
+typedef struct ConfigFlavor {
+    char *name;
+    char *addons_path;
+} ConfigFlavor;
+
 typedef struct Config {
+    // Addons path of the selected flavor, the first one in the file unless
+    // config_select_flavor says otherwise.
     char *addons_path;
+
+    // Flavors in the order they are in the file.
+    ConfigFlavor flavors[CONFIG_MAX_FLAVORS];
+    size_t nflavors;
+
+    // Optional GitHub token. Never printed or saved anywhere else.
+    char *github_token;
+
+    // Optional base url of the GitHub API, replaces 'https://api.github.com'
+    // in catalog urls.
+    char *github_api_url;
+
+    // Whether installed files are deduplicated through the content store.
+    bool store_enabled;
+
+    // Optional directory of the content store. Defaults to one in the addons
+    // path of the first flavor.
+    char *store_path;
+
+    // Whether update downloads the archives of outdated addons in the
+    // background, as with 'update --prefetch'.
+    bool update_prefetch;
 } Config;
 
 Config *config_create(void);
@@ -14,4 +55,33 @@ Config *config_create(void);
  */
 void config_free(Config *cfg);
 
+/**
+ * Loads the config file at path. At least one flavor is required. Flavor names
+ * may only contain letters, digits, '-' and '_'. The content store is enabled
+ * with 'enabled = true' in the [Store] section, prefetching with
+ * 'prefetch = true' in the [Update] section.
+ *
+ * Returns 0 on success, otherwise -1.
+ */
 int config_load(Config *cfg, const char *path);
+
+/**
+ * Returns the flavor called name, ignoring case, or NULL if there is none.
+ */
+const ConfigFlavor *config_find_flavor(const Config *cfg, const char *name);
+
+/**
+ * Makes addons_path refer to the flavor called name.
+ *
+ * Returns 0 on success, otherwise -1.
+ */
+int config_select_flavor(Config *cfg, const char *name);
+
+/**
+ * Overrides config values with values from the environment.
+ *
+ * WOWPKG_GITHUB_TOKEN replaces the GitHub token from the config file. If
+ * neither are set then GITHUB_TOKEN is used. WOWPKG_GITHUB_API_URL replaces
+ * the GitHub API url.
+ */
+void config_load_env(Config *cfg);
@@ -1,9 +1,45 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "appstate.h"
 #include "config.h"
+#include "search.h"
+#include "threadpool.h"
+#include "watch.h"
 
-typedef struct Context {
+/**
+ * A flavor of the game from the config and its app state.
+ */
+typedef struct ContextFlavor {
+    const char *name;
+    const char *addons_path;
     AppState *state;
+    const char *manifest_path; // See manifest.h.
+    Watch *watch; // Changes in addons_path, NULL if they are not watched.
+} ContextFlavor;
+
+typedef struct Context {
+    AppState *state; // State of the flavor in config->addons_path.
+    const char *flavor; // Name of the flavor in config->addons_path, NULL if not known.
+    const char *manifest_path; // Manifest of the flavor in config->addons_path.
+    Watch *watch; // Changes in config->addons_path, NULL if not watched.
     Config *config;
+    ThreadPool *pool; // Work of commands is run here. May be NULL.
+    const char *store_path; // Content store, NULL if it is disabled.
+    const char *search_index_path; // Saved search index, NULL to build it every time.
+    SearchIndex *search_index; // Loaded search index, NULL to load it when needed.
+    bool fix_typos; // Go on with the closest catalog name to one not found.
+    bool json; // Print results as one JSON object per line instead of text.
+
+    // Addons whose versions install and upgrade replaced. Their archives are
+    // deleted once the replacement is committed, if no flavor still has that
+    // version. NULL to keep the archives.
+    struct List *old_archives;
+
+    // Flavors that install and upgrade work on. If there are none then state
+    // and config->addons_path are the only flavor.
+    ContextFlavor *flavors;
+    size_t nflavors;
 } Context;
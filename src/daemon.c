@@ -0,0 +1,654 @@
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "daemon.h"
+#include "osapi.h"
+#include "wowpkg.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/**
+ * Most bytes of the arguments of a single command. Anything longer is not
+ * something a person typed.
+ */
+#define DAEMON_MAX_REQUEST (1024 * 1024)
+
+/**
+ * Seconds a client has to send its command once connected, so that a stuck
+ * client does not keep everyone else waiting.
+ */
+#define DAEMON_REQUEST_TIMEOUT 5
+
+/**
+ * stdin, stdout and stderr, in that order.
+ */
+#define DAEMON_NFDS 3
+
+#ifdef MSG_NOSIGNAL
+#define DAEMON_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define DAEMON_SEND_FLAGS 0
+#endif
+
+/**
+ * Sent back to the client once the command finished. code is DAEMON_OK if
+ * the command ran and status is its exit status.
+ */
+typedef struct DaemonReply {
+    int32_t code;
+    int32_t status;
+} DaemonReply;
+
+/**
+ * Watches the client of the running command for an interrupt until woken
+ * through wake.
+ */
+typedef struct DaemonWatch {
+    int client;
+    int wake[2];
+    DaemonInterruptFn interrupt;
+} DaemonWatch;
+
+static volatile sig_atomic_t stopping = 0;
+static volatile sig_atomic_t stop_fd = -1;
+static volatile sig_atomic_t call_fd = -1;
+
+/**
+ * Fills in addr with the socket at path.
+ *
+ * Returns DAEMON_OK or DAEMON_ENAMETOOLONG.
+ */
+static int daemon_addr(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    int n = snprintf(addr->sun_path, ARRAY_SIZE(addr->sun_path), "%s", path);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(addr->sun_path)) {
+        return DAEMON_ENAMETOOLONG;
+    }
+
+    return DAEMON_OK;
+}
+
+/**
+ * Creates a socket that is not inherited by programs that commands run.
+ *
+ * Returns the socket or -1 on error.
+ */
+static int daemon_socket(void)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    return fd;
+}
+
+/**
+ * Reads exactly n bytes from fd, retrying when a signal interrupts the read.
+ *
+ * Returns 0 on success, -1 on error or if the other side closed the
+ * connection first.
+ */
+static int daemon_read(int fd, void *buf, size_t n)
+{
+    char *p = buf;
+    while (n > 0) {
+        ssize_t r = recv(fd, p, n, 0);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        } else if (r <= 0) {
+            return -1;
+        }
+
+        p += r;
+        n -= (size_t)r;
+    }
+
+    return 0;
+}
+
+/**
+ * Writes all n bytes of buf to fd, retrying when a signal interrupts the
+ * write.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int daemon_write(int fd, const void *buf, size_t n)
+{
+    const char *p = buf;
+    while (n > 0) {
+        ssize_t w = send(fd, p, n, DAEMON_SEND_FLAGS);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        } else if (w < 0) {
+            return -1;
+        }
+
+        p += w;
+        n -= (size_t)w;
+    }
+
+    return 0;
+}
+
+/**
+ * Reads the length of a request along with the descriptors that came with it
+ * and stores them in len and fds.
+ *
+ * Returns 0 on success, -1 if the request is not a valid one. Descriptors are
+ * never left open on error.
+ */
+static int daemon_recv_header(int fd, uint32_t *len, int fds[DAEMON_NFDS])
+{
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * DAEMON_NFDS)];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = { .iov_base = len, .iov_len = sizeof(*len) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t r;
+    do {
+        r = recvmsg(fd, &msg, 0);
+    } while (r < 0 && errno == EINTR);
+
+    size_t nfds = 0;
+    for (struct cmsghdr *c = r > 0 ? CMSG_FIRSTHDR(&msg) : NULL; c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+
+        size_t n = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < n; i++) {
+            int received;
+            memcpy(&received, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+            if (nfds < DAEMON_NFDS) {
+                fds[nfds++] = received;
+                fcntl(received, F_SETFD, FD_CLOEXEC);
+            } else {
+                close(received);
+            }
+        }
+    }
+
+    // The rest of the length may come separately.
+    if (r <= 0 || (msg.msg_flags & MSG_CTRUNC) || nfds != DAEMON_NFDS || daemon_read(fd, (char *)len + r, sizeof(*len) - (size_t)r) != 0) {
+        for (size_t i = 0; i < nfds; i++) {
+            close(fds[i]);
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Splits the arguments of a request of len bytes in buf, each one ending with
+ * a null character, and stores them in argv, which the caller shall free, and
+ * their amount in argc.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int daemon_split_args(char *buf, size_t len, int *argc, const char ***argv)
+{
+    if (len == 0 || buf[len - 1] != '\0') {
+        return -1;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        n += buf[i] == '\0';
+    }
+
+    const char **args = calloc(n + 1, sizeof(*args));
+    if (args == NULL) {
+        return -1;
+    }
+
+    char *s = buf;
+    for (size_t i = 0; i < n; i++) {
+        args[i] = s;
+        s += strlen(s) + 1;
+    }
+
+    *argc = (int)n;
+    *argv = args;
+
+    return 0;
+}
+
+static void daemon_watch(void *arg)
+{
+    DaemonWatch *w = arg;
+
+    struct pollfd fds[2] = {
+        { .fd = w->wake[0], .events = POLLIN },
+        { .fd = w->client, .events = POLLIN },
+    };
+    nfds_t nfds = 2;
+
+    for (;;) {
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (fds[0].revents != 0) {
+            break;
+        }
+
+        // The client was interrupted or went away. Either way nobody is left
+        // waiting for the command, so only wait to be woken from now on.
+        if (fds[1].revents != 0) {
+            w->interrupt();
+            nfds = 1;
+        }
+    }
+}
+
+/**
+ * Runs the command that the client connected on fd sends with the client's
+ * stdin, stdout and stderr. saved are the descriptors of the daemon that are
+ * put back once the command is done.
+ */
+static void daemon_handle(int fd, const int saved[DAEMON_NFDS], DaemonFn fn, DaemonInterruptFn interrupt, void *arg)
+{
+    DaemonReply reply = { .code = DAEMON_OK, .status = 1 };
+    int fds[DAEMON_NFDS];
+    uint32_t len = 0;
+    char *buf = NULL;
+    const char **argv = NULL;
+    int argc = 0;
+
+    struct timeval timeout = { .tv_sec = DAEMON_REQUEST_TIMEOUT };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (daemon_recv_header(fd, &len, fds) != 0) {
+        return;
+    }
+
+    if (len == 0 || len > DAEMON_MAX_REQUEST || (buf = malloc(len)) == NULL || daemon_read(fd, buf, len) != 0) {
+        goto cleanup;
+    }
+
+    // The first argument is the version of the client.
+    if (daemon_split_args(buf, len, &argc, &argv) != 0 || argc < 1) {
+        goto cleanup;
+    } else if (strcmp(argv[0], WOWPKG_VERSION) != 0) {
+        reply.code = DAEMON_EMISMATCH;
+        daemon_write(fd, &reply, sizeof(reply));
+        goto cleanup;
+    }
+
+    timeout.tv_sec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    DaemonWatch watch = { .client = fd, .interrupt = interrupt };
+    OsThread thread;
+    bool watching = interrupt != NULL && pipe(watch.wake) == 0;
+    if (watching && os_thread_create(&thread, daemon_watch, &watch) != 0) {
+        close(watch.wake[0]);
+        close(watch.wake[1]);
+        watching = false;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < DAEMON_NFDS; i++) {
+        dup2(fds[i], i);
+    }
+
+    // In place of the program name the client sent its version.
+    argv[0] = WOWPKG_NAME;
+    reply.status = fn(argc, argv, arg);
+
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < DAEMON_NFDS; i++) {
+        dup2(saved[i], i);
+    }
+    clearerr(stdin);
+    clearerr(stdout);
+    clearerr(stderr);
+
+    if (watching) {
+        char c = 0;
+        while (write(watch.wake[1], &c, 1) < 0 && errno == EINTR) {
+        }
+        os_thread_join(thread);
+        close(watch.wake[0]);
+        close(watch.wake[1]);
+    }
+
+    daemon_write(fd, &reply, sizeof(reply));
+
+cleanup:
+    for (int i = 0; i < DAEMON_NFDS; i++) {
+        close(fds[i]);
+    }
+    free(argv);
+    free(buf);
+}
+
+/**
+ * Checks if a daemon is listening on the socket at addr and removes the socket
+ * if it was left behind by one that is gone.
+ *
+ * Returns DAEMON_OK if the socket can be created, otherwise DAEMON_ERUNNING.
+ */
+static int daemon_claim(const struct sockaddr_un *addr)
+{
+    int fd = daemon_socket();
+    if (fd < 0) {
+        return DAEMON_EIO;
+    }
+
+    int err = DAEMON_OK;
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) == 0) {
+        err = DAEMON_ERUNNING;
+    } else if (errno == ECONNREFUSED) {
+        unlink(addr->sun_path);
+    }
+
+    close(fd);
+
+    return err;
+}
+
+int daemon_serve(const char *path, DaemonFn fn, DaemonInterruptFn interrupt, void *arg)
+{
+    struct sockaddr_un addr;
+    int err = daemon_addr(&addr, path);
+    if (err != DAEMON_OK) {
+        return err;
+    }
+
+    err = daemon_claim(&addr);
+    if (err != DAEMON_OK) {
+        return err;
+    }
+
+    int listener = -1;
+    int stop[2] = { -1, -1 };
+    int saved[DAEMON_NFDS] = { -1, -1, -1 };
+    bool bound = false;
+
+    for (int i = 0; i < DAEMON_NFDS; i++) {
+        saved[i] = dup(i);
+        if (saved[i] < 0) {
+            err = DAEMON_EIO;
+            goto cleanup;
+        }
+        fcntl(saved[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    if (pipe(stop) != 0) {
+        err = DAEMON_EIO;
+        goto cleanup;
+    }
+    fcntl(stop[0], F_SETFD, FD_CLOEXEC);
+    fcntl(stop[1], F_SETFD, FD_CLOEXEC);
+
+    listener = daemon_socket();
+    if (listener < 0) {
+        err = DAEMON_EIO;
+        goto cleanup;
+    }
+
+    // Only the user that started the daemon may connect.
+    mode_t mask = umask(0077);
+    int bind_err = bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+
+    if (bind_err != 0) {
+        err = errno == EADDRINUSE ? DAEMON_ERUNNING : DAEMON_EIO;
+        goto cleanup;
+    }
+    bound = true;
+
+    if (listen(listener, SOMAXCONN) != 0) {
+        err = DAEMON_EIO;
+        goto cleanup;
+    }
+
+    // Writing to a client that went away shall fail the write, not end the
+    // daemon. Every command sees what it printed line by line, and nothing a
+    // client sent is left buffered for the next one.
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdin, NULL, _IONBF, 0);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    stopping = 0;
+    stop_fd = stop[1];
+
+    while (!stopping) {
+        struct pollfd fds[2] = {
+            { .fd = stop[0], .events = POLLIN },
+            { .fd = listener, .events = POLLIN },
+        };
+
+        if (poll(fds, ARRAY_SIZE(fds), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            err = DAEMON_EIO;
+            break;
+        } else if (fds[0].revents != 0) {
+            break;
+        } else if (fds[1].revents == 0) {
+            continue;
+        }
+
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        fcntl(client, F_SETFD, FD_CLOEXEC);
+
+        daemon_handle(client, saved, fn, interrupt, arg);
+        close(client);
+    }
+
+    stop_fd = -1;
+
+cleanup:
+    if (bound) {
+        unlink(addr.sun_path);
+    }
+    if (listener >= 0) {
+        close(listener);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (stop[i] >= 0) {
+            close(stop[i]);
+        }
+    }
+    for (int i = 0; i < DAEMON_NFDS; i++) {
+        if (saved[i] >= 0) {
+            close(saved[i]);
+        }
+    }
+
+    return err;
+}
+
+void daemon_stop(void)
+{
+    stopping = 1;
+
+    // Wakes up the daemon if it is waiting for a client.
+    int fd = stop_fd;
+    if (fd >= 0) {
+        char c = 0;
+        ssize_t w = write(fd, &c, 1);
+        (void)w;
+    }
+}
+
+int daemon_call(const char *path, int argc, const char *argv[], int *status)
+{
+    struct sockaddr_un addr;
+    int err = daemon_addr(&addr, path);
+    if (err != DAEMON_OK) {
+        return err;
+    }
+
+    int fd = daemon_socket();
+    if (fd < 0) {
+        return DAEMON_ENOENT;
+    }
+
+    char *buf = NULL;
+
+    // Nothing ran unless the daemon accepted the connection.
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        err = DAEMON_ENOENT;
+        goto cleanup;
+    }
+
+    // The version of the client takes the place of the program name.
+    size_t len = strlen(WOWPKG_VERSION) + 1;
+    for (int i = 1; i < argc; i++) {
+        len += strlen(argv[i]) + 1;
+    }
+
+    if (len > DAEMON_MAX_REQUEST) {
+        err = DAEMON_EIO;
+        goto cleanup;
+    }
+
+    buf = malloc(len);
+    if (buf == NULL) {
+        err = DAEMON_EIO;
+        goto cleanup;
+    }
+
+    char *p = buf;
+    for (int i = 0; i < argc; i++) {
+        const char *s = i == 0 ? WOWPKG_VERSION : argv[i];
+        size_t n = strlen(s) + 1;
+        memcpy(p, s, n);
+        p += n;
+    }
+
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * DAEMON_NFDS)];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    uint32_t header = (uint32_t)len;
+    struct iovec iov = { .iov_base = &header, .iov_len = sizeof(header) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int) * DAEMON_NFDS);
+    int fds[DAEMON_NFDS] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+    ssize_t w;
+    do {
+        w = sendmsg(fd, &msg, DAEMON_SEND_FLAGS);
+    } while (w < 0 && errno == EINTR);
+
+    if (w < 0) {
+        // The fds could not be passed, so nothing ran.
+        err = DAEMON_ENOENT;
+        goto cleanup;
+    } else if (daemon_write(fd, (char *)&header + w, sizeof(header) - (size_t)w) != 0 || daemon_write(fd, buf, len) != 0) {
+        err = DAEMON_EIO;
+        goto cleanup;
+    }
+
+    call_fd = fd;
+
+    DaemonReply reply;
+    int read_err = daemon_read(fd, &reply, sizeof(reply));
+
+    call_fd = -1;
+
+    if (read_err != 0) {
+        err = DAEMON_EIO;
+    } else if (reply.code != DAEMON_OK) {
+        err = DAEMON_EMISMATCH;
+    } else {
+        *status = reply.status;
+    }
+
+cleanup:
+    free(buf);
+    close(fd);
+
+    return err;
+}
+
+void daemon_interrupt(void)
+{
+    int fd = call_fd;
+    if (fd >= 0) {
+        char c = 0;
+        ssize_t w = send(fd, &c, 1, DAEMON_SEND_FLAGS);
+        (void)w;
+    }
+}
+
+#else
+
+int daemon_serve(const char *path, DaemonFn fn, DaemonInterruptFn interrupt, void *arg)
+{
+    UNUSED(path);
+    UNUSED(fn);
+    UNUSED(interrupt);
+    UNUSED(arg);
+
+    return DAEMON_EUNSUPPORTED;
+}
+
+void daemon_stop(void)
+{
+}
+
+int daemon_call(const char *path, int argc, const char *argv[], int *status)
+{
+    UNUSED(path);
+    UNUSED(argc);
+    UNUSED(argv);
+    UNUSED(status);
+
+    return DAEMON_EUNSUPPORTED;
+}
+
+void daemon_interrupt(void)
+{
+}
+
+#endif
@@ -0,0 +1,69 @@
+#pragma once
+
+/**
+ * Lets a long running process run the commands of other invocations of the
+ * program, so that they do not have to load everything again.
+ *
+ * The daemon listens on a Unix domain socket. A client sends its arguments
+ * together with its stdin, stdout and stderr, so everything the command prints
+ * goes straight to the client, and then waits for the exit status of the
+ * command. Commands run one at a time in the order they arrive.
+ *
+ * The socket is only accessible to the user that started the daemon. Not
+ * supported on Windows.
+ */
+
+enum {
+    DAEMON_OK = 0,
+
+    DAEMON_ENOENT, // No daemon is listening on the socket.
+    DAEMON_ERUNNING, // Another daemon is already listening on the socket.
+    DAEMON_EMISMATCH, // The daemon is another version of the program.
+    DAEMON_EIO, // Connection failed or was lost.
+    DAEMON_ENAMETOOLONG,
+    DAEMON_EUNSUPPORTED,
+};
+
+/**
+ * Runs a command for a client. stdin, stdout and stderr are the ones of the
+ * client while it runs.
+ *
+ * Returns the exit status of the command.
+ */
+typedef int (*DaemonFn)(int argc, const char *argv[], void *arg);
+
+/**
+ * Called from another thread when the client of the running command was
+ * interrupted or went away.
+ */
+typedef void (*DaemonInterruptFn)(void);
+
+/**
+ * Listens on the socket at path and calls fn for every client until
+ * daemon_stop is called. A socket left behind by a daemon that is no longer
+ * running is replaced, and the socket is removed again on return.
+ *
+ * Returns DAEMON_OK once stopped, otherwise one of the DAEMON_E values.
+ */
+int daemon_serve(const char *path, DaemonFn fn, DaemonInterruptFn interrupt, void *arg);
+
+/**
+ * Makes daemon_serve return after the command that is running, if any. Only
+ * sets a flag, so it is safe to call from a signal handler.
+ */
+void daemon_stop(void);
+
+/**
+ * Runs the command in argv on the daemon listening on the socket at path and
+ * stores its exit status in status.
+ *
+ * Returns DAEMON_OK if the command ran. DAEMON_ENOENT and DAEMON_EMISMATCH
+ * mean that nothing was run. On any other error the command may have run.
+ */
+int daemon_call(const char *path, int argc, const char *argv[], int *status);
+
+/**
+ * Tells the daemon that the command started by daemon_call shall stop early,
+ * as if Ctrl-C was pressed in the daemon. Safe to call from a signal handler.
+ */
+void daemon_interrupt(void);
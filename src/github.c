@@ -0,0 +1,266 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "github.h"
+#include "osstring.h"
+#include "wowpkg.h"
+
+#define GITHUB_REPOS_PATH "/repos/"
+#define GITHUB_WEB_HOST "github.com/"
+
+/**
+ * Query for a single repository. Each repository gets an alias of r<index> so
+ * that results can be matched back to the request.
+ */
+#define GITHUB_GRAPHQL_REPO_FMT                      \
+    "r%zu:repository(owner:\"%s\",name:\"%s\"){" \
+    "latestRelease{tagName releaseAssets(first:100){nodes{contentType downloadUrl}}}}"
+
+/**
+ * GitHub owner and repository names only contain ASCII letters, digits, '-',
+ * '_', and '.'. Since names are inserted into the query text anything else is
+ * rejected.
+ */
+static bool github_is_name_ch(int ch)
+{
+    return isalnum(ch) || ch == '-' || ch == '_' || ch == '.';
+}
+
+/**
+ * Copies the path segment starting at src into dst. Returns a pointer to the
+ * character that ended the segment, NULL if the segment is empty, too long, or
+ * has invalid characters.
+ */
+static const char *copy_name_segment(char *dst, size_t n, const char *src)
+{
+    size_t len = 0;
+    while (src[len] != '\0' && src[len] != '/') {
+        if (!github_is_name_ch((unsigned char)src[len]) || len + 1 >= n) {
+            return NULL;
+        }
+
+        dst[len] = src[len];
+        len++;
+    }
+
+    if (len == 0) {
+        return NULL;
+    }
+
+    dst[len] = '\0';
+
+    return &src[len];
+}
+
+static bool json_check_string(const cJSON *value)
+{
+    return cJSON_IsString(value) && value->valuestring != NULL;
+}
+
+int github_repo_from_url(GitHubRepo *repo, const char *url)
+{
+    const char *p = strstr(url, GITHUB_REPOS_PATH);
+    if (p == NULL) {
+        return -1;
+    }
+
+    p += strlen(GITHUB_REPOS_PATH);
+
+    p = copy_name_segment(repo->owner, ARRAY_SIZE(repo->owner), p);
+    if (p == NULL || *p != '/') {
+        return -1;
+    }
+
+    p = copy_name_segment(repo->name, ARRAY_SIZE(repo->name), p + 1);
+    if (p == NULL || strcmp(p, "/releases/latest") != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int github_repo_from_web_url(GitHubRepo *repo, const char *url)
+{
+    // The host, not a path that happens to contain it.
+    size_t host_len = strlen(GITHUB_WEB_HOST);
+    const char *p = url;
+    while (*p != '\0' && (strncasecmp(p, GITHUB_WEB_HOST, host_len) != 0 || (p != url && p[-1] != '/' && p[-1] != '.'))) {
+        p++;
+    }
+
+    if (*p == '\0') {
+        return -1;
+    }
+
+    p += host_len;
+
+    p = copy_name_segment(repo->owner, ARRAY_SIZE(repo->owner), p);
+    if (p == NULL || *p != '/') {
+        return -1;
+    }
+
+    // The repository may be followed by a path, a query or a fragment.
+    p++;
+    size_t len = 0;
+    while (github_is_name_ch((unsigned char)p[len])) {
+        len++;
+    }
+
+    if (len >= 4 && strncasecmp(&p[len - 4], ".git", 4) == 0) {
+        len -= 4;
+    }
+
+    if (len == 0 || len >= ARRAY_SIZE(repo->name) || (p[len] != '\0' && p[len] != '/' && p[len] != '?' && p[len] != '#' && strcasecmp(&p[len], ".git") != 0)) {
+        return -1;
+    }
+
+    memcpy(repo->name, p, len);
+    repo->name[len] = '\0';
+
+    return 0;
+}
+
+int sngithub_graphql_url(char *s, size_t n, const char *url)
+{
+    const char *p = strstr(url, GITHUB_REPOS_PATH);
+    if (p == NULL) {
+        return -1;
+    }
+
+    return snprintf(s, n, "%.*s/graphql", (int)(p - url), url);
+}
+
+int sngithub_rebase_url(char *s, size_t n, const char *url, const char *api_url)
+{
+    const char *p = strstr(url, GITHUB_REPOS_PATH);
+    if (p == NULL) {
+        return -1;
+    }
+
+    // Avoid a double separator when api_url ends with one.
+    size_t len = strlen(api_url);
+    if (len > 0 && api_url[len - 1] == '/') {
+        len--;
+    }
+
+    return snprintf(s, n, "%.*s%s", (int)len, api_url, p);
+}
+
+int sngithub_auth_header(char *s, size_t n, const char *token)
+{
+    return snprintf(s, n, "Authorization: Bearer %s", token);
+}
+
+char *github_graphql_latest_releases_body(const GitHubRepo *repos, size_t n)
+{
+    if (n > GITHUB_GRAPHQL_MAX_BATCH) {
+        return NULL;
+    }
+
+    size_t cap = 16;
+    for (size_t i = 0; i < n; i++) {
+        cap += strlen(GITHUB_GRAPHQL_REPO_FMT) + strlen(repos[i].owner) + strlen(repos[i].name) + 20;
+    }
+
+    char *query = malloc(cap);
+    if (query == NULL) {
+        return NULL;
+    }
+
+    size_t len = (size_t)snprintf(query, cap, "query{");
+    for (size_t i = 0; i < n; i++) {
+        len += (size_t)snprintf(&query[len], cap - len, GITHUB_GRAPHQL_REPO_FMT, i, repos[i].owner, repos[i].name);
+    }
+    snprintf(&query[len], cap - len, "}");
+
+    char *result = NULL;
+    cJSON *body = cJSON_CreateObject();
+    if (body != NULL && cJSON_AddStringToObject(body, "query", query) != NULL) {
+        result = cJSON_PrintUnformatted(body);
+    }
+
+    cJSON_Delete(body);
+    free(query);
+
+    return result;
+}
+
+/**
+ * Converts one repository object of the GraphQL response to addon metadata.
+ * Returns NULL if the repository has no release with a .zip asset.
+ */
+static cJSON *github_graphql_release_meta(const cJSON *repository)
+{
+    cJSON *release = cJSON_GetObjectItemCaseSensitive(repository, "latestRelease");
+    cJSON *tag_name = cJSON_GetObjectItemCaseSensitive(release, "tagName");
+    if (!json_check_string(tag_name)) {
+        return NULL;
+    }
+
+    // Same as the REST response, the last .zip asset is the one used.
+    const char *zip_url = NULL;
+    cJSON *assets = cJSON_GetObjectItemCaseSensitive(release, "releaseAssets");
+    cJSON *nodes = cJSON_GetObjectItemCaseSensitive(assets, "nodes");
+    cJSON *asset = NULL;
+    cJSON_ArrayForEach(asset, nodes)
+    {
+        cJSON *content_type = cJSON_GetObjectItemCaseSensitive(asset, "contentType");
+        cJSON *download_url = cJSON_GetObjectItemCaseSensitive(asset, "downloadUrl");
+        if (!json_check_string(content_type) || !json_check_string(download_url)) {
+            continue;
+        }
+
+        if (strcmp(content_type->valuestring, "application/zip") == 0) {
+            zip_url = download_url->valuestring;
+        }
+    }
+
+    if (zip_url == NULL) {
+        return NULL;
+    }
+
+    cJSON *result = cJSON_CreateObject();
+    if (result == NULL
+        || cJSON_AddStringToObject(result, "version", tag_name->valuestring) == NULL
+        || cJSON_AddStringToObject(result, "url", zip_url) == NULL) {
+
+        cJSON_Delete(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+int github_graphql_parse_latest_releases(const char *resp, cJSON **out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = NULL;
+    }
+
+    cJSON *json = cJSON_Parse(resp);
+    if (json == NULL) {
+        return -1;
+    }
+
+    cJSON *data = cJSON_GetObjectItemCaseSensitive(json, "data");
+    if (!cJSON_IsObject(data)) {
+        cJSON_Delete(json);
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        char alias[32];
+        snprintf(alias, ARRAY_SIZE(alias), "r%zu", i);
+
+        cJSON *repository = cJSON_GetObjectItemCaseSensitive(data, alias);
+        if (cJSON_IsObject(repository)) {
+            out[i] = github_graphql_release_meta(repository);
+        }
+    }
+
+    cJSON_Delete(json);
+
+    return 0;
+}
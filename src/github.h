@@ -0,0 +1,97 @@
+/**
+ * Helpers for talking to the GitHub API that do not make any requests
+ * themselves. Builds the batched GraphQL query for the latest release of many
+ * repositories and parses its response.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <cjson/cJSON.h>
+
+/**
+ * GitHub limits owner and repository names to 100 characters.
+ */
+#define GITHUB_MAX_NAME 101
+
+/**
+ * Maximum amount of repositories that will be asked for in one GraphQL
+ * request.
+ */
+#define GITHUB_GRAPHQL_MAX_BATCH 100
+
+/**
+ * Size of a buffer that fits an Authorization header with any token that can
+ * be read from the config file.
+ */
+#define GITHUB_MAX_AUTH_HEADER 1024
+
+typedef struct GitHubRepo {
+    char owner[GITHUB_MAX_NAME];
+    char name[GITHUB_MAX_NAME];
+} GitHubRepo;
+
+/**
+ * Parses the owner and repository name from a catalog url in the form
+ * '<base>/repos/{owner}/{repo}/releases/latest'.
+ *
+ * Returns 0 on success, -1 if the url is not in the expected form or contains
+ * characters that are not valid in GitHub names.
+ */
+int github_repo_from_url(GitHubRepo *repo, const char *url);
+
+/**
+ * Parses the owner and repository name from the url of a repository on the
+ * GitHub website, such as 'https://github.com/{owner}/{repo}' or the same with
+ * '.git' or a path after it.
+ *
+ * Returns 0 on success, -1 if the url is not in the expected form or contains
+ * characters that are not valid in GitHub names.
+ */
+int github_repo_from_web_url(GitHubRepo *repo, const char *url);
+
+/**
+ * Creates the GraphQL endpoint that belongs to the same API as the catalog url.
+ * For 'https://api.github.com/repos/...' this is 'https://api.github.com/graphql'.
+ *
+ * Has similar semantics as snprintf(3). Returns -1 if url is not a catalog url.
+ */
+int sngithub_graphql_url(char *s, size_t n, const char *url);
+
+/**
+ * Replaces the API part of a catalog url, everything before '/repos/', with
+ * api_url. Used to point the program at another server, such as a GitHub
+ * Enterprise instance or a local mock server.
+ *
+ * Has similar semantics as snprintf(3). Returns -1 if url is not a catalog url.
+ */
+int sngithub_rebase_url(char *s, size_t n, const char *url, const char *api_url);
+
+/**
+ * Creates the header line that authenticates requests with token.
+ *
+ * Has similar semantics as snprintf(3).
+ */
+int sngithub_auth_header(char *s, size_t n, const char *token);
+
+/**
+ * Creates the JSON request body that asks for the latest release of every given
+ * repository. n shall not be larger than GITHUB_GRAPHQL_MAX_BATCH.
+ *
+ * Returns a string that shall be freed by the caller, NULL on error.
+ */
+char *github_graphql_latest_releases_body(const GitHubRepo *repos, size_t n);
+
+/**
+ * Parses a response to the request created by github_graphql_latest_releases_body.
+ *
+ * For each of the n repositories, out[i] is set to an object with 'version' and
+ * 'url' properties, the same as addon_fetch_github_meta returns. If the
+ * response has no usable release for a repository then out[i] is set to NULL.
+ * Each non NULL out[i] shall be freed by the caller with cJSON_Delete.
+ *
+ * Returns 0 on success, -1 if the response could not be parsed at all. On error
+ * every out[i] is NULL.
+ */
+int github_graphql_parse_latest_releases(const char *resp, cJSON **out, size_t n);
@@ -0,0 +1,269 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <cjson/cJSON.h>
+
+#include "lockfile.h"
+#include "osapi.h"
+#include "osstring.h"
+#include "wowpkg.h"
+
+#define LOCKFILE_ADDONS "addons"
+
+static void lock_entry_clear(LockEntry *e)
+{
+    free(e->name);
+    free(e->version);
+    free(e->url);
+}
+
+Lockfile *lockfile_create(void)
+{
+    return calloc(1, sizeof(Lockfile));
+}
+
+void lockfile_free(Lockfile *lock)
+{
+    if (lock == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < lock->n; i++) {
+        lock_entry_clear(&lock->entries[i]);
+    }
+
+    free(lock->entries);
+    free(lock);
+}
+
+int lockfile_add(Lockfile *lock, const char *name, const char *version, const char *url, long long size, const char *sha256)
+{
+    if (lockfile_find(lock, name) != NULL) {
+        return LOCKFILE_EEXIST;
+    }
+
+    if (strlen(sha256) != SHA256_HEX_SIZE - 1 || size < 0) {
+        return LOCKFILE_EPARSE;
+    }
+
+    for (const char *c = sha256; *c != '\0'; c++) {
+        if (!isxdigit((unsigned char)*c)) {
+            return LOCKFILE_EPARSE;
+        }
+    }
+
+    if (lock->n == lock->cap) {
+        size_t cap = lock->cap == 0 ? 16 : lock->cap * 2;
+        LockEntry *grown = realloc(lock->entries, sizeof(*grown) * cap);
+        if (grown == NULL) {
+            return LOCKFILE_ENOMEM;
+        }
+        lock->entries = grown;
+        lock->cap = cap;
+    }
+
+    LockEntry *e = &lock->entries[lock->n];
+    e->name = strdup(name);
+    e->version = strdup(version);
+    e->url = strdup(url);
+    e->size = size;
+
+    if (e->name == NULL || e->version == NULL || e->url == NULL) {
+        lock_entry_clear(e);
+        return LOCKFILE_ENOMEM;
+    }
+
+    for (size_t i = 0; i < SHA256_HEX_SIZE; i++) {
+        e->sha256[i] = (char)tolower((unsigned char)sha256[i]);
+    }
+
+    lock->n++;
+
+    return LOCKFILE_OK;
+}
+
+const LockEntry *lockfile_find(const Lockfile *lock, const char *name)
+{
+    for (size_t i = 0; i < lock->n; i++) {
+        if (strcasecmp(lock->entries[i].name, name) == 0) {
+            return &lock->entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int cmp_entry_ptr(const void *a, const void *b)
+{
+    const LockEntry *aa = *(const LockEntry *const *)a;
+    const LockEntry *bb = *(const LockEntry *const *)b;
+
+    return strcasecmp(aa->name, bb->name);
+}
+
+/**
+ * Returns e as a JSON object on a single line that the caller shall free, or
+ * NULL if memory could not be allocated.
+ */
+static char *lock_entry_to_json(const LockEntry *e)
+{
+    char *result = NULL;
+
+    cJSON *json = cJSON_CreateObject();
+    if (json != NULL && cJSON_AddStringToObject(json, "name", e->name) != NULL
+        && cJSON_AddStringToObject(json, "version", e->version) != NULL
+        && cJSON_AddStringToObject(json, "url", e->url) != NULL
+        && cJSON_AddNumberToObject(json, "size", (double)e->size) != NULL
+        && cJSON_AddStringToObject(json, "sha256", e->sha256) != NULL) {
+        result = cJSON_PrintUnformatted(json);
+    }
+
+    cJSON_Delete(json);
+
+    return result;
+}
+
+int lockfile_save(const Lockfile *lock, const char *path)
+{
+    int err = LOCKFILE_OK;
+
+    const LockEntry **sorted = malloc(sizeof(*sorted) * (lock->n + 1));
+    if (sorted == NULL) {
+        return LOCKFILE_ENOMEM;
+    }
+
+    for (size_t i = 0; i < lock->n; i++) {
+        sorted[i] = &lock->entries[i];
+    }
+    qsort(sorted, lock->n, sizeof(*sorted), cmp_entry_ptr);
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        free(sorted);
+        return errno == ENOENT ? LOCKFILE_ENOENT : LOCKFILE_EIO;
+    }
+
+    fprintf(f, "{\n\"" LOCKFILE_ADDONS "\": [\n");
+
+    for (size_t i = 0; i < lock->n; i++) {
+        char *line = lock_entry_to_json(sorted[i]);
+        if (line == NULL) {
+            err = LOCKFILE_ENOMEM;
+            break;
+        }
+
+        fprintf(f, "    %s%s\n", line, i + 1 < lock->n ? "," : "");
+        free(line);
+    }
+
+    fprintf(f, "]\n}\n");
+
+    if (ferror(f) && err == LOCKFILE_OK) {
+        err = LOCKFILE_EIO;
+    }
+
+    if (fclose(f) != 0 && err == LOCKFILE_OK) {
+        err = LOCKFILE_EIO;
+    }
+
+    free(sorted);
+
+    if (err != LOCKFILE_OK) {
+        remove(path);
+    }
+
+    return err;
+}
+
+/**
+ * Adds the addon in json, an element of the addons array, to lock.
+ */
+static int lock_add_json(Lockfile *lock, const cJSON *json)
+{
+    const cJSON *name = cJSON_GetObjectItemCaseSensitive(json, "name");
+    const cJSON *version = cJSON_GetObjectItemCaseSensitive(json, "version");
+    const cJSON *url = cJSON_GetObjectItemCaseSensitive(json, "url");
+    const cJSON *size = cJSON_GetObjectItemCaseSensitive(json, "size");
+    const cJSON *sha256 = cJSON_GetObjectItemCaseSensitive(json, "sha256");
+
+    if (!cJSON_IsString(name) || !cJSON_IsString(version) || !cJSON_IsString(url) || !cJSON_IsNumber(size) || !cJSON_IsString(sha256)
+        || name->valuestring == NULL || version->valuestring == NULL || url->valuestring == NULL || sha256->valuestring == NULL) {
+        return LOCKFILE_EPARSE;
+    }
+
+    return lockfile_add(lock, name->valuestring, version->valuestring, url->valuestring, (long long)size->valuedouble, sha256->valuestring);
+}
+
+int lockfile_load(Lockfile **out, const char *path)
+{
+    int err = LOCKFILE_OK;
+    char *buf = NULL;
+    cJSON *json = NULL;
+
+    Lockfile *lock = lockfile_create();
+    if (lock == NULL) {
+        return LOCKFILE_ENOMEM;
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        err = errno == ENOENT ? LOCKFILE_ENOENT : LOCKFILE_EIO;
+        goto error;
+    }
+
+    struct os_stat s;
+    if (os_stat(path, &s) != 0 || s.st_size < 0) {
+        err = LOCKFILE_EIO;
+        goto error;
+    }
+
+    size_t bufsz = (size_t)s.st_size;
+    buf = malloc(bufsz + 1);
+    if (buf == NULL) {
+        err = LOCKFILE_ENOMEM;
+        goto error;
+    }
+
+    if (fread(buf, 1, bufsz, f) != bufsz) {
+        err = LOCKFILE_EIO;
+        goto error;
+    }
+    buf[bufsz] = '\0';
+
+    json = cJSON_Parse(buf);
+    const cJSON *addons = cJSON_GetObjectItemCaseSensitive(json, LOCKFILE_ADDONS);
+    if (!cJSON_IsArray(addons)) {
+        err = LOCKFILE_EPARSE;
+        goto error;
+    }
+
+    const cJSON *addon = NULL;
+    cJSON_ArrayForEach(addon, addons)
+    {
+        err = lock_add_json(lock, addon);
+        if (err != LOCKFILE_OK) {
+            goto error;
+        }
+    }
+
+    cJSON_Delete(json);
+    free(buf);
+    fclose(f);
+
+    *out = lock;
+
+    return LOCKFILE_OK;
+
+error:
+    cJSON_Delete(json);
+    free(buf);
+    if (f != NULL) {
+        fclose(f);
+    }
+    lockfile_free(lock);
+
+    return err;
+}
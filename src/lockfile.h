@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "sha256.h"
+
+/**
+ * Pins the exact release of every addon of a flavor, so that sync can make the
+ * addons directory of another machine match it without asking GitHub for the
+ * latest releases.
+ *
+ * The file is a JSON object with an "addons" array of objects that have the
+ * name, the tag of the release as "version", the "url" of the .zip asset and
+ * its "size" and "sha256". Addons are written one per line and sorted by name
+ * so that lockfiles can be compared with diff.
+ */
+
+enum {
+    LOCKFILE_OK = 0,
+
+    LOCKFILE_ENOENT, // File does not exist.
+    LOCKFILE_EPARSE, // File is not a valid lockfile.
+    LOCKFILE_EEXIST, // An addon is in the lockfile twice.
+    LOCKFILE_EIO,
+    LOCKFILE_ENOMEM,
+};
+
+typedef struct LockEntry {
+    char *name;
+    char *version; // Tag of the release.
+    char *url; // Download of the .zip asset.
+    long long size;
+    char sha256[SHA256_HEX_SIZE]; // Lower case hex.
+} LockEntry;
+
+typedef struct Lockfile {
+    LockEntry *entries;
+    size_t n;
+    size_t cap;
+} Lockfile;
+
+/**
+ * Returns a new empty lockfile, or NULL if it could not be allocated.
+ */
+Lockfile *lockfile_create(void);
+
+/**
+ * Passing a NULL pointer will make this function return immediately with no
+ * action.
+ */
+void lockfile_free(Lockfile *lock);
+
+/**
+ * Adds a copy of the addon to lock. sha256 is a hex string of any case.
+ *
+ * Returns LOCKFILE_OK on success, LOCKFILE_EEXIST if lock already has an addon
+ * called name, LOCKFILE_EPARSE if sha256 is not a SHA-256 hash, otherwise
+ * LOCKFILE_ENOMEM.
+ */
+int lockfile_add(Lockfile *lock, const char *name, const char *version, const char *url, long long size, const char *sha256);
+
+/**
+ * Returns the entry of the addon called name, ignoring case, or NULL if lock
+ * does not have it.
+ */
+const LockEntry *lockfile_find(const Lockfile *lock, const char *name);
+
+/**
+ * Saves or loads the lockfile at path.
+ *
+ * Returns LOCKFILE_OK on success, otherwise one of the LOCKFILE_E values.
+ */
+int lockfile_save(const Lockfile *lock, const char *path);
+int lockfile_load(Lockfile **out, const char *path);
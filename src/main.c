@@ -1,11 +1,25 @@
+#include <ctype.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "addon.h"
+#include "batch.h"
 #include "command.h"
 #include "context.h"
+#include "daemon.h"
+#include "list.h"
+#include "manifest.h"
+#include "net.h"
 #include "osapi.h"
 #include "osstring.h"
+#include "search.h"
+#include "stats.h"
+#include "store.h"
+#include "threadpool.h"
+#include "transaction.h"
 #include "wowpkg.h"
+#include "zipper.h"
 
 /**
  * Determines if '.exe' should be appended to the program's name when trying to
@@ -17,21 +31,112 @@
 #define USE_EXE_EXT 0
 #endif
 
+typedef int (*CommandFn)(Context *ctx, int argc, const char *argv[], FILE *stream);
+
+/**
+ * Options that come before the command.
+ */
+typedef struct Options {
+    const char *trace_path;
+    const char *flavor_names[CONFIG_MAX_FLAVORS];
+    size_t nflavor_names;
+    long jobs;
+    bool fix_typos;
+    bool json;
+    bool stats;
+    bool no_daemon;
+} Options;
+
+/**
+ * Path of the program that is running, relative to the directory it is in,
+ * which is the working directory once main changed to it.
+ */
+static char program_path[OS_MAX_PATH];
+
+/**
+ * Identifies a version of a file, to find out if it changed since it was read.
+ */
+typedef struct FileStamp {
+    bool exists;
+    long long mtime;
+    long long size;
+} FileStamp;
+
+/**
+ * The context that commands run with along with everything it points to.
+ */
+typedef struct Session {
+    Context ctx;
+    ContextFlavor flavors[CONFIG_MAX_FLAVORS];
+
+    // Where the app state of each flavor is saved.
+    char state_paths[CONFIG_MAX_FLAVORS][OS_MAX_PATH];
+
+    // Where the manifest of the installed files of each flavor is saved.
+    char manifest_paths[CONFIG_MAX_FLAVORS][OS_MAX_PATH];
+
+    // Where the content store is when it is enabled.
+    char store_path[OS_MAX_PATH];
+
+    // Where the search index of the catalog is saved.
+    char search_index_path[OS_MAX_PATH];
+
+    // Where archives are downloaded to and kept.
+    char download_path[OS_MAX_PATH];
+
+    char config_path[OS_MAX_PATH];
+
+    // The config, the catalog and the app state of each flavor as they were
+    // when the session last read or wrote them.
+    FileStamp stamps[CONFIG_MAX_FLAVORS + 2];
+
+    // Held while a transaction of the flavor may be pending, see session_lock.
+    TransactionLock *locks[CONFIG_MAX_FLAVORS];
+
+    // Set while the commands of a batch run. What they change is saved once
+    // the batch is done, see session_flush.
+    bool batch;
+    unsigned dirty; // Bit f is set if the app state of flavor f changed.
+    bool prune; // Files of the content store may no longer be used.
+    bool prefetch; // Upgrades are prefetched once the command or the batch is done.
+} Session;
+
+/**
+ * Stops queued work and transfers in progress on the first Ctrl-C so that the
+ * command can finish cleanly. A second Ctrl-C terminates right away.
+ */
+static void on_interrupt(int sig)
+{
+    threadpool_interrupt();
+    net_abort();
+    signal(sig, SIG_DFL);
+}
+
+static void print_save_state_error(void)
+{
+    PRINT_ERROR("failed to save addon data\n");
+    PRINT_ERROR("this should never happen\n");
+    PRINT_ERROR("it is possible the saved addon data is no\n");
+    PRINT_ERROR("longer in sync with the addons directory\n");
+    PRINT_ERROR("\n");
+    PRINT_ERROR("re-running the last command may fix this\n");
+}
+
 /**
  * Attempts to save app state if err is 0. Otherwise does not attempt to write to disk.
  *
  * Returns -1 if the save fails, otherwise returns err.
  */
-static int try_save_state(Context *ctx, const char *path, int err)
+static int try_save_state(AppState *state, const char *path, int err)
 {
     if (err == 0) {
-        if (appstate_save(ctx->state, path) != APPSTATE_OK) {
-            PRINT_ERROR("failed to save addon data\n");
-            PRINT_ERROR("this should never happen\n");
-            PRINT_ERROR("it is possible the saved addon data is no\n");
-            PRINT_ERROR("longer in sync with the addons directory\n");
-            PRINT_ERROR("\n");
-            PRINT_ERROR("re-running the last command may fix this\n");
+        StatsTimer timer;
+        stats_start(&timer, STATS_SAVE, NULL);
+        int save_err = appstate_save(state, path);
+        stats_stop(&timer);
+
+        if (save_err != APPSTATE_OK) {
+            print_save_state_error();
             return -1;
         }
     }
@@ -39,6 +144,86 @@ static int try_save_state(Context *ctx, const char *path, int err)
     return err;
 }
 
+/**
+ * Saves the manifest of the installed files of flavor. It is only used to check
+ * the files later, so failing to save it does not fail the command.
+ */
+static void try_save_manifest(const ContextFlavor *flavor)
+{
+    StatsTimer timer;
+    stats_start(&timer, STATS_SAVE, NULL);
+    int err = manifest_save(flavor->state, flavor->manifest_path);
+    stats_stop(&timer);
+
+    if (err != MANIFEST_OK) {
+        PRINT_WARNING("failed to save the manifest of the installed files to %s\n", flavor->manifest_path);
+        PRINT_WARNING("'verify' and 'repair' will skip the addons that changed\n");
+    }
+}
+
+/**
+ * Saves app state of flavor for the addons that made it into its addons
+ * directory and then commits the transaction that moved them. If the state can
+ * not be saved then every addon is rolled back so that the addons directory
+ * still matches the saved state. Without a pending transaction this is
+ * try_save_state.
+ *
+ * Returns -1 if the save fails, otherwise returns err.
+ */
+static int try_commit_transaction(const ContextFlavor *flavor, const char *path, int err)
+{
+    const char *addons_path = flavor->addons_path;
+
+    if (!transaction_pending(addons_path)) {
+        return try_save_state(flavor->state, path, err);
+    }
+
+    // Renaming the new state over the old one is the commit point. If the
+    // program stops before that the transaction is rolled back, after that it
+    // is committed, see transaction_recover.
+    char tmp[OS_MAX_PATH];
+    int n = snprintf(tmp, ARRAY_SIZE(tmp), "%s" APPSTATE_TMP_EXT, path);
+    bool has_tmp = n >= 0 && (size_t)n < ARRAY_SIZE(tmp);
+
+    StatsTimer timer;
+    stats_start(&timer, STATS_SAVE, NULL);
+    bool saved = has_tmp && appstate_save_tmp(flavor->state, tmp) == APPSTATE_OK
+        && transaction_prepare(addons_path, tmp) == TRANSACTION_OK && os_rename(tmp, path) == 0;
+    stats_stop(&timer);
+
+    if (!saved) {
+        print_save_state_error();
+
+        if (transaction_rollback(addons_path) != TRANSACTION_OK) {
+            PRINT_ERROR("failed to restore the previous addons\n");
+            PRINT_ERROR("they will be restored the next time the program runs\n");
+        } else if (has_tmp) {
+            remove(tmp);
+        }
+
+        return -1;
+    }
+
+    try_save_manifest(flavor);
+
+    if (transaction_commit(addons_path) != TRANSACTION_OK) {
+        PRINT_WARNING("failed to remove backups of the previous addons in %s%c%s\n", addons_path, OS_SEPARATOR, TRANSACTION_DIR_NAME);
+    }
+
+    return err;
+}
+
+/**
+ * Deletes the files of the content store that no addon uses after a command
+ * replaced or removed addons.
+ */
+static void try_prune_store(const Context *ctx)
+{
+    if (ctx->store_path != NULL && store_prune(ctx->store_path, NULL) != STORE_OK) {
+        PRINT_WARNING("failed to remove unused files from the content store in %s\n", ctx->store_path);
+    }
+}
+
 /**
  * Attempts to change the directory to the path that contains the running
  * executable.
@@ -153,124 +338,1316 @@ static int snuser_file_path(char *s, size_t n, const char *filename)
 #endif
 }
 
-int main(int argc, const char *argv[])
+/**
+ * Gets the path to a file of a flavor, such as the saved addon data when base
+ * is "saved". Retail uses <base>.wowpkg, where the data was saved before there
+ * were other flavors, every other flavor uses <base>_<flavor>.wowpkg.
+ *
+ * Function has similar semantics as snuser_file_path.
+ */
+static int snflavor_file_path(char *s, size_t n, const char *base, const char *flavor)
 {
-    if (argc <= 1) {
-        fprintf(stderr, "Usage: wowpkg COMMAND [ARGS...]\n");
-        exit(1);
+    char filename[OS_MAX_FILENAME];
+    int len = strcasecmp(flavor, "retail") == 0 ? snprintf(filename, ARRAY_SIZE(filename), "%s.wowpkg", base) : snprintf(filename, ARRAY_SIZE(filename), "%s_%s.wowpkg", base, flavor);
+    if (len < 0 || (size_t)len >= ARRAY_SIZE(filename)) {
+        return len < 0 ? -1 : (int)n;
     }
 
-    if (chdir_to_executable_path(argv[0]) != 0) {
-        PRINT_ERROR("could not find program executable path\n");
-        exit(1);
+    // Flavor names are not case sensitive.
+    for (char *c = filename; *c; c++) {
+        *c = (char)tolower((unsigned char)*c);
     }
 
-    Context ctx;
-    memset(&ctx, 0, sizeof(ctx));
+    return snuser_file_path(s, n, filename);
+}
 
-    ctx.config = config_create();
-    ctx.state = appstate_create();
-    if (ctx.config == NULL || ctx.state == NULL) {
-        PRINT_ERROR("failed to allocate memory\n");
-        exit(1);
+/**
+ * Makes flavor f of ctx the one that commands that work on a single flavor use.
+ */
+static void select_flavor(Context *ctx, size_t f)
+{
+    ctx->state = ctx->flavors[f].state;
+    ctx->flavor = ctx->flavors[f].name;
+    ctx->manifest_path = ctx->flavors[f].manifest_path;
+    ctx->watch = ctx->flavors[f].watch;
+    config_select_flavor(ctx->config, ctx->flavors[f].name);
+}
+
+/**
+ * Saves the app state of flavor f of s if err is 0. In a batch it is only
+ * marked to be saved when the batch is done.
+ *
+ * Returns -1 if the save fails, otherwise returns err.
+ */
+static int session_save(Session *s, size_t f, int err)
+{
+    if (!s->batch) {
+        return try_save_state(s->flavors[f].state, s->state_paths[f], err);
     }
 
-    int err = 0;
-    int n;
+    if (err == 0) {
+        s->dirty |= 1u << f;
+    }
 
-    char config_path[OS_MAX_PATH];
-    n = snuser_file_path(config_path, ARRAY_SIZE(config_path), "config.ini");
-    if (n < 0) {
-        err = -1;
-        goto cleanup;
-    } else if ((size_t)n >= ARRAY_SIZE(config_path)) {
-        PRINT_ERROR("path to config file is too long\n");
-        err = -1;
-        goto cleanup;
+    return err;
+}
+
+/**
+ * Saves the manifest of every flavor of s after a command changed the files of
+ * addons, unless that waits for the end of a batch.
+ */
+static void session_save_manifests(Session *s)
+{
+    for (size_t f = 0; f < s->ctx.nflavors && !s->batch; f++) {
+        try_save_manifest(&s->flavors[f]);
     }
+}
 
-    if (config_load(ctx.config, config_path) != 0) {
-        PRINT_ERROR("failed to load user config file\n");
-        PRINT_ERROR("ensure file exists and has valid entries\n");
+/**
+ * Deletes the unused files of the content store, unless that waits for the end
+ * of a batch.
+ */
+static void session_prune(Session *s)
+{
+    if (s->batch) {
+        s->prune = true;
+    } else {
+        try_prune_store(&s->ctx);
+    }
+}
 
-        err = -1;
-        goto cleanup;
+/**
+ * Finishes the transaction that a program that stopped left pending in the
+ * addons directory of flavor. The lock of the addons directory shall be held.
+ * Errors are printed.
+ *
+ * Returns 0 on success, otherwise -1.
+ */
+static int recover_flavor(const ContextFlavor *flavor)
+{
+    bool committed;
+    if (transaction_recover(flavor->addons_path, &committed) != TRANSACTION_OK) {
+        PRINT_ERROR("found an install or upgrade that did not finish but\n");
+        PRINT_ERROR("failed to restore the previous addons\n");
+        PRINT_ERROR("check %s%c%s\n", flavor->addons_path, OS_SEPARATOR, TRANSACTION_DIR_NAME);
+        return -1;
+    } else if (!committed) {
+        PRINT_WARNING("restored the previous addons of an install or upgrade that did not finish\n");
     }
 
-    // Test that addon path actually exists and is a directory.
-    struct os_stat s;
-    if (os_stat(ctx.config->addons_path, &s) != 0 || !S_ISDIR(s.st_mode)) {
-        PRINT_ERROR("addons path from config file does not exist or\n");
-        PRINT_ERROR("is not a directory\n");
+    return 0;
+}
 
-        err = -1;
-        goto cleanup;
+/**
+ * Takes the lock of the addons directory of every flavor of s that it does not
+ * hold yet, before a command begins transactions in them, and recovers any
+ * transaction that was left pending. Errors are printed.
+ *
+ * Returns 0 on success, otherwise -1. Locks that were taken stay held either
+ * way until session_unlock.
+ */
+static int session_lock(Session *s)
+{
+    for (size_t f = 0; f < s->ctx.nflavors; f++) {
+        const ContextFlavor *flavor = &s->flavors[f];
+        if (s->locks[f] != NULL) {
+            continue;
+        }
+
+        int err = transaction_lock(&s->locks[f], flavor->addons_path);
+        if (err == TRANSACTION_ELOCKED) {
+            PRINT_ERROR("another %s is changing the addons in %s\n", WOWPKG_NAME, flavor->addons_path);
+            PRINT_ERROR("try again once it is done\n");
+            return -1;
+        } else if (err != TRANSACTION_OK) {
+            PRINT_ERROR("failed to lock %s%c%s\n", flavor->addons_path, OS_SEPARATOR, TRANSACTION_LOCK_NAME);
+            return -1;
+        }
+
+        if (transaction_pending(flavor->addons_path) && recover_flavor(flavor) != 0) {
+            return -1;
+        }
     }
 
-    char saved_file_path[OS_MAX_PATH];
-    n = snuser_file_path(saved_file_path, ARRAY_SIZE(saved_file_path), "saved.wowpkg");
-    if (n < 0) {
-        err = -1;
-        goto cleanup;
-    } else if ((size_t)n >= ARRAY_SIZE(saved_file_path)) {
-        PRINT_ERROR("path to saved addon data file is too long\n");
-        err = -1;
-        goto cleanup;
+    return 0;
+}
+
+/**
+ * Returns true if another process holds the lock of the addons directory of a
+ * flavor of s, which is printed. The locks are not kept.
+ */
+static bool session_busy(const Session *s)
+{
+    for (size_t f = 0; f < s->ctx.nflavors; f++) {
+        TransactionLock *lock = NULL;
+        if (s->locks[f] == NULL && transaction_lock(&lock, s->flavors[f].addons_path) == TRANSACTION_ELOCKED) {
+            PRINT_ERROR("another %s is changing the addons in %s\n", WOWPKG_NAME, s->flavors[f].addons_path);
+            return true;
+        }
+        transaction_unlock(lock);
+    }
+
+    return false;
+}
+
+/**
+ * Releases the locks that s holds. Every transaction of s shall be committed
+ * or rolled back first.
+ */
+static void session_unlock(Session *s)
+{
+    for (size_t f = 0; f < ARRAY_SIZE(s->locks); f++) {
+        transaction_unlock(s->locks[f]);
+        s->locks[f] = NULL;
+    }
+}
+
+/**
+ * Clears the old archives of s without deleting them.
+ */
+static void session_keep_archives(Session *s)
+{
+    while (s->ctx.old_archives != NULL && !list_isempty(s->ctx.old_archives)) {
+        list_remove(s->ctx.old_archives, s->ctx.old_archives->head);
+    }
+}
+
+/**
+ * Deletes the archives of the versions that install and upgrade replaced, see
+ * Context.old_archives. The archives are shared by every flavor in the config,
+ * so a version is kept while the saved app state of any of them, selected or
+ * not, still has it installed. Runs once the transactions were committed or
+ * rolled back so that the saved app states are final.
+ */
+static void session_remove_archives(Session *s)
+{
+    List *archives = s->ctx.old_archives;
+    if (archives == NULL || list_isempty(archives)) {
+        return;
+    }
+
+    const Config *config = s->ctx.config;
+    for (size_t i = 0; i < config->nflavors && !list_isempty(archives); i++) {
+        char path[OS_MAX_PATH];
+        int n = snflavor_file_path(path, ARRAY_SIZE(path), "saved", config->flavors[i].name);
+
+        AppState *state = appstate_create();
+        int err = state == NULL || n < 0 || (size_t)n >= ARRAY_SIZE(path) ? APPSTATE_EINTERNAL : appstate_load(state, path);
+        if (err != APPSTATE_OK && err != APPSTATE_ENOENT) {
+            // Without knowing what the flavor has installed nothing is deleted.
+            appstate_free(state);
+            session_keep_archives(s);
+            return;
+        }
+
+        ListNode *node = archives->head;
+        while (node != NULL) {
+            ListNode *next = node->next;
+            const Addon *old = node->value;
+
+            ListNode *installed = NULL;
+            list_foreach(installed, state->installed)
+            {
+                const Addon *a = installed->value;
+                if (strcmp(a->name, old->name) == 0 && a->version != NULL && strcmp(a->version, old->version) == 0) {
+                    list_remove(archives, node);
+                    break;
+                }
+            }
+
+            node = next;
+        }
+
+        appstate_free(state);
+    }
+
+    ListNode *node = NULL;
+    list_foreach(node, archives)
+    {
+        addon_remove_archive(node->value);
+    }
+
+    session_keep_archives(s);
+}
+
+/**
+ * Saves what the commands of a batch changed: commits the pending transaction
+ * of each flavor along with its app state and manifest, saves them for the
+ * other flavors that changed, and then deletes the archives of the versions
+ * that were replaced and the unused files of the content store.
+ *
+ * Returns -1 if anything could not be saved, otherwise 0.
+ */
+static int session_flush(Session *s)
+{
+    int err = 0;
+
+    for (size_t f = 0; f < s->ctx.nflavors; f++) {
+        if (transaction_pending(s->flavors[f].addons_path)) {
+            err = try_commit_transaction(&s->flavors[f], s->state_paths[f], 0) != 0 ? -1 : err;
+        } else if ((s->dirty & (1u << f)) != 0) {
+            err = try_save_state(s->flavors[f].state, s->state_paths[f], 0) != 0 ? -1 : err;
+            try_save_manifest(&s->flavors[f]);
+        }
+    }
+
+    s->dirty = 0;
+    session_remove_archives(s);
+
+    if (s->prune) {
+        try_prune_store(&s->ctx);
+        s->prune = false;
+    }
+
+    return err;
+}
+
+/**
+ * Returns true if a flavor of s has a transaction that was not committed yet.
+ */
+static bool session_pending(const Session *s)
+{
+    for (size_t f = 0; f < s->ctx.nflavors; f++) {
+        if (transaction_pending(s->flavors[f].addons_path)) {
+            return true;
+        }
     }
 
-    err = appstate_load(ctx.state, saved_file_path);
-    if (err == APPSTATE_ENOENT) {
-        // Assuming that since the config file was found with valid data that it
-        // should be safe to create a new saved file in the expected location.
-        err = 0;
+    return false;
+}
+
+/**
+ * Runs cmd once for each flavor of the session, saving the state of a flavor
+ * after cmd succeeded for it if save is true, see session_save. The name of each flavor is
+ * printed first if there is more than one.
+ *
+ * Returns -1 if cmd failed for any flavor, otherwise 0.
+ */
+static int run_each_flavor(Session *s, CommandFn cmd, bool save, int argc, const char *argv[], FILE *stream)
+{
+    Context *ctx = &s->ctx;
+    int err = 0;
+
+    for (size_t f = 0; f < ctx->nflavors; f++) {
+        select_flavor(ctx, f);
+
+        // Each JSON object names its flavor.
+        if (ctx->nflavors > 1 && !ctx->json) {
+            fprintf(stream, "==> " TERM_WRAP(TERM_BOLD_BLUE, "%s") "\n", ctx->flavors[f].name);
+        }
 
-        PRINT_WARNING("could not find any saved addon data\n");
-        PRINT_WARNING("\n");
-        PRINT_WARNING("if this is the first time running the program\n");
-        PRINT_WARNING("then this message can safely be ignored\n\n");
+        int cmd_err = cmd(ctx, argc, argv, stream);
+        if (save) {
+            cmd_err = session_save(s, f, cmd_err);
+        }
 
-        if (try_save_state(&ctx, saved_file_path, 0) != 0) {
+        if (cmd_err != 0) {
             err = -1;
-            goto cleanup;
         }
-    } else if (err != APPSTATE_OK) {
-        PRINT_ERROR("failed to load saved program data\n");
-        PRINT_ERROR("this should never happen\n");
-        PRINT_ERROR("saved data is stored in saved.wowpkg\n");
-        PRINT_ERROR("the saved program data may be corrupted and needs to be manually fixed\n");
-        PRINT_ERROR("or the file can be deleted but will reset all saved data\n");
-    }
-
-    if (strcasecmp(argv[1], "info") == 0) {
-        err = cmd_info(&ctx, argc - 1, &argv[1], stdout);
-    } else if (strcasecmp(argv[1], "install") == 0) {
-        err = cmd_install(&ctx, argc - 1, &argv[1], stdout);
-        err = try_save_state(&ctx, saved_file_path, err);
-    } else if (strcasecmp(argv[1], "list") == 0) {
-        err = cmd_list(&ctx, argc - 1, &argv[1], stdout);
-    } else if (strcasecmp(argv[1], "outdated") == 0) {
-        err = cmd_outdated(&ctx, argc - 1, &argv[1], stdout);
-    } else if (strcasecmp(argv[1], "search") == 0) {
-        err = cmd_search(&ctx, argc - 1, &argv[1], stdout);
-    } else if (strcasecmp(argv[1], "remove") == 0) {
-        err = cmd_remove(&ctx, argc - 1, &argv[1], stdout);
-        err = try_save_state(&ctx, saved_file_path, err);
-    } else if (strcasecmp(argv[1], "update") == 0) {
-        err = cmd_update(&ctx, argc - 1, &argv[1], stdout);
-        err = try_save_state(&ctx, saved_file_path, err);
-    } else if (strcasecmp(argv[1], "upgrade") == 0) {
-        err = cmd_upgrade(&ctx, argc - 1, &argv[1], stdout);
-        err = try_save_state(&ctx, saved_file_path, err);
-    } else if (strcasecmp(argv[1], "help") == 0) {
-        err = cmd_help(&ctx, argc - 1, &argv[1], stdout);
-    } else {
-        PRINT_ERROR("unknown command '%s'\n", argv[1]);
-        err = -1;
     }
 
-cleanup:
-    config_free(ctx.config);
-    appstate_free(ctx.state);
+    select_flavor(ctx, 0);
 
-    return err < 0 ? 1 : err;
+    return err;
+}
+
+/**
+ * Parses the options before the command in argv into opts. Options that are
+ * not given are zero.
+ *
+ * Returns the index of the command in argv, which is argc if there is none, or
+ * -1 if an option is not valid.
+ */
+static int parse_options(Options *opts, int argc, const char *argv[])
+{
+    memset(opts, 0, sizeof(*opts));
+
+    int i = 1;
+    for (; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            opts->stats = true;
+        } else if (strcmp(argv[i], "--fix-typos") == 0) {
+            opts->fix_typos = true;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            opts->json = true;
+        } else if (strcmp(argv[i], "--no-daemon") == 0) {
+            opts->no_daemon = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            opts->trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--flavor") == 0 && i + 1 < argc) {
+            if (opts->nflavor_names >= ARRAY_SIZE(opts->flavor_names)) {
+                PRINT_ERROR("--flavor may be given at most %d times\n", CONFIG_MAX_FLAVORS);
+                return -1;
+            }
+            opts->flavor_names[opts->nflavor_names++] = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            char *end = NULL;
+            opts->jobs = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || opts->jobs < 1 || opts->jobs > THREADPOOL_MAX_THREADS) {
+                PRINT_ERROR("--jobs expects a number from 1 to %d\n", THREADPOOL_MAX_THREADS);
+                return -1;
+            }
+        } else {
+            PRINT_ERROR("unknown option '%s'\n", argv[i]);
+            return -1;
+        }
+    }
+
+    if (i >= argc) {
+        fprintf(stderr, "Usage: wowpkg [--fix-typos] [--flavor NAME]... [--jobs N] [--json] [--no-daemon] [--stats] [--trace FILE] COMMAND [ARGS...]\n");
+        return -1;
+    }
+
+    return i;
+}
+
+static FileStamp file_stamp(const char *path)
+{
+    FileStamp stamp;
+    memset(&stamp, 0, sizeof(stamp));
+
+    struct os_stat st;
+    if (os_stat(path, &st) == 0) {
+        stamp.exists = true;
+        stamp.mtime = (long long)st.st_mtime;
+        stamp.size = (long long)st.st_size;
+    }
+
+    return stamp;
+}
+
+/**
+ * Stores the stamps of the files that s was loaded from in out, which has room
+ * for all of them.
+ */
+static void session_stamps(const Session *s, FileStamp *out)
+{
+    out[0] = file_stamp(s->config_path);
+
+    // The catalog directory does not change when its files are edited.
+    memset(&out[1], 0, sizeof(out[1]));
+    out[1].exists = search_catalog_stamp(WOWPKG_CATALOG_PATH, &out[1].mtime) == SEARCH_OK;
+
+    for (size_t f = 0; f < s->ctx.nflavors; f++) {
+        out[f + 2] = file_stamp(s->state_paths[f]);
+    }
+}
+
+/**
+ * Returns true if any file that s was loaded from changed since s was last
+ * stamped.
+ */
+static bool session_changed(const Session *s)
+{
+    FileStamp now[ARRAY_SIZE(s->stamps)];
+    session_stamps(s, now);
+
+    for (size_t i = 0; i < s->ctx.nflavors + 2; i++) {
+        if (now[i].exists != s->stamps[i].exists || now[i].mtime != s->stamps[i].mtime || now[i].size != s->stamps[i].size) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Passing a NULL pointer will make this function return immediately with no
+ * action.
+ */
+static void session_close(Session *s)
+{
+    if (s == NULL) {
+        return;
+    }
+
+    zipper_set_threadpool(NULL);
+    threadpool_free(s->ctx.pool);
+
+    session_unlock(s);
+    config_free(s->ctx.config);
+    list_free(s->ctx.old_archives);
+    for (size_t f = 0; f < s->ctx.nflavors; f++) {
+        appstate_free(s->flavors[f].state);
+        watch_free(s->flavors[f].watch);
+    }
+
+    search_index_free(s->ctx.search_index);
+    free(s);
+}
+
+/**
+ * Points the modules that keep settings of their own at the ones of s, so that
+ * commands run with s.
+ */
+static void session_use(Session *s)
+{
+    addon_set_github_token(s->ctx.config->github_token);
+    addon_set_github_api_url(s->ctx.config->github_api_url);
+    addon_set_store_path(s->ctx.store_path);
+    addon_set_download_path(s->download_path);
+    zipper_set_threadpool(s->ctx.pool);
+    select_flavor(&s->ctx, 0);
+}
+
+/**
+ * Loads the config, recovers the addons directories and loads the app state
+ * of the flavors that opts selects. Errors are printed.
+ *
+ * A read only session neither recovers the addons directories nor saves an
+ * app state that does not exist yet, for commands that run in the background
+ * next to others, like prefetch.
+ *
+ * Returns the session, which shall be closed with session_close, or NULL on
+ * error.
+ */
+static Session *session_open(const Options *opts, bool read_only)
+{
+    Session *s = calloc(1, sizeof(*s));
+    if (s == NULL) {
+        PRINT_ERROR("failed to allocate memory\n");
+        return NULL;
+    }
+
+    Context *ctx = &s->ctx;
+    ctx->flavors = s->flavors;
+    ctx->fix_typos = opts->fix_typos;
+    ctx->json = opts->json;
+
+    ctx->config = config_create();
+    ctx->old_archives = list_create();
+    if (ctx->config == NULL || ctx->old_archives == NULL) {
+        PRINT_ERROR("failed to allocate memory\n");
+        goto error;
+    }
+    list_set_free_fn(ctx->old_archives, (ListFreeFn)addon_free);
+
+    int n = snuser_file_path(s->config_path, ARRAY_SIZE(s->config_path), "config.ini");
+    if (n < 0) {
+        goto error;
+    } else if ((size_t)n >= ARRAY_SIZE(s->config_path)) {
+        PRINT_ERROR("path to config file is too long\n");
+        goto error;
+    }
+
+    if (config_load(ctx->config, s->config_path) != 0) {
+        PRINT_ERROR("failed to load user config file\n");
+        PRINT_ERROR("ensure file exists and has valid entries\n");
+        goto error;
+    }
+
+    config_load_env(ctx->config);
+
+    // The store is shared by every flavor so it does not move with --flavor.
+    if (ctx->config->store_enabled) {
+        if (ctx->config->store_path != NULL) {
+            n = snprintf(s->store_path, ARRAY_SIZE(s->store_path), "%s", ctx->config->store_path);
+        } else {
+            n = snprintf(s->store_path, ARRAY_SIZE(s->store_path), "%s%c%s", ctx->config->flavors[0].addons_path, OS_SEPARATOR, STORE_DIR_NAME);
+        }
+
+        if (n < 0 || (size_t)n >= ARRAY_SIZE(s->store_path)) {
+            PRINT_ERROR("path to content store is too long\n");
+            goto error;
+        }
+
+        ctx->store_path = s->store_path;
+    }
+
+    // Archives are used as they are found in the download directory, so it is
+    // one that only the user can write to, unlike the temp directory.
+    n = snuser_file_path(s->download_path, ARRAY_SIZE(s->download_path), "downloads");
+    if (n < 0) {
+        goto error;
+    } else if ((size_t)n >= ARRAY_SIZE(s->download_path)) {
+        PRINT_ERROR("path to download directory is too long\n");
+        goto error;
+    }
+
+    if (os_mkdir_private(s->download_path) != 0) {
+        PRINT_ERROR("failed to create download directory %s\n", s->download_path);
+        PRINT_ERROR("ensure it is a directory that only you can read and write, not a link\n");
+        goto error;
+    }
+
+    // Without a saved index search still works, it just reads the catalog.
+    n = snuser_file_path(s->search_index_path, ARRAY_SIZE(s->search_index_path), "search.wowpkg");
+    if (n >= 0 && (size_t)n < ARRAY_SIZE(s->search_index_path)) {
+        ctx->search_index_path = s->search_index_path;
+    }
+
+    // Commands work on the flavors given with --flavor, otherwise on every
+    // flavor in the config.
+    int err = 0;
+    for (size_t i = 0; i < (opts->nflavor_names > 0 ? opts->nflavor_names : ctx->config->nflavors); i++) {
+        const ConfigFlavor *cf = opts->nflavor_names > 0 ? config_find_flavor(ctx->config, opts->flavor_names[i]) : &ctx->config->flavors[i];
+        if (cf == NULL) {
+            PRINT_ERROR("unknown flavor '%s'\n", opts->flavor_names[i]);
+            goto error;
+        }
+
+        ContextFlavor *flavor = &s->flavors[ctx->nflavors];
+        flavor->name = cf->name;
+        flavor->addons_path = cf->addons_path;
+        flavor->state = appstate_create();
+        if (flavor->state == NULL) {
+            PRINT_ERROR("failed to allocate memory\n");
+            goto error;
+        }
+        ctx->nflavors++;
+
+        // Test that addon path actually exists and is a directory.
+        struct os_stat st;
+        if (os_stat(flavor->addons_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            PRINT_ERROR("addons path of '%s' from config file does not exist or\n", flavor->name);
+            PRINT_ERROR("is not a directory\n");
+            goto error;
+        }
+
+        // An install or upgrade that did not finish is undone before anything
+        // else looks at the addons directory, unless the process that runs it
+        // still holds the lock.
+        if (!read_only && transaction_pending(flavor->addons_path)) {
+            TransactionLock *lock = NULL;
+            int lock_err = transaction_lock(&lock, flavor->addons_path);
+            if (lock_err != TRANSACTION_OK && lock_err != TRANSACTION_ELOCKED) {
+                PRINT_ERROR("failed to lock %s%c%s\n", flavor->addons_path, OS_SEPARATOR, TRANSACTION_LOCK_NAME);
+                goto error;
+            }
+
+            int recover_err = lock != NULL ? recover_flavor(flavor) : 0;
+            transaction_unlock(lock);
+            if (recover_err != 0) {
+                goto error;
+            }
+        }
+
+        char *saved_file_path = s->state_paths[ctx->nflavors - 1];
+        n = snflavor_file_path(saved_file_path, OS_MAX_PATH, "saved", flavor->name);
+        if (n < 0) {
+            goto error;
+        } else if ((size_t)n >= OS_MAX_PATH) {
+            PRINT_ERROR("path to saved addon data file is too long\n");
+            goto error;
+        }
+
+        n = snflavor_file_path(s->manifest_paths[ctx->nflavors - 1], OS_MAX_PATH, "manifest", flavor->name);
+        if (n < 0) {
+            goto error;
+        } else if ((size_t)n >= OS_MAX_PATH) {
+            PRINT_ERROR("path to manifest file is too long\n");
+            goto error;
+        }
+        flavor->manifest_path = s->manifest_paths[ctx->nflavors - 1];
+
+        err = appstate_load(flavor->state, saved_file_path);
+        if (err == APPSTATE_ENOENT && read_only) {
+            err = 0;
+        } else if (err == APPSTATE_ENOENT) {
+            // Assuming that since the config file was found with valid data
+            // that it should be safe to create a new saved file in the
+            // expected location.
+            err = 0;
+
+            PRINT_WARNING("could not find any saved addon data\n");
+            PRINT_WARNING("\n");
+            PRINT_WARNING("if this is the first time running the program\n");
+            PRINT_WARNING("then this message can safely be ignored\n\n");
+
+            if (try_save_state(flavor->state, saved_file_path, 0) != 0) {
+                goto error;
+            }
+        } else if (err != APPSTATE_OK) {
+            PRINT_ERROR("failed to load saved program data\n");
+            PRINT_ERROR("this should never happen\n");
+            PRINT_ERROR("saved data is stored in %s\n", saved_file_path);
+            PRINT_ERROR("the saved program data may be corrupted and needs to be manually fixed\n");
+            PRINT_ERROR("or the file can be deleted but will reset all saved data\n");
+        }
+    }
+
+    // With a single job everything runs on this thread. Otherwise one worker
+    // per processor is used unless --jobs says otherwise.
+    if (opts->jobs != 1) {
+        ctx->pool = threadpool_create((int)opts->jobs);
+        if (ctx->pool == NULL) {
+            PRINT_WARNING("failed to start worker threads, running one job at a time\n");
+        }
+    }
+
+    session_stamps(s, s->stamps);
+    session_use(s);
+
+    return s;
+
+error:
+    session_close(s);
+    return NULL;
+}
+
+/**
+ * Starts the prefetch command for the flavors of ctx in another process, which
+ * keeps running after this one exits. It runs at a low priority and downloads
+ * one archive at a time so that it does not slow down anything else. Its
+ * session is read only and it does nothing while an install or upgrade holds
+ * the lock of an addons directory.
+ */
+static void start_prefetch(const Context *ctx)
+{
+    const char *args[CONFIG_MAX_FLAVORS * 2 + 6];
+    size_t n = 0;
+    args[n++] = program_path;
+    args[n++] = "--no-daemon";
+    args[n++] = "--jobs";
+    args[n++] = "1";
+    for (size_t f = 0; f < ctx->nflavors; f++) {
+        args[n++] = "--flavor";
+        args[n++] = ctx->flavors[f].name;
+    }
+    args[n++] = "prefetch";
+    args[n] = NULL;
+
+    if (os_spawn_background(program_path, args) == 0) {
+        fprintf(stdout, "==> " TERM_WRAP(TERM_BOLD, "Prefetching") " upgrades in the background\n");
+    } else {
+        PRINT_WARNING("failed to start prefetching upgrades in the background\n");
+    }
+}
+
+/**
+ * Returns true if the command called name prints its results as JSON with
+ * --json.
+ */
+static bool has_json_output(const char *name)
+{
+    const char *names[] = { "batch", "info", "install", "list", "outdated", "upgrade" };
+    for (size_t i = 0; i < ARRAY_SIZE(names); i++) {
+        if (strcasecmp(name, names[i]) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Returns true if the command called name runs with a read only session, see
+ * session_open.
+ */
+static bool is_read_only(const char *name)
+{
+    return strcasecmp(name, "prefetch") == 0;
+}
+
+static int run_command(Session *s, int argc, const char *argv[]);
+
+/**
+ * Returns true if the command called name changes the addons directories or
+ * saves the app state without a transaction, so it holds the locks of the
+ * addons directories while it runs, see session_lock. install, sync and
+ * upgrade take them on their own.
+ */
+static bool changes_addons(const char *name)
+{
+    const char *names[] = { "adopt", "dedupe", "remove", "repair", "update" };
+    for (size_t i = 0; i < ARRAY_SIZE(names); i++) {
+        if (strcasecmp(name, names[i]) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Returns true if the command called name can be a line of a batch.
+ */
+static bool is_batch_command(const char *name)
+{
+    const char *names[] = { "adopt", "dedupe", "info", "install", "list", "outdated", "remove", "repair", "search", "update", "upgrade", "verify" };
+    for (size_t i = 0; i < ARRAY_SIZE(names); i++) {
+        if (strcasecmp(name, names[i]) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Runs the commands in the file argv[1], or in stdin if it is "-", one after
+ * another with the context of s. The network stays up between them, and what
+ * they change is saved once they are done instead of after each of them.
+ *
+ * Returns the exit status of the batch, which is 1 if any command failed.
+ */
+static int run_batch(Session *s, int argc, const char *argv[])
+{
+    if (argc != 2) {
+        PRINT_ERROR("usage: batch FILE|-\n");
+        return -1;
+    }
+
+    if (s->batch) {
+        PRINT_ERROR("batch: a batch can not run another batch\n");
+        return -1;
+    }
+
+    bool from_stdin = strcmp(argv[1], "-") == 0;
+    FILE *f = from_stdin ? stdin : fopen(argv[1], "rb");
+    if (f == NULL) {
+        PRINT_ERROR("batch: failed to open %s\n", argv[1]);
+        return -1;
+    }
+
+    Batch *b = NULL;
+    size_t line = 0;
+    int err = batch_read(&b, f, &line);
+
+    if (!from_stdin) {
+        fclose(f);
+    }
+
+    if (err == BATCH_EOPTION) {
+        PRINT_ERROR("batch: line %zu: options go before the batch command\n", line);
+        return -1;
+    } else if (err != BATCH_OK) {
+        PRINT_ERROR("batch: failed to read %s\n", from_stdin ? "stdin" : argv[1]);
+        return -1;
+    }
+
+    // Checked before anything runs so that a typo does not stop it halfway.
+    for (size_t i = 0; i < b->nsteps; i++) {
+        if (!is_batch_command(b->steps[i].argv[0])) {
+            PRINT_ERROR("batch: line %zu: '%s' can not run in a batch\n", b->steps[i].line, b->steps[i].argv[0]);
+            batch_free(b);
+            return -1;
+        } else if (s->ctx.json && !has_json_output(b->steps[i].argv[0])) {
+            PRINT_ERROR("batch: line %zu: %s: --json is not supported\n", b->steps[i].line, b->steps[i].argv[0]);
+            batch_free(b);
+            return -1;
+        }
+    }
+
+    net_init();
+    s->batch = true;
+
+    int status = 0;
+    for (size_t i = 0; i < b->nsteps && !threadpool_canceled(NULL); i++) {
+        const BatchStep *step = &b->steps[i];
+        if (!s->ctx.json) {
+            fprintf(stdout, "==> " TERM_WRAP(TERM_BOLD, "Running") " %s (line %zu)\n", step->argv[0], step->line);
+        }
+
+        if (run_command(s, step->argc, step->argv) != 0) {
+            status = 1;
+        }
+    }
+
+    s->batch = false;
+    if (session_flush(s) != 0) {
+        status = 1;
+    }
+    session_unlock(s);
+
+    if (s->prefetch && status == 0) {
+        start_prefetch(&s->ctx);
+    }
+    s->prefetch = false;
+
+    net_cleanup();
+    batch_free(b);
+
+    return status;
+}
+
+/**
+ * Runs the command in argv, where argv[0] is the name of the command, with the
+ * context of s.
+ *
+ * Returns the exit status of the command.
+ */
+static int run_command(Session *s, int argc, const char *argv[])
+{
+    Context *ctx = &s->ctx;
+    int err = 0;
+
+    session_use(s);
+
+    double cmd_start = os_monotonic();
+
+    if (ctx->json && !has_json_output(argv[0])) {
+        PRINT_ERROR("%s: --json is not supported\n", argv[0]);
+        return 1;
+    }
+
+    // Like the transactions of install, the locks are held until a batch is
+    // done.
+    bool lock = changes_addons(argv[0]);
+    if (lock && session_lock(s) != 0) {
+        if (!s->batch) {
+            session_unlock(s);
+        }
+        return 1;
+    }
+
+    if (strcasecmp(argv[0], "adopt") == 0) {
+        err = run_each_flavor(s, cmd_adopt, true, argc, argv, stdout);
+        session_save_manifests(s);
+    } else if (strcasecmp(argv[0], "batch") == 0) {
+        err = run_batch(s, argc, argv);
+    } else if (strcasecmp(argv[0], "info") == 0) {
+        err = cmd_info(ctx, argc, argv, stdout);
+    } else if (strcasecmp(argv[0], "install") == 0 || strcasecmp(argv[0], "sync") == 0 || strcasecmp(argv[0], "upgrade") == 0) {
+        // Run once for every flavor so that each archive is only downloaded
+        // and unzipped once.
+        CommandFn cmd = strcasecmp(argv[0], "install") == 0 ? cmd_install : strcasecmp(argv[0], "sync") == 0 ? cmd_sync : cmd_upgrade;
+
+        // Each of them needs a transaction of its own, so the one of an
+        // earlier command of a batch is committed first.
+
+        // The locks are held until the transactions are committed, which in
+        // a batch is once it is done.
+        if (session_lock(s) != 0) {
+            err = -1;
+        } else if (s->batch && session_pending(s) && session_flush(s) != 0) {
+            err = -1;
+        } else if (s->batch) {
+            err = cmd(ctx, argc, argv, stdout);
+            if (err == 0) {
+                s->dirty |= (1u << ctx->nflavors) - 1;
+            }
+        } else {
+            err = cmd(ctx, argc, argv, stdout);
+
+            for (size_t f = 0; f < ctx->nflavors; f++) {
+                if (try_commit_transaction(&s->flavors[f], s->state_paths[f], err) != 0) {
+                    err = -1;
+                }
+            }
+            session_remove_archives(s);
+        }
+
+        if (!s->batch) {
+            session_unlock(s);
+        }
+
+        session_prune(s);
+    } else if (strcasecmp(argv[0], "list") == 0) {
+        err = run_each_flavor(s, cmd_list, false, argc, argv, stdout);
+    } else if (strcasecmp(argv[0], "lock") == 0) {
+        err = cmd_lock(ctx, argc, argv, stdout);
+    } else if (strcasecmp(argv[0], "outdated") == 0) {
+        err = run_each_flavor(s, cmd_outdated, false, argc, argv, stdout);
+    } else if (strcasecmp(argv[0], "search") == 0) {
+        err = cmd_search(ctx, argc, argv, stdout);
+    } else if (strcasecmp(argv[0], "remove") == 0) {
+        err = run_each_flavor(s, cmd_remove, true, argc, argv, stdout);
+        session_save_manifests(s);
+        session_prune(s);
+    } else if (strcasecmp(argv[0], "update") == 0) {
+        err = run_each_flavor(s, cmd_update, true, argc, argv, stdout);
+
+        // Started once the locks are released, the prefetch does not run
+        // while the addons directories are locked.
+        if (err == 0 && cmd_update_prefetch(ctx, argc, argv)) {
+            s->prefetch = true;
+        }
+    } else if (strcasecmp(argv[0], "prefetch") == 0) {
+        // An install or upgrade that is running downloads what it needs itself.
+        err = session_busy(s) ? -1 : cmd_prefetch(ctx, argc, argv, stdout);
+    } else if (strcasecmp(argv[0], "dedupe") == 0) {
+        err = run_each_flavor(s, cmd_dedupe, false, argc, argv, stdout);
+    } else if (strcasecmp(argv[0], "verify") == 0) {
+        err = run_each_flavor(s, cmd_verify, false, argc, argv, stdout);
+    } else if (strcasecmp(argv[0], "repair") == 0) {
+        err = run_each_flavor(s, cmd_repair, false, argc, argv, stdout);
+    } else if (strcasecmp(argv[0], "stats") == 0) {
+        err = cmd_stats(ctx, argc, argv, stdout);
+    } else if (strcasecmp(argv[0], "help") == 0) {
+        err = cmd_help(ctx, argc, argv, stdout);
+    } else if (strcasecmp(argv[0], "daemon") == 0) {
+        PRINT_ERROR("daemon: already running\n");
+        err = -1;
+    } else {
+        PRINT_ERROR("unknown command '%s'\n", argv[0]);
+        err = -1;
+    }
+
+    if (lock && !s->batch) {
+        session_unlock(s);
+
+        if (s->prefetch) {
+            start_prefetch(ctx);
+        }
+        s->prefetch = false;
+    }
+
+    stats_trace_span("command", argv[0], cmd_start);
+
+    return err < 0 ? 1 : err;
+}
+
+/**
+ * Prints the stats of the command that ran and writes its trace file, if they
+ * were asked for in opts.
+ *
+ * Returns 1 if the trace file could not be written, otherwise status.
+ */
+static int finish_command(const Options *opts, int status)
+{
+    // Kept apart from the results when they are read by a program.
+    stats_print(opts->json ? stderr : stdout);
+    stats_reset();
+
+    if (stats_trace_close() != 0) {
+        PRINT_ERROR("failed to write trace file %s\n", opts->trace_path);
+        status = 1;
+    }
+
+    return status;
+}
+
+/**
+ * Starts watching the addons directory of every flavor of s, so that the
+ * commands that check the installed files only look at the addons that
+ * changed since they last did. Errors are printed as warnings.
+ */
+static void session_watch(Session *s)
+{
+    for (size_t f = 0; f < s->ctx.nflavors; f++) {
+        ContextFlavor *flavor = &s->flavors[f];
+        int err = watch_create(&flavor->watch, flavor->addons_path);
+        if (err == WATCH_ELIMIT) {
+            PRINT_WARNING("too many directories to watch in %s, raise fs.inotify.max_user_watches\n", flavor->addons_path);
+        } else if (err != WATCH_OK && err != WATCH_EUNSUPPORTED) {
+            PRINT_WARNING("failed to watch %s for changes\n", flavor->addons_path);
+        }
+    }
+}
+
+/**
+ * State of the daemon between the commands it runs.
+ */
+typedef struct Daemon {
+    Options opts; // Options the daemon was started with.
+    Session *session; // Kept loaded for the next command, may be NULL.
+    bool reload; // The last command failed so the session may be off.
+} Daemon;
+
+/**
+ * Stops the command that the daemon runs on the first Ctrl-C of its client.
+ */
+static void on_daemon_interrupt(void)
+{
+    threadpool_interrupt();
+    net_abort();
+}
+
+/**
+ * Stops the daemon once the command that is running, which is interrupted,
+ * is done.
+ */
+static void on_daemon_signal(int sig)
+{
+    UNUSED(sig);
+
+    daemon_stop();
+    threadpool_interrupt();
+    net_abort();
+}
+
+/**
+ * Runs a command of a client of the daemon in arg. Commands use the session of
+ * the daemon, loaded again when its files changed, unless they select other
+ * flavors or jobs.
+ */
+static int serve_command(int argc, const char *argv[], void *arg)
+{
+    Daemon *d = arg;
+
+    Options opts;
+    int cmd_index = parse_options(&opts, argc, argv);
+    if (cmd_index < 0) {
+        return 1;
+    }
+
+    if (opts.trace_path != NULL && stats_trace_open(opts.trace_path) != 0) {
+        PRINT_ERROR("failed to create trace file %s\n", opts.trace_path);
+        return 1;
+    }
+
+    stats_enable(opts.stats || d->opts.stats);
+
+    Session *s = NULL;
+    bool own = opts.nflavor_names > 0 || opts.jobs != 0;
+    if (own) {
+        opts.fix_typos = opts.fix_typos || d->opts.fix_typos;
+        s = session_open(&opts, is_read_only(argv[cmd_index]));
+    } else {
+        if (d->session == NULL || d->reload || session_changed(d->session)) {
+            session_close(d->session);
+            d->session = session_open(&d->opts, false);
+            if (d->session != NULL && search_index_open(&d->session->ctx.search_index, d->session->ctx.search_index_path, WOWPKG_CATALOG_PATH) != SEARCH_OK) {
+                d->session->ctx.search_index = NULL;
+            }
+            if (d->session != NULL) {
+                session_watch(d->session);
+            }
+        }
+
+        s = d->session;
+        if (s != NULL) {
+            s->ctx.fix_typos = opts.fix_typos || d->opts.fix_typos;
+            s->ctx.json = opts.json;
+        }
+    }
+
+    int status = s != NULL ? run_command(s, argc - cmd_index, &argv[cmd_index]) : 1;
+
+    if (own) {
+        session_close(s);
+    } else if (s != NULL) {
+        d->reload = status != 0;
+        session_stamps(s, s->stamps);
+    }
+
+    status = finish_command(&opts, status);
+    stats_enable(false);
+
+    threadpool_clear_interrupt();
+    net_reset();
+
+    return status;
+}
+
+/**
+ * Gets the path to the socket of the daemon.
+ *
+ * Returns 0 on success, -1 if the path does not fit in n.
+ */
+static int sndaemon_path(char *s, size_t n)
+{
+    int len = snuser_file_path(s, n, "daemon.sock");
+    return len < 0 || (size_t)len >= n ? -1 : 0;
+}
+
+/**
+ * Runs the daemon with the options in opts until it is stopped.
+ *
+ * Returns the exit status of the program.
+ */
+static int run_daemon(const Options *opts, int argc, const char *argv[])
+{
+    UNUSED(argv);
+
+    if (argc != 1) {
+        PRINT_ERROR("daemon: expected no arguments\n");
+        return 1;
+    }
+
+    char path[OS_MAX_PATH];
+    if (sndaemon_path(path, ARRAY_SIZE(path)) != 0) {
+        PRINT_ERROR("daemon: path to socket is too long\n");
+        return 1;
+    }
+
+    Daemon d;
+    memset(&d, 0, sizeof(d));
+    d.opts = *opts;
+    d.opts.trace_path = NULL;
+
+    // Connections are kept between commands.
+    net_init();
+
+    signal(SIGINT, on_daemon_signal);
+    signal(SIGTERM, on_daemon_signal);
+
+    int err = daemon_serve(path, serve_command, on_daemon_interrupt, &d);
+
+    session_close(d.session);
+    net_cleanup();
+
+    switch (err) {
+    case DAEMON_OK:
+        return 0;
+    case DAEMON_ERUNNING:
+        PRINT_ERROR("daemon: already running on %s\n", path);
+        break;
+    case DAEMON_ENAMETOOLONG:
+        PRINT_ERROR("daemon: path to socket is too long: %s\n", path);
+        break;
+    case DAEMON_EUNSUPPORTED:
+        PRINT_ERROR("daemon: not supported on this system\n");
+        break;
+    case DAEMON_ENOENT:
+    case DAEMON_EMISMATCH:
+    case DAEMON_EIO:
+    default:
+        PRINT_ERROR("daemon: failed to listen on %s\n", path);
+        break;
+    }
+
+    return 1;
+}
+
+/**
+ * Tells the daemon to stop the command of this client on the first Ctrl-C. A
+ * second Ctrl-C terminates right away.
+ */
+static void on_client_interrupt(int sig)
+{
+    daemon_interrupt();
+    signal(sig, SIG_DFL);
+}
+
+/**
+ * Writes path made absolute with the working directory to s.
+ *
+ * Returns -1 on error, 0 otherwise.
+ */
+static int snabsolute_path(char *s, size_t n, const char *path)
+{
+    char cwd[OS_MAX_PATH];
+    int len = os_getcwd(cwd, ARRAY_SIZE(cwd)) != NULL ? snprintf(s, n, "%s%c%s", cwd, OS_SEPARATOR, path) : -1;
+
+    return len < 0 || (size_t)len >= n ? -1 : 0;
+}
+
+/**
+ * Returns true if the command called name takes the path of a FILE as its only
+ * argument.
+ */
+static bool has_file_arg(const char *name)
+{
+    const char *names[] = { "batch", "lock", "sync" };
+    for (size_t i = 0; i < ARRAY_SIZE(names); i++) {
+        if (strcasecmp(name, names[i]) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Runs the program on the daemon if one is running, with a trace file that is
+ * relative to where the program was run from made absolute for it.
+ *
+ * Returns true and stores the exit status in status if the daemon ran it.
+ * Otherwise the program shall run the command itself.
+ */
+static bool call_daemon(const Options *opts, int argc, const char *argv[], int *status)
+{
+    char path[OS_MAX_PATH];
+    if (opts->no_daemon || sndaemon_path(path, ARRAY_SIZE(path)) != 0) {
+        return false;
+    }
+
+    const char **args = malloc(sizeof(*args) * (size_t)argc);
+    if (args == NULL) {
+        return false;
+    }
+    memcpy(args, argv, sizeof(*args) * (size_t)argc);
+
+    char trace_path[OS_MAX_PATH];
+    if (opts->trace_path != NULL && strchr(OS_VALID_SEPARATORS, opts->trace_path[0]) == NULL) {
+        if (snabsolute_path(trace_path, ARRAY_SIZE(trace_path), opts->trace_path) != 0) {
+            free(args);
+            return false;
+        }
+
+        for (int i = 1; i < argc; i++) {
+            if (argv[i] == opts->trace_path) {
+                args[i] = trace_path;
+            }
+        }
+    }
+
+    signal(SIGINT, on_client_interrupt);
+    int err = daemon_call(path, argc, args, status);
+    signal(SIGINT, SIG_DFL);
+
+    free(args);
+
+    if (err == DAEMON_EMISMATCH) {
+        PRINT_WARNING("the running daemon is another version of %s, restart it to use it again\n", WOWPKG_NAME);
+    } else if (err == DAEMON_EIO) {
+        PRINT_ERROR("lost the connection to the daemon\n");
+        *status = 1;
+        return true;
+    }
+
+    return err == DAEMON_OK;
+}
+
+int main(int argc, const char *argv[])
+{
+    // Options before the command apply to every command.
+    Options opts;
+    int cmd_index = parse_options(&opts, argc, argv);
+    if (cmd_index < 0) {
+        exit(1);
+    }
+
+    int cmd_argc = argc - cmd_index;
+    const char **cmd_argv = &argv[cmd_index];
+    bool daemon = strcasecmp(cmd_argv[0], "daemon") == 0;
+
+    // Like the trace file, the FILE of a command is relative to where the
+    // program was run from, both for the daemon and after changing directory.
+    // Static since it is stored in argv, which main does not own.
+    static char file_path[OS_MAX_PATH];
+    if (has_file_arg(cmd_argv[0]) && cmd_argc == 2 && strcmp(cmd_argv[1], "-") != 0
+        && strchr(OS_VALID_SEPARATORS, cmd_argv[1][0]) == NULL) {
+        if (snabsolute_path(file_path, ARRAY_SIZE(file_path), cmd_argv[1]) != 0) {
+            PRINT_ERROR("%s: path is too long: %s\n", cmd_argv[0], cmd_argv[1]);
+            exit(1);
+        }
+        cmd_argv[1] = file_path;
+    }
+
+    int status = 0;
+    if (!daemon && call_daemon(&opts, argc, argv, &status)) {
+        return status;
+    }
+
+    // Opened before changing directory so that a relative path is relative to
+    // where the program was run from.
+    if (opts.trace_path != NULL && stats_trace_open(opts.trace_path) != 0) {
+        PRINT_ERROR("failed to create trace file %s\n", opts.trace_path);
+        exit(1);
+    }
+
+    if (chdir_to_executable_path(argv[0]) != 0) {
+        PRINT_ERROR("could not find program executable path\n");
+        exit(1);
+    }
+
+    // Either way the program is in the working directory now.
+    const char *name = argv[0];
+    for (const char *c = argv[0]; *c; c++) {
+        if (strchr(OS_VALID_SEPARATORS, *c) != NULL) {
+            name = c + 1;
+        }
+    }
+    snprintf(program_path, ARRAY_SIZE(program_path), ".%c%s%s", OS_SEPARATOR, name, USE_EXE_EXT && strstr(name, ".exe") == NULL ? ".exe" : "");
+
+    if (daemon) {
+        return run_daemon(&opts, cmd_argc, cmd_argv);
+    }
+
+    stats_enable(opts.stats);
+
+    Session *s = session_open(&opts, is_read_only(cmd_argv[0]));
+    if (s != NULL) {
+        signal(SIGINT, on_interrupt);
+        status = run_command(s, cmd_argc, cmd_argv);
+    } else {
+        status = 1;
+    }
+
+    session_close(s);
+
+    return finish_command(&opts, status);
 }
@@ -0,0 +1,587 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "addon.h"
+#include "manifest.h"
+#include "osapi.h"
+#include "osstring.h"
+#include "wowpkg.h"
+
+#define MANIFEST_HEADER "wowpkg manifest 2"
+
+/**
+ * Size of the buffer files are read with when their CRC is computed.
+ */
+#define MANIFEST_READ_SIZE (64 * 1024)
+
+ManifestFile *manifest_file_create(const char *path, unsigned long long size, unsigned long crc, long long mtime)
+{
+    ManifestFile *result = malloc(sizeof(*result));
+    if (result == NULL) {
+        return NULL;
+    }
+
+    result->path = strdup(path);
+    if (result->path == NULL) {
+        free(result);
+        return NULL;
+    }
+
+    result->size = size;
+    result->crc = crc;
+    result->mtime = mtime;
+
+    return result;
+}
+
+void manifest_file_free(ManifestFile *f)
+{
+    if (f == NULL) {
+        return;
+    }
+
+    free(f->path);
+    free(f);
+}
+
+List *manifest_files_dup(const List *files)
+{
+    if (files == NULL) {
+        return NULL;
+    }
+
+    List *result = list_create();
+    if (result == NULL) {
+        return NULL;
+    }
+    list_set_free_fn(result, (ListFreeFn)manifest_file_free);
+
+    // Inserting at the front reverses the order, which does not matter.
+    ListNode *node = NULL;
+    list_foreach(node, files)
+    {
+        const ManifestFile *f = node->value;
+        ManifestFile *copy = manifest_file_create(f->path, f->size, f->crc, f->mtime);
+        if (copy == NULL) {
+            list_free(result);
+            return NULL;
+        }
+
+        list_insert(result, copy);
+    }
+
+    return result;
+}
+
+int snmanifest_path(char *s, size_t n, const char *root, const char *rel)
+{
+    int len = snprintf(s, n, "%s%c%s", root, OS_SEPARATOR, rel);
+
+    if (len >= 0 && (size_t)len < n) {
+        for (char *c = s + strlen(root); *c != '\0'; c++) {
+            if (*c == '/') {
+                *c = OS_SEPARATOR;
+            }
+        }
+    }
+
+    return len;
+}
+
+int manifest_crc_file(const char *path, unsigned long long *size, unsigned long *crc)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return errno == ENOENT ? MANIFEST_ENOENT : MANIFEST_EIO;
+    }
+
+    unsigned char *buf = malloc(MANIFEST_READ_SIZE);
+    if (buf == NULL) {
+        fclose(f);
+        return MANIFEST_EIO;
+    }
+
+    uLong result = crc32(0L, Z_NULL, 0);
+    unsigned long long total = 0;
+
+    size_t n = 0;
+    while ((n = fread(buf, sizeof(*buf), MANIFEST_READ_SIZE, f)) > 0) {
+        result = crc32(result, buf, (uInt)n);
+        total += n;
+    }
+
+    int err = ferror(f) ? MANIFEST_EIO : MANIFEST_OK;
+
+    free(buf);
+    fclose(f);
+
+    *size = total;
+    *crc = (unsigned long)result;
+
+    return err;
+}
+
+int manifest_scan_dir(List *files, const char *root, const char *rel)
+{
+    char dirpath[OS_MAX_PATH];
+    int n = rel[0] == '\0' ? snprintf(dirpath, ARRAY_SIZE(dirpath), "%s", root) : snmanifest_path(dirpath, ARRAY_SIZE(dirpath), root, rel);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(dirpath)) {
+        return MANIFEST_ENAMETOOLONG;
+    }
+
+    OsDir *dir = os_opendir(dirpath);
+    if (dir == NULL) {
+        return MANIFEST_EIO;
+    }
+
+    int err = MANIFEST_OK;
+
+    OsDirEnt *entry = NULL;
+    while (err == MANIFEST_OK && (entry = os_readdir(dir)) != NULL) {
+        if (strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0) {
+            continue;
+        }
+
+        char child_rel[OS_MAX_PATH];
+        char child[OS_MAX_PATH];
+        int n1 = rel[0] == '\0' ? snprintf(child_rel, ARRAY_SIZE(child_rel), "%s", entry->name) : snprintf(child_rel, ARRAY_SIZE(child_rel), "%s/%s", rel, entry->name);
+        int n2 = n1 < 0 ? -1 : snmanifest_path(child, ARRAY_SIZE(child), root, child_rel);
+        if (n1 < 0 || (size_t)n1 >= ARRAY_SIZE(child_rel) || n2 < 0 || (size_t)n2 >= ARRAY_SIZE(child)) {
+            err = MANIFEST_ENAMETOOLONG;
+            break;
+        }
+
+        struct os_stat s;
+        if (os_stat(child, &s) != 0) {
+            err = MANIFEST_EIO;
+            break;
+        }
+
+        if (S_ISDIR(s.st_mode)) {
+            err = manifest_scan_dir(files, root, child_rel);
+            continue;
+        }
+
+        unsigned long long size;
+        unsigned long crc;
+        if ((err = manifest_crc_file(child, &size, &crc)) != MANIFEST_OK) {
+            break;
+        }
+
+        ManifestFile *f = manifest_file_create(child_rel, size, crc, (long long)s.st_mtime);
+        if (f == NULL) {
+            err = MANIFEST_EIO;
+            break;
+        }
+
+        list_insert(files, f);
+    }
+
+    os_closedir(dir);
+
+    return err;
+}
+
+int manifest_scan(List *files, const char *root)
+{
+    return manifest_scan_dir(files, root, "");
+}
+
+int manifest_check(const char *root, const ManifestFile *f)
+{
+    char path[OS_MAX_PATH];
+    int n = snmanifest_path(path, ARRAY_SIZE(path), root, f->path);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(path)) {
+        return MANIFEST_ENAMETOOLONG;
+    }
+
+    struct os_stat s;
+    if (os_stat(path, &s) != 0) {
+        return MANIFEST_ENOENT;
+    }
+
+    if (S_ISDIR(s.st_mode) || (unsigned long long)s.st_size != f->size) {
+        return MANIFEST_ECHANGED;
+    }
+
+    unsigned long long size;
+    unsigned long crc;
+    int err = manifest_crc_file(path, &size, &crc);
+    if (err != MANIFEST_OK) {
+        return err;
+    }
+
+    return size == f->size && crc == f->crc ? MANIFEST_OK : MANIFEST_ECHANGED;
+}
+
+static int cmp_file_path(const void *a, const void *b)
+{
+    return strcmp((*(const ManifestFile *const *)a)->path, (*(const ManifestFile *const *)b)->path);
+}
+
+static int cmp_path_to_file(const void *path, const void *file)
+{
+    return strcmp(path, (*(const ManifestFile *const *)file)->path);
+}
+
+const ManifestFile *manifest_find(const ManifestFile **files, size_t n, const char *path)
+{
+    const ManifestFile **found = n > 0 ? bsearch(path, files, n, sizeof(*files), cmp_path_to_file) : NULL;
+
+    return found != NULL ? *found : NULL;
+}
+
+const ManifestFile **manifest_sort(const List *files, size_t *n)
+{
+    size_t len = 0;
+    ListNode *node = NULL;
+    list_foreach(node, files)
+    {
+        len++;
+    }
+
+    const ManifestFile **result = malloc((len + 1) * sizeof(*result));
+    if (result == NULL) {
+        return NULL;
+    }
+
+    len = 0;
+    node = NULL;
+    list_foreach(node, files)
+    {
+        result[len++] = node->value;
+    }
+
+    qsort(result, len, sizeof(*result), cmp_file_path);
+    *n = len;
+
+    return result;
+}
+
+/**
+ * Orders paths so that every directory comes before the directory it is in.
+ * Equal paths end up next to each other.
+ */
+static int cmp_str_deepest(const void *a, const void *b)
+{
+    const char *str_a = *(char *const *)a;
+    const char *str_b = *(char *const *)b;
+    size_t len_a = strlen(str_a);
+    size_t len_b = strlen(str_b);
+
+    if (len_a != len_b) {
+        return len_a < len_b ? 1 : -1;
+    }
+
+    return strcmp(str_a, str_b);
+}
+
+/**
+ * Dynamic array of paths of directories, see manifest_remove.
+ */
+typedef struct ManifestDirs {
+    char **paths;
+    size_t n;
+    size_t cap;
+} ManifestDirs;
+
+static int manifest_dirs_add(ManifestDirs *dirs, const char *path, size_t len)
+{
+    if (dirs->n == dirs->cap) {
+        size_t cap = dirs->cap == 0 ? 16 : dirs->cap * 2;
+        char **grown = realloc(dirs->paths, cap * sizeof(*grown));
+        if (grown == NULL) {
+            return MANIFEST_EIO;
+        }
+
+        dirs->paths = grown;
+        dirs->cap = cap;
+    }
+
+    char *copy = malloc(len + 1);
+    if (copy == NULL) {
+        return MANIFEST_EIO;
+    }
+
+    memcpy(copy, path, len);
+    copy[len] = '\0';
+
+    dirs->paths[dirs->n++] = copy;
+
+    return MANIFEST_OK;
+}
+
+int manifest_remove(const char *root, const List *files, const char *dir)
+{
+    char path[OS_MAX_PATH];
+    int n = snmanifest_path(path, ARRAY_SIZE(path), root, dir);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(path)) {
+        return MANIFEST_ENAMETOOLONG;
+    }
+
+    struct os_stat s;
+    if (os_stat(path, &s) != 0) {
+        return MANIFEST_ENOENT;
+    }
+
+    int err = MANIFEST_OK;
+    size_t dirlen = strlen(dir);
+    ManifestDirs dirs = { NULL, 0, 0 };
+
+    ListNode *node = NULL;
+    list_foreach(node, files)
+    {
+        const ManifestFile *f = node->value;
+        if (strncmp(f->path, dir, dirlen) != 0 || f->path[dirlen] != '/') {
+            continue;
+        }
+
+        n = snmanifest_path(path, ARRAY_SIZE(path), root, f->path);
+        if (n < 0 || (size_t)n >= ARRAY_SIZE(path)) {
+            err = MANIFEST_ENAMETOOLONG;
+            break;
+        }
+
+        if (remove(path) != 0 && errno != ENOENT) {
+            err = MANIFEST_EIO;
+            break;
+        }
+
+        // Every directory between the file and dir.
+        const char *end = strrchr(f->path, '/');
+        while (err == MANIFEST_OK && (size_t)(end - f->path) > dirlen) {
+            err = manifest_dirs_add(&dirs, f->path, (size_t)(end - f->path));
+            while (*--end != '/') {
+            }
+        }
+    }
+
+    if (err == MANIFEST_OK) {
+        if (dirs.n > 1) {
+            qsort(dirs.paths, dirs.n, sizeof(*dirs.paths), cmp_str_deepest);
+        }
+
+        // A directory that is not empty is left behind and so are the ones
+        // it is in.
+        for (size_t i = 0; i < dirs.n; i++) {
+            if (i > 0 && strcmp(dirs.paths[i - 1], dirs.paths[i]) == 0) {
+                continue;
+            }
+
+            n = snmanifest_path(path, ARRAY_SIZE(path), root, dirs.paths[i]);
+            if (n >= 0 && (size_t)n < ARRAY_SIZE(path)) {
+                os_rmdir(path);
+            }
+        }
+
+        snmanifest_path(path, ARRAY_SIZE(path), root, dir);
+        if (os_rmdir(path) != 0) {
+            err = MANIFEST_EIO;
+        }
+    }
+
+    for (size_t i = 0; i < dirs.n; i++) {
+        free(dirs.paths[i]);
+    }
+    free(dirs.paths);
+
+    return err;
+}
+
+static int cmp_name_to_addon(const void *name, const void *addon)
+{
+    return strcasecmp(name, ((const Addon *)addon)->name);
+}
+
+/**
+ * Splits a line in the form '<crc> <size> <mtime> <shared> <rest>' and adds it
+ * to files. The path is the first shared characters of prev, the path of the
+ * line before, followed by rest. prev is updated to the path.
+ */
+static int manifest_parse_file(List *files, char *line, char *prev, size_t n)
+{
+    char *end = NULL;
+
+    unsigned long crc = strtoul(line, &end, 16);
+    if (end == line || *end != ' ') {
+        return MANIFEST_EPARSE;
+    }
+
+    line = end + 1;
+    unsigned long long size = strtoull(line, &end, 10);
+    if (end == line || *end != ' ') {
+        return MANIFEST_EPARSE;
+    }
+
+    line = end + 1;
+    long long mtime = strtoll(line, &end, 10);
+    if (end == line || *end != ' ') {
+        return MANIFEST_EPARSE;
+    }
+
+    line = end + 1;
+    unsigned long long shared = strtoull(line, &end, 10);
+    if (end == line || *end != ' ' || shared > strlen(prev) || shared + strlen(end + 1) == 0) {
+        return MANIFEST_EPARSE;
+    }
+
+    int len = snprintf(prev + shared, n - (size_t)shared, "%s", end + 1);
+    if (len < 0 || (size_t)len >= n - (size_t)shared) {
+        return MANIFEST_EPARSE;
+    }
+
+    ManifestFile *f = manifest_file_create(prev, size, crc, mtime);
+    if (f == NULL) {
+        return MANIFEST_EIO;
+    }
+
+    list_insert(files, f);
+
+    return MANIFEST_OK;
+}
+
+int manifest_load(AppState *state, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return errno == ENOENT ? MANIFEST_ENOENT : MANIFEST_EIO;
+    }
+
+    int err = MANIFEST_OK;
+    char line[OS_MAX_PATH + 64];
+
+    // Files of the current addon, NULL if they are skipped.
+    List *files = NULL;
+    char prev[OS_MAX_PATH] = "";
+
+    if (fgets(line, ARRAY_SIZE(line), f) == NULL || strncmp(line, MANIFEST_HEADER, strlen(MANIFEST_HEADER)) != 0) {
+        err = MANIFEST_EPARSE;
+        goto cleanup;
+    }
+
+    while (fgets(line, ARRAY_SIZE(line), f) != NULL) {
+        size_t len = strcspn(line, "\r\n");
+        if (line[len] == '\0' && !feof(f)) {
+            err = MANIFEST_EPARSE;
+            break;
+        }
+        line[len] = '\0';
+
+        if (line[0] == '@') {
+            ListNode *node = list_search(state->installed, &line[1], cmp_name_to_addon);
+            Addon *a = node != NULL ? node->value : NULL;
+
+            files = NULL;
+            prev[0] = '\0';
+            if (a != NULL && a->files == NULL) {
+                a->files = list_create();
+                if (a->files == NULL) {
+                    err = MANIFEST_EIO;
+                    break;
+                }
+
+                list_set_free_fn(a->files, (ListFreeFn)manifest_file_free);
+                files = a->files;
+            }
+        } else if (line[0] != '\0' && files != NULL) {
+            if ((err = manifest_parse_file(files, line, prev, ARRAY_SIZE(prev))) != MANIFEST_OK) {
+                break;
+            }
+        }
+    }
+
+    if (err == MANIFEST_OK && ferror(f)) {
+        err = MANIFEST_EIO;
+    }
+
+cleanup:
+    fclose(f);
+
+    return err;
+}
+
+int manifest_save(AppState *state, const char *path)
+{
+    int err = manifest_load(state, path);
+    if (err == MANIFEST_ENOENT || err == MANIFEST_EPARSE) {
+        // Nothing to keep.
+        err = MANIFEST_OK;
+    } else if (err != MANIFEST_OK) {
+        return err;
+    }
+
+    char tmp[OS_MAX_PATH];
+    int n = snprintf(tmp, ARRAY_SIZE(tmp), "%s.tmp", path);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(tmp)) {
+        return MANIFEST_ENAMETOOLONG;
+    }
+
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL) {
+        return MANIFEST_EIO;
+    }
+
+    fprintf(f, MANIFEST_HEADER "\n");
+
+    ListNode *node = NULL;
+    list_foreach(node, state->installed)
+    {
+        const Addon *a = node->value;
+        if (a->files == NULL) {
+            continue;
+        }
+
+        size_t nfiles = 0;
+        const ManifestFile **files = manifest_sort(a->files, &nfiles);
+        if (files == NULL) {
+            err = MANIFEST_EIO;
+            break;
+        }
+
+        fprintf(f, "@%s\n", a->name);
+
+        const char *prev = "";
+        for (size_t i = 0; i < nfiles; i++) {
+            const ManifestFile *file = files[i];
+
+            // A path with a line break can not be written, it is skipped and
+            // so never checked.
+            if (strpbrk(file->path, "\r\n") != NULL) {
+                continue;
+            }
+
+            size_t shared = 0;
+            while (prev[shared] != '\0' && prev[shared] == file->path[shared]) {
+                shared++;
+            }
+
+            fprintf(f, "%08lx %llu %lld %zu %s\n", file->crc, file->size, file->mtime, shared, file->path + shared);
+            prev = file->path;
+        }
+
+        free(files);
+    }
+
+    if (ferror(f)) {
+        err = MANIFEST_EIO;
+    }
+
+    if (fclose(f) != 0) {
+        err = MANIFEST_EIO;
+    }
+
+    // The old manifest is only replaced by a complete one.
+    if (err == MANIFEST_OK && os_rename(tmp, path) != 0) {
+        err = MANIFEST_EIO;
+    }
+
+    if (err != MANIFEST_OK) {
+        remove(tmp);
+    }
+
+    return err;
+}
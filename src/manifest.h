@@ -0,0 +1,128 @@
+#pragma once
+
+#include "appstate.h"
+#include "list.h"
+
+/**
+ * Records every file that was installed for an addon with its size, CRC-32 and
+ * modification time, so that the installed files can be checked, reused by
+ * upgrades and deleted without reading the addons directory or the archive.
+ *
+ * The manifests of all addons of a flavor are kept in one file next to its
+ * saved app state. Paths are relative to the addons directory and always use
+ * '/' as the separator.
+ */
+
+enum {
+    MANIFEST_OK = 0,
+
+    MANIFEST_ENOENT, // File does not exist.
+    MANIFEST_ECHANGED, // File exists but is not the one that was installed.
+    MANIFEST_EPARSE,
+    MANIFEST_EIO,
+    MANIFEST_ENAMETOOLONG,
+};
+
+typedef struct ManifestFile {
+    char *path;
+    unsigned long long size;
+    unsigned long crc;
+    long long mtime; // Modification time the file was installed with.
+} ManifestFile;
+
+/**
+ * Returns a new entry, or NULL if it could not be allocated.
+ */
+ManifestFile *manifest_file_create(const char *path, unsigned long long size, unsigned long crc, long long mtime);
+
+/**
+ * Passing a NULL pointer will make this function return immediately with no
+ * action.
+ */
+void manifest_file_free(ManifestFile *f);
+
+/**
+ * Returns a list with a copy of every entry in files, or NULL if files is NULL
+ * or memory could not be allocated.
+ */
+List *manifest_files_dup(const List *files);
+
+/**
+ * Writes the native path of the manifest path rel in the directory root to s.
+ * Has similar semantics as snprintf(3).
+ */
+int snmanifest_path(char *s, size_t n, const char *root, const char *rel);
+
+/**
+ * Gets the size and CRC-32 of the file at path.
+ *
+ * Returns MANIFEST_OK on success, otherwise MANIFEST_ENOENT or MANIFEST_EIO.
+ */
+int manifest_crc_file(const char *path, unsigned long long *size, unsigned long *crc);
+
+/**
+ * Adds an entry for every file below the directory at root to files.
+ *
+ * Returns MANIFEST_OK on success, otherwise one of the MANIFEST_E values.
+ */
+int manifest_scan(List *files, const char *root);
+
+/**
+ * Adds an entry for every file below the directory rel of root to files, with
+ * paths relative to root. rel is a manifest path, "" for root itself.
+ *
+ * Returns MANIFEST_OK on success, otherwise one of the MANIFEST_E values.
+ */
+int manifest_scan_dir(List *files, const char *root, const char *rel);
+
+/**
+ * Checks that the file of f in the directory root is the one that was
+ * installed. A file with another size is not read.
+ *
+ * Returns MANIFEST_OK if it is, otherwise MANIFEST_ENOENT, MANIFEST_ECHANGED,
+ * MANIFEST_EIO or MANIFEST_ENAMETOOLONG.
+ */
+int manifest_check(const char *root, const ManifestFile *f);
+
+/**
+ * Returns the entry of files with the given path, or NULL if there is none.
+ * files shall be sorted with manifest_sort.
+ */
+const ManifestFile *manifest_find(const ManifestFile **files, size_t n, const char *path);
+
+/**
+ * Returns an array of the entries of files sorted by path and stores its
+ * length in n, or NULL if it could not be allocated. The entries still belong
+ * to files.
+ */
+const ManifestFile **manifest_sort(const List *files, size_t *n);
+
+/**
+ * Deletes the files of files that are in the directory dir of root, and then
+ * the directories that held them from the deepest up, without reading any
+ * directory.
+ *
+ * Returns MANIFEST_OK if dir was deleted, MANIFEST_ENOENT if it did not exist,
+ * otherwise MANIFEST_EIO or MANIFEST_ENAMETOOLONG. dir is left behind when it
+ * has files that are not in files.
+ */
+int manifest_remove(const char *root, const List *files, const char *dir);
+
+/**
+ * Loads the manifest file at path into the files of the installed addons of
+ * state that do not have any yet.
+ *
+ * Returns MANIFEST_OK on success, otherwise one of the MANIFEST_E values.
+ */
+int manifest_load(AppState *state, const char *path);
+
+/**
+ * Saves the files of every installed addon of state to the manifest file at
+ * path. Addons without files keep what the file had for them. Entries of
+ * addons that are no longer installed are dropped. The files of each addon are
+ * sorted by path so that each path is only stored as what it does not share
+ * with the one before it.
+ *
+ * Returns MANIFEST_OK on success, otherwise one of the MANIFEST_E values.
+ */
+int manifest_save(AppState *state, const char *path);
@@ -0,0 +1,1165 @@
+#include <ctype.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "net.h"
+#include "osapi.h"
+#include "osstring.h"
+#include "wowpkg.h"
+
+/**
+ * Maximum amount of connections that will be opened to a single host. With
+ * HTTP/2 all requests to a host are multiplexed over one connection so this
+ * only matters for servers that are limited to HTTP/1.1.
+ */
+#define NET_MAX_HOST_CONNECTIONS 6
+
+/**
+ * Maximum amount of requests that are in flight at the same time.
+ */
+#define NET_MAX_CONCURRENT 16
+
+/**
+ * Amount of times a request is retried after a transfer error, a 5xx status,
+ * or being rate limited.
+ */
+#define NET_MAX_RETRIES 3
+
+/**
+ * Delay before the first retry of a failed request. Doubles for each retry.
+ */
+#define NET_BACKOFF_MS 500
+
+/**
+ * Longest time in seconds that requests will wait for a rate limit to reset.
+ * If the reset is further away the requests fail with NET_ERATE_LIMIT instead.
+ */
+#define NET_MAX_RATE_LIMIT_WAIT 60
+
+/**
+ * Per request scheduling state.
+ */
+typedef struct NetTransfer {
+    NetRequest *req;
+    CURL *curl;
+    int attempts;
+    double not_before; // os_monotonic time before which the request shall not start.
+    bool in_flight;
+    bool done;
+} NetTransfer;
+
+/**
+ * Share handle of a thread. libcurl does not support sharing connections
+ * between threads that make requests at the same time, so every thread that
+ * makes requests gets its own.
+ */
+typedef struct NetShare {
+    CURLSH *share;
+    struct NetShare *next;
+} NetShare;
+
+static int init_count = 0;
+
+/**
+ * Requests may be made from many threads at once. net_lock guards stats, the
+ * rate limit budget, and the list of share handles.
+ */
+static OsMutex net_lock = OS_MUTEX_INIT;
+
+static NetShare *shares = NULL;
+static unsigned share_generation = 0; // Changes every time shares is emptied.
+static OS_THREAD_LOCAL CURLSH *thread_share = NULL;
+static OS_THREAD_LOCAL unsigned thread_share_generation = 0;
+
+static NetStats stats;
+static OS_THREAD_LOCAL NetStats thread_stats;
+
+static volatile sig_atomic_t aborted = 0;
+
+/**
+ * Rate limit budget as last reported by the server. remaining is -1 while it is
+ * unknown.
+ */
+static long ratelimit_remaining = -1;
+static long long ratelimit_reset = 0;
+
+static size_t write_response_cb(void *restrict data, size_t size, size_t nmemb, void *restrict userdata)
+{
+    size_t realsize = size * nmemb;
+    NetResponse *res = userdata;
+
+    char *ptr = realloc(res->data, res->size + realsize + 1);
+    if (ptr == NULL) {
+        return 0;
+    }
+
+    res->data = ptr;
+    memcpy(&(res->data[res->size]), data, realsize);
+    res->size += realsize;
+    res->data[res->size] = '\0';
+
+    return realsize;
+}
+
+/**
+ * Copies a header value without the trailing line ending into dst. Values that
+ * do not fit are dropped.
+ */
+static void copy_header_value(char *dst, size_t n, const char *value)
+{
+    size_t len = strcspn(value, "\r\n");
+    if (len >= n) {
+        dst[0] = '\0';
+        return;
+    }
+
+    memcpy(dst, value, len);
+    dst[len] = '\0';
+}
+
+/**
+ * Parses the value of a Content-Range header in the form
+ * 'bytes <first>-<last>/<complete length>'. The complete length may be '*'.
+ */
+static void parse_content_range(NetResponse *res, const char *value)
+{
+    if (strncmp(value, "bytes ", 6) != 0 || !isdigit((unsigned char)value[6])) {
+        return;
+    }
+
+    char *end = NULL;
+    res->range_start = strtoll(&value[6], &end, 10);
+
+    const char *total = strchr(end, '/');
+    if (total != NULL && isdigit((unsigned char)total[1])) {
+        res->range_total = strtoll(&total[1], NULL, 10);
+    }
+}
+
+/**
+ * If the header line starts with name, followed by ':', then returns a pointer
+ * to the value with leading whitespace skipped. Otherwise returns NULL.
+ */
+static const char *header_value(const char *line, size_t len, const char *name)
+{
+    size_t name_len = strlen(name);
+    if (len <= name_len || line[name_len] != ':' || strncasecmp(line, name, name_len) != 0) {
+        return NULL;
+    }
+
+    const char *value = &line[name_len + 1];
+    while (*value == ' ' || *value == '\t') {
+        value++;
+    }
+
+    return value;
+}
+
+static size_t header_cb(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    size_t realsize = size * nitems;
+    NetResponse *res = userdata;
+
+    // Header lines are not null terminated. Values of interest are short so
+    // anything that does not fit is not one of them.
+    char line[256];
+    if (realsize >= ARRAY_SIZE(line)) {
+        return realsize;
+    }
+
+    memcpy(line, buffer, realsize);
+    line[realsize] = '\0';
+
+    const char *value = NULL;
+    if (strncmp(line, "HTTP/", 5) == 0) {
+        // Start of a new response, e.g. after a redirect.
+        res->ratelimit_remaining = -1;
+        res->ratelimit_reset = 0;
+        res->retry_after = -1;
+        res->etag[0] = '\0';
+        res->last_modified[0] = '\0';
+        res->content_length = -1;
+        res->range_start = -1;
+        res->range_total = -1;
+    } else if ((value = header_value(line, realsize, "X-RateLimit-Remaining")) != NULL) {
+        res->ratelimit_remaining = strtol(value, NULL, 10);
+    } else if ((value = header_value(line, realsize, "X-RateLimit-Reset")) != NULL) {
+        res->ratelimit_reset = strtoll(value, NULL, 10);
+    } else if ((value = header_value(line, realsize, "Retry-After")) != NULL) {
+        // Only the delay-seconds form is used by GitHub.
+        if (isdigit((unsigned char)*value)) {
+            res->retry_after = strtol(value, NULL, 10);
+        }
+    } else if ((value = header_value(line, realsize, "ETag")) != NULL) {
+        copy_header_value(res->etag, ARRAY_SIZE(res->etag), value);
+    } else if ((value = header_value(line, realsize, "Last-Modified")) != NULL) {
+        copy_header_value(res->last_modified, ARRAY_SIZE(res->last_modified), value);
+    } else if ((value = header_value(line, realsize, "Content-Length")) != NULL) {
+        if (isdigit((unsigned char)*value)) {
+            res->content_length = strtoll(value, NULL, 10);
+        }
+    } else if ((value = header_value(line, realsize, "Content-Range")) != NULL) {
+        parse_content_range(res, value);
+    }
+
+    return realsize;
+}
+
+/**
+ * Returns the share handle of the calling thread, creating it on first use.
+ *
+ * Sharing is an optimization only. If it is not available requests still work,
+ * they just do not reuse connections between each other, so NULL is returned
+ * on error.
+ */
+static CURLSH *net_thread_share(void)
+{
+    os_mutex_lock(&net_lock);
+    unsigned generation = share_generation;
+    os_mutex_unlock(&net_lock);
+
+    if (thread_share != NULL && thread_share_generation == generation) {
+        return thread_share;
+    }
+
+    thread_share = NULL;
+
+    NetShare *s = calloc(1, sizeof(*s));
+    if (s == NULL) {
+        return NULL;
+    }
+
+    s->share = curl_share_init();
+    if (s->share == NULL) {
+        free(s);
+        return NULL;
+    }
+
+    curl_share_setopt(s->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(s->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(s->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+    os_mutex_lock(&net_lock);
+    s->next = shares;
+    shares = s;
+    os_mutex_unlock(&net_lock);
+
+    thread_share = s->share;
+    thread_share_generation = generation;
+
+    return thread_share;
+}
+
+/**
+ * Stops transfers that are in progress once net_abort was called.
+ */
+static int xferinfo_cb(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+    UNUSED(clientp);
+    UNUSED(dltotal);
+    UNUSED(dlnow);
+    UNUSED(ultotal);
+    UNUSED(ulnow);
+
+    return aborted ? 1 : 0;
+}
+
+/**
+ * Creates an easy handle with all options that are common between requests
+ * set.
+ */
+static CURL *net_easy_create(NetRequest *req)
+{
+    CURL *curl = curl_easy_init();
+    if (curl == NULL) {
+        return NULL;
+    }
+
+    // curl_easy_setopt(curl, CURLOPT_VERBOSE, true);
+    curl_easy_setopt(curl, CURLOPT_URL, req->url);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, WOWPKG_USER_AGENT);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_response_cb);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&req->res);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_cb);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void *)&req->res);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, req->headers);
+
+    if (req->body != NULL) {
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, req->body);
+    }
+
+    // An empty string enables every encoding the linked libcurl was built
+    // with. Options that are not supported by the build are ignored.
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    // Not CURLOPT_PIPEWAIT: over HTTP/1.1, which is plain http, proxies and
+    // builds without HTTP/2, it would run concurrent requests one at a time.
+    // Requests are still multiplexed once a connection has HTTP/2, see
+    // CURLMOPT_PIPELINING in net_get_many.
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+
+    CURLSH *share = net_thread_share();
+    if (share != NULL) {
+        curl_easy_setopt(curl, CURLOPT_SHARE, share);
+    }
+
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xferinfo_cb);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+
+    return curl;
+}
+
+/**
+ * Clears the response so that a request can be attempted again.
+ */
+static void net_response_clear(NetResponse *res)
+{
+    free(res->data);
+    res->data = NULL;
+    res->size = 0;
+    res->status = 0;
+    res->ratelimit_remaining = -1;
+    res->ratelimit_reset = 0;
+    res->retry_after = -1;
+    res->etag[0] = '\0';
+    res->last_modified[0] = '\0';
+    res->content_length = -1;
+    res->range_start = -1;
+    res->range_total = -1;
+}
+
+/**
+ * Adds to the stats of all threads and of the calling thread.
+ */
+static void net_add_stats(const NetStats *add)
+{
+    os_mutex_lock(&net_lock);
+    stats.requests += add->requests;
+    stats.wire_bytes += add->wire_bytes;
+    stats.decoded_bytes += add->decoded_bytes;
+    stats.reused_connections += add->reused_connections;
+    stats.resumed_bytes += add->resumed_bytes;
+    os_mutex_unlock(&net_lock);
+
+    thread_stats.requests += add->requests;
+    thread_stats.wire_bytes += add->wire_bytes;
+    thread_stats.decoded_bytes += add->decoded_bytes;
+    thread_stats.reused_connections += add->reused_connections;
+    thread_stats.resumed_bytes += add->resumed_bytes;
+}
+
+/**
+ * Stores the result of a finished transfer in req and adds it to the stats.
+ */
+static void net_finish(NetRequest *req, CURL *curl, CURLcode status)
+{
+    if (status != CURLE_OK) {
+        req->err = NET_ETRANSFER;
+        req->res.status = 0;
+    } else {
+        req->err = NET_OK;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &req->res.status);
+    }
+
+    curl_off_t wire = 0;
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &wire);
+
+    long nconnects = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &nconnects);
+
+    NetStats add;
+    memset(&add, 0, sizeof(add));
+    add.requests = 1;
+    add.wire_bytes = wire;
+    add.decoded_bytes = (curl_off_t)req->res.size;
+    add.reused_connections = status == CURLE_OK && nconnects == 0 ? 1 : 0;
+
+    net_add_stats(&add);
+
+    if (req->res.ratelimit_remaining >= 0) {
+        os_mutex_lock(&net_lock);
+        ratelimit_remaining = req->res.ratelimit_remaining;
+        ratelimit_reset = req->res.ratelimit_reset;
+        os_mutex_unlock(&net_lock);
+    }
+}
+
+/**
+ * Returns true if the response says the request was rejected because of a
+ * rate limit.
+ */
+static bool net_is_rate_limited(const NetResponse *res)
+{
+    if (res->status == 429) {
+        return true;
+    }
+
+    return res->status == 403 && (res->ratelimit_remaining == 0 || res->retry_after >= 0);
+}
+
+/**
+ * Returns the amount of seconds until the rate limit budget is restored
+ * according to the response.
+ */
+static long long net_rate_limit_delay(const NetResponse *res)
+{
+    if (res->retry_after >= 0) {
+        return res->retry_after;
+    }
+
+    long long delay = res->ratelimit_reset - (long long)time(NULL);
+
+    return delay > 0 ? delay : 1;
+}
+
+/**
+ * Decides what happens to a transfer that just finished. Either it is done, or
+ * it is scheduled to be attempted again.
+ */
+static void net_schedule_retry(NetTransfer *t, double now)
+{
+    NetResponse *res = &t->req->res;
+    bool rate_limited = net_is_rate_limited(res);
+
+    t->done = true;
+
+    double delay = 0.0;
+    if (rate_limited) {
+        long long wait = net_rate_limit_delay(res);
+        if (wait > NET_MAX_RATE_LIMIT_WAIT || t->attempts > NET_MAX_RETRIES) {
+            t->req->err = NET_ERATE_LIMIT;
+            return;
+        }
+
+        PRINT_WARNING("rate limited by %s, retrying in %llds\n", t->req->url, wait);
+        delay = (double)wait;
+    } else if (t->req->err == NET_ETRANSFER || res->status >= 500) {
+        if (t->attempts > NET_MAX_RETRIES) {
+            return;
+        }
+
+        delay = (double)(NET_BACKOFF_MS << (t->attempts - 1)) / 1000.0;
+    } else {
+        return;
+    }
+
+    net_response_clear(res);
+    t->req->err = NET_ETRANSFER;
+    t->not_before = now + delay;
+    t->done = false;
+}
+
+/**
+ * Returns true if the known rate limit budget does not allow another request
+ * to be started while in_flight requests are still outstanding.
+ */
+static bool net_budget_exhausted(size_t in_flight)
+{
+    bool exhausted = false;
+
+    os_mutex_lock(&net_lock);
+    if (ratelimit_remaining >= 0 && ratelimit_reset <= (long long)time(NULL)) {
+        // The budget has been restored. It is unknown again until the next
+        // response.
+        ratelimit_remaining = -1;
+    } else if (ratelimit_remaining >= 0) {
+        exhausted = (size_t)ratelimit_remaining <= in_flight;
+    }
+    os_mutex_unlock(&net_lock);
+
+    return exhausted;
+}
+
+/**
+ * Sorts transfers by descending priority. Ties keep the order the requests
+ * were given in.
+ */
+static int cmp_transfer(const void *a, const void *b)
+{
+    const NetTransfer *ta = a;
+    const NetTransfer *tb = b;
+
+    if (ta->req->priority != tb->req->priority) {
+        return ta->req->priority < tb->req->priority ? 1 : -1;
+    }
+
+    return ta->req < tb->req ? -1 : (ta->req > tb->req);
+}
+
+/**
+ * Returns how many milliseconds to wait for activity on the in flight
+ * transfers before checking if more transfers can be started. next_start is
+ * the earliest time a delayed transfer may start.
+ */
+static int net_poll_timeout(const NetTransfer *transfers, size_t n, size_t in_flight, double next_start)
+{
+    double now = os_monotonic();
+
+    for (size_t i = 0; i < n && in_flight < NET_MAX_CONCURRENT; i++) {
+        const NetTransfer *t = &transfers[i];
+        if (!t->done && !t->in_flight && t->not_before <= now && !net_budget_exhausted(in_flight)) {
+            return 0;
+        }
+    }
+
+    double timeout = (next_start - now) * 1000.0;
+    if (in_flight > 0 || timeout > 1000.0) {
+        return 1000;
+    }
+
+    return timeout > 0.0 ? (int)timeout : 0;
+}
+
+int net_init(void)
+{
+    if (init_count++ > 0) {
+        return NET_OK;
+    }
+
+    os_mutex_lock(&net_lock);
+    memset(&stats, 0, sizeof(stats));
+    os_mutex_unlock(&net_lock);
+
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
+        init_count = 0;
+        return NET_EINTERNAL;
+    }
+
+    return NET_OK;
+}
+
+void net_cleanup(void)
+{
+    if (init_count == 0 || --init_count > 0) {
+        return;
+    }
+
+    // No requests are in progress at this point. Threads notice that their
+    // share handle is gone by the changed generation.
+    os_mutex_lock(&net_lock);
+    while (shares != NULL) {
+        NetShare *next = shares->next;
+        curl_share_cleanup(shares->share);
+        free(shares);
+        shares = next;
+    }
+    share_generation++;
+    os_mutex_unlock(&net_lock);
+
+    curl_global_cleanup();
+}
+
+int net_get(NetRequest *req)
+{
+    if (net_get_many(req, 1) != NET_OK) {
+        req->err = NET_EINTERNAL;
+    }
+
+    return req->err;
+}
+
+int net_get_many(NetRequest *reqs, size_t n)
+{
+    int err = NET_OK;
+
+    NetTransfer *transfers = calloc(n, sizeof(*transfers));
+    if (n > 0 && transfers == NULL) {
+        return NET_ENOMEM;
+    }
+
+    CURLM *multi = curl_multi_init();
+    if (multi == NULL) {
+        err = NET_EINTERNAL;
+        goto cleanup;
+    }
+
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)NET_MAX_HOST_CONNECTIONS);
+
+    for (size_t i = 0; i < n; i++) {
+        net_request_reset(&reqs[i]);
+
+        // Overwritten once the transfer finishes.
+        reqs[i].err = NET_ETRANSFER;
+
+        transfers[i].req = &reqs[i];
+        transfers[i].curl = net_easy_create(&reqs[i]);
+        if (transfers[i].curl == NULL) {
+            err = NET_EINTERNAL;
+            goto cleanup;
+        }
+    }
+
+    qsort(transfers, n, sizeof(*transfers), cmp_transfer);
+
+    for (size_t i = 0; i < n; i++) {
+        curl_easy_setopt(transfers[i].curl, CURLOPT_PRIVATE, (void *)&transfers[i]);
+    }
+
+    size_t in_flight = 0;
+    size_t ndone = 0;
+    while (ndone < n) {
+        double now = os_monotonic();
+        double next_start = now + 1.0;
+
+        if (aborted) {
+            for (size_t i = 0; i < n; i++) {
+                if (!transfers[i].done) {
+                    net_response_clear(&transfers[i].req->res);
+                    transfers[i].req->err = NET_EABORTED;
+                    transfers[i].done = true;
+                }
+            }
+            break;
+        }
+
+        // Start as many waiting transfers as allowed, in priority order.
+        for (size_t i = 0; i < n && in_flight < NET_MAX_CONCURRENT; i++) {
+            NetTransfer *t = &transfers[i];
+            if (t->done || t->in_flight) {
+                continue;
+            }
+
+            if (t->not_before > now) {
+                if (t->not_before < next_start) {
+                    next_start = t->not_before;
+                }
+                continue;
+            }
+
+            if (net_budget_exhausted(in_flight)) {
+                if (in_flight > 0) {
+                    // Responses that are still outstanding will tell how
+                    // much budget is left.
+                    break;
+                }
+
+                long remaining;
+                long long reset;
+                net_get_ratelimit(&remaining, &reset);
+
+                long long wait = reset - (long long)time(NULL);
+                if (wait > NET_MAX_RATE_LIMIT_WAIT) {
+                    // Stop before hitting the limit. Nothing else can be
+                    // started so everything left over is rate limited.
+                    for (size_t j = 0; j < n; j++) {
+                        if (!transfers[j].done) {
+                            transfers[j].req->err = NET_ERATE_LIMIT;
+                            transfers[j].done = true;
+                            ndone++;
+                        }
+                    }
+                    break;
+                }
+
+                PRINT_WARNING("rate limit reached, waiting %llds for it to reset\n", wait);
+                next_start = now + (double)wait;
+                for (size_t j = 0; j < n; j++) {
+                    transfers[j].not_before = next_start;
+                }
+                break;
+            }
+
+            t->attempts++;
+            t->in_flight = true;
+            in_flight++;
+
+            curl_multi_add_handle(multi, t->curl);
+        }
+
+        if (ndone == n) {
+            break;
+        }
+
+        int running = 0;
+        CURLMcode mc = curl_multi_perform(multi, &running);
+        if (mc != CURLM_OK) {
+            err = NET_EINTERNAL;
+            break;
+        }
+
+        CURLMsg *msg = NULL;
+        int msgs_left = 0;
+        while ((msg = curl_multi_info_read(multi, &msgs_left)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+
+            char *priv = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+            NetTransfer *t = (NetTransfer *)(void *)priv;
+
+            net_finish(t->req, t->curl, msg->data.result);
+            curl_multi_remove_handle(multi, t->curl);
+
+            t->in_flight = false;
+            in_flight--;
+
+            net_schedule_retry(t, os_monotonic());
+            if (t->done) {
+                ndone++;
+            }
+        }
+
+        if (ndone == n) {
+            break;
+        }
+
+        int timeout_ms = net_poll_timeout(transfers, n, in_flight, next_start);
+        if (timeout_ms > 0 && curl_multi_poll(multi, NULL, 0, timeout_ms, NULL) != CURLM_OK) {
+            err = NET_EINTERNAL;
+            break;
+        }
+    }
+
+cleanup:
+    for (size_t i = 0; i < n && transfers != NULL; i++) {
+        if (transfers[i].curl != NULL) {
+            if (transfers[i].in_flight) {
+                curl_multi_remove_handle(multi, transfers[i].curl);
+            }
+            curl_easy_cleanup(transfers[i].curl);
+        }
+    }
+
+    curl_multi_cleanup(multi);
+    free(transfers);
+
+    return err;
+}
+
+/**
+ * Returns the size of the file at path, or -1 if it does not exist.
+ */
+static long long net_file_size(const char *path)
+{
+    struct stat st;
+    if (os_stat(path, &st) != 0) {
+        return -1;
+    }
+
+    return (long long)st.st_size;
+}
+
+/**
+ * Reads the validator and size of a .part file. The validator is the ETag if
+ * one was sent, otherwise Last-Modified. Weak ETags can not be used with
+ * If-Range so they are skipped, and so are values that are too long to be sent
+ * whole.
+ *
+ * Returns 0 if a validator was found, -1 otherwise.
+ */
+static int net_part_meta_read(const char *meta_path, char *validator, size_t n, long long *size)
+{
+    FILE *f = os_fopen_nofollow(meta_path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    char etag[ARRAY_SIZE(((NetResponse *)0)->etag)] = { 0 };
+    char last_modified[ARRAY_SIZE(((NetResponse *)0)->last_modified)] = { 0 };
+    *size = -1;
+
+    char line[256];
+    while (fgets(line, ARRAY_SIZE(line), f) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (strncmp(line, "etag=", 5) == 0) {
+            copy_header_value(etag, ARRAY_SIZE(etag), &line[5]);
+        } else if (strncmp(line, "last-modified=", 14) == 0) {
+            copy_header_value(last_modified, ARRAY_SIZE(last_modified), &line[14]);
+        } else if (strncmp(line, "size=", 5) == 0) {
+            *size = strtoll(&line[5], NULL, 10);
+        }
+    }
+
+    fclose(f);
+
+    if (etag[0] != '\0' && strncmp(etag, "W/", 2) != 0) {
+        snprintf(validator, n, "%s", etag);
+    } else if (last_modified[0] != '\0') {
+        snprintf(validator, n, "%s", last_modified);
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void net_part_meta_write(const char *meta_path, const NetResponse *res, long long size)
+{
+    FILE *f = os_fopen_nofollow(meta_path, "w");
+    if (f == NULL) {
+        return;
+    }
+
+    fprintf(f, "etag=%s\nlast-modified=%s\nsize=%lld\n", res->etag, res->last_modified, size);
+
+    // A meta file that does not describe the .part file is worse than none.
+    if (fclose(f) != 0) {
+        remove(meta_path);
+    }
+}
+
+/**
+ * State of one attempt to download to a .part file.
+ */
+typedef struct NetDownload {
+    CURL *curl;
+    NetResponse *res;
+    Sha256 *sha256; // See NetRequest.sha256, may be NULL.
+    const char *part_path;
+    const char *meta_path;
+    FILE *f;
+    long long offset; // Size of the .part file when the attempt started.
+    long long size; // Size of the complete file, -1 if unknown.
+    bool started; // Response status has been checked.
+    bool discard; // Response body is not part of the file.
+    bool invalid; // The .part file does not belong to the response and shall be removed.
+} NetDownload;
+
+/**
+ * Decides what to do with the response body once its headers are known.
+ *
+ * Returns 0 if the body can be written, -1 if the transfer shall be aborted.
+ */
+static int net_download_start(NetDownload *dl)
+{
+    long status = 0;
+    curl_easy_getinfo(dl->curl, CURLINFO_RESPONSE_CODE, &status);
+
+    dl->started = true;
+
+    if (status == 206) {
+        if (dl->offset == 0 || dl->res->range_start != dl->offset
+            || (dl->size >= 0 && dl->res->range_total != dl->size)) {
+
+            dl->invalid = true;
+            return -1;
+        }
+
+        dl->size = dl->res->range_total;
+        NetStats add;
+        memset(&add, 0, sizeof(add));
+        add.resumed_bytes = (curl_off_t)dl->offset;
+        net_add_stats(&add);
+
+        return 0;
+    }
+
+    if (status == 200) {
+        // Either the range was not asked for, or the file changed since the
+        // .part file was created. Start over.
+        if (dl->offset > 0) {
+            dl->f = freopen(dl->part_path, "wb", dl->f);
+            if (dl->f == NULL) {
+                return -1;
+            }
+            dl->offset = 0;
+
+            if (dl->sha256 != NULL) {
+                sha256_init(dl->sha256);
+            }
+        }
+
+        dl->size = dl->res->content_length;
+        net_part_meta_write(dl->meta_path, dl->res, dl->size);
+
+        return 0;
+    }
+
+    // Error responses are not written to the file.
+    dl->discard = true;
+
+    return 0;
+}
+
+static size_t write_download_cb(void *restrict data, size_t size, size_t nmemb, void *restrict userdata)
+{
+    size_t realsize = size * nmemb;
+    NetDownload *dl = userdata;
+
+    if (!dl->started && net_download_start(dl) != 0) {
+        return 0;
+    }
+
+    if (dl->discard) {
+        return realsize;
+    }
+
+    if (fwrite(data, 1, realsize, dl->f) != realsize) {
+        return 0;
+    }
+
+    if (dl->sha256 != NULL) {
+        sha256_update(dl->sha256, data, realsize);
+    }
+
+    dl->res->size += realsize;
+
+    return realsize;
+}
+
+/**
+ * Starts dl->sha256 over with the first dl->offset bytes of the .part file
+ * that the download continues.
+ *
+ * Returns 0 on success, -1 if the .part file could not be read.
+ */
+static int net_download_hash_part(NetDownload *dl)
+{
+    sha256_init(dl->sha256);
+
+    FILE *f = dl->offset > 0 ? os_fopen_nofollow(dl->part_path, "rb") : NULL;
+    if (f == NULL) {
+        return dl->offset > 0 ? -1 : 0;
+    }
+
+    unsigned char buf[16384];
+    long long left = dl->offset;
+    while (left > 0) {
+        size_t n = fread(buf, 1, left < (long long)sizeof(buf) ? (size_t)left : sizeof(buf), f);
+        if (n == 0) {
+            break;
+        }
+
+        sha256_update(dl->sha256, buf, n);
+        left -= (long long)n;
+    }
+
+    fclose(f);
+
+    return left == 0 ? 0 : -1;
+}
+
+/**
+ * Performs one attempt of a download, resuming the .part file if possible.
+ *
+ * Returns NET_OK if the request was attempted, the result is in req.
+ */
+static int net_download_attempt(NetRequest *req, NetDownload *dl)
+{
+    int err = NET_OK;
+    struct curl_slist *headers = NULL;
+
+    char validator[ARRAY_SIZE(req->res.etag)];
+    dl->offset = net_file_size(dl->part_path);
+    if (dl->offset > 0 && net_part_meta_read(dl->meta_path, validator, ARRAY_SIZE(validator), &dl->size) != 0) {
+        // Without a validator there is no way to tell if the remaining bytes
+        // would belong to the same file.
+        dl->offset = 0;
+    }
+
+    if (dl->offset <= 0) {
+        dl->offset = 0;
+        dl->size = -1;
+    }
+
+    // Hashed from the start even if only the rest is downloaded.
+    if (dl->sha256 != NULL && net_download_hash_part(dl) != 0) {
+        dl->offset = 0;
+        dl->size = -1;
+        sha256_init(dl->sha256);
+    }
+
+    dl->f = os_fopen_nofollow(dl->part_path, dl->offset > 0 ? "ab" : "wb");
+    if (dl->f == NULL) {
+        return NET_EINTERNAL;
+    }
+
+    for (const struct curl_slist *h = req->headers; h != NULL; h = h->next) {
+        headers = curl_slist_append(headers, h->data);
+        if (headers == NULL) {
+            err = NET_ENOMEM;
+            goto cleanup;
+        }
+    }
+
+    if (dl->offset > 0) {
+        char range[64];
+        char if_range[ARRAY_SIZE(validator) + 16];
+        snprintf(range, ARRAY_SIZE(range), "Range: bytes=%lld-", dl->offset);
+        snprintf(if_range, ARRAY_SIZE(if_range), "If-Range: %s", validator);
+
+        struct curl_slist *tmp = curl_slist_append(headers, range);
+        tmp = tmp == NULL ? NULL : curl_slist_append(tmp, if_range);
+        if (tmp == NULL) {
+            err = NET_ENOMEM;
+            goto cleanup;
+        }
+        headers = tmp;
+    }
+
+    dl->curl = net_easy_create(req);
+    if (dl->curl == NULL) {
+        err = NET_EINTERNAL;
+        goto cleanup;
+    }
+
+    // Ranges apply to the encoded body. Archives are already compressed so
+    // there is nothing to gain from asking for an encoding anyway.
+    curl_easy_setopt(dl->curl, CURLOPT_ACCEPT_ENCODING, NULL);
+    curl_easy_setopt(dl->curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(dl->curl, CURLOPT_WRITEFUNCTION, write_download_cb);
+    curl_easy_setopt(dl->curl, CURLOPT_WRITEDATA, (void *)dl);
+
+    dl->started = false;
+    dl->discard = false;
+    dl->invalid = false;
+
+    CURLcode status = curl_easy_perform(dl->curl);
+    if (status == CURLE_OK && !dl->started && net_download_start(dl) != 0) {
+        // The response had no body so it was not checked while receiving.
+        status = CURLE_WRITE_ERROR;
+    }
+
+    net_finish(req, dl->curl, status);
+
+cleanup:
+    if (dl->f != NULL && fclose(dl->f) != 0 && err == NET_OK && req->err == NET_OK) {
+        err = NET_EINTERNAL;
+    }
+    dl->f = NULL;
+
+    curl_easy_cleanup(dl->curl);
+    dl->curl = NULL;
+    curl_slist_free_all(headers);
+
+    return err;
+}
+
+int net_download(NetRequest *req, const char *path)
+{
+    char part_path[OS_MAX_PATH];
+    char meta_path[OS_MAX_PATH];
+
+    int n = snprintf(part_path, ARRAY_SIZE(part_path), "%s.part", path);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(part_path)) {
+        req->err = NET_EINTERNAL;
+        return req->err;
+    }
+
+    n = snprintf(meta_path, ARRAY_SIZE(meta_path), "%s.part.meta", path);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(meta_path)) {
+        req->err = NET_EINTERNAL;
+        return req->err;
+    }
+
+    NetDownload dl;
+    memset(&dl, 0, sizeof(dl));
+    dl.res = &req->res;
+    dl.sha256 = req->sha256;
+    dl.part_path = part_path;
+    dl.meta_path = meta_path;
+
+    for (int attempts = 1;; attempts++) {
+        net_request_reset(req);
+
+        int err = net_download_attempt(req, &dl);
+        if (err != NET_OK) {
+            req->err = err;
+            break;
+        }
+
+        NetResponse *res = &req->res;
+        bool retry = attempts <= NET_MAX_RETRIES;
+
+        if (dl.invalid || res->status == 416) {
+            // The .part file does not match what the server has.
+            remove(part_path);
+            remove(meta_path);
+            req->err = NET_ETRANSFER;
+            if (retry) {
+                continue;
+            }
+            break;
+        }
+
+        if (net_is_rate_limited(res)) {
+            req->err = NET_ERATE_LIMIT;
+            break;
+        }
+
+        long long size = net_file_size(part_path);
+        bool complete = req->err == NET_OK && (res->status == 200 || res->status == 206)
+            && (dl.size < 0 || size == dl.size);
+
+        if (complete) {
+            if (os_rename(part_path, path) != 0) {
+                req->err = NET_EINTERNAL;
+            }
+            remove(meta_path);
+            break;
+        }
+
+        if (aborted) {
+            // The .part file is kept so that the next run can resume it.
+            req->err = NET_EABORTED;
+            break;
+        }
+
+        if (req->err == NET_OK && res->status / 100 != 2 && res->status < 500) {
+            // Not something a retry will fix.
+            break;
+        }
+
+        if (dl.size >= 0 && size > dl.size) {
+            remove(part_path);
+            remove(meta_path);
+        }
+
+        // Either the transfer was cut short or the server had an error, the
+        // next attempt continues where this one stopped.
+        req->err = NET_ETRANSFER;
+        if (!retry) {
+            break;
+        }
+
+        os_sleep((double)(NET_BACKOFF_MS << (attempts - 1)) / 1000.0);
+    }
+
+    return req->err;
+}
+
+void net_request_reset(NetRequest *req)
+{
+    net_response_clear(&req->res);
+    req->err = NET_OK;
+}
+
+void net_get_stats(NetStats *out)
+{
+    os_mutex_lock(&net_lock);
+    *out = stats;
+    os_mutex_unlock(&net_lock);
+}
+
+void net_get_thread_stats(NetStats *out)
+{
+    *out = thread_stats;
+}
+
+void net_get_ratelimit(long *remaining, long long *reset)
+{
+    os_mutex_lock(&net_lock);
+    *remaining = ratelimit_remaining;
+    *reset = ratelimit_reset;
+    os_mutex_unlock(&net_lock);
+}
+
+void net_abort(void)
+{
+    aborted = 1;
+}
+
+void net_reset(void)
+{
+    os_mutex_lock(&net_lock);
+    memset(&stats, 0, sizeof(stats));
+    os_mutex_unlock(&net_lock);
+
+    aborted = 0;
+}
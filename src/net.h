@@ -0,0 +1,168 @@
+/**
+ * Thin wrapper around libcurl that every HTTP request made by the program goes
+ * through.
+ *
+ * All requests negotiate HTTP/2 and any content encoding (gzip, br, zstd) that
+ * the linked libcurl supports. Requests made with net_get_many are performed
+ * concurrently and are multiplexed over a single connection per host when the
+ * server supports HTTP/2.
+ *
+ * Requests are scheduled with the server's rate limit in mind. The budget
+ * reported by X-RateLimit-Remaining and X-RateLimit-Reset limits how many
+ * requests are started, and requests that are rejected with a rate limit or a
+ * server error are retried with a delay taken from Retry-After or with
+ * exponential backoff. When the budget will not reset soon, requests that have
+ * not been started fail with NET_ERATE_LIMIT instead of being sent.
+ *
+ * Requests may be made from multiple threads at the same time once net_init
+ * was called. Connections, DNS results, and TLS sessions are reused between
+ * the requests made by the same thread.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <curl/curl.h>
+
+#include "sha256.h"
+
+enum {
+    NET_OK = 0,
+
+    NET_ETRANSFER, // Transfer failed before a HTTP response was received.
+    NET_ERATE_LIMIT, // Request was not made, or was rejected, because of a rate limit.
+    NET_ENOMEM, // Memory allocation failed.
+    NET_EINTERNAL, // Internal error.
+    NET_EABORTED, // Request was stopped by net_abort.
+};
+
+typedef struct NetResponse {
+    long status; // HTTP status code, 0 if no response was received.
+    char *data; // Response body. When not NULL it is always null terminated.
+    size_t size; // Size of the response body, not including the terminating null.
+
+    long ratelimit_remaining; // X-RateLimit-Remaining, -1 if not sent.
+    long long ratelimit_reset; // X-RateLimit-Reset in seconds since epoch, 0 if not sent.
+    long retry_after; // Retry-After in seconds, -1 if not sent.
+
+    char etag[128]; // ETag, empty if not sent.
+    char last_modified[64]; // Last-Modified, empty if not sent.
+    long long content_length; // Content-Length, -1 if not sent.
+    long long range_start; // First byte position of Content-Range, -1 if not sent.
+    long long range_total; // Complete length of Content-Range, -1 if not sent or unknown.
+} NetResponse;
+
+typedef struct NetRequest {
+    const char *url;
+    const struct curl_slist *headers;
+    const char *body; // When not NULL the request is sent as a POST with this body.
+    int priority; // Requests with a higher priority are started first.
+    Sha256 *sha256; // When not NULL net_download hashes the file as it is written.
+
+    NetResponse res;
+    int err;
+} NetRequest;
+
+/**
+ * Counters for all requests performed since net_init.
+ *
+ * wire_bytes is the amount of body bytes as they were received, before any
+ * content decoding. decoded_bytes is the amount of body bytes after decoding.
+ *
+ * reused_connections is the amount of requests that were sent over an already
+ * open connection instead of connecting again. resumed_bytes is the amount of
+ * bytes that downloads did not have to receive again because they were resumed.
+ */
+typedef struct NetStats {
+    size_t requests;
+    curl_off_t wire_bytes;
+    curl_off_t decoded_bytes;
+    size_t reused_connections;
+    curl_off_t resumed_bytes;
+} NetStats;
+
+/**
+ * Initializes and cleans up the network layer. Calls may be nested, only the
+ * outermost net_cleanup releases resources.
+ *
+ * net_init returns NET_OK on success.
+ */
+int net_init(void);
+void net_cleanup(void);
+
+/**
+ * Performs a GET request, or POST if req->body is set, for req->url with
+ * req->headers. Redirects are followed.
+ *
+ * On return req->res contains the response and req->err is set. Even if an
+ * error occurred, net_request_reset shall be called to release the response.
+ *
+ * Returns req->err. A non 2xx status code is not considered an error.
+ */
+int net_get(NetRequest *req);
+
+/**
+ * Same as net_get except all n requests are performed concurrently.
+ *
+ * Returns NET_OK if every request could be attempted. The result of each
+ * individual request is stored in its err member.
+ */
+int net_get_many(NetRequest *reqs, size_t n);
+
+/**
+ * Downloads req->url to the file at path, replacing it if it exists. The
+ * response body is not stored in req->res.data.
+ *
+ * Data is first written to '<path>.part' together with the ETag, Last-Modified,
+ * and size of the file in '<path>.part.meta'. If the transfer is interrupted
+ * then the next attempt, either a retry or a later call with the same path,
+ * asks for the remaining bytes with a Range request. If-Range makes sure the
+ * server only sends a partial response when the file has not changed, so a
+ * stale .part file is replaced instead of being completed with other content.
+ * Once the size matches the announced size the .part file is renamed to path.
+ *
+ * If req->sha256 is set it is initialized and then updated with every byte of
+ * the file, including the ones of a .part file that is resumed, so that the
+ * caller only has to finalize it to check the download.
+ *
+ * Returns req->err, same as net_get. On success req->res.status is either 200
+ * or 206. Partial data is kept when the download fails.
+ */
+int net_download(NetRequest *req, const char *path);
+
+/**
+ * Frees the response body and resets the response so that the request can be
+ * reused.
+ */
+void net_request_reset(NetRequest *req);
+
+/**
+ * Copies the counters for all requests made so far into out.
+ *
+ * net_get_thread_stats only counts the requests made by the calling thread.
+ * These counters are never reset.
+ */
+void net_get_stats(NetStats *out);
+void net_get_thread_stats(NetStats *out);
+
+/**
+ * Gets the rate limit budget last reported by the server. remaining is -1 if it
+ * is unknown, reset is in seconds since epoch.
+ */
+void net_get_ratelimit(long *remaining, long long *reset);
+
+/**
+ * Stops every request in progress and fails every request that is made
+ * afterwards with NET_EABORTED. Only sets a flag, so it is safe to call from a
+ * signal handler.
+ */
+void net_abort(void);
+
+/**
+ * Undoes net_abort and zeroes the counters of net_get_stats, as if net_init was
+ * called for the first time, so that a long running process can make requests
+ * for other work without the connections it keeps being closed.
+ */
+void net_reset(void);
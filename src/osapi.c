@@ -5,8 +5,24 @@
 
 #ifdef _WIN32
 #include <io.h>
+#include <sys/utime.h>
 #else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
+#include <utime.h>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+#ifdef __APPLE__
+#include <sys/clonefile.h>
 #endif
 
 #include "osapi.h"
@@ -49,7 +65,50 @@ static int copy_file(const char *oldpath, const char *newpath)
 }
 
 /**
- * Copies all contents of directory at old path to new path.
+ * Makes the file at new path a copy of the file at old path that shares storage
+ * with it when the file system allows. A copy-on-write clone is tried first,
+ * then a hard link, and the contents are copied as a last resort.
+ */
+static int clone_file(const char *oldpath, const char *newpath)
+{
+#if defined(__linux__) && defined(FICLONE)
+    int fold = open(oldpath, O_RDONLY);
+    if (fold >= 0) {
+        struct os_stat s_old;
+        int fnew = fstat(fold, &s_old) == 0 ? open(newpath, O_WRONLY | O_CREAT | O_EXCL, s_old.st_mode & (S_IRWXU | S_IRWXG | S_IRWXO)) : -1;
+        if (fnew >= 0) {
+            int err = ioctl(fnew, FICLONE, fold);
+            close(fnew);
+            if (err == 0) {
+                close(fold);
+                return 0;
+            }
+            unlink(newpath);
+        }
+        close(fold);
+    }
+#elif defined(__APPLE__)
+    if (clonefile(oldpath, newpath, 0) == 0) {
+        return 0;
+    }
+#endif
+
+#ifdef _WIN32
+    if (CreateHardLinkA(newpath, oldpath, NULL)) {
+        return 0;
+    }
+#else
+    if (link(oldpath, newpath) == 0) {
+        return 0;
+    }
+#endif
+
+    return copy_file(oldpath, newpath);
+}
+
+/**
+ * Copies all contents of directory at old path to new path. Each file is
+ * copied with copy_fn.
  *
  * Old and new path shall be paths to directories that already exist. If new
  * path contains a file with the same path from old path, then the file will be
@@ -57,7 +116,7 @@ static int copy_file(const char *oldpath, const char *newpath)
  *
  * Returns 0, -1 and sets errno on errors.
  */
-static int copy_dir(const char *oldpath, const char *newpath)
+static int copy_dir(const char *oldpath, const char *newpath, int (*copy_fn)(const char *, const char *))
 {
     int err = 0;
 
@@ -121,9 +180,9 @@ static int copy_dir(const char *oldpath, const char *newpath)
                 return -1;
             }
 
-            err = copy_dir(oldname, newname);
+            err = copy_dir(oldname, newname, copy_fn);
         } else {
-            err = copy_file(oldname, newname);
+            err = copy_fn(oldname, newname);
         }
 
         if (err != 0) {
@@ -234,6 +293,63 @@ int os_mkdir(const char *path, mode_t perms)
 #endif
 }
 
+int os_mkdir_private(const char *path)
+{
+    if (os_mkdir(path, 0700) != 0 && errno != EEXIST) {
+        return -1;
+    }
+
+    struct os_stat s;
+    if (os_lstat(path, &s) != 0) {
+        return -1;
+    }
+
+#ifdef _WIN32
+    if (!S_ISDIR(s.st_mode)) {
+        errno = EPERM;
+        return -1;
+    }
+#else
+    if (!S_ISDIR(s.st_mode) || s.st_uid != getuid() || (s.st_mode & 0777) != 0700) {
+        errno = EPERM;
+        return -1;
+    }
+#endif
+
+    return 0;
+}
+
+FILE *os_fopen_nofollow(const char *path, const char *mode)
+{
+#ifdef _WIN32
+    return fopen(path, mode);
+#else
+    int flags = 0;
+    if (mode[0] == 'r') {
+        flags = O_RDONLY;
+    } else if (mode[0] == 'w') {
+        flags = O_WRONLY | O_CREAT | O_TRUNC;
+    } else if (mode[0] == 'a') {
+        flags = O_WRONLY | O_CREAT | O_APPEND;
+    } else {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    int fd = open(path, flags | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    FILE *f = fdopen(fd, mode);
+    if (f == NULL) {
+        close(fd);
+    }
+
+    return f;
+#endif
+}
+
 int os_mkdir_all(char *path, mode_t perms)
 {
 #ifdef _WIN32
@@ -448,7 +564,7 @@ int os_rename(const char *oldpath, const char *newpath)
             }
         }
 
-        if (copy_dir(oldpath, newpath) != 0) {
+        if (copy_dir(oldpath, newpath, copy_file) != 0) {
             return -1;
         }
 
@@ -458,3 +574,447 @@ int os_rename(const char *oldpath, const char *newpath)
     return 0;
 #endif
 }
+
+int os_fsync(FILE *f)
+{
+    if (fflush(f) != 0) {
+        return -1;
+    }
+
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0 ? 0 : -1;
+#else
+    return fsync(fileno(f)) == 0 ? 0 : -1;
+#endif
+}
+
+int os_clone_tree(const char *oldpath, const char *newpath)
+{
+    struct os_stat s_old;
+    if (os_stat(oldpath, &s_old) != 0) {
+        return -1;
+    }
+
+    if (!S_ISDIR(s_old.st_mode)) {
+        return clone_file(oldpath, newpath);
+    }
+
+#ifdef _WIN32
+    mode_t permissions = 0755;
+#else
+    mode_t permissions = s_old.st_mode & (S_IRWXU | S_IRWXG | S_IRWXO);
+#endif
+    if (os_mkdir(newpath, permissions) != 0) {
+        return -1;
+    }
+
+    return copy_dir(oldpath, newpath, clone_file);
+}
+
+int os_link(const char *oldpath, const char *newpath)
+{
+#ifdef _WIN32
+    if (!CreateHardLinkA(newpath, oldpath, NULL)) {
+        DWORD err = GetLastError();
+        errno = err == ERROR_ALREADY_EXISTS ? EEXIST : err == ERROR_FILE_NOT_FOUND || err == ERROR_PATH_NOT_FOUND ? ENOENT : EIO;
+        return -1;
+    }
+
+    return 0;
+#else
+    return link(oldpath, newpath);
+#endif
+}
+
+int os_file_info(const char *path, OsFileInfo *info)
+{
+#ifdef _WIN32
+    HANDLE h = CreateFileA(path, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (h == INVALID_HANDLE_VALUE) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    BY_HANDLE_FILE_INFORMATION fi;
+    BOOL ok = GetFileInformationByHandle(h, &fi);
+    CloseHandle(h);
+    if (!ok) {
+        errno = EIO;
+        return -1;
+    }
+
+    info->size = (unsigned long long)fi.nFileSizeHigh << 32 | fi.nFileSizeLow;
+    info->nlink = fi.nNumberOfLinks;
+    info->dev = fi.dwVolumeSerialNumber;
+    info->ino = (unsigned long long)fi.nFileIndexHigh << 32 | fi.nFileIndexLow;
+#else
+    struct os_stat s;
+    if (os_stat(path, &s) != 0) {
+        return -1;
+    }
+
+    info->size = (unsigned long long)s.st_size;
+    info->nlink = (unsigned long)s.st_nlink;
+    info->dev = (unsigned long long)s.st_dev;
+    info->ino = (unsigned long long)s.st_ino;
+#endif
+
+    return 0;
+}
+
+int os_set_mtime(const char *path, long long mtime)
+{
+#ifdef _WIN32
+    struct _utimbuf times = { .actime = (time_t)mtime, .modtime = (time_t)mtime };
+    return _utime(path, &times);
+#else
+    struct utimbuf times = { .actime = (time_t)mtime, .modtime = (time_t)mtime };
+    return utime(path, &times);
+#endif
+}
+
+int os_lock_file(const char *path, OsFileLock *lock)
+{
+#ifdef _WIN32
+    HANDLE h = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_HIDDEN, NULL);
+    if (h == INVALID_HANDLE_VALUE) {
+        errno = EACCES;
+        return -1;
+    }
+
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    if (!LockFileEx(h, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &ov)) {
+        CloseHandle(h);
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+
+    *lock = h;
+#else
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // Unlike fcntl(2) locks, these conflict between files opened by the same
+    // process too.
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    *lock = fd;
+#endif
+
+    return 0;
+}
+
+void os_unlock_file(OsFileLock lock)
+{
+#ifdef _WIN32
+    CloseHandle(lock);
+#else
+    close(lock);
+#endif
+}
+
+double os_monotonic(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+void os_sleep(double seconds)
+{
+    if (seconds <= 0.0) {
+        return;
+    }
+
+#ifdef _WIN32
+    Sleep((DWORD)(seconds * 1000.0));
+#else
+    struct timespec ts;
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1e9);
+
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+#endif
+}
+
+int os_mutex_init(OsMutex *m)
+{
+#ifdef _WIN32
+    InitializeSRWLock(m);
+    return 0;
+#else
+    return pthread_mutex_init(m, NULL) == 0 ? 0 : -1;
+#endif
+}
+
+void os_mutex_destroy(OsMutex *m)
+{
+#ifdef _WIN32
+    // SRW locks do not need to be destroyed.
+    UNUSED(m);
+#else
+    pthread_mutex_destroy(m);
+#endif
+}
+
+void os_mutex_lock(OsMutex *m)
+{
+#ifdef _WIN32
+    AcquireSRWLockExclusive(m);
+#else
+    pthread_mutex_lock(m);
+#endif
+}
+
+void os_mutex_unlock(OsMutex *m)
+{
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(m);
+#else
+    pthread_mutex_unlock(m);
+#endif
+}
+
+int os_cond_init(OsCond *c)
+{
+#ifdef _WIN32
+    InitializeConditionVariable(c);
+    return 0;
+#else
+    return pthread_cond_init(c, NULL) == 0 ? 0 : -1;
+#endif
+}
+
+void os_cond_destroy(OsCond *c)
+{
+#ifdef _WIN32
+    UNUSED(c);
+#else
+    pthread_cond_destroy(c);
+#endif
+}
+
+void os_cond_wait(OsCond *c, OsMutex *m)
+{
+#ifdef _WIN32
+    SleepConditionVariableSRW(c, m, INFINITE, 0);
+#else
+    pthread_cond_wait(c, m);
+#endif
+}
+
+void os_cond_signal(OsCond *c)
+{
+#ifdef _WIN32
+    WakeConditionVariable(c);
+#else
+    pthread_cond_signal(c);
+#endif
+}
+
+void os_cond_broadcast(OsCond *c)
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(c);
+#else
+    pthread_cond_broadcast(c);
+#endif
+}
+
+/**
+ * Arguments of a new thread. Allocated by os_thread_create and freed by the
+ * thread once it started.
+ */
+typedef struct OsThreadStart {
+    OsThreadFn fn;
+    void *arg;
+} OsThreadStart;
+
+#ifdef _WIN32
+static DWORD WINAPI os_thread_start(LPVOID param)
+#else
+static void *os_thread_start(void *param)
+#endif
+{
+    OsThreadStart start = *(OsThreadStart *)param;
+    free(param);
+
+    start.fn(start.arg);
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+int os_thread_create(OsThread *t, OsThreadFn fn, void *arg)
+{
+    OsThreadStart *start = malloc(sizeof(*start));
+    if (start == NULL) {
+        return -1;
+    }
+
+    start->fn = fn;
+    start->arg = arg;
+
+#ifdef _WIN32
+    *t = CreateThread(NULL, 0, os_thread_start, start, 0, NULL);
+    if (*t == NULL) {
+        free(start);
+        return -1;
+    }
+#else
+    if (pthread_create(t, NULL, os_thread_start, start) != 0) {
+        free(start);
+        return -1;
+    }
+#endif
+
+    return 0;
+}
+
+void os_thread_join(OsThread t)
+{
+#ifdef _WIN32
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+#else
+    pthread_join(t, NULL);
+#endif
+}
+
+int os_cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long n = (long)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if (n < 1) {
+        return 1;
+    }
+
+    return n > 1024 ? 1024 : (int)n;
+}
+
+int os_spawn_background(const char *path, const char *const argv[])
+{
+#ifdef _WIN32
+    // Every argument is quoted, quotes inside of them are escaped.
+    char cmdline[32768];
+    size_t len = 0;
+    for (size_t i = 0; argv[i] != NULL; i++) {
+        if (len + 2 >= ARRAY_SIZE(cmdline)) {
+            return -1;
+        }
+        cmdline[len++] = i == 0 ? '"' : ' ';
+        if (i > 0) {
+            cmdline[len++] = '"';
+        }
+
+        for (const char *c = argv[i]; *c; c++) {
+            if (len + 3 >= ARRAY_SIZE(cmdline)) {
+                return -1;
+            }
+            if (*c == '"') {
+                cmdline[len++] = '\\';
+            }
+            cmdline[len++] = *c;
+        }
+        cmdline[len++] = '"';
+    }
+    cmdline[len] = '\0';
+
+    STARTUPINFOA si;
+    memset(&si, 0, sizeof(si));
+    si.cb = sizeof(si);
+    PROCESS_INFORMATION pi;
+
+    DWORD flags = DETACHED_PROCESS | CREATE_NEW_PROCESS_GROUP | BELOW_NORMAL_PRIORITY_CLASS;
+    if (!CreateProcessA(path, cmdline, NULL, NULL, FALSE, flags, NULL, NULL, &si, &pi)) {
+        return -1;
+    }
+
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+
+    return 0;
+#else
+    if (access(path, X_OK) != 0) {
+        return -1;
+    }
+
+    // execv takes the same strings without const.
+    union {
+        const char *const *in;
+        char *const *out;
+    } args = { .in = argv };
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    } else if (pid == 0) {
+        // The program runs in a grandchild of the caller, which is adopted
+        // and reaped by init once this child exits, so that the caller never
+        // has to wait for it. Only async-signal-safe calls are made since the
+        // caller may have other threads.
+        if (setsid() < 0) {
+            _exit(1);
+        }
+
+        pid_t grandchild = fork();
+        if (grandchild != 0) {
+            _exit(grandchild < 0 ? 1 : 0);
+        }
+
+        int fd = open("/dev/null", O_RDWR);
+        if (fd >= 0) {
+            dup2(fd, STDIN_FILENO);
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            if (fd > STDERR_FILENO) {
+                close(fd);
+            }
+        }
+
+        // Running at the normal priority is better than not running.
+        int niced = nice(10);
+        UNUSED(niced);
+
+        execv(path, args.out);
+        _exit(127);
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+#endif
+}
@@ -8,6 +8,7 @@
 #include <windows.h>
 #else
 #include <dirent.h>
+#include <pthread.h>
 #include <unistd.h>
 #endif
 
@@ -32,6 +33,7 @@
 #endif
 
 #define os_stat _stat
+#define os_lstat _stat
 #define os_rmdir _rmdir
 #define os_getcwd _getcwd
 #define os_chdir _chdir
@@ -47,6 +49,7 @@ typedef unsigned short mode_t;
 #define OS_MAX_FILENAME FILENAME_MAX
 
 #define os_stat stat
+#define os_lstat lstat
 #define os_rmdir rmdir
 #define os_getcwd getcwd
 #define os_chdir chdir
@@ -98,6 +101,25 @@ void os_closedir(OsDir *dir);
 int os_mkdir(const char *path, mode_t perms);
 int os_mkdir_all(char *path, mode_t perms);
 
+/**
+ * Creates a directory at path that only the calling user can use, or checks
+ * that the one that is already there is such a directory: on non-Windows it
+ * shall not be a symbolic link, be owned by the user and have permissions
+ * 0700. Use it for directories in shared places like os_tempdir, where another
+ * user could otherwise create the directory first.
+ *
+ * On success returns 0, otherwise returns -1 and sets errno on errors, to
+ * EPERM if the directory exists but is not private.
+ */
+int os_mkdir_private(const char *path);
+
+/**
+ * Same as fopen(3) with a mode of "r", "w" or "a", each optionally followed by
+ * "b", except that the file is not opened if path is a symbolic link. On
+ * Windows this is fopen.
+ */
+FILE *os_fopen_nofollow(const char *path, const char *mode);
+
 /**
  * Generates a unique temporary filename from template. Creates and opens the
  * file, and returns the FILE stream.
@@ -159,3 +181,139 @@ int os_remove_all(const char *path);
  * On success returns 0, otherwise returns -1 and sets errno on errors.
  */
 int os_rename(const char *oldpath, const char *newpath);
+
+/**
+ * Flushes the stream f and then writes what the OS cached of its file to disk.
+ * See fsync(2) for *nix and _commit for Windows.
+ *
+ * On success returns 0, otherwise returns -1 and sets errno on errors.
+ */
+int os_fsync(FILE *f);
+
+/**
+ * Copies the file or directory at old path to new path, which shall not exist.
+ * Files share storage with the originals where possible: they are reflinked if
+ * the file system supports copy-on-write clones, otherwise hard linked, and
+ * only copied if neither works, for example across file systems.
+ *
+ * On success returns 0, otherwise returns -1 and sets errno on errors.
+ */
+int os_clone_tree(const char *oldpath, const char *newpath);
+
+/**
+ * Creates a hard link at new path to the file at old path, which shall be on
+ * the same file system. See link(2) for *nix and CreateHardLinkA for Windows.
+ *
+ * On success returns 0, otherwise returns -1 and sets errno on errors.
+ */
+int os_link(const char *oldpath, const char *newpath);
+
+typedef struct OsFileInfo {
+    unsigned long long size;
+    unsigned long nlink; // Amount of hard links to the file.
+
+    // Together these are the same for every hard link to a file and differ for
+    // any other file.
+    unsigned long long dev;
+    unsigned long long ino;
+} OsFileInfo;
+
+/**
+ * Gets the size, link count and identity of the file at path. Unlike os_stat
+ * these are also filled in on Windows.
+ *
+ * On success returns 0, otherwise returns -1 and sets errno on errors.
+ */
+int os_file_info(const char *path, OsFileInfo *info);
+
+/**
+ * Sets the access and modification time of the file at path to mtime, in
+ * seconds since the epoch. See utime(3).
+ *
+ * On success returns 0, otherwise returns -1 and sets errno on errors.
+ */
+int os_set_mtime(const char *path, long long mtime);
+
+#ifdef _WIN32
+typedef HANDLE OsFileLock;
+#else
+typedef int OsFileLock;
+#endif
+
+/**
+ * Creates the file at path if it does not exist and takes an exclusive lock on
+ * it without waiting. The lock is held until os_unlock_file is called or the
+ * process exits, and programs started by the process do not inherit it. See
+ * flock(2) for *nix and LockFileEx for Windows.
+ *
+ * On success returns 0 and stores the lock in lock. Otherwise returns -1 and
+ * sets errno, to EWOULDBLOCK if the file is already locked, even by the
+ * calling process.
+ */
+int os_lock_file(const char *path, OsFileLock *lock);
+void os_unlock_file(OsFileLock lock);
+
+/**
+ * Returns the time in seconds from a monotonic clock. The starting point is
+ * unspecified so the value is only useful for measuring elapsed time.
+ */
+double os_monotonic(void);
+
+/**
+ * Suspends the calling thread for at least the given amount of seconds.
+ */
+void os_sleep(double seconds);
+
+/**
+ * Minimal threading primitives. Mutexes can be statically initialized with
+ * OS_MUTEX_INIT, otherwise they shall be initialized with os_mutex_init.
+ *
+ * os_mutex_init, os_cond_init, and os_thread_create return 0 on success and -1
+ * on error.
+ */
+#ifdef _WIN32
+typedef SRWLOCK OsMutex;
+typedef CONDITION_VARIABLE OsCond;
+typedef HANDLE OsThread;
+
+#define OS_MUTEX_INIT SRWLOCK_INIT
+#define OS_THREAD_LOCAL __declspec(thread)
+#else
+typedef pthread_mutex_t OsMutex;
+typedef pthread_cond_t OsCond;
+typedef pthread_t OsThread;
+
+#define OS_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define OS_THREAD_LOCAL _Thread_local
+#endif
+
+typedef void (*OsThreadFn)(void *arg);
+
+int os_mutex_init(OsMutex *m);
+void os_mutex_destroy(OsMutex *m);
+void os_mutex_lock(OsMutex *m);
+void os_mutex_unlock(OsMutex *m);
+
+int os_cond_init(OsCond *c);
+void os_cond_destroy(OsCond *c);
+void os_cond_wait(OsCond *c, OsMutex *m);
+void os_cond_signal(OsCond *c);
+void os_cond_broadcast(OsCond *c);
+
+int os_thread_create(OsThread *t, OsThreadFn fn, void *arg);
+void os_thread_join(OsThread t);
+
+/**
+ * Returns the amount of processors that are online, at least 1.
+ */
+int os_cpu_count(void);
+
+/**
+ * Starts the program at path with the NULL terminated argv at a low priority
+ * and returns without waiting for it. The program gets no stdin, stdout or
+ * stderr and keeps running after the calling process exits.
+ *
+ * On success returns 0, otherwise returns -1. The program failing to start
+ * after that is not reported.
+ */
+int os_spawn_background(const char *path, const char *const argv[]);
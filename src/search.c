@@ -0,0 +1,1177 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "addon.h"
+#include "ini.h"
+#include "osapi.h"
+#include "search.h"
+#include "wowpkg.h"
+
+#define SEARCH_HEADER "wowpkg search 2\n"
+#define SEARCH_CATALOG_EXT ".ini"
+
+/**
+ * How much more a word in the name counts than one in the description.
+ */
+#define SEARCH_NAME_WEIGHT 3.0
+
+/**
+ * BM25 parameters. K1 is how fast more of the same word stops counting, B is
+ * how much longer text counts less.
+ */
+#define SEARCH_K1 1.2
+#define SEARCH_B 0.75
+
+/**
+ * Only the start of longer names is compared when looking for typos.
+ */
+#define SEARCH_TYPO_LEN 64
+
+/**
+ * Marks the end of a list of children in the BK-tree.
+ */
+#define SEARCH_NONE UINT32_MAX
+
+/**
+ * The index is saved as it is kept in memory, in the byte order of the
+ * machine, since it is only a cache of the catalog that can be built again.
+ */
+struct SearchIndex {
+    long long stamp; // See search_catalog_stamp.
+    uint32_t ndocs;
+    uint32_t ngrams;
+    uint32_t npostings;
+    uint32_t text_len;
+
+    // Name, searched name and searched description of every entry, each
+    // null terminated.
+    char *text;
+
+    // Offsets in text of the three strings of each entry. Entries are sorted
+    // by name.
+    uint32_t *docs;
+
+    // Sorted trigrams, the entries that have trigram i are
+    // postings[offsets[i]] to postings[offsets[i + 1]] in ascending order.
+    uint32_t *grams;
+    uint32_t *offsets;
+    uint32_t *postings;
+
+    // BK-tree of the names for finding typos, rooted at entry 0. First child,
+    // next sibling and typos from the parent of each entry.
+    uint32_t *tree;
+
+    // Lengths of the searched name and description of each entry, and their
+    // averages.
+    uint32_t *lens;
+    double avg_name;
+    double avg_desc;
+};
+
+/**
+ * Dynamic array used while building the index.
+ */
+typedef struct SearchBuf {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+} SearchBuf;
+
+static int search_buf_reserve(SearchBuf *buf, size_t n)
+{
+    if (buf->len + n <= buf->cap) {
+        return SEARCH_OK;
+    }
+
+    size_t cap = buf->cap == 0 ? 4096 : buf->cap;
+    while (cap < buf->len + n) {
+        cap *= 2;
+    }
+
+    unsigned char *grown = realloc(buf->data, cap);
+    if (grown == NULL) {
+        return SEARCH_ENOMEM;
+    }
+
+    buf->data = grown;
+    buf->cap = cap;
+
+    return SEARCH_OK;
+}
+
+static int search_buf_append(SearchBuf *buf, const void *data, size_t n)
+{
+    if (search_buf_reserve(buf, n) != SEARCH_OK) {
+        return SEARCH_ENOMEM;
+    }
+
+    memcpy(buf->data + buf->len, data, n);
+    buf->len += n;
+
+    return SEARCH_OK;
+}
+
+static bool is_word_char(char c)
+{
+    // Bytes of UTF-8 sequences are kept as they are.
+    return isalnum((unsigned char)c) || (unsigned char)c >= 0x80;
+}
+
+/**
+ * Writes the text that src is searched as to dest: lower case words, each
+ * with a space before and after it. dest shall have room for strlen(src) + 3
+ * characters.
+ *
+ * Returns the length of the written text.
+ */
+static size_t search_normalize(char *dest, const char *src)
+{
+    size_t len = 0;
+    dest[len++] = ' ';
+
+    for (const char *c = src; *c; c++) {
+        if (is_word_char(*c)) {
+            dest[len++] = (char)tolower((unsigned char)*c);
+        } else if (dest[len - 1] != ' ') {
+            dest[len++] = ' ';
+        }
+    }
+
+    if (dest[len - 1] != ' ') {
+        dest[len++] = ' ';
+    }
+    dest[len] = '\0';
+
+    return len;
+}
+
+static uint32_t search_gram(const char *s)
+{
+    return (uint32_t)(unsigned char)s[0] << 16 | (uint32_t)(unsigned char)s[1] << 8 | (uint32_t)(unsigned char)s[2];
+}
+
+/**
+ * Mixes the bytes at p into the 64-bit FNV-1a hash h.
+ */
+static uint64_t stamp_mix(uint64_t h, const void *p, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        h ^= ((const unsigned char *)p)[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+int search_catalog_stamp(const char *catalog, long long *stamp)
+{
+    struct os_stat s;
+    if (os_stat(catalog, &s) != 0) {
+        return SEARCH_ENOENT;
+    }
+
+    OsDir *dir = os_opendir(catalog);
+    if (dir == NULL) {
+        return SEARCH_ENOENT;
+    }
+
+    // The directory only changes when files are added, removed or renamed,
+    // so every catalog file is stamped as well. Their stamps are added up so
+    // that the order they are read in does not matter.
+    uint64_t files = 0;
+
+    OsDirEnt *entry = NULL;
+    while ((entry = os_readdir(dir)) != NULL) {
+        size_t len = strlen(entry->name);
+        size_t ext_len = strlen(SEARCH_CATALOG_EXT);
+        if (len <= ext_len || strcmp(entry->name + len - ext_len, SEARCH_CATALOG_EXT) != 0) {
+            continue;
+        }
+
+        char path[OS_MAX_PATH];
+        int n = snprintf(path, ARRAY_SIZE(path), "%s%c%s", catalog, OS_SEPARATOR, entry->name);
+        struct os_stat fs;
+        if (n < 0 || (size_t)n >= ARRAY_SIZE(path) || os_stat(path, &fs) != 0) {
+            continue;
+        }
+
+        long long mtime = (long long)fs.st_mtime;
+        long long size = (long long)fs.st_size;
+        uint64_t h = stamp_mix(0xcbf29ce484222325ULL, entry->name, len);
+        h = stamp_mix(h, &mtime, sizeof(mtime));
+        files += stamp_mix(h, &size, sizeof(size));
+    }
+
+    os_closedir(dir);
+
+    long long mtime = (long long)s.st_mtime;
+    *stamp = (long long)stamp_mix(stamp_mix(0xcbf29ce484222325ULL, &mtime, sizeof(mtime)), &files, sizeof(files));
+
+    return SEARCH_OK;
+}
+
+static const char *doc_name(const SearchIndex *idx, uint32_t doc)
+{
+    return idx->text + idx->docs[doc * 3];
+}
+
+static const char *doc_search_name(const SearchIndex *idx, uint32_t doc)
+{
+    return idx->text + idx->docs[doc * 3 + 1];
+}
+
+static const char *doc_search_desc(const SearchIndex *idx, uint32_t doc)
+{
+    return idx->text + idx->docs[doc * 3 + 2];
+}
+
+/**
+ * Computes what BM25 needs to know about the whole index.
+ */
+static int search_index_finish(SearchIndex *idx)
+{
+    idx->lens = malloc(sizeof(*idx->lens) * ((size_t)idx->ndocs * 2 + 1));
+    if (idx->lens == NULL) {
+        return SEARCH_ENOMEM;
+    }
+
+    double name_len = 0;
+    double desc_len = 0;
+
+    for (uint32_t doc = 0; doc < idx->ndocs; doc++) {
+        idx->lens[doc * 2] = (uint32_t)strlen(doc_search_name(idx, doc));
+        idx->lens[doc * 2 + 1] = (uint32_t)strlen(doc_search_desc(idx, doc));
+        name_len += idx->lens[doc * 2];
+        desc_len += idx->lens[doc * 2 + 1];
+    }
+
+    idx->avg_name = idx->ndocs > 0 ? name_len / idx->ndocs : 1;
+    idx->avg_desc = idx->ndocs > 0 ? desc_len / idx->ndocs : 1;
+
+    return SEARCH_OK;
+}
+
+/**
+ * A catalog entry while the index is built.
+ */
+typedef struct SearchEntry {
+    char *name;
+    char *desc;
+} SearchEntry;
+
+static int cmp_entry_name(const void *a, const void *b)
+{
+    return strcmp(((const SearchEntry *)a)->name, ((const SearchEntry *)b)->name);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Reads the description of the catalog file at path. Files without one are
+ * still found by their name.
+ */
+static char *read_catalog_desc(const char *path)
+{
+    INI *ini = ini_open(path);
+    if (ini == NULL) {
+        return strdup("");
+    }
+
+    char *result = NULL;
+
+    INIKey *key = NULL;
+    while ((key = ini_readkey(ini)) != NULL) {
+        if (strcasecmp(key->name, ADDON_DESC) == 0) {
+            free(result);
+            result = strdup(key->value);
+        }
+    }
+
+    ini_close(ini);
+
+    return result != NULL ? result : strdup("");
+}
+
+/**
+ * Adds every entry of the catalog directory at catalog to entries.
+ */
+static int read_catalog(const char *catalog, SearchBuf *entries)
+{
+    OsDir *dir = os_opendir(catalog);
+    if (dir == NULL) {
+        return SEARCH_ENOENT;
+    }
+
+    int err = SEARCH_OK;
+
+    OsDirEnt *entry = NULL;
+    while ((entry = os_readdir(dir)) != NULL) {
+        size_t len = strlen(entry->name);
+        size_t ext_len = strlen(SEARCH_CATALOG_EXT);
+        if (len <= ext_len || strcmp(entry->name + len - ext_len, SEARCH_CATALOG_EXT) != 0) {
+            continue;
+        }
+
+        char path[OS_MAX_PATH];
+        int n = snprintf(path, ARRAY_SIZE(path), "%s%c%s", catalog, OS_SEPARATOR, entry->name);
+        if (n < 0 || (size_t)n >= ARRAY_SIZE(path)) {
+            continue;
+        }
+
+        SearchEntry e = { .name = malloc(len - ext_len + 1), .desc = read_catalog_desc(path) };
+        if (e.name != NULL) {
+            memcpy(e.name, entry->name, len - ext_len);
+            e.name[len - ext_len] = '\0';
+        }
+
+        if (e.name == NULL || e.desc == NULL || search_buf_append(entries, &e, sizeof(e)) != SEARCH_OK) {
+            free(e.name);
+            free(e.desc);
+            err = SEARCH_ENOMEM;
+            break;
+        }
+    }
+
+    os_closedir(dir);
+
+    return err;
+}
+
+/**
+ * Appends str to text as it is and stores its offset in doc.
+ */
+static int append_text(SearchBuf *text, const char *str, uint32_t *doc)
+{
+    if (text->len > UINT32_MAX) {
+        return SEARCH_ENOMEM;
+    }
+
+    *doc = (uint32_t)text->len;
+
+    return search_buf_append(text, str, strlen(str) + 1);
+}
+
+/**
+ * Appends the text that str is searched as to text, stores its offset in doc,
+ * and adds a pair of every trigram in it and id to pairs.
+ */
+static int append_search_text(SearchBuf *text, SearchBuf *pairs, const char *str, uint32_t id, uint32_t *doc)
+{
+    size_t len = strlen(str) + 3;
+    if (text->len > UINT32_MAX || search_buf_reserve(text, len) != SEARCH_OK) {
+        return SEARCH_ENOMEM;
+    }
+
+    char *dest = (char *)text->data + text->len;
+    *doc = (uint32_t)text->len;
+    len = search_normalize(dest, str);
+    text->len += len + 1;
+
+    for (size_t i = 0; i + 3 <= len; i++) {
+        // Trigrams take three bytes so the entry fits in the bytes below.
+        uint64_t pair = (uint64_t)search_gram(dest + i) << 32 | id;
+        if (search_buf_append(pairs, &pair, sizeof(pair)) != SEARCH_OK) {
+            return SEARCH_ENOMEM;
+        }
+    }
+
+    return SEARCH_OK;
+}
+
+/**
+ * Turns the sorted pairs of trigrams and entries into the trigrams and posting
+ * lists of idx. Repeated pairs are only added once.
+ */
+static int build_postings(SearchIndex *idx, const uint64_t *pairs, size_t npairs)
+{
+    idx->grams = malloc(sizeof(*idx->grams) * (npairs + 1));
+    idx->offsets = malloc(sizeof(*idx->offsets) * (npairs + 2));
+    idx->postings = malloc(sizeof(*idx->postings) * (npairs + 1));
+    if (idx->grams == NULL || idx->offsets == NULL || idx->postings == NULL) {
+        return SEARCH_ENOMEM;
+    }
+
+    uint32_t ngrams = 0;
+    uint32_t npostings = 0;
+
+    for (size_t i = 0; i < npairs; i++) {
+        if (i > 0 && pairs[i] == pairs[i - 1]) {
+            continue;
+        }
+
+        uint32_t gram = (uint32_t)(pairs[i] >> 32);
+        if (ngrams == 0 || idx->grams[ngrams - 1] != gram) {
+            idx->grams[ngrams] = gram;
+            idx->offsets[ngrams] = npostings;
+            ngrams++;
+        }
+
+        idx->postings[npostings++] = (uint32_t)pairs[i];
+    }
+
+    idx->offsets[ngrams] = npostings;
+    idx->ngrams = ngrams;
+    idx->npostings = npostings;
+
+    return SEARCH_OK;
+}
+
+/**
+ * Returns the Damerau-Levenshtein distance of a and b without case: how many
+ * characters have to be added, removed, changed or swapped with the next one
+ * to turn one into the other. Unlike the more common variant that never edits
+ * a swapped pair again, this is a metric, which the BK-tree depends on.
+ */
+static size_t search_typos(const char *a, const char *b)
+{
+    unsigned char x[SEARCH_TYPO_LEN];
+    unsigned char y[SEARCH_TYPO_LEN];
+    size_t lx = 0;
+    size_t ly = 0;
+
+    for (; a[lx] != '\0' && lx < ARRAY_SIZE(x); lx++) {
+        x[lx] = (unsigned char)tolower((unsigned char)a[lx]);
+    }
+
+    for (; b[ly] != '\0' && ly < ARRAY_SIZE(y); ly++) {
+        y[ly] = (unsigned char)tolower((unsigned char)b[ly]);
+    }
+
+    // Row i and column j are the first i characters of x and j of y, shifted
+    // by one so that row and column 0 are past the start of both.
+    size_t d[SEARCH_TYPO_LEN + 2][SEARCH_TYPO_LEN + 2];
+    size_t last_row[256] = { 0 }; // Last row with each character of x.
+    size_t max = lx + ly;
+
+    d[0][0] = max;
+    for (size_t i = 0; i <= lx; i++) {
+        d[i + 1][0] = max;
+        d[i + 1][1] = i;
+    }
+    for (size_t j = 0; j <= ly; j++) {
+        d[0][j + 1] = max;
+        d[1][j + 1] = j;
+    }
+
+    for (size_t i = 1; i <= lx; i++) {
+        size_t last_col = 0; // Last column in this row where x[i] matched.
+
+        for (size_t j = 1; j <= ly; j++) {
+            size_t k = last_row[y[j - 1]];
+            size_t l = last_col;
+            size_t cost = 1;
+
+            if (x[i - 1] == y[j - 1]) {
+                cost = 0;
+                last_col = j;
+            }
+
+            size_t best = d[i][j] + cost;
+            if (d[i + 1][j] + 1 < best) {
+                best = d[i + 1][j] + 1;
+            }
+            if (d[i][j + 1] + 1 < best) {
+                best = d[i][j + 1] + 1;
+            }
+
+            // Swapping x[k] and x[i] with what was between them edited.
+            size_t swap = d[k][l] + (i - k - 1) + 1 + (j - l - 1);
+            if (swap < best) {
+                best = swap;
+            }
+
+            d[i + 1][j + 1] = best;
+        }
+
+        last_row[x[i - 1]] = i;
+    }
+
+    return d[lx + 1][ly + 1];
+}
+
+/**
+ * Builds the BK-tree of the names of idx. Every child of an entry has a
+ * different amount of typos from it, and by the triangle inequality a name
+ * within n typos of a query that is t typos from an entry can only be below
+ * the children with t - n to t + n typos.
+ */
+static int build_tree(SearchIndex *idx)
+{
+    idx->tree = malloc(sizeof(*idx->tree) * ((size_t)idx->ndocs * 3 + 1));
+    if (idx->tree == NULL) {
+        return SEARCH_ENOMEM;
+    }
+
+    for (uint32_t doc = 0; doc < idx->ndocs; doc++) {
+        idx->tree[doc * 3] = SEARCH_NONE;
+        idx->tree[doc * 3 + 1] = SEARCH_NONE;
+        idx->tree[doc * 3 + 2] = 0;
+    }
+
+    for (uint32_t doc = 1; doc < idx->ndocs; doc++) {
+        uint32_t node = 0;
+
+        for (;;) {
+            uint32_t typos = (uint32_t)search_typos(doc_name(idx, doc), doc_name(idx, node));
+
+            uint32_t child = idx->tree[node * 3];
+            while (child != SEARCH_NONE && idx->tree[child * 3 + 2] != typos) {
+                child = idx->tree[child * 3 + 1];
+            }
+
+            if (child == SEARCH_NONE) {
+                idx->tree[doc * 3 + 1] = idx->tree[node * 3];
+                idx->tree[doc * 3 + 2] = typos;
+                idx->tree[node * 3] = doc;
+                break;
+            }
+
+            node = child;
+        }
+    }
+
+    return SEARCH_OK;
+}
+
+int search_index_build(SearchIndex **out, const char *catalog)
+{
+    int err = SEARCH_OK;
+    SearchBuf entries = { 0 };
+    SearchBuf text = { 0 };
+    SearchBuf pairs = { 0 };
+
+    SearchIndex *idx = calloc(1, sizeof(*idx));
+    if (idx == NULL) {
+        return SEARCH_ENOMEM;
+    }
+
+    err = search_catalog_stamp(catalog, &idx->stamp);
+    if (err != SEARCH_OK) {
+        goto cleanup;
+    }
+
+    err = read_catalog(catalog, &entries);
+    if (err != SEARCH_OK) {
+        goto cleanup;
+    }
+
+    SearchEntry *e = (SearchEntry *)entries.data;
+    size_t nentries = entries.len / sizeof(*e);
+    if (nentries > UINT32_MAX / 3) {
+        err = SEARCH_ENOMEM;
+        goto cleanup;
+    }
+
+    if (nentries > 1) {
+        qsort(e, nentries, sizeof(*e), cmp_entry_name);
+    }
+
+    idx->ndocs = (uint32_t)nentries;
+    idx->docs = malloc(sizeof(*idx->docs) * (nentries * 3 + 1));
+    if (idx->docs == NULL) {
+        err = SEARCH_ENOMEM;
+        goto cleanup;
+    }
+
+    for (uint32_t doc = 0; doc < idx->ndocs; doc++) {
+        uint32_t *offsets = idx->docs + doc * 3;
+        if (append_text(&text, e[doc].name, &offsets[0]) != SEARCH_OK
+            || append_search_text(&text, &pairs, e[doc].name, doc, &offsets[1]) != SEARCH_OK
+            || append_search_text(&text, &pairs, e[doc].desc, doc, &offsets[2]) != SEARCH_OK) {
+
+            err = SEARCH_ENOMEM;
+            goto cleanup;
+        }
+    }
+
+    if (text.len > UINT32_MAX) {
+        err = SEARCH_ENOMEM;
+        goto cleanup;
+    }
+
+    idx->text = (char *)text.data;
+    idx->text_len = (uint32_t)text.len;
+    text.data = NULL;
+
+    uint64_t *p = (uint64_t *)pairs.data;
+    size_t npairs = pairs.len / sizeof(*p);
+    if (npairs > 1) {
+        qsort(p, npairs, sizeof(*p), cmp_u64);
+    }
+
+    err = build_postings(idx, p, npairs);
+    if (err != SEARCH_OK) {
+        goto cleanup;
+    }
+
+    err = build_tree(idx);
+    if (err != SEARCH_OK) {
+        goto cleanup;
+    }
+
+    err = search_index_finish(idx);
+
+cleanup:
+    for (size_t i = 0; i < entries.len / sizeof(SearchEntry); i++) {
+        free(((SearchEntry *)entries.data)[i].name);
+        free(((SearchEntry *)entries.data)[i].desc);
+    }
+    free(entries.data);
+    free(text.data);
+    free(pairs.data);
+
+    if (err != SEARCH_OK) {
+        search_index_free(idx);
+        idx = NULL;
+    }
+
+    *out = idx;
+
+    return err;
+}
+
+static bool read_all(FILE *f, void *data, size_t size, size_t n)
+{
+    return fread(data, size, n, f) == n;
+}
+
+/**
+ * Checks that idx only refers to its own data, so a damaged file can not make
+ * a search read past it.
+ */
+static bool search_index_valid(const SearchIndex *idx)
+{
+    if (idx->text_len == 0 || idx->text[idx->text_len - 1] != '\0') {
+        return false;
+    }
+
+    for (size_t i = 0; i < (size_t)idx->ndocs * 3; i++) {
+        if (idx->docs[i] >= idx->text_len) {
+            return false;
+        }
+    }
+
+    if (idx->offsets[0] != 0 || idx->offsets[idx->ngrams] != idx->npostings) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < idx->ngrams; i++) {
+        if (idx->offsets[i] > idx->offsets[i + 1] || (i > 0 && idx->grams[i - 1] >= idx->grams[i])) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < idx->npostings; i++) {
+        if (idx->postings[i] >= idx->ndocs) {
+            return false;
+        }
+    }
+
+    // Every entry but the root is linked to once, so walking the tree from
+    // the root can not visit an entry twice.
+    unsigned char *linked = calloc((size_t)idx->ndocs + 1, sizeof(*linked));
+    if (linked == NULL) {
+        return false;
+    }
+
+    bool result = true;
+    for (size_t i = 0; i < (size_t)idx->ndocs * 3 && result; i++) {
+        uint32_t doc = idx->tree[i];
+        if (i % 3 == 2 || doc == SEARCH_NONE) {
+            continue;
+        }
+
+        result = doc != 0 && doc < idx->ndocs && !linked[doc];
+        if (result) {
+            linked[doc] = 1;
+        }
+    }
+
+    free(linked);
+
+    return result;
+}
+
+int search_index_load(SearchIndex **out, const char *path, const char *catalog)
+{
+    *out = NULL;
+
+    long long stamp = 0;
+    int err = search_catalog_stamp(catalog, &stamp);
+    if (err != SEARCH_OK) {
+        return err;
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return SEARCH_ENOENT;
+    }
+
+    SearchIndex *idx = calloc(1, sizeof(*idx));
+    if (idx == NULL) {
+        fclose(f);
+        return SEARCH_ENOMEM;
+    }
+
+    char header[sizeof(SEARCH_HEADER) - 1];
+    if (!read_all(f, header, sizeof(*header), ARRAY_SIZE(header))
+        || memcmp(header, SEARCH_HEADER, ARRAY_SIZE(header)) != 0
+        || !read_all(f, &idx->stamp, sizeof(idx->stamp), 1)
+        || !read_all(f, &idx->ndocs, sizeof(idx->ndocs), 1)
+        || !read_all(f, &idx->ngrams, sizeof(idx->ngrams), 1)
+        || !read_all(f, &idx->npostings, sizeof(idx->npostings), 1)
+        || !read_all(f, &idx->text_len, sizeof(idx->text_len), 1)) {
+
+        err = SEARCH_EPARSE;
+        goto cleanup;
+    }
+
+    if (idx->stamp != stamp) {
+        err = SEARCH_ESTALE;
+        goto cleanup;
+    }
+
+    // Sizes are checked against the file before anything is allocated for
+    // them.
+    long start = ftell(f);
+    if (start < 0 || fseek(f, 0, SEEK_END) != 0) {
+        err = SEARCH_EIO;
+        goto cleanup;
+    }
+
+    long end = ftell(f);
+    unsigned long long expected = (unsigned long long)idx->text_len
+        + sizeof(uint32_t) * ((unsigned long long)idx->ndocs * 6 + idx->ngrams + (idx->ngrams + 1ULL) + idx->npostings);
+    if (end < start || (unsigned long long)(end - start) != expected || fseek(f, start, SEEK_SET) != 0) {
+        err = SEARCH_EPARSE;
+        goto cleanup;
+    }
+
+    idx->text = malloc(idx->text_len + 1);
+    idx->docs = malloc(sizeof(*idx->docs) * ((size_t)idx->ndocs * 3 + 1));
+    idx->grams = malloc(sizeof(*idx->grams) * ((size_t)idx->ngrams + 1));
+    idx->offsets = malloc(sizeof(*idx->offsets) * ((size_t)idx->ngrams + 1));
+    idx->postings = malloc(sizeof(*idx->postings) * ((size_t)idx->npostings + 1));
+    idx->tree = malloc(sizeof(*idx->tree) * ((size_t)idx->ndocs * 3 + 1));
+    if (idx->text == NULL || idx->docs == NULL || idx->grams == NULL || idx->offsets == NULL || idx->postings == NULL || idx->tree == NULL) {
+        err = SEARCH_ENOMEM;
+        goto cleanup;
+    }
+
+    if (!read_all(f, idx->text, sizeof(*idx->text), idx->text_len)
+        || !read_all(f, idx->docs, sizeof(*idx->docs), (size_t)idx->ndocs * 3)
+        || !read_all(f, idx->grams, sizeof(*idx->grams), idx->ngrams)
+        || !read_all(f, idx->offsets, sizeof(*idx->offsets), (size_t)idx->ngrams + 1)
+        || !read_all(f, idx->postings, sizeof(*idx->postings), idx->npostings)
+        || !read_all(f, idx->tree, sizeof(*idx->tree), (size_t)idx->ndocs * 3)) {
+
+        err = SEARCH_EIO;
+        goto cleanup;
+    }
+
+    if (!search_index_valid(idx)) {
+        err = SEARCH_EPARSE;
+        goto cleanup;
+    }
+
+    err = search_index_finish(idx);
+
+cleanup:
+    fclose(f);
+
+    if (err != SEARCH_OK) {
+        search_index_free(idx);
+        idx = NULL;
+    }
+
+    *out = idx;
+
+    return err;
+}
+
+int search_index_save(const SearchIndex *idx, const char *path)
+{
+    char tmp[OS_MAX_PATH];
+    int n = snprintf(tmp, ARRAY_SIZE(tmp), "%s.tmp", path);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(tmp)) {
+        return SEARCH_EIO;
+    }
+
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL) {
+        return SEARCH_EIO;
+    }
+
+    int err = SEARCH_OK;
+
+    fwrite(SEARCH_HEADER, sizeof(char), strlen(SEARCH_HEADER), f);
+    fwrite(&idx->stamp, sizeof(idx->stamp), 1, f);
+    fwrite(&idx->ndocs, sizeof(idx->ndocs), 1, f);
+    fwrite(&idx->ngrams, sizeof(idx->ngrams), 1, f);
+    fwrite(&idx->npostings, sizeof(idx->npostings), 1, f);
+    fwrite(&idx->text_len, sizeof(idx->text_len), 1, f);
+    fwrite(idx->text, sizeof(*idx->text), idx->text_len, f);
+    fwrite(idx->docs, sizeof(*idx->docs), (size_t)idx->ndocs * 3, f);
+    fwrite(idx->grams, sizeof(*idx->grams), idx->ngrams, f);
+    fwrite(idx->offsets, sizeof(*idx->offsets), (size_t)idx->ngrams + 1, f);
+    fwrite(idx->postings, sizeof(*idx->postings), idx->npostings, f);
+    fwrite(idx->tree, sizeof(*idx->tree), (size_t)idx->ndocs * 3, f);
+
+    if (ferror(f)) {
+        err = SEARCH_EIO;
+    }
+
+    if (fclose(f) != 0) {
+        err = SEARCH_EIO;
+    }
+
+    if (err == SEARCH_OK && os_rename(tmp, path) != 0) {
+        err = SEARCH_EIO;
+    }
+
+    if (err != SEARCH_OK) {
+        remove(tmp);
+    }
+
+    return err;
+}
+
+int search_index_open(SearchIndex **out, const char *path, const char *catalog)
+{
+    if (path != NULL && search_index_load(out, path, catalog) == SEARCH_OK) {
+        return SEARCH_OK;
+    }
+
+    int err = search_index_build(out, catalog);
+    if (err == SEARCH_OK && path != NULL) {
+        // Searching still works, the index is just built again next time.
+        search_index_save(*out, path);
+    }
+
+    return err;
+}
+
+void search_index_free(SearchIndex *idx)
+{
+    if (idx == NULL) {
+        return;
+    }
+
+    free(idx->text);
+    free(idx->docs);
+    free(idx->grams);
+    free(idx->offsets);
+    free(idx->postings);
+    free(idx->tree);
+    free(idx->lens);
+    free(idx);
+}
+
+size_t search_index_size(const SearchIndex *idx)
+{
+    return idx->ndocs;
+}
+
+/**
+ * Returns how many times word is in text without overlapping.
+ */
+static size_t count_word(const char *text, const char *word, size_t len)
+{
+    size_t result = 0;
+
+    const char *found = text;
+    while ((found = strstr(found, word)) != NULL) {
+        result++;
+        found += len;
+    }
+
+    return result;
+}
+
+static int cmp_gram(const void *key, const void *gram)
+{
+    uint32_t x = *(const uint32_t *)key;
+    uint32_t y = *(const uint32_t *)gram;
+
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * An entry that has every query word so far, in ascending order of entries.
+ */
+typedef struct SearchHit {
+    uint32_t doc;
+    size_t name_words;
+    double score;
+} SearchHit;
+
+/**
+ * Replaces the hits with the ones that also have word, a null terminated
+ * searched text of len characters. When first is true every entry with word is
+ * a hit.
+ */
+static int search_word(const SearchIndex *idx, const char *word, size_t len, SearchBuf *hits, bool first)
+{
+    // Only the entries of the trigram with the fewest entries need to be
+    // looked at. Words without a trigram are looked for in every entry.
+    const uint32_t *candidates = NULL;
+    size_t ncandidates = idx->ndocs;
+
+    for (size_t i = 0; i + 3 <= len; i++) {
+        uint32_t gram = search_gram(word + i);
+        const uint32_t *found = bsearch(&gram, idx->grams, idx->ngrams, sizeof(*idx->grams), cmp_gram);
+        if (found == NULL) {
+            hits->len = 0;
+            return SEARCH_OK;
+        }
+
+        size_t g = (size_t)(found - idx->grams);
+        size_t n = idx->offsets[g + 1] - idx->offsets[g];
+        if (candidates == NULL || n < ncandidates) {
+            candidates = idx->postings + idx->offsets[g];
+            ncandidates = n;
+        }
+    }
+
+    SearchBuf matches = { 0 };
+    if (search_buf_reserve(&matches, sizeof(SearchHit) * (ncandidates + 1)) != SEARCH_OK) {
+        return SEARCH_ENOMEM;
+    }
+
+    SearchHit *m = (SearchHit *)matches.data;
+    size_t nmatches = 0;
+
+    for (size_t i = 0; i < ncandidates; i++) {
+        uint32_t doc = candidates != NULL ? candidates[i] : (uint32_t)i;
+
+        const char *name = doc_search_name(idx, doc);
+        const char *desc = doc_search_desc(idx, doc);
+        size_t tf_name = count_word(name, word, len);
+        size_t tf_desc = count_word(desc, word, len);
+        if (tf_name == 0 && tf_desc == 0) {
+            continue;
+        }
+
+        // BM25F, the counts of both fields are weighed and made relative to
+        // their length before they are saturated.
+        double tf = SEARCH_NAME_WEIGHT * (double)tf_name / (1 - SEARCH_B + SEARCH_B * idx->lens[doc * 2] / idx->avg_name)
+            + (double)tf_desc / (1 - SEARCH_B + SEARCH_B * idx->lens[doc * 2 + 1] / idx->avg_desc);
+
+        m[nmatches].doc = doc;
+        m[nmatches].name_words = tf_name > 0;
+        m[nmatches].score = tf * (SEARCH_K1 + 1) / (tf + SEARCH_K1);
+        nmatches++;
+    }
+
+    double df = (double)nmatches;
+    double idf = log(1 + ((double)idx->ndocs - df + 0.5) / (df + 0.5));
+
+    SearchHit *h = (SearchHit *)hits->data;
+    size_t nhits = hits->len / sizeof(*h);
+    size_t kept = 0;
+
+    if (first) {
+        if (search_buf_reserve(hits, sizeof(*h) * nmatches) != SEARCH_OK) {
+            free(matches.data);
+            return SEARCH_ENOMEM;
+        }
+
+        h = (SearchHit *)hits->data;
+        for (size_t i = 0; i < nmatches; i++) {
+            h[kept] = m[i];
+            h[kept].score *= idf;
+            kept++;
+        }
+    } else {
+        // Both are in ascending order of entries.
+        for (size_t i = 0, j = 0; i < nhits && j < nmatches;) {
+            if (h[i].doc < m[j].doc) {
+                i++;
+            } else if (h[i].doc > m[j].doc) {
+                j++;
+            } else {
+                h[kept] = h[i];
+                h[kept].name_words += m[j].name_words;
+                h[kept].score += m[j].score * idf;
+                kept++;
+                i++;
+                j++;
+            }
+        }
+    }
+
+    hits->len = kept * sizeof(*h);
+    free(matches.data);
+
+    return SEARCH_OK;
+}
+
+static int cmp_result(const void *a, const void *b)
+{
+    const SearchResult *x = a;
+    const SearchResult *y = b;
+
+    if (x->name_words != y->name_words) {
+        return x->name_words < y->name_words ? 1 : -1;
+    }
+
+    if (x->score != y->score) {
+        return x->score < y->score ? 1 : -1;
+    }
+
+    return strcmp(x->name, y->name);
+}
+
+int search_query(const SearchIndex *idx, const char *query, SearchResult **out, size_t *n)
+{
+    *out = NULL;
+    *n = 0;
+
+    char *words = malloc(strlen(query) + 3);
+    if (words == NULL) {
+        return SEARCH_ENOMEM;
+    }
+
+    int err = SEARCH_OK;
+    SearchBuf hits = { 0 };
+    bool first = true;
+
+    size_t len = search_normalize(words, query);
+    for (size_t start = 1; start < len; start++) {
+        size_t end = start;
+        while (words[end] != ' ') {
+            end++;
+        }
+
+        if (end == start) {
+            continue;
+        }
+
+        // Short words keep the space before them so they only match the
+        // start of a word.
+        size_t word = end - start < 3 ? start - 1 : start;
+        words[end] = '\0';
+        err = search_word(idx, words + word, end - word, &hits, first);
+        words[end] = ' ';
+        first = false;
+
+        if (err != SEARCH_OK || hits.len == 0) {
+            break;
+        }
+
+        start = end;
+    }
+
+    SearchHit *h = (SearchHit *)hits.data;
+    size_t nhits = hits.len / sizeof(*h);
+    SearchResult *results = NULL;
+
+    if (err == SEARCH_OK && nhits > 0) {
+        results = malloc(sizeof(*results) * nhits);
+        if (results == NULL) {
+            err = SEARCH_ENOMEM;
+        }
+    }
+
+    if (results != NULL) {
+        for (size_t i = 0; i < nhits; i++) {
+            results[i].name = doc_name(idx, h[i].doc);
+            results[i].name_words = h[i].name_words;
+            results[i].score = h[i].score;
+        }
+
+        if (nhits > 1) {
+            qsort(results, nhits, sizeof(*results), cmp_result);
+        }
+
+        *out = results;
+        *n = nhits;
+    }
+
+    free(words);
+    free(hits.data);
+
+    return err;
+}
+
+/**
+ * Adds doc to the n best suggestions in out when it is closer than the worst
+ * of them, or as close and first by name.
+ */
+static void add_suggestion(const SearchIndex *idx, uint32_t doc, size_t typos, SearchSuggestion *out, size_t *nout, size_t max)
+{
+    const char *name = doc_name(idx, doc);
+
+    size_t i = *nout;
+    while (i > 0 && (out[i - 1].typos > typos || (out[i - 1].typos == typos && strcmp(out[i - 1].name, name) > 0))) {
+        i--;
+    }
+
+    if (i >= max) {
+        return;
+    }
+
+    size_t n = *nout < max ? *nout : max - 1;
+    memmove(out + i + 1, out + i, sizeof(*out) * (n - i));
+    out[i].name = name;
+    out[i].typos = typos;
+
+    if (*nout < max) {
+        (*nout)++;
+    }
+}
+
+size_t search_suggest(const SearchIndex *idx, const char *name, SearchSuggestion *out, size_t n)
+{
+    if (idx->ndocs == 0 || n == 0) {
+        return 0;
+    }
+
+    uint32_t *stack = malloc(sizeof(*stack) * idx->ndocs);
+    if (stack == NULL) {
+        return 0;
+    }
+
+    size_t nout = 0;
+    size_t tolerance = strlen(name) <= 4 ? 1 : SEARCH_MAX_TYPOS;
+
+    size_t nstack = 0;
+    stack[nstack++] = 0;
+
+    while (nstack > 0) {
+        uint32_t node = stack[--nstack];
+        size_t typos = search_typos(name, doc_name(idx, node));
+
+        if (typos <= tolerance) {
+            add_suggestion(idx, node, typos, out, &nout, n);
+
+            // Once there are enough, only names as close as the worst one
+            // can still be better.
+            if (nout == n && out[n - 1].typos < tolerance) {
+                tolerance = out[n - 1].typos;
+            }
+        }
+
+        for (uint32_t child = idx->tree[node * 3]; child != SEARCH_NONE; child = idx->tree[child * 3 + 1]) {
+            size_t edge = idx->tree[child * 3 + 2];
+            if (edge + tolerance >= typos && edge <= typos + tolerance) {
+                stack[nstack++] = child;
+            }
+        }
+    }
+
+    free(stack);
+
+    return nout;
+}
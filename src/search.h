@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * Full text search over the names and descriptions of the catalog.
+ *
+ * Every catalog entry is indexed by the trigrams, runs of three characters, of
+ * its name and description. A query word is only compared against the entries
+ * that have its rarest trigram, so searching does not depend on the size of
+ * the catalog. The index is saved to a file and only built again when the
+ * catalog changes.
+ *
+ * Text is compared without case, and anything that is not a letter or a digit
+ * separates words. The name of an entry is the name of its catalog file, the
+ * one that commands take.
+ */
+
+enum {
+    SEARCH_OK = 0,
+
+    SEARCH_ENOENT, // Catalog or index file could not be read.
+    SEARCH_EPARSE, // Index file is not one that was saved by this version.
+    SEARCH_ESTALE, // Index file was built from another catalog.
+    SEARCH_EIO,
+    SEARCH_ENOMEM,
+};
+
+typedef struct SearchIndex SearchIndex;
+
+/**
+ * The most typos a name given to a command may have and still be matched to
+ * one in the catalog.
+ */
+#define SEARCH_MAX_TYPOS 2
+
+typedef struct SearchSuggestion {
+    const char *name; // Belongs to the index.
+    size_t typos;
+} SearchSuggestion;
+
+typedef struct SearchResult {
+    const char *name; // Belongs to the index.
+    size_t name_words; // Query words that are in the name.
+    double score;
+} SearchResult;
+
+/**
+ * Builds the index of the catalog directory at catalog.
+ *
+ * On success returns SEARCH_OK and stores the index in out. On error returns
+ * one of the SEARCH_E values.
+ */
+int search_index_build(SearchIndex **out, const char *catalog);
+
+/**
+ * Loads the index file at path. The index shall have been built from the
+ * catalog directory at catalog as it is now.
+ *
+ * On success returns SEARCH_OK and stores the index in out. On error returns
+ * one of the SEARCH_E values.
+ */
+int search_index_load(SearchIndex **out, const char *path, const char *catalog);
+
+/**
+ * Saves idx to the index file at path.
+ *
+ * Returns SEARCH_OK on success, otherwise one of the SEARCH_E values.
+ */
+int search_index_save(const SearchIndex *idx, const char *path);
+
+/**
+ * Stores a value in stamp that changes whenever a file of the catalog directory
+ * at catalog is added, removed or modified, going by the modification times
+ * and sizes of the directory and its catalog files.
+ *
+ * Returns SEARCH_OK on success, otherwise SEARCH_ENOENT.
+ */
+int search_catalog_stamp(const char *catalog, long long *stamp);
+
+/**
+ * Loads the index file at path, or builds the index of catalog when it can not
+ * be loaded and saves it to path for the next time. Nothing is saved when path
+ * is NULL.
+ *
+ * On success returns SEARCH_OK and stores the index in out. On error returns
+ * one of the SEARCH_E values.
+ */
+int search_index_open(SearchIndex **out, const char *path, const char *catalog);
+
+/**
+ * Passing a NULL pointer will make this function return immediately with no
+ * action.
+ */
+void search_index_free(SearchIndex *idx);
+
+/**
+ * Returns the amount of entries in idx.
+ */
+size_t search_index_size(const SearchIndex *idx);
+
+/**
+ * Finds the entries of idx that have every word of query in their name or
+ * description. Words shorter than three characters only match the start of a
+ * word.
+ *
+ * Results are ranked with BM25, where words in the name count more than words
+ * in the description. Entries with more query words in their name always come
+ * first, so an entry is never ranked below one that only mentions it.
+ *
+ * On success returns SEARCH_OK, stores an array of the results in out that the
+ * caller shall free, and its length in n. On error returns SEARCH_ENOMEM.
+ */
+int search_query(const SearchIndex *idx, const char *query, SearchResult **out, size_t *n);
+
+/**
+ * Finds the names of idx that name could have been meant as, without case. A
+ * typo is a character that is missing, extra, wrong or swapped with the next
+ * one. Names of up to four characters may have one typo, longer ones
+ * SEARCH_MAX_TYPOS.
+ *
+ * Stores up to n of the names in out, fewest typos first, and returns how many
+ * were stored. An entry with the same name has no typos.
+ */
+size_t search_suggest(const SearchIndex *idx, const char *name, SearchSuggestion *out, size_t n);
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "sha256.h"
+#include "wowpkg.h"
+
+// SHA-256 as specified in FIPS 180-4.
+
+static const uint32_t k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(Sha256 *ctx, const unsigned char *block)
+{
+    uint32_t w[64];
+
+    for (size_t i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 | (uint32_t)block[i * 4 + 3];
+    }
+
+    for (size_t i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = ctx->state[0];
+    uint32_t b = ctx->state[1];
+    uint32_t c = ctx->state[2];
+    uint32_t d = ctx->state[3];
+    uint32_t e = ctx->state[4];
+    uint32_t f = ctx->state[5];
+    uint32_t g = ctx->state[6];
+    uint32_t h = ctx->state[7];
+
+    for (size_t i = 0; i < 64; i++) {
+        uint32_t s1 = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + k[i] + w[i];
+        uint32_t s0 = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+    ctx->state[5] += f;
+    ctx->state[6] += g;
+    ctx->state[7] += h;
+}
+
+void sha256_init(Sha256 *ctx)
+{
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memcpy(ctx->state, init, sizeof(init));
+    ctx->len = 0;
+    ctx->buflen = 0;
+}
+
+void sha256_update(Sha256 *ctx, const void *data, size_t n)
+{
+    const unsigned char *p = data;
+
+    ctx->len += n;
+
+    if (ctx->buflen > 0) {
+        size_t take = ARRAY_SIZE(ctx->buf) - ctx->buflen;
+        if (take > n) {
+            take = n;
+        }
+
+        memcpy(ctx->buf + ctx->buflen, p, take);
+        ctx->buflen += take;
+        p += take;
+        n -= take;
+
+        if (ctx->buflen < ARRAY_SIZE(ctx->buf)) {
+            return;
+        }
+
+        sha256_block(ctx, ctx->buf);
+        ctx->buflen = 0;
+    }
+
+    for (; n >= ARRAY_SIZE(ctx->buf); p += ARRAY_SIZE(ctx->buf), n -= ARRAY_SIZE(ctx->buf)) {
+        sha256_block(ctx, p);
+    }
+
+    memcpy(ctx->buf, p, n);
+    ctx->buflen = n;
+}
+
+void sha256_final(Sha256 *ctx, unsigned char digest[SHA256_DIGEST_SIZE])
+{
+    uint64_t bits = ctx->len * 8;
+
+    ctx->buf[ctx->buflen++] = 0x80;
+
+    if (ctx->buflen > 56) {
+        memset(ctx->buf + ctx->buflen, 0, ARRAY_SIZE(ctx->buf) - ctx->buflen);
+        sha256_block(ctx, ctx->buf);
+        ctx->buflen = 0;
+    }
+
+    memset(ctx->buf + ctx->buflen, 0, 56 - ctx->buflen);
+    for (size_t i = 0; i < 8; i++) {
+        ctx->buf[56 + i] = (unsigned char)(bits >> (56 - i * 8));
+    }
+    sha256_block(ctx, ctx->buf);
+
+    for (size_t i = 0; i < 8; i++) {
+        digest[i * 4] = (unsigned char)(ctx->state[i] >> 24);
+        digest[i * 4 + 1] = (unsigned char)(ctx->state[i] >> 16);
+        digest[i * 4 + 2] = (unsigned char)(ctx->state[i] >> 8);
+        digest[i * 4 + 3] = (unsigned char)ctx->state[i];
+    }
+}
+
+int sha256_stream(FILE *f, unsigned char digest[SHA256_DIGEST_SIZE])
+{
+    Sha256 ctx;
+    sha256_init(&ctx);
+
+    unsigned char buf[BUFSIZ];
+    size_t n = 0;
+    while ((n = fread(buf, sizeof(*buf), ARRAY_SIZE(buf), f)) > 0) {
+        sha256_update(&ctx, buf, n);
+    }
+
+    if (ferror(f)) {
+        return -1;
+    }
+
+    sha256_final(&ctx, digest);
+
+    return 0;
+}
+
+int sha256_file(const char *path, unsigned char digest[SHA256_DIGEST_SIZE])
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+
+    int err = sha256_stream(f, digest);
+    fclose(f);
+
+    return err;
+}
+
+void sha256_hex(const unsigned char digest[SHA256_DIGEST_SIZE], char hex[SHA256_HEX_SIZE])
+{
+    static const char digits[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0x0f];
+    }
+    hex[SHA256_HEX_SIZE - 1] = '\0';
+}
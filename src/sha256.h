@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+/**
+ * Size of a buffer that holds a digest as a null terminated hex string.
+ */
+#define SHA256_HEX_SIZE (SHA256_DIGEST_SIZE * 2 + 1)
+
+typedef struct Sha256 {
+    uint32_t state[8];
+    uint64_t len; // Bytes hashed so far.
+    unsigned char buf[64];
+    size_t buflen;
+} Sha256;
+
+void sha256_init(Sha256 *ctx);
+void sha256_update(Sha256 *ctx, const void *data, size_t n);
+void sha256_final(Sha256 *ctx, unsigned char digest[SHA256_DIGEST_SIZE]);
+
+/**
+ * Hashes what is left to read of f.
+ *
+ * Returns 0 on success, otherwise -1.
+ */
+int sha256_stream(FILE *f, unsigned char digest[SHA256_DIGEST_SIZE]);
+
+/**
+ * Hashes the contents of the file at path.
+ *
+ * Returns 0 on success, otherwise -1.
+ */
+int sha256_file(const char *path, unsigned char digest[SHA256_DIGEST_SIZE]);
+
+/**
+ * Writes digest to hex as a lower case, null terminated string.
+ */
+void sha256_hex(const unsigned char digest[SHA256_DIGEST_SIZE], char hex[SHA256_HEX_SIZE]);
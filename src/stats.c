@@ -0,0 +1,376 @@
+#include <stdlib.h>
+
+#include "list.h"
+#include "osapi.h"
+#include "osstring.h"
+#include "stats.h"
+#include "term.h"
+#include "threadpool.h"
+#include "wowpkg.h"
+
+/**
+ * Name of the row that work shared by many addons is recorded in.
+ */
+#define STATS_SHARED_NAME "(shared)"
+
+typedef struct StatsEntry {
+    char *name;
+    double seconds[STATS_NPHASES];
+    curl_off_t wire_bytes;
+    curl_off_t resumed_bytes;
+    size_t reused_connections;
+    size_t files_written;
+    size_t files_renamed;
+} StatsEntry;
+
+static const char *const phase_names[STATS_NPHASES] = {
+    [STATS_META] = "meta",
+    [STATS_DOWNLOAD] = "download",
+    [STATS_PACKAGE] = "package",
+    [STATS_EXTRACT] = "extract",
+    [STATS_REMOVE] = "remove",
+    [STATS_SAVE] = "save",
+};
+
+static bool enabled = false;
+static List *entries = NULL;
+
+static FILE *trace = NULL;
+static double trace_start = 0;
+static size_t trace_nevents = 0;
+static bool trace_named[THREADPOOL_MAX_THREADS + 1]; // Thread names written.
+
+/**
+ * Phases may be measured by worker threads, lock guards entries and trace.
+ */
+static OsMutex lock = OS_MUTEX_INIT;
+
+static void stats_entry_free(StatsEntry *e)
+{
+    if (e == NULL) {
+        return;
+    }
+
+    free(e->name);
+    free(e);
+}
+
+static int cmp_entry_name(const void *name, const void *entry)
+{
+    const StatsEntry *e = entry;
+    return strcmp(name, e->name);
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+    const StatsEntry *aa = a;
+    const StatsEntry *bb = b;
+    return strcasecmp(aa->name, bb->name);
+}
+
+/**
+ * Finds the entry for name, creating it if it does not exist yet.
+ *
+ * Returns NULL if memory could not be allocated.
+ */
+static StatsEntry *stats_entry(const char *name)
+{
+    if (name == NULL) {
+        name = STATS_SHARED_NAME;
+    }
+
+    if (entries == NULL) {
+        entries = list_create();
+        if (entries == NULL) {
+            return NULL;
+        }
+        list_set_free_fn(entries, (ListFreeFn)stats_entry_free);
+    }
+
+    ListNode *node = list_search(entries, name, cmp_entry_name);
+    if (node != NULL) {
+        return node->value;
+    }
+
+    StatsEntry *e = calloc(1, sizeof(*e));
+    if (e == NULL) {
+        return NULL;
+    }
+
+    e->name = strdup(name);
+    if (e->name == NULL || list_insert(entries, e) == NULL) {
+        stats_entry_free(e);
+        return NULL;
+    }
+
+    return e;
+}
+
+/**
+ * Writes s as the contents of a JSON string.
+ */
+static void trace_write_escaped(const char *s)
+{
+    for (; *s != '\0'; s++) {
+        unsigned char ch = (unsigned char)*s;
+        if (ch == '"' || ch == '\\') {
+            fprintf(trace, "\\%c", ch);
+        } else if (ch < 0x20) {
+            fprintf(trace, "\\u%04x", ch);
+        } else {
+            fputc(ch, trace);
+        }
+    }
+}
+
+/**
+ * Returns the trace thread id of the calling thread, writing its name the
+ * first time it is seen. The main thread is 1, worker threads follow it.
+ */
+static int trace_thread(void)
+{
+    int id = threadpool_worker_id();
+    if (id < 0 || id > THREADPOOL_MAX_THREADS) {
+        id = 0;
+    }
+
+    if (!trace_named[id]) {
+        trace_named[id] = true;
+
+        fprintf(trace, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"", id + 1);
+        if (id == 0) {
+            fprintf(trace, "main");
+        } else {
+            fprintf(trace, "worker %d", id);
+        }
+        fprintf(trace, "\"}}");
+        trace_nevents++;
+    }
+
+    return id + 1;
+}
+
+/**
+ * Writes a complete event, a span with a start and a duration. The span is
+ * named after cat and detail, detail is also stored in args under arg_name.
+ * Shall be called with lock held.
+ */
+static void trace_write_span(const char *cat, const char *arg_name, const char *detail, double start, double end)
+{
+    int tid = trace_thread();
+
+    fprintf(trace, "%s\n{\"name\":\"%s", trace_nevents > 0 ? "," : "", cat);
+    if (detail != NULL) {
+        fputc(' ', trace);
+        trace_write_escaped(detail);
+    }
+
+    fprintf(trace, "\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f",
+        cat, tid, (start - trace_start) * 1e6, (end - start) * 1e6);
+
+    if (detail != NULL) {
+        fprintf(trace, ",\"args\":{\"%s\":\"", arg_name);
+        trace_write_escaped(detail);
+        fprintf(trace, "\"}");
+    }
+
+    fputc('}', trace);
+    trace_nevents++;
+}
+
+void stats_enable(bool enable)
+{
+    enabled = enable;
+}
+
+bool stats_enabled(void)
+{
+    return enabled;
+}
+
+void stats_start(StatsTimer *t, int phase, const char *name)
+{
+    t->phase = phase;
+    t->name = name;
+
+    if (!enabled && trace == NULL) {
+        return;
+    }
+
+    net_get_thread_stats(&t->net);
+    t->start = os_monotonic();
+}
+
+void stats_stop(StatsTimer *t)
+{
+    if (!enabled && trace == NULL) {
+        return;
+    }
+
+    double end = os_monotonic();
+    double elapsed = end - t->start;
+
+    // Only the requests made by this thread count, so that phases that run at
+    // the same time on other threads are not attributed to this one.
+    NetStats net;
+    net_get_thread_stats(&net);
+
+    os_mutex_lock(&lock);
+
+    if (trace != NULL) {
+        trace_write_span(phase_names[t->phase], "addon", t->name, t->start, end);
+    }
+
+    StatsEntry *e = enabled ? stats_entry(t->name) : NULL;
+    if (e != NULL) {
+        e->seconds[t->phase] += elapsed;
+        e->wire_bytes += net.wire_bytes - t->net.wire_bytes;
+        e->resumed_bytes += net.resumed_bytes - t->net.resumed_bytes;
+        e->reused_connections += net.reused_connections - t->net.reused_connections;
+    }
+
+    os_mutex_unlock(&lock);
+}
+
+void stats_add_files(const char *name, size_t written, size_t renamed)
+{
+    if (!enabled) {
+        return;
+    }
+
+    os_mutex_lock(&lock);
+
+    StatsEntry *e = stats_entry(name);
+    if (e != NULL) {
+        e->files_written += written;
+        e->files_renamed += renamed;
+    }
+
+    os_mutex_unlock(&lock);
+}
+
+static void stats_print_row(FILE *stream, const StatsEntry *e)
+{
+    double total = 0;
+
+    fprintf(stream, "%-24.24s", e->name);
+    for (int i = 0; i < STATS_NPHASES; i++) {
+        if (e->seconds[i] > 0) {
+            fprintf(stream, " %8.3f", e->seconds[i]);
+        } else {
+            fprintf(stream, " %8s", "-");
+        }
+
+        total += e->seconds[i];
+    }
+
+    fprintf(stream, " %8.3f %10.1f %10.1f %6zu %6zu %6zu\n",
+        total,
+        (double)e->wire_bytes / 1024.0,
+        (double)e->resumed_bytes / 1024.0,
+        e->reused_connections,
+        e->files_written,
+        e->files_renamed);
+}
+
+void stats_print(FILE *stream)
+{
+    if (!enabled || entries == NULL || list_isempty(entries)) {
+        return;
+    }
+
+    list_sort(entries, cmp_entry);
+
+    fprintf(stream, TERM_WRAP(TERM_BOLD, "%-24s"), "Addon");
+    for (int i = 0; i < STATS_NPHASES; i++) {
+        fprintf(stream, TERM_WRAP(TERM_BOLD, " %8s"), phase_names[i]);
+    }
+    fprintf(stream, TERM_WRAP(TERM_BOLD, " %8s %10s %10s %6s %6s %6s") "\n", "total", "KiB", "resumed", "reused", "files", "moved");
+
+    char total_name[] = "Total";
+    StatsEntry total;
+    memset(&total, 0, sizeof(total));
+    total.name = total_name;
+
+    ListNode *node = NULL;
+    list_foreach(node, entries)
+    {
+        const StatsEntry *e = node->value;
+        stats_print_row(stream, e);
+
+        for (int i = 0; i < STATS_NPHASES; i++) {
+            total.seconds[i] += e->seconds[i];
+        }
+
+        total.wire_bytes += e->wire_bytes;
+        total.resumed_bytes += e->resumed_bytes;
+        total.reused_connections += e->reused_connections;
+        total.files_written += e->files_written;
+        total.files_renamed += e->files_renamed;
+    }
+
+    stats_print_row(stream, &total);
+
+    fprintf(stream, "\nTimes are in seconds. 'resumed' KiB and 'reused' connections did not have to be\n");
+    fprintf(stream, "transferred or opened again. 'moved' counts top level directories moved into place.\n");
+}
+
+void stats_reset(void)
+{
+    list_free(entries);
+    entries = NULL;
+}
+
+int stats_trace_open(const char *path)
+{
+    if (trace != NULL) {
+        stats_trace_close();
+    }
+
+    trace = fopen(path, "w");
+    if (trace == NULL) {
+        return -1;
+    }
+
+    trace_start = os_monotonic();
+    trace_nevents = 0;
+    memset(trace_named, 0, sizeof(trace_named));
+
+    // The JSON array format is used since viewers also accept it when the
+    // program exits before the closing bracket is written.
+    fprintf(trace, "[");
+    fprintf(trace, "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"" WOWPKG_NAME "\"}}");
+    trace_nevents++;
+
+    return 0;
+}
+
+int stats_trace_close(void)
+{
+    if (trace == NULL) {
+        return 0;
+    }
+
+    fprintf(trace, "\n]\n");
+
+    int err = ferror(trace) ? -1 : 0;
+    if (fclose(trace) != 0) {
+        err = -1;
+    }
+    trace = NULL;
+
+    return err;
+}
+
+void stats_trace_span(const char *name, const char *detail, double start)
+{
+    if (trace == NULL) {
+        return;
+    }
+
+    double end = os_monotonic();
+
+    os_mutex_lock(&lock);
+    trace_write_span(name, "detail", detail, start, end);
+    os_mutex_unlock(&lock);
+}
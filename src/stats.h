@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "net.h"
+
+/**
+ * Lightweight instrumentation of the phases of a command. Nothing is measured
+ * unless stats_enable or stats_trace_open was called, so the calls can stay in
+ * place at all times.
+ *
+ * Measurements are recorded per addon name. Work that is shared by many addons,
+ * like fetching metadata in one batch, is recorded with a NULL name and only
+ * shows up in the totals.
+ */
+
+enum {
+    STATS_META = 0,
+    STATS_DOWNLOAD,
+    STATS_PACKAGE,
+    STATS_EXTRACT,
+    STATS_REMOVE,
+    STATS_SAVE,
+
+    STATS_NPHASES,
+};
+
+typedef struct StatsTimer {
+    int phase;
+    const char *name;
+    double start;
+    NetStats net;
+} StatsTimer;
+
+void stats_enable(bool enable);
+bool stats_enabled(void);
+
+/**
+ * Starts timing a phase for the addon with the given name. The network counters
+ * are sampled as well so that stats_stop can attribute the bytes transferred
+ * during the phase.
+ *
+ * name is not copied and shall stay valid until stats_stop.
+ */
+void stats_start(StatsTimer *t, int phase, const char *name);
+void stats_stop(StatsTimer *t);
+
+/**
+ * Adds the amount of files written and the amount of files or directories that
+ * were moved into place.
+ */
+void stats_add_files(const char *name, size_t written, size_t renamed);
+
+/**
+ * Prints a table with a row per addon and a total row. Prints nothing if no
+ * measurements were recorded.
+ */
+void stats_print(FILE *stream);
+
+/**
+ * Discards all recorded measurements.
+ */
+void stats_reset(void);
+
+/**
+ * Writes every phase measured from now on as a span to a Chrome trace event
+ * file at path. The file can be opened with chrome://tracing or
+ * https://ui.perfetto.dev.
+ *
+ * stats_trace_open returns 0 on success, -1 if the file could not be created.
+ * stats_trace_close finishes the file and returns -1 if it could not be
+ * written.
+ */
+int stats_trace_open(const char *path);
+int stats_trace_close(void);
+
+/**
+ * Writes a span from start, a time from os_monotonic, until now for something
+ * that is not one of the phases, for example the whole command. name shall be
+ * a JSON safe string, detail may be NULL.
+ */
+void stats_trace_span(const char *name, const char *detail, double start);
@@ -0,0 +1,415 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "list.h"
+#include "osapi.h"
+#include "sha256.h"
+#include "store.h"
+#include "wowpkg.h"
+
+#define STORE_OBJECTS_NAME "objects"
+#define STORE_LINK_SUFFIX ".wowpkg_link"
+
+/**
+ * Objects are spread over directories named after the first two hex digits of
+ * their hash so that no directory gets too large.
+ */
+static int snobject_path(char *s, size_t n, const char *path, const char *hex)
+{
+    return snprintf(s, n, "%s%c" STORE_OBJECTS_NAME "%c%.2s%c%s", path, OS_SEPARATOR, OS_SEPARATOR, hex, OS_SEPARATOR, hex + 2);
+}
+
+static int snjoin_path(char *s, size_t n, const char *dir, const char *filename)
+{
+    return snprintf(s, n, "%s%c%s", dir, OS_SEPARATOR, filename);
+}
+
+/**
+ * Adds the names in the directory at path to names. Names are collected before
+ * anything is moved out of the directory since removing entries while reading
+ * a directory may skip some.
+ */
+static int list_dir_names(const char *path, List *names)
+{
+    OsDir *dir = os_opendir(path);
+    if (dir == NULL) {
+        return STORE_EIO;
+    }
+
+    OsDirEnt *entry = NULL;
+    while ((entry = os_readdir(dir)) != NULL) {
+        if (strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0) {
+            continue;
+        }
+
+        char *name = strdup(entry->name);
+        if (name == NULL) {
+            os_closedir(dir);
+            return STORE_EIO;
+        }
+
+        list_insert(names, name);
+    }
+
+    os_closedir(dir);
+
+    return STORE_OK;
+}
+
+/**
+ * Makes dest a link to object. An existing dest is replaced by linking next to
+ * it and renaming over it so that dest is never missing.
+ */
+static int link_object(const char *object, const char *dest, bool replace)
+{
+    if (!replace) {
+        return os_link(object, dest);
+    }
+
+    char tmp[OS_MAX_PATH];
+    int n = snprintf(tmp, ARRAY_SIZE(tmp), "%s" STORE_LINK_SUFFIX, dest);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(tmp)) {
+        return -1;
+    }
+
+    remove(tmp);
+    if (os_link(object, tmp) != 0) {
+        return -1;
+    }
+
+    if (os_rename(tmp, dest) != 0) {
+        remove(tmp);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Returns true if the files at a and b have the same contents.
+ */
+static bool same_contents(const char *a, const char *b)
+{
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    bool same = fa != NULL && fb != NULL;
+
+    unsigned char bufa[BUFSIZ];
+    unsigned char bufb[BUFSIZ];
+    while (same) {
+        size_t na = fread(bufa, 1, ARRAY_SIZE(bufa), fa);
+        size_t nb = fread(bufb, 1, ARRAY_SIZE(bufb), fb);
+        if (na != nb || memcmp(bufa, bufb, na) != 0 || ferror(fa) || ferror(fb)) {
+            same = false;
+        } else if (na == 0) {
+            break;
+        }
+    }
+
+    if (fa != NULL) {
+        fclose(fa);
+    }
+    if (fb != NULL) {
+        fclose(fb);
+    }
+
+    return same;
+}
+
+/**
+ * Makes the object at path read only so that it is not edited through one of
+ * its links by accident. Windows does not let read only files be renamed over
+ * or deleted, which upgrades and removes do, so objects are left as they are
+ * there.
+ */
+static void protect_object(const char *path)
+{
+#ifndef _WIN32
+    chmod(path, 0444);
+#else
+    UNUSED(path);
+#endif
+}
+
+/**
+ * Moves the file at src to dest through the store, see store_import. When src
+ * and dest are the same the file is deduplicated in place.
+ */
+static int store_file(const char *path, const char *src, const char *dest)
+{
+    bool in_place = strcmp(src, dest) == 0;
+
+    OsFileInfo src_info;
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    if (os_file_info(src, &src_info) != 0 || sha256_file(src, digest) != 0) {
+        return STORE_EIO;
+    }
+
+    char hex[SHA256_HEX_SIZE];
+    sha256_hex(digest, hex);
+
+    char object[OS_MAX_PATH];
+    int n = snobject_path(object, ARRAY_SIZE(object), path, hex);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(object)) {
+        return STORE_ENAMETOOLONG;
+    }
+
+    OsFileInfo object_info;
+    bool found = os_file_info(object, &object_info) == 0;
+    bool is_src = found && object_info.dev == src_info.dev && object_info.ino == src_info.ino;
+    if (found && !is_src && (object_info.size != src_info.size || !same_contents(object, src))) {
+        // Edited through one of its links so it no longer matches its name.
+        // Removed like store_repair does so that nothing links to it again.
+        remove(object);
+        found = false;
+    }
+
+    if (is_src) {
+        if (!in_place && os_rename(src, dest) != 0) {
+            return STORE_EIO;
+        }
+
+        return STORE_OK;
+    }
+
+    if (found && link_object(object, dest, in_place) == 0) {
+        protect_object(object);
+
+        if (!in_place) {
+            remove(src);
+        }
+
+        return STORE_OK;
+    }
+
+    if (!in_place && os_rename(src, dest) != 0) {
+        return STORE_EIO;
+    }
+
+    if (!found) {
+        char dir[OS_MAX_PATH];
+        memcpy(dir, object, (size_t)n + 1);
+
+        // Fails if another thread added the same contents first or the store
+        // is on another file system. Either way dest is left as it is.
+        if (os_mkdir_all(dir, 0755) == 0 && os_link(dest, object) == 0) {
+            protect_object(object);
+        }
+    }
+
+    return STORE_OK;
+}
+
+static int store_tree(const char *path, const char *src, const char *dest)
+{
+    struct os_stat s;
+    if (os_stat(src, &s) != 0) {
+        return STORE_EIO;
+    }
+
+    if (!S_ISDIR(s.st_mode)) {
+        return store_file(path, src, dest);
+    }
+
+    bool in_place = strcmp(src, dest) == 0;
+    if (!in_place && os_mkdir(dest, 0755) != 0 && errno != EEXIST) {
+        return STORE_EIO;
+    }
+
+    List *names = list_create();
+    if (names == NULL) {
+        return STORE_EIO;
+    }
+    list_set_free_fn(names, free);
+
+    int err = list_dir_names(src, names);
+
+    ListNode *node = NULL;
+    list_foreach(node, names)
+    {
+        if (err != STORE_OK) {
+            break;
+        }
+
+        char child_src[OS_MAX_PATH];
+        char child_dest[OS_MAX_PATH];
+        int n1 = snjoin_path(child_src, ARRAY_SIZE(child_src), src, node->value);
+        int n2 = snjoin_path(child_dest, ARRAY_SIZE(child_dest), dest, node->value);
+        if (n1 < 0 || (size_t)n1 >= ARRAY_SIZE(child_src) || n2 < 0 || (size_t)n2 >= ARRAY_SIZE(child_dest)) {
+            err = STORE_ENAMETOOLONG;
+            break;
+        }
+
+        err = store_tree(path, child_src, child_dest);
+    }
+
+    list_free(names);
+
+    if (err == STORE_OK && !in_place) {
+        os_rmdir(src);
+    }
+
+    return err;
+}
+
+int store_import(const char *path, const char *src, const char *dest)
+{
+    return store_tree(path, src, dest);
+}
+
+int store_dedupe(const char *path, const char *target)
+{
+    return store_tree(path, target, target);
+}
+
+int store_repair(const char *path, const char *good, const char *target)
+{
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    if (sha256_file(good, digest) != 0) {
+        return STORE_EIO;
+    }
+
+    char hex[SHA256_HEX_SIZE];
+    sha256_hex(digest, hex);
+
+    char object[OS_MAX_PATH];
+    int n = snobject_path(object, ARRAY_SIZE(object), path, hex);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(object)) {
+        return STORE_ENAMETOOLONG;
+    }
+
+    // The edited object is target itself, so it is dropped here rather than
+    // left for store_file to compare against the good file.
+    OsFileInfo object_info;
+    OsFileInfo target_info;
+    if (os_file_info(object, &object_info) == 0 && os_file_info(target, &target_info) == 0 && object_info.dev == target_info.dev && object_info.ino == target_info.ino) {
+        remove(object);
+    }
+
+    if (os_rename(good, target) != 0) {
+        return STORE_EIO;
+    }
+
+    return store_file(path, target, target);
+}
+
+typedef int (*ObjectFn)(const char *object, const OsFileInfo *info, void *arg);
+
+/**
+ * Calls fn for every object in the store at path.
+ */
+static int foreach_object(const char *path, ObjectFn fn, void *arg)
+{
+    char objects[OS_MAX_PATH];
+    int n = snjoin_path(objects, ARRAY_SIZE(objects), path, STORE_OBJECTS_NAME);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(objects)) {
+        return STORE_ENAMETOOLONG;
+    }
+
+    OsDir *dir = os_opendir(objects);
+    if (dir == NULL) {
+        return errno == ENOENT ? STORE_OK : STORE_EIO;
+    }
+
+    int err = STORE_OK;
+
+    OsDirEnt *entry = NULL;
+    while (err == STORE_OK && (entry = os_readdir(dir)) != NULL) {
+        if (strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0) {
+            continue;
+        }
+
+        char prefix[OS_MAX_PATH];
+        n = snjoin_path(prefix, ARRAY_SIZE(prefix), objects, entry->name);
+        if (n < 0 || (size_t)n >= ARRAY_SIZE(prefix)) {
+            err = STORE_ENAMETOOLONG;
+            break;
+        }
+
+        List *names = list_create();
+        if (names == NULL) {
+            err = STORE_EIO;
+            break;
+        }
+        list_set_free_fn(names, free);
+
+        // Anything that is not a directory is not an object.
+        list_dir_names(prefix, names);
+
+        ListNode *node = NULL;
+        list_foreach(node, names)
+        {
+            char object[OS_MAX_PATH];
+            n = snjoin_path(object, ARRAY_SIZE(object), prefix, node->value);
+            if (n < 0 || (size_t)n >= ARRAY_SIZE(object)) {
+                err = STORE_ENAMETOOLONG;
+                break;
+            }
+
+            OsFileInfo info;
+            if (os_file_info(object, &info) == 0 && (err = fn(object, &info, arg)) != STORE_OK) {
+                break;
+            }
+        }
+
+        list_free(names);
+    }
+
+    os_closedir(dir);
+
+    return err;
+}
+
+static int add_usage(const char *object, const OsFileInfo *info, void *arg)
+{
+    UNUSED(object);
+
+    StoreUsage *usage = arg;
+
+    usage->objects++;
+    usage->bytes += info->size;
+
+    // The object itself is one of the links.
+    if (info->nlink <= 1) {
+        usage->unused++;
+    } else {
+        usage->links += info->nlink - 1;
+        usage->saved += (info->nlink - 2) * info->size;
+    }
+
+    return STORE_OK;
+}
+
+int store_usage(const char *path, StoreUsage *usage)
+{
+    memset(usage, 0, sizeof(*usage));
+
+    return foreach_object(path, add_usage, usage);
+}
+
+static int prune_object(const char *object, const OsFileInfo *info, void *arg)
+{
+    size_t *removed = arg;
+
+    if (info->nlink <= 1 && remove(object) == 0) {
+        (*removed)++;
+    }
+
+    return STORE_OK;
+}
+
+int store_prune(const char *path, size_t *removed)
+{
+    size_t n = 0;
+    int err = foreach_object(path, prune_object, &n);
+
+    if (removed != NULL) {
+        *removed = n;
+    }
+
+    return err;
+}
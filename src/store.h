@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * Content addressed store of addon files. Every file is named after the
+ * SHA-256 hash of its contents, and files in addons directories with the same
+ * contents are hard links to it, so embedded libraries and sounds that many
+ * addons ship are only stored once.
+ *
+ * The link count of an object is how the store knows which objects are still
+ * used, so the store and the addons directories shall be on the same file
+ * system. Files that can not be linked are left as they are.
+ *
+ * Addon files shall not be edited in place while they are in the store,
+ * every other addon with the same file would see the change. Objects are made
+ * read only, except on Windows, and an object whose contents no longer match
+ * the file being added is dropped instead of linked to.
+ */
+
+#define STORE_DIR_NAME ".wowpkg_store"
+
+enum {
+    STORE_OK = 0,
+
+    STORE_EIO, // A file or directory could not be read, created or moved.
+    STORE_ENAMETOOLONG,
+};
+
+typedef struct StoreUsage {
+    size_t objects; // Files in the store.
+    unsigned long long bytes; // Size of all objects.
+    size_t links; // Files in addons directories that are an object.
+    unsigned long long saved; // Bytes that would be used without the store.
+    size_t unused; // Objects that are not linked to anymore.
+} StoreUsage;
+
+/**
+ * Moves the file or directory at src to dest, which shall not exist. Every
+ * file whose contents are already in the store at path is linked to instead of
+ * being moved, so no data is copied even if src is on another file system.
+ * Other files are moved and added to the store.
+ *
+ * May be called from multiple threads at the same time.
+ *
+ * Returns STORE_OK on success, otherwise one of the STORE_E values.
+ */
+int store_import(const char *path, const char *src, const char *dest);
+
+/**
+ * Replaces every file in the file or directory at target that is already in
+ * the store at path with a link to it, and adds the others.
+ *
+ * Returns STORE_OK on success, otherwise one of the STORE_E values.
+ */
+int store_dedupe(const char *path, const char *target);
+
+/**
+ * Replaces target, a file that does not have the contents it was installed
+ * with, by the file at good. When target is the object of its contents the
+ * object was edited, so it is removed from the store first. The file at good
+ * is moved and deduplicated like store_dedupe does.
+ *
+ * Returns STORE_OK on success, otherwise one of the STORE_E values.
+ */
+int store_repair(const char *path, const char *good, const char *target);
+
+/**
+ * Counts the objects in the store at path and the space they save. A store
+ * that does not exist is empty.
+ *
+ * Returns STORE_OK on success, otherwise one of the STORE_E values.
+ */
+int store_usage(const char *path, StoreUsage *usage);
+
+/**
+ * Deletes the objects in the store at path that no file links to anymore. The
+ * amount deleted is stored in removed if it is not NULL.
+ *
+ * Returns STORE_OK on success, otherwise one of the STORE_E values.
+ */
+int store_prune(const char *path, size_t *removed);
@@ -0,0 +1,340 @@
+#include <signal.h>
+#include <stdlib.h>
+
+#include "osapi.h"
+#include "threadpool.h"
+
+enum {
+    TASK_QUEUED = 0,
+    TASK_DONE,
+    TASK_CANCELED,
+};
+
+struct ThreadTask {
+    struct ThreadTask *next;
+    ThreadPool *pool;
+    ThreadTaskFn fn;
+    ThreadTaskDoneFn done;
+    void *arg;
+    int result;
+    int state;
+};
+
+/**
+ * Argument of a worker thread.
+ */
+typedef struct ThreadWorker {
+    ThreadPool *pool;
+    int id;
+} ThreadWorker;
+
+struct ThreadPool {
+    OsMutex lock;
+    OsCond work; // Signaled when a task was queued or the pool is stopping.
+    OsCond finished; // Signaled when a task finished or was canceled.
+
+    ThreadTask *head;
+    ThreadTask *tail;
+
+    OsThread *threads;
+    ThreadWorker *workers;
+    int nthreads;
+
+    bool stopping;
+    bool canceled;
+};
+
+static volatile sig_atomic_t interrupted = 0;
+static OS_THREAD_LOCAL int worker_id = 0;
+
+/**
+ * Removes the first task from the queue. Shall be called with the pool locked.
+ */
+static ThreadTask *threadpool_pop(ThreadPool *pool)
+{
+    ThreadTask *task = pool->head;
+    if (task != NULL) {
+        pool->head = task->next;
+        if (pool->head == NULL) {
+            pool->tail = NULL;
+        }
+        task->next = NULL;
+    }
+
+    return task;
+}
+
+/**
+ * Runs or cancels a task that was removed from the queue and wakes up anyone
+ * waiting for it. Shall be called with the pool unlocked.
+ */
+static void threadpool_run(ThreadPool *pool, ThreadTask *task)
+{
+    int state = TASK_CANCELED;
+
+    if (!threadpool_canceled(pool)) {
+        task->result = task->fn(task->arg);
+        if (task->done != NULL) {
+            task->done(task->arg, task->result);
+        }
+        state = TASK_DONE;
+    }
+
+    if (pool == NULL) {
+        task->state = state;
+        return;
+    }
+
+    os_mutex_lock(&pool->lock);
+    task->state = state;
+    os_cond_broadcast(&pool->finished);
+    os_mutex_unlock(&pool->lock);
+}
+
+static void threadpool_worker(void *arg)
+{
+    ThreadWorker *worker = arg;
+    ThreadPool *pool = worker->pool;
+
+    worker_id = worker->id;
+
+    os_mutex_lock(&pool->lock);
+    while (1) {
+        ThreadTask *task = threadpool_pop(pool);
+        if (task != NULL) {
+            os_mutex_unlock(&pool->lock);
+            threadpool_run(pool, task);
+            os_mutex_lock(&pool->lock);
+            continue;
+        }
+
+        if (pool->stopping) {
+            break;
+        }
+
+        os_cond_wait(&pool->work, &pool->lock);
+    }
+    os_mutex_unlock(&pool->lock);
+}
+
+ThreadPool *threadpool_create(int nthreads)
+{
+    if (nthreads < 1) {
+        nthreads = os_cpu_count();
+    }
+
+    if (nthreads > THREADPOOL_MAX_THREADS) {
+        nthreads = THREADPOOL_MAX_THREADS;
+    }
+
+    ThreadPool *pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    pool->threads = calloc((size_t)nthreads, sizeof(*pool->threads));
+    pool->workers = calloc((size_t)nthreads, sizeof(*pool->workers));
+    if (pool->threads == NULL || pool->workers == NULL) {
+        goto error;
+    }
+
+    if (os_mutex_init(&pool->lock) != 0) {
+        goto error;
+    }
+
+    if (os_cond_init(&pool->work) != 0) {
+        os_mutex_destroy(&pool->lock);
+        goto error;
+    }
+
+    if (os_cond_init(&pool->finished) != 0) {
+        os_cond_destroy(&pool->work);
+        os_mutex_destroy(&pool->lock);
+        goto error;
+    }
+
+    for (int i = 0; i < nthreads; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i + 1;
+
+        if (os_thread_create(&pool->threads[i], threadpool_worker, &pool->workers[i]) != 0) {
+            break;
+        }
+
+        pool->nthreads++;
+    }
+
+    if (pool->nthreads == 0) {
+        threadpool_free(pool);
+        return NULL;
+    }
+
+    return pool;
+
+error:
+    free(pool->threads);
+    free(pool->workers);
+    free(pool);
+
+    return NULL;
+}
+
+void threadpool_free(ThreadPool *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+
+    os_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    os_cond_broadcast(&pool->work);
+    os_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nthreads; i++) {
+        os_thread_join(pool->threads[i]);
+    }
+
+    os_cond_destroy(&pool->finished);
+    os_cond_destroy(&pool->work);
+    os_mutex_destroy(&pool->lock);
+
+    free(pool->threads);
+    free(pool->workers);
+    free(pool);
+}
+
+int threadpool_size(const ThreadPool *pool)
+{
+    return pool == NULL ? 1 : pool->nthreads;
+}
+
+ThreadTask *threadpool_submit(ThreadPool *pool, ThreadTaskFn fn, ThreadTaskDoneFn done, void *arg)
+{
+    ThreadTask *task = calloc(1, sizeof(*task));
+    if (task == NULL) {
+        return NULL;
+    }
+
+    task->pool = pool;
+    task->fn = fn;
+    task->done = done;
+    task->arg = arg;
+    task->state = TASK_QUEUED;
+
+    if (pool == NULL) {
+        threadpool_run(NULL, task);
+        return task;
+    }
+
+    os_mutex_lock(&pool->lock);
+    if (pool->tail != NULL) {
+        pool->tail->next = task;
+    } else {
+        pool->head = task;
+    }
+    pool->tail = task;
+    os_cond_signal(&pool->work);
+    os_mutex_unlock(&pool->lock);
+
+    return task;
+}
+
+int threadpool_wait(ThreadTask *task, int *result)
+{
+    if (task == NULL) {
+        return THREADPOOL_ENOMEM;
+    }
+
+    ThreadPool *pool = task->pool;
+
+    if (pool != NULL) {
+        os_mutex_lock(&pool->lock);
+        while (task->state == TASK_QUEUED) {
+            // Help out instead of blocking so that tasks waiting on other
+            // tasks can not use up every worker.
+            ThreadTask *other = threadpool_pop(pool);
+            if (other != NULL) {
+                os_mutex_unlock(&pool->lock);
+                threadpool_run(pool, other);
+                os_mutex_lock(&pool->lock);
+                continue;
+            }
+
+            os_cond_wait(&pool->finished, &pool->lock);
+        }
+        os_mutex_unlock(&pool->lock);
+    }
+
+    int err = THREADPOOL_OK;
+    if (task->state == TASK_DONE) {
+        *result = task->result;
+    } else {
+        err = THREADPOOL_ECANCELED;
+    }
+
+    free(task);
+
+    return err;
+}
+
+int threadpool_wait_all(ThreadTask **tasks, size_t n, int *results, int err_result)
+{
+    int err = THREADPOOL_OK;
+
+    for (size_t i = 0; i < n; i++) {
+        int task_err = threadpool_wait(tasks[i], &results[i]);
+        tasks[i] = NULL;
+
+        if (task_err != THREADPOOL_OK) {
+            results[i] = err_result;
+            if (err == THREADPOOL_OK) {
+                err = task_err;
+            }
+        }
+    }
+
+    return err;
+}
+
+void threadpool_cancel(ThreadPool *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+
+    os_mutex_lock(&pool->lock);
+    pool->canceled = true;
+    os_mutex_unlock(&pool->lock);
+}
+
+void threadpool_interrupt(void)
+{
+    interrupted = 1;
+}
+
+void threadpool_clear_interrupt(void)
+{
+    interrupted = 0;
+}
+
+bool threadpool_canceled(ThreadPool *pool)
+{
+    if (interrupted) {
+        return true;
+    }
+
+    if (pool == NULL) {
+        return false;
+    }
+
+    os_mutex_lock(&pool->lock);
+    bool canceled = pool->canceled;
+    os_mutex_unlock(&pool->lock);
+
+    return canceled;
+}
+
+int threadpool_worker_id(void)
+{
+    return worker_id;
+}
@@ -0,0 +1,118 @@
+/**
+ * A bounded pool of worker threads that runs submitted tasks in the order they
+ * were submitted. Every task returns a ThreadTask that works like a future, it
+ * shall be passed to threadpool_wait exactly once to get the result and to
+ * release it.
+ *
+ * A thread waiting for a task runs queued tasks itself while it waits. Tasks
+ * may therefore submit and wait for other tasks without deadlocking the pool.
+ *
+ * Passing a NULL pool to any function is allowed. Tasks are then run on the
+ * calling thread as soon as they are submitted.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Upper limit on the amount of worker threads in a pool.
+ */
+#define THREADPOOL_MAX_THREADS 64
+
+enum {
+    THREADPOOL_OK = 0,
+
+    THREADPOOL_ECANCELED, // Task was canceled before it started.
+    THREADPOOL_ENOMEM, // Task could not be allocated.
+};
+
+typedef struct ThreadPool ThreadPool;
+typedef struct ThreadTask ThreadTask;
+
+typedef int (*ThreadTaskFn)(void *arg);
+
+/**
+ * Called right after a task finished, on the thread that ran it. Not called
+ * for canceled tasks.
+ */
+typedef void (*ThreadTaskDoneFn)(void *arg, int result);
+
+/**
+ * Creates a pool with nthreads worker threads. If nthreads is less than 1 then
+ * the amount of processors is used. At most THREADPOOL_MAX_THREADS threads are
+ * created.
+ *
+ * Returns NULL on error.
+ */
+ThreadPool *threadpool_create(int nthreads);
+
+/**
+ * Runs every queued task, or cancels them if the pool was canceled, and then
+ * stops and destroys the pool.
+ *
+ * Passing a NULL pointer will make this function return immediately with no
+ * action.
+ */
+void threadpool_free(ThreadPool *pool);
+
+/**
+ * Returns the amount of worker threads in pool, 1 for a NULL pool.
+ */
+int threadpool_size(const ThreadPool *pool);
+
+/**
+ * Queues fn to be called with arg. done may be NULL.
+ *
+ * Returns the task, or NULL if it could not be allocated. NULL may be passed to
+ * threadpool_wait.
+ */
+ThreadTask *threadpool_submit(ThreadPool *pool, ThreadTaskFn fn, ThreadTaskDoneFn done, void *arg);
+
+/**
+ * Waits for task to finish, stores what the task returned in result, and
+ * releases the task.
+ *
+ * Returns THREADPOOL_OK if the task ran. Otherwise returns THREADPOOL_ECANCELED
+ * or THREADPOOL_ENOMEM and result is left untouched.
+ */
+int threadpool_wait(ThreadTask *task, int *result);
+
+/**
+ * Waits for all n tasks, stores their results in results, and releases them.
+ * Results of tasks that did not run are set to err_result.
+ *
+ * Returns THREADPOOL_OK if every task ran, otherwise the first error.
+ */
+int threadpool_wait_all(ThreadTask **tasks, size_t n, int *results, int err_result);
+
+/**
+ * Cancels every task of pool that has not started yet, as well as every task
+ * that is submitted afterwards. Running tasks may check threadpool_canceled to
+ * stop early.
+ */
+void threadpool_cancel(ThreadPool *pool);
+
+/**
+ * Cancels all pools. Only sets a flag, so it is safe to call from a signal
+ * handler.
+ */
+void threadpool_interrupt(void);
+
+/**
+ * Undoes threadpool_interrupt so that a long running process can go on with
+ * other work once the interrupted work is done.
+ */
+void threadpool_clear_interrupt(void);
+
+/**
+ * Returns true if pool was canceled or threadpool_interrupt was called.
+ */
+bool threadpool_canceled(ThreadPool *pool);
+
+/**
+ * Returns the number of the worker thread that is calling, starting at 1. The
+ * thread that created the pool and any other thread is 0.
+ */
+int threadpool_worker_id(void);
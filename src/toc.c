@@ -0,0 +1,305 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "osapi.h"
+#include "osstring.h"
+#include "toc.h"
+#include "wowpkg.h"
+
+#define TOC_EXT ".toc"
+
+/**
+ * Header lines are short, longer ones are cut off.
+ */
+#define TOC_MAX_LINE 1024
+
+static void toc_field_free(TocField *field)
+{
+    if (field == NULL) {
+        return;
+    }
+
+    free(field->key);
+    free(field->value);
+    free(field);
+}
+
+/**
+ * Removes the whitespace at both ends of s in place and returns where it now
+ * starts.
+ */
+static char *toc_trim(char *s)
+{
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+
+    size_t len = strlen(s);
+    while (len > 0 && isspace((unsigned char)s[len - 1])) {
+        len--;
+    }
+    s[len] = '\0';
+
+    return s;
+}
+
+/**
+ * Returns a copy of s without the escape sequences that color text or show
+ * textures in the game, or NULL if nothing is left or memory could not be
+ * allocated.
+ */
+static char *toc_strip_escapes(const char *s, bool *nomem)
+{
+    char *result = malloc(strlen(s) + 1);
+    if (result == NULL) {
+        *nomem = true;
+        return NULL;
+    }
+
+    size_t len = 0;
+    for (size_t i = 0; s[i] != '\0';) {
+        if (s[i] != '|') {
+            result[len++] = s[i++];
+            continue;
+        }
+
+        char code = s[i + 1];
+        if (code == 'c' || code == 'C') {
+            size_t digits = 0;
+            while (digits < 8 && isxdigit((unsigned char)s[i + 2 + digits])) {
+                digits++;
+            }
+            i += 2 + digits;
+        } else if (code == 'r' || code == 'R') {
+            i += 2;
+        } else if (code == 'T') {
+            const char *end = strstr(&s[i + 2], "|t");
+            i = end != NULL ? (size_t)(end - s) + 2 : strlen(s);
+        } else if (code == '|') {
+            result[len++] = '|';
+            i += 2;
+        } else {
+            result[len++] = s[i++];
+        }
+    }
+    result[len] = '\0';
+
+    char *trimmed = toc_trim(result);
+    if (*trimmed == '\0') {
+        free(result);
+        return NULL;
+    }
+
+    memmove(result, trimmed, strlen(trimmed) + 1);
+
+    return result;
+}
+
+/**
+ * Reads the header of the .toc file at path into toc.
+ */
+static int toc_parse(Toc *toc, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return errno == ENOENT ? TOC_ENOENT : TOC_EIO;
+    }
+
+    int err = TOC_OK;
+    bool nomem = false;
+    char line[TOC_MAX_LINE];
+
+    for (bool first = true; fgets(line, ARRAY_SIZE(line), f) != NULL; first = false) {
+        size_t len = strcspn(line, "\r\n");
+        if (line[len] == '\0' && !feof(f)) {
+            int ch;
+            while ((ch = fgetc(f)) != EOF && ch != '\n') {
+            }
+        }
+        line[len] = '\0';
+
+        char *p = line;
+        if (first && strncmp(p, "\xEF\xBB\xBF", 3) == 0) {
+            p += 3;
+        }
+
+        p = toc_trim(p);
+        if (*p == '\0') {
+            continue;
+        } else if (*p != '#') {
+            // The first file of the addon, the header is over.
+            break;
+        } else if (p[1] != '#') {
+            continue;
+        }
+
+        char *colon = strchr(p + 2, ':');
+        if (colon == NULL) {
+            continue;
+        }
+
+        *colon = '\0';
+        char *key = toc_trim(p + 2);
+        char *value = toc_trim(colon + 1);
+
+        if (strcasecmp(key, "Title") == 0 && toc->title == NULL) {
+            toc->title = toc_strip_escapes(value, &nomem);
+        } else if (strcasecmp(key, "Version") == 0 && toc->version == NULL) {
+            // Left as '@project-version@' by checkouts that were not packaged.
+            if (*value != '\0' && strchr(value, '@') == NULL) {
+                toc->version = strdup(value);
+                nomem = toc->version == NULL;
+            }
+        } else if (strncasecmp(key, "X-", 2) == 0) {
+            TocField *field = calloc(1, sizeof(*field));
+            if (field != NULL) {
+                field->key = strdup(key);
+                field->value = strdup(value);
+            }
+
+            if (field == NULL || field->key == NULL || field->value == NULL || list_insert(toc->fields, field) == NULL) {
+                toc_field_free(field);
+                nomem = true;
+            }
+        }
+
+        if (nomem) {
+            err = TOC_ENOMEM;
+            break;
+        }
+    }
+
+    if (err == TOC_OK && ferror(f)) {
+        err = TOC_EIO;
+    }
+
+    fclose(f);
+
+    return err;
+}
+
+/**
+ * Writes the path of the .toc file of the directory called name in root for a
+ * single flavor of the game to s, the first one by name if there are several.
+ *
+ * Returns TOC_OK on success, TOC_ENOENT if there is none, otherwise one of the
+ * TOC_E values.
+ */
+static int toc_find_flavor(char *s, size_t n, const char *root, const char *name)
+{
+    char dirpath[OS_MAX_PATH];
+    int len = snprintf(dirpath, ARRAY_SIZE(dirpath), "%s%c%s", root, OS_SEPARATOR, name);
+    if (len < 0 || (size_t)len >= ARRAY_SIZE(dirpath)) {
+        return TOC_ENAMETOOLONG;
+    }
+
+    OsDir *dir = os_opendir(dirpath);
+    if (dir == NULL) {
+        return errno == ENOENT || errno == ENOTDIR ? TOC_ENOENT : TOC_EIO;
+    }
+
+    size_t name_len = strlen(name);
+    size_t ext_len = strlen(TOC_EXT);
+    char found[OS_MAX_FILENAME] = "";
+
+    OsDirEnt *entry = NULL;
+    while ((entry = os_readdir(dir)) != NULL) {
+        const char *e = entry->name;
+        size_t e_len = strlen(e);
+        if (e_len <= name_len + 1 + ext_len || strncasecmp(e, name, name_len) != 0 || (e[name_len] != '_' && e[name_len] != '-')
+            || strcasecmp(&e[e_len - ext_len], TOC_EXT) != 0 || e_len >= ARRAY_SIZE(found)) {
+            continue;
+        }
+
+        if (found[0] == '\0' || strcmp(e, found) < 0) {
+            memcpy(found, e, e_len + 1);
+        }
+    }
+
+    os_closedir(dir);
+
+    if (found[0] == '\0') {
+        return TOC_ENOENT;
+    }
+
+    len = snprintf(s, n, "%s%c%s", dirpath, OS_SEPARATOR, found);
+    if (len < 0 || (size_t)len >= n) {
+        return TOC_ENAMETOOLONG;
+    }
+
+    return TOC_OK;
+}
+
+int toc_load(Toc **out, const char *root, const char *name)
+{
+    Toc *toc = calloc(1, sizeof(*toc));
+    if (toc == NULL) {
+        return TOC_ENOMEM;
+    }
+
+    int err = TOC_OK;
+
+    toc->fields = list_create();
+    if (toc->fields == NULL) {
+        err = TOC_ENOMEM;
+        goto error;
+    }
+    list_set_free_fn(toc->fields, (ListFreeFn)toc_field_free);
+
+    char path[OS_MAX_PATH];
+    int n = snprintf(path, ARRAY_SIZE(path), "%s%c%s%c%s" TOC_EXT, root, OS_SEPARATOR, name, OS_SEPARATOR, name);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(path)) {
+        err = TOC_ENAMETOOLONG;
+        goto error;
+    }
+
+    err = toc_parse(toc, path);
+    if (err == TOC_ENOENT) {
+        err = toc_find_flavor(path, ARRAY_SIZE(path), root, name);
+        if (err == TOC_OK) {
+            err = toc_parse(toc, path);
+        }
+    }
+
+    if (err != TOC_OK) {
+        goto error;
+    }
+
+    *out = toc;
+
+    return TOC_OK;
+
+error:
+    toc_free(toc);
+
+    return err;
+}
+
+void toc_free(Toc *toc)
+{
+    if (toc == NULL) {
+        return;
+    }
+
+    free(toc->title);
+    free(toc->version);
+    list_free(toc->fields);
+    free(toc);
+}
+
+const char *toc_field(const Toc *toc, const char *key)
+{
+    ListNode *node = NULL;
+    list_foreach(node, toc->fields)
+    {
+        const TocField *field = node->value;
+        if (strcasecmp(field->key, key) == 0) {
+            return field->value;
+        }
+    }
+
+    return NULL;
+}
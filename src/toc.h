@@ -0,0 +1,60 @@
+#pragma once
+
+#include "list.h"
+
+/**
+ * Reads the metadata of an addon directory from its .toc file, the file that
+ * the game loads the addon by. Only the header is read, the lines at the top
+ * in the form '## Key: Value', which ends at the first line that is not a
+ * comment.
+ *
+ * Keys are compared without case. Localized keys such as 'Title-deDE' are not
+ * read.
+ */
+
+enum {
+    TOC_OK = 0,
+
+    TOC_ENOENT, // The directory has no .toc file.
+    TOC_EIO,
+    TOC_ENAMETOOLONG,
+    TOC_ENOMEM,
+};
+
+/**
+ * A '## X-' line, which addons use for metadata of their own such as their
+ * website.
+ */
+typedef struct TocField {
+    char *key; // Without the '## '.
+    char *value;
+} TocField;
+
+typedef struct Toc {
+    char *title; // Without color codes, NULL if there is none.
+    char *version; // NULL if there is none or the packager did not fill it in.
+    List *fields; // TocField of every '## X-' line.
+} Toc;
+
+/**
+ * Reads the .toc file of the addon directory called name in the addons
+ * directory root. That is the file named after the directory, or if there is
+ * none the first one for a single flavor of the game, such as
+ * 'Name_Mainline.toc' or 'Name-Classic.toc'.
+ *
+ * On success returns TOC_OK and stores the metadata in out. On error returns
+ * one of the TOC_E values.
+ */
+int toc_load(Toc **out, const char *root, const char *name);
+
+/**
+ * Passing a NULL pointer will make this function return immediately with no
+ * action.
+ */
+void toc_free(Toc *toc);
+
+/**
+ * Returns the value of the '## X-' line with the given key, or NULL if there is
+ * none.
+ */
+const char *toc_field(const Toc *toc, const char *key);
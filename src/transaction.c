@@ -0,0 +1,723 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "osapi.h"
+#include "osstring.h"
+#include "transaction.h"
+#include "wowpkg.h"
+
+#define TRANSACTION_JOURNAL_NAME "journal"
+#define TRANSACTION_STAGE_NAME "stage"
+#define TRANSACTION_BACKUP_NAME "backup"
+
+/**
+ * Operations written to the journal, one per line as 'op<TAB>name<TAB>dir'.
+ * BACKUP and INSTALL are written before the rename they describe is made.
+ */
+enum {
+    JOURNAL_BEGIN = 'S', // Swapping of the addon started.
+    JOURNAL_BACKUP = 'B', // Addons dir moved to backup.
+    JOURNAL_INSTALL = 'I', // Staged dir moved to addons dir.
+    JOURNAL_ABORT = 'A', // Every rename of the addon was undone.
+    JOURNAL_PREPARE = 'C', // Committed once the file in dir was renamed.
+};
+
+struct Transaction {
+    char path[OS_MAX_PATH];
+    FILE *journal;
+};
+
+struct TransactionLock {
+    OsFileLock file;
+};
+
+typedef struct JournalEntry {
+    char op;
+    char *name;
+    char *dir;
+} JournalEntry;
+
+static void journal_entry_free(JournalEntry *e)
+{
+    if (e == NULL) {
+        return;
+    }
+
+    free(e->name);
+    free(e->dir);
+    free(e);
+}
+
+static JournalEntry *journal_entry_create(char op, const char *name, const char *dir)
+{
+    JournalEntry *e = calloc(1, sizeof(*e));
+    if (e == NULL) {
+        return NULL;
+    }
+
+    e->op = op;
+    e->name = strdup(name);
+    e->dir = strdup(dir);
+    if (e->name == NULL || e->dir == NULL) {
+        journal_entry_free(e);
+        return NULL;
+    }
+
+    return e;
+}
+
+/**
+ * Creates a path to something in the transaction directory of the addons
+ * directory at path, 'path/.wowpkg_txn/area/name/dir'. Trailing NULL
+ * components are left out.
+ *
+ * This function has similar semantics as snprintf(3).
+ */
+static int sntxn_path(char *s, size_t n, const char *path, const char *area, const char *name, const char *dir)
+{
+    const char *parts[] = { area, name, dir };
+
+    int total = snprintf(s, n, "%s%c%s", path, OS_SEPARATOR, TRANSACTION_DIR_NAME);
+    for (size_t i = 0; i < ARRAY_SIZE(parts) && parts[i] != NULL && total >= 0; i++) {
+        size_t len = (size_t)total;
+        int nwrote = snprintf(len < n ? s + len : NULL, len < n ? n - len : 0, "%c%s", OS_SEPARATOR, parts[i]);
+        total = nwrote < 0 ? -1 : total + nwrote;
+    }
+
+    return total;
+}
+
+#define TXN_PATH(buf, path, area, name, dir)                                                               \
+    do {                                                                                                   \
+        int txn_n_ = sntxn_path(buf, ARRAY_SIZE(buf), path, area, name, dir);                              \
+        if (txn_n_ < 0 || (size_t)txn_n_ >= ARRAY_SIZE(buf)) {                                             \
+            return TRANSACTION_ENAMETOOLONG;                                                               \
+        }                                                                                                  \
+    } while (0)
+
+#define JOIN_PATH(buf, dir, filename)                                                                      \
+    do {                                                                                                   \
+        int join_n_ = snprintf(buf, ARRAY_SIZE(buf), "%s%c%s", dir, OS_SEPARATOR, filename);               \
+        if (join_n_ < 0 || (size_t)join_n_ >= ARRAY_SIZE(buf)) {                                           \
+            return TRANSACTION_ENAMETOOLONG;                                                               \
+        }                                                                                                  \
+    } while (0)
+
+static bool path_exists(const char *path)
+{
+    struct os_stat s;
+    return os_stat(path, &s) == 0;
+}
+
+static int mkdir_exists_ok(const char *path)
+{
+    if (os_mkdir(path, 0755) != 0 && errno != EEXIST) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Moves addons/dir back into the staging area unless that already happened or
+ * the staged dir was never moved.
+ */
+static int undo_install(const char *path, const char *name, const char *dir)
+{
+    char staged[OS_MAX_PATH];
+    char installed[OS_MAX_PATH];
+    TXN_PATH(staged, path, TRANSACTION_STAGE_NAME, name, dir);
+    JOIN_PATH(installed, path, dir);
+
+    if (path_exists(staged) || !path_exists(installed)) {
+        return TRANSACTION_OK;
+    }
+
+    return os_rename(installed, staged) == 0 ? TRANSACTION_OK : TRANSACTION_EMOVE;
+}
+
+/**
+ * Moves a backed up dir back into the addons directory unless that already
+ * happened or it was never backed up.
+ */
+static int undo_backup(const char *path, const char *name, const char *dir)
+{
+    char backup[OS_MAX_PATH];
+    char original[OS_MAX_PATH];
+    TXN_PATH(backup, path, TRANSACTION_BACKUP_NAME, name, dir);
+    JOIN_PATH(original, path, dir);
+
+    if (!path_exists(backup)) {
+        return TRANSACTION_OK;
+    }
+
+    if (path_exists(original)) {
+        // Something new is in the way, it was not put there by the transaction.
+        return TRANSACTION_EMOVE;
+    }
+
+    return os_rename(backup, original) == 0 ? TRANSACTION_OK : TRANSACTION_EMOVE;
+}
+
+static int undo_entry(const char *path, const JournalEntry *e)
+{
+    if (e->op == JOURNAL_INSTALL) {
+        return undo_install(path, e->name, e->dir);
+    } else if (e->op == JOURNAL_BACKUP) {
+        return undo_backup(path, e->name, e->dir);
+    }
+
+    return TRANSACTION_OK;
+}
+
+static int journal_write(Transaction *t, char op, const char *name, const char *dir)
+{
+    fprintf(t->journal, "%c\t%s\t%s\n", op, name, dir);
+
+    // The rename may only happen once its intent is on disk, not just in the
+    // cache of the OS, or a crash could leave a rename that is not journaled.
+    if (ferror(t->journal) || os_fsync(t->journal) != 0) {
+        return TRANSACTION_EJOURNAL;
+    }
+
+    return TRANSACTION_OK;
+}
+
+/**
+ * Appends the names of everything in path to names.
+ */
+static int list_dir_names(const char *path, List *names)
+{
+    OsDir *dir = os_opendir(path);
+    if (dir == NULL) {
+        return TRANSACTION_EMOVE;
+    }
+
+    int err = TRANSACTION_OK;
+
+    OsDirEnt *entry = NULL;
+    while ((entry = os_readdir(dir)) != NULL) {
+        if (strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0) {
+            continue;
+        }
+
+        char *name = strdup(entry->name);
+        if (name == NULL || list_insert(names, name) == NULL) {
+            free(name);
+            err = TRANSACTION_ENOMEM;
+            break;
+        }
+    }
+
+    os_closedir(dir);
+
+    return err;
+}
+
+int transaction_lock(TransactionLock **out, const char *path)
+{
+    *out = NULL;
+
+    char lock_path[OS_MAX_PATH];
+    JOIN_PATH(lock_path, path, TRANSACTION_LOCK_NAME);
+
+    TransactionLock *lock = malloc(sizeof(*lock));
+    if (lock == NULL) {
+        return TRANSACTION_ENOMEM;
+    }
+
+    if (os_lock_file(lock_path, &lock->file) != 0) {
+        int err = errno == EWOULDBLOCK ? TRANSACTION_ELOCKED : TRANSACTION_EJOURNAL;
+        free(lock);
+        return err;
+    }
+
+    *out = lock;
+
+    return TRANSACTION_OK;
+}
+
+void transaction_unlock(TransactionLock *lock)
+{
+    if (lock == NULL) {
+        return;
+    }
+
+    os_unlock_file(lock->file);
+    free(lock);
+}
+
+int transaction_begin(Transaction **out, const char *path)
+{
+    *out = NULL;
+
+    if (transaction_pending(path)) {
+        return TRANSACTION_EPENDING;
+    }
+
+    char dir[OS_MAX_PATH];
+    char stage[OS_MAX_PATH];
+    char backup[OS_MAX_PATH];
+    char journal[OS_MAX_PATH];
+    TXN_PATH(dir, path, NULL, NULL, NULL);
+    TXN_PATH(stage, path, TRANSACTION_STAGE_NAME, NULL, NULL);
+    TXN_PATH(backup, path, TRANSACTION_BACKUP_NAME, NULL, NULL);
+    TXN_PATH(journal, path, TRANSACTION_JOURNAL_NAME, NULL, NULL);
+
+    if (mkdir_exists_ok(dir) != 0 || mkdir_exists_ok(stage) != 0 || mkdir_exists_ok(backup) != 0) {
+        os_remove_all(dir);
+        return TRANSACTION_EMOVE;
+    }
+
+    Transaction *t = calloc(1, sizeof(*t));
+    if (t == NULL) {
+        os_remove_all(dir);
+        return TRANSACTION_ENOMEM;
+    }
+
+    snprintf(t->path, ARRAY_SIZE(t->path), "%s", path);
+
+    t->journal = fopen(journal, "w");
+    if (t->journal == NULL) {
+        free(t);
+        os_remove_all(dir);
+        return TRANSACTION_EJOURNAL;
+    }
+
+    *out = t;
+
+    return TRANSACTION_OK;
+}
+
+void transaction_free(Transaction *t)
+{
+    if (t == NULL) {
+        return;
+    }
+
+    fclose(t->journal);
+    free(t);
+}
+
+static int rename_move(const char *src, const char *dest, void *unused)
+{
+    UNUSED(unused);
+
+    return os_rename(src, dest);
+}
+
+int transaction_stage(Transaction *t, const char *name, const char *package_path)
+{
+    return transaction_stage_with(t, name, package_path, rename_move, NULL);
+}
+
+int transaction_stage_with(Transaction *t, const char *name, const char *package_path, TransactionMoveFn move, void *arg)
+{
+    char stage[OS_MAX_PATH];
+    TXN_PATH(stage, t->path, TRANSACTION_STAGE_NAME, name, NULL);
+
+    if (mkdir_exists_ok(stage) != 0) {
+        return TRANSACTION_EMOVE;
+    }
+
+    List *names = list_create();
+    if (names == NULL) {
+        return TRANSACTION_ENOMEM;
+    }
+
+    int err = list_dir_names(package_path, names);
+
+    ListNode *node = NULL;
+    list_foreach(node, names)
+    {
+        if (err != TRANSACTION_OK) {
+            break;
+        }
+
+        const char *filename = node->value;
+
+        char src[OS_MAX_PATH];
+        char dest[OS_MAX_PATH];
+        int n1 = snprintf(src, ARRAY_SIZE(src), "%s%c%s", package_path, OS_SEPARATOR, filename);
+        int n2 = snprintf(dest, ARRAY_SIZE(dest), "%s%c%s", stage, OS_SEPARATOR, filename);
+        if (n1 < 0 || (size_t)n1 >= ARRAY_SIZE(src) || n2 < 0 || (size_t)n2 >= ARRAY_SIZE(dest)) {
+            err = TRANSACTION_ENAMETOOLONG;
+            break;
+        }
+
+        // Copies if the package is on another file system, which is why this
+        // is done before anything in the addons directory is touched.
+        if (move(src, dest, arg) != 0) {
+            err = TRANSACTION_EMOVE;
+        }
+    }
+
+    list_set_free_fn(names, free);
+    list_free(names);
+
+    return err;
+}
+
+int transaction_stage_clone(Transaction *t, const char *name, const Transaction *from)
+{
+    char src[OS_MAX_PATH];
+    char dest[OS_MAX_PATH];
+    TXN_PATH(src, from->path, TRANSACTION_STAGE_NAME, name, NULL);
+    TXN_PATH(dest, t->path, TRANSACTION_STAGE_NAME, name, NULL);
+
+    return os_clone_tree(src, dest) == 0 ? TRANSACTION_OK : TRANSACTION_EMOVE;
+}
+
+/**
+ * Journals and makes a single rename for transaction_swap. The step is added
+ * to done so that it can be undone.
+ */
+static int swap_step(Transaction *t, List *done, char op, const char *name, const char *dir)
+{
+    char src[OS_MAX_PATH];
+    char dest[OS_MAX_PATH];
+
+    if (op == JOURNAL_BACKUP) {
+        JOIN_PATH(src, t->path, dir);
+        TXN_PATH(dest, t->path, TRANSACTION_BACKUP_NAME, name, dir);
+    } else {
+        TXN_PATH(src, t->path, TRANSACTION_STAGE_NAME, name, dir);
+        JOIN_PATH(dest, t->path, dir);
+    }
+
+    JournalEntry *e = journal_entry_create(op, name, dir);
+    if (e == NULL || list_insert(done, e) == NULL) {
+        journal_entry_free(e);
+        return TRANSACTION_ENOMEM;
+    }
+
+    int err = journal_write(t, op, name, dir);
+    if (err != TRANSACTION_OK) {
+        return err;
+    }
+
+    return os_rename(src, dest) == 0 ? TRANSACTION_OK : TRANSACTION_EMOVE;
+}
+
+int transaction_swap(Transaction *t, const char *name, List *old_dirs, List *new_dirs)
+{
+    char stage[OS_MAX_PATH];
+    char backup[OS_MAX_PATH];
+    TXN_PATH(stage, t->path, TRANSACTION_STAGE_NAME, name, NULL);
+    TXN_PATH(backup, t->path, TRANSACTION_BACKUP_NAME, name, NULL);
+
+    if (mkdir_exists_ok(backup) != 0) {
+        return TRANSACTION_EMOVE;
+    }
+
+    List *staged = list_create();
+    List *done = list_create();
+    if (staged == NULL || done == NULL) {
+        list_free(staged);
+        list_free(done);
+        return TRANSACTION_ENOMEM;
+    }
+
+    list_set_free_fn(staged, free);
+    list_set_free_fn(done, (ListFreeFn)journal_entry_free);
+
+    int err = list_dir_names(stage, staged);
+    if (err == TRANSACTION_OK) {
+        err = journal_write(t, JOURNAL_BEGIN, name, "");
+    }
+
+    // Old directories are moved out of the way first.
+    ListNode *node = NULL;
+    if (old_dirs != NULL) {
+        list_foreach(node, old_dirs)
+        {
+            if (err != TRANSACTION_OK) {
+                break;
+            }
+
+            char installed[OS_MAX_PATH];
+            int n = snprintf(installed, ARRAY_SIZE(installed), "%s%c%s", t->path, OS_SEPARATOR, (const char *)node->value);
+            if (n < 0 || (size_t)n >= ARRAY_SIZE(installed)) {
+                err = TRANSACTION_ENAMETOOLONG;
+            } else if (path_exists(installed)) {
+                err = swap_step(t, done, JOURNAL_BACKUP, name, node->value);
+            }
+        }
+    }
+
+    node = NULL;
+    list_foreach(node, staged)
+    {
+        if (err != TRANSACTION_OK) {
+            break;
+        }
+
+        // A directory that is not part of the old addon may still be in the
+        // way, for example one left behind by another addon.
+        char target[OS_MAX_PATH];
+        int n = snprintf(target, ARRAY_SIZE(target), "%s%c%s", t->path, OS_SEPARATOR, (const char *)node->value);
+        if (n < 0 || (size_t)n >= ARRAY_SIZE(target)) {
+            err = TRANSACTION_ENAMETOOLONG;
+            break;
+        }
+
+        if (path_exists(target)) {
+            err = swap_step(t, done, JOURNAL_BACKUP, name, node->value);
+            if (err != TRANSACTION_OK) {
+                break;
+            }
+        }
+
+        err = swap_step(t, done, JOURNAL_INSTALL, name, node->value);
+    }
+
+    if (err != TRANSACTION_OK) {
+        // Steps were inserted at the front so this undoes them in reverse.
+        bool undone = true;
+        node = NULL;
+        list_foreach(node, done)
+        {
+            if (undo_entry(t->path, node->value) != TRANSACTION_OK) {
+                undone = false;
+            }
+        }
+
+        // If undoing failed a rollback of the whole transaction will try again.
+        if (undone) {
+            journal_write(t, JOURNAL_ABORT, name, "");
+        }
+    } else {
+        node = NULL;
+        list_foreach(node, staged)
+        {
+            char *dir = strdup(node->value);
+            if (dir == NULL || list_insert(new_dirs, dir) == NULL) {
+                free(dir);
+            }
+        }
+    }
+
+    list_free(staged);
+    list_free(done);
+
+    return err;
+}
+
+int transaction_remove(Transaction *t, const char *name, List *old_dirs)
+{
+    // An empty staging area swaps nothing in.
+    char stage[OS_MAX_PATH];
+    TXN_PATH(stage, t->path, TRANSACTION_STAGE_NAME, name, NULL);
+
+    if (mkdir_exists_ok(stage) != 0) {
+        return TRANSACTION_EMOVE;
+    }
+
+    List *new_dirs = list_create();
+    if (new_dirs == NULL) {
+        return TRANSACTION_ENOMEM;
+    }
+    list_set_free_fn(new_dirs, free);
+
+    int err = transaction_swap(t, name, old_dirs, new_dirs);
+    list_free(new_dirs);
+
+    return err;
+}
+
+bool transaction_pending(const char *path)
+{
+    char dir[OS_MAX_PATH];
+    int n = sntxn_path(dir, ARRAY_SIZE(dir), path, NULL, NULL, NULL);
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(dir)) {
+        return false;
+    }
+
+    return path_exists(dir);
+}
+
+int transaction_commit(const char *path)
+{
+    if (!transaction_pending(path)) {
+        return TRANSACTION_OK;
+    }
+
+    char dir[OS_MAX_PATH];
+    TXN_PATH(dir, path, NULL, NULL, NULL);
+
+    return os_remove_all(dir) == 0 ? TRANSACTION_OK : TRANSACTION_EMOVE;
+}
+
+/**
+ * Reads every entry of the journal at journal_path into entries, newest first.
+ * A missing journal has no entries.
+ */
+static int journal_read(const char *journal_path, List *entries)
+{
+    FILE *f = fopen(journal_path, "r");
+    if (f == NULL) {
+        return errno == ENOENT ? TRANSACTION_OK : TRANSACTION_EJOURNAL;
+    }
+
+    int err = TRANSACTION_OK;
+    char line[OS_MAX_PATH * 2];
+
+    while (fgets(line, ARRAY_SIZE(line), f) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        // A line cut short by a crash is skipped, its rename never happened.
+        char *name = strchr(line, '\t');
+        char *dir = name != NULL ? strchr(name + 1, '\t') : NULL;
+        if (line[0] == '\0' || name == NULL || dir == NULL) {
+            continue;
+        }
+
+        *name++ = '\0';
+        *dir++ = '\0';
+
+        JournalEntry *e = journal_entry_create(line[0], name, dir);
+        if (e == NULL || list_insert(entries, e) == NULL) {
+            journal_entry_free(e);
+            err = TRANSACTION_ENOMEM;
+            break;
+        }
+    }
+
+    if (ferror(f)) {
+        err = TRANSACTION_EJOURNAL;
+    }
+
+    fclose(f);
+
+    return err;
+}
+
+static int cmp_aborted_name(const void *name, const void *entry)
+{
+    const JournalEntry *e = entry;
+    return e->op == JOURNAL_ABORT ? strcmp(name, e->name) : 1;
+}
+
+int transaction_rollback(const char *path)
+{
+    if (!transaction_pending(path)) {
+        return TRANSACTION_OK;
+    }
+
+    char dir[OS_MAX_PATH];
+    char journal[OS_MAX_PATH];
+    TXN_PATH(dir, path, NULL, NULL, NULL);
+    TXN_PATH(journal, path, TRANSACTION_JOURNAL_NAME, NULL, NULL);
+
+    List *entries = list_create();
+    if (entries == NULL) {
+        return TRANSACTION_ENOMEM;
+    }
+    list_set_free_fn(entries, (ListFreeFn)journal_entry_free);
+
+    int err = journal_read(journal, entries);
+
+    ListNode *node = NULL;
+    list_foreach(node, entries)
+    {
+        if (err != TRANSACTION_OK) {
+            break;
+        }
+
+        const JournalEntry *e = node->value;
+
+        // Addons that were aborted have already been undone.
+        if (list_search(entries, e->name, cmp_aborted_name) != NULL) {
+            continue;
+        }
+
+        err = undo_entry(path, e);
+    }
+
+    list_free(entries);
+
+    // Everything is kept if anything could not be undone so that another
+    // rollback can finish the job.
+    if (err == TRANSACTION_OK && os_remove_all(dir) != 0) {
+        err = TRANSACTION_EMOVE;
+    }
+
+    return err;
+}
+
+int transaction_prepare(const char *path, const char *commit_path)
+{
+    char journal[OS_MAX_PATH];
+    TXN_PATH(journal, path, TRANSACTION_JOURNAL_NAME, NULL, NULL);
+
+    FILE *f = fopen(journal, "a");
+    if (f == NULL) {
+        return TRANSACTION_EJOURNAL;
+    }
+
+    fprintf(f, "%c\t\t%s\n", JOURNAL_PREPARE, commit_path);
+
+    // The commit file may only be renamed once this is on disk.
+    int err = ferror(f) || os_fsync(f) != 0 ? TRANSACTION_EJOURNAL : TRANSACTION_OK;
+    if (fclose(f) != 0) {
+        err = TRANSACTION_EJOURNAL;
+    }
+
+    return err;
+}
+
+static int cmp_prepare(const void *unused, const void *entry)
+{
+    UNUSED(unused);
+
+    const JournalEntry *e = entry;
+    return e->op == JOURNAL_PREPARE ? 0 : 1;
+}
+
+int transaction_recover(const char *path, bool *committed)
+{
+    *committed = false;
+
+    if (!transaction_pending(path)) {
+        return TRANSACTION_OK;
+    }
+
+    char journal[OS_MAX_PATH];
+    char commit_path[OS_MAX_PATH] = { 0 };
+    TXN_PATH(journal, path, TRANSACTION_JOURNAL_NAME, NULL, NULL);
+
+    List *entries = list_create();
+    if (entries == NULL) {
+        return TRANSACTION_ENOMEM;
+    }
+    list_set_free_fn(entries, (ListFreeFn)journal_entry_free);
+
+    int err = journal_read(journal, entries);
+
+    // The commit file is renamed right after the prepare entry is written, so
+    // the transaction was committed only if that file is gone.
+    ListNode *prepared = err == TRANSACTION_OK ? list_search(entries, NULL, cmp_prepare) : NULL;
+    if (prepared != NULL) {
+        const JournalEntry *e = prepared->value;
+        snprintf(commit_path, ARRAY_SIZE(commit_path), "%s", e->dir);
+        *committed = !path_exists(commit_path);
+    }
+
+    list_free(entries);
+
+    if (err != TRANSACTION_OK) {
+        return err;
+    } else if (*committed) {
+        return transaction_commit(path);
+    }
+
+    // Once rolled back the transaction can no longer be committed, which is
+    // when the commit file is no longer needed.
+    err = transaction_rollback(path);
+    if (err == TRANSACTION_OK && commit_path[0] != '\0') {
+        remove(commit_path);
+    }
+
+    return err;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "list.h"
+
+/**
+ * Replaces the directories of many addons in an addons directory so that each
+ * addon is either fully replaced or left as it was, even if the program stops
+ * part way through.
+ *
+ * New directories are first staged inside the addons directory. Swapping an
+ * addon then only renames directories: the old ones are moved to a backup
+ * directory and the staged ones are moved into place. Every rename is written
+ * to a journal before the next one is made so that transaction_rollback can
+ * undo them.
+ *
+ * Everything is kept in a hidden directory in the addons directory until
+ * transaction_commit or transaction_rollback is called. The app state is
+ * expected to be saved in between, by renaming a file that transaction_prepare
+ * was told about over it. A transaction that is still pending when the program
+ * starts is finished with transaction_recover.
+ */
+
+#define TRANSACTION_DIR_NAME ".wowpkg_txn"
+#define TRANSACTION_LOCK_NAME ".wowpkg_lock"
+
+enum {
+    TRANSACTION_OK = 0,
+
+    TRANSACTION_EPENDING, // Another transaction has not been finished.
+    TRANSACTION_ELOCKED, // Another process holds the lock of the addons directory.
+    TRANSACTION_EJOURNAL, // Journal could not be read or written.
+    TRANSACTION_EMOVE, // A file or directory could not be moved.
+    TRANSACTION_ENAMETOOLONG,
+    TRANSACTION_ENOMEM,
+};
+
+typedef struct Transaction Transaction;
+typedef struct TransactionLock TransactionLock;
+
+/**
+ * Takes the lock of the addons directory at path without waiting. A process
+ * holds it from before it begins or recovers a transaction there until the
+ * transaction is committed or rolled back, so that no other process rolls back
+ * a transaction that is still running. The lock is a hidden file in the addons
+ * directory and is released when the process exits.
+ *
+ * On success returns TRANSACTION_OK and stores the lock in out. Returns
+ * TRANSACTION_ELOCKED if it is held, even by the calling process, otherwise
+ * one of the TRANSACTION_E values.
+ */
+int transaction_lock(TransactionLock **out, const char *path);
+
+/**
+ * Passing a NULL pointer will make this function return immediately with no
+ * action.
+ */
+void transaction_unlock(TransactionLock *lock);
+
+/**
+ * Starts a transaction in the addons directory at path.
+ *
+ * On success returns TRANSACTION_OK and stores the transaction in out. On error
+ * returns one of the TRANSACTION_E values.
+ */
+int transaction_begin(Transaction **out, const char *path);
+
+/**
+ * Closes the journal of t. The transaction stays pending on disk.
+ *
+ * Passing a NULL pointer will make this function return immediately with no
+ * action.
+ */
+void transaction_free(Transaction *t);
+
+/**
+ * Moves everything in package_path into the staging area for the addon called
+ * name. Nothing in the addons directory is changed.
+ *
+ * May be called from multiple threads at the same time for different addons.
+ *
+ * Returns TRANSACTION_OK on success, otherwise one of the TRANSACTION_E values.
+ */
+int transaction_stage(Transaction *t, const char *name, const char *package_path);
+
+/**
+ * Moves a file or directory at src to dest, which does not exist. Returns 0 on
+ * success, otherwise -1.
+ */
+typedef int (*TransactionMoveFn)(const char *src, const char *dest, void *arg);
+
+/**
+ * Same as transaction_stage but each file and directory at the top of
+ * package_path is moved into the staging area with move, which is passed arg.
+ */
+int transaction_stage_with(Transaction *t, const char *name, const char *package_path, TransactionMoveFn move, void *arg);
+
+/**
+ * Stages the addon called name in t with what was staged for it in from, which
+ * is a transaction in another addons directory. Files are cloned or hard linked
+ * when both are on the same file system so the addon is stored only once.
+ *
+ * May be called from multiple threads at the same time for different addons.
+ *
+ * Returns TRANSACTION_OK on success, otherwise one of the TRANSACTION_E values.
+ */
+int transaction_stage_clone(Transaction *t, const char *name, const Transaction *from);
+
+/**
+ * Replaces the directories in old_dirs with the ones staged for name. Staged
+ * directories are added to new_dirs. Any directory in the way of a staged
+ * one is backed up as well.
+ *
+ * If a rename fails then every rename made for name is undone before
+ * returning, new_dirs is left untouched. old_dirs may be NULL.
+ *
+ * Returns TRANSACTION_OK on success, otherwise one of the TRANSACTION_E values.
+ */
+int transaction_swap(Transaction *t, const char *name, List *old_dirs, List *new_dirs);
+
+/**
+ * Backs up the directories in old_dirs of the addon called name without
+ * putting anything in their place, so that they are deleted when t is
+ * committed and restored when it is rolled back. Nothing shall be staged for
+ * name. old_dirs may be NULL.
+ *
+ * Returns TRANSACTION_OK on success, otherwise one of the TRANSACTION_E values.
+ */
+int transaction_remove(Transaction *t, const char *name, List *old_dirs);
+
+/**
+ * Returns true if the addons directory at path has a transaction that was not
+ * committed or rolled back.
+ */
+bool transaction_pending(const char *path);
+
+/**
+ * Commit deletes the backups of a pending transaction in the addons directory
+ * at path. Rollback undoes every swap in reverse order and restores the
+ * backups. Both do nothing if no transaction is pending.
+ *
+ * Rollback can be called again if it was interrupted.
+ *
+ * Return TRANSACTION_OK on success, otherwise one of the TRANSACTION_E values.
+ */
+int transaction_commit(const char *path);
+int transaction_rollback(const char *path);
+
+/**
+ * Marks the pending transaction in the addons directory at path as committed
+ * once the file at commit_path is gone. That file shall already be on disk.
+ * The caller commits by renaming it into place, such as the new app state over
+ * the old one, and then calls transaction_commit.
+ *
+ * Return TRANSACTION_OK on success, otherwise one of the TRANSACTION_E values.
+ */
+int transaction_prepare(const char *path, const char *commit_path);
+
+/**
+ * Finishes a transaction in the addons directory at path that was left pending
+ * by a program that stopped. A prepared transaction whose commit file was
+ * renamed is committed and committed is set to true. Otherwise it is rolled
+ * back and the commit file is removed.
+ *
+ * Return TRANSACTION_OK on success, otherwise one of the TRANSACTION_E values.
+ */
+int transaction_recover(const char *path, bool *committed);
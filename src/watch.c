@@ -0,0 +1,406 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "osapi.h"
+#include "watch.h"
+#include "wowpkg.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+/**
+ * A watched directory, the addons directory itself or one inside of an addon
+ * directory.
+ */
+typedef struct WatchDir {
+    int wd;
+    char *path;
+    char *addon; // Name of the addon directory it is in, NULL for the root.
+} WatchDir;
+
+/**
+ * An addon directory, a directory right inside of the addons directory.
+ */
+typedef struct WatchAddon {
+    char *name;
+    bool clean;
+} WatchAddon;
+
+struct Watch {
+    int fd;
+    char *root;
+
+    WatchDir *dirs; // Sorted by wd.
+    size_t ndirs;
+    size_t dirs_cap;
+
+    WatchAddon *addons; // Sorted by name.
+    size_t naddons;
+    size_t addons_cap;
+
+    // Set once changes may have been missed, nothing is clean after that.
+    bool lost;
+};
+
+/**
+ * Returns the index of the directory with the watch descriptor wd, or where it
+ * would be.
+ */
+static size_t watch_find_dir(const Watch *w, int wd)
+{
+    size_t lo = 0;
+    size_t hi = w->ndirs;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (w->dirs[mid].wd < wd) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static size_t watch_find_addon(const Watch *w, const char *name)
+{
+    size_t lo = 0;
+    size_t hi = w->naddons;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(w->addons[mid].name, name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/**
+ * Returns the addon directory called name, which is added if there is none
+ * yet, or NULL if out of memory.
+ */
+static WatchAddon *watch_addon(Watch *w, const char *name)
+{
+    size_t i = watch_find_addon(w, name);
+    if (i < w->naddons && strcmp(w->addons[i].name, name) == 0) {
+        return &w->addons[i];
+    }
+
+    if (w->naddons == w->addons_cap) {
+        size_t cap = w->addons_cap == 0 ? 64 : w->addons_cap * 2;
+        WatchAddon *addons = realloc(w->addons, cap * sizeof(*addons));
+        if (addons == NULL) {
+            return NULL;
+        }
+        w->addons = addons;
+        w->addons_cap = cap;
+    }
+
+    char *copy = strdup(name);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    memmove(&w->addons[i + 1], &w->addons[i], (w->naddons - i) * sizeof(*w->addons));
+    w->addons[i].name = copy;
+    w->addons[i].clean = false;
+    w->naddons++;
+
+    return &w->addons[i];
+}
+
+/**
+ * Marks the addon directory called name as not clean.
+ */
+static void watch_mark_changed(Watch *w, const char *name)
+{
+    WatchAddon *addon = watch_addon(w, name);
+    if (addon == NULL) {
+        w->lost = true;
+    } else {
+        addon->clean = false;
+    }
+}
+
+/**
+ * Watches the directory at path, which is in the addon directory called addon
+ * or is the root if addon is NULL, and every directory in it.
+ *
+ * Returns WATCH_OK on success, otherwise one of the WATCH_E values.
+ */
+static int watch_add(Watch *w, const char *path, const char *addon)
+{
+    int wd = inotify_add_watch(w->fd, path, WATCH_MASK);
+    if (wd < 0) {
+        // Gone before it could be watched, which was seen as a change.
+        if (errno == ENOENT || errno == ENOTDIR) {
+            return WATCH_OK;
+        }
+        return errno == ENOSPC ? WATCH_ELIMIT : errno == ENOMEM ? WATCH_ENOMEM : WATCH_EIO;
+    }
+
+    char *path_copy = strdup(path);
+    char *addon_copy = addon != NULL ? strdup(addon) : NULL;
+    if (path_copy == NULL || (addon != NULL && addon_copy == NULL)) {
+        free(path_copy);
+        free(addon_copy);
+        return WATCH_ENOMEM;
+    }
+
+    // A directory that is already watched was moved, or was created while its
+    // parent was being read. It keeps its watch under the new name.
+    size_t i = watch_find_dir(w, wd);
+    if (i < w->ndirs && w->dirs[i].wd == wd) {
+        free(w->dirs[i].path);
+        free(w->dirs[i].addon);
+    } else {
+        if (w->ndirs == w->dirs_cap) {
+            size_t cap = w->dirs_cap == 0 ? 256 : w->dirs_cap * 2;
+            WatchDir *dirs = realloc(w->dirs, cap * sizeof(*dirs));
+            if (dirs == NULL) {
+                free(path_copy);
+                free(addon_copy);
+                return WATCH_ENOMEM;
+            }
+            w->dirs = dirs;
+            w->dirs_cap = cap;
+        }
+
+        memmove(&w->dirs[i + 1], &w->dirs[i], (w->ndirs - i) * sizeof(*w->dirs));
+        w->dirs[i].wd = wd;
+        w->ndirs++;
+    }
+
+    w->dirs[i].path = path_copy;
+    w->dirs[i].addon = addon_copy;
+
+    OsDir *dir = os_opendir(path);
+    if (dir == NULL) {
+        return WATCH_OK;
+    }
+
+    int err = WATCH_OK;
+
+    OsDirEnt *entry = NULL;
+    while (err == WATCH_OK && (entry = os_readdir(dir)) != NULL) {
+        if (strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0 || (addon == NULL && entry->name[0] == '.')) {
+            continue;
+        }
+
+        char child[OS_MAX_PATH];
+        int n = snprintf(child, ARRAY_SIZE(child), "%s%c%s", path, OS_SEPARATOR, entry->name);
+        if (n < 0 || (size_t)n >= ARRAY_SIZE(child)) {
+            err = WATCH_EIO;
+            break;
+        }
+
+        struct os_stat s;
+        if (os_stat(child, &s) == 0 && S_ISDIR(s.st_mode)) {
+            err = watch_add(w, child, addon != NULL ? addon : entry->name);
+        }
+
+        if (addon == NULL && err == WATCH_OK && watch_addon(w, entry->name) == NULL) {
+            err = WATCH_ENOMEM;
+        }
+    }
+
+    os_closedir(dir);
+
+    return err;
+}
+
+static void watch_remove_dir(Watch *w, size_t i)
+{
+    free(w->dirs[i].path);
+    free(w->dirs[i].addon);
+    memmove(&w->dirs[i], &w->dirs[i + 1], (w->ndirs - i - 1) * sizeof(*w->dirs));
+    w->ndirs--;
+}
+
+/**
+ * Marks the addon directory that ev happened in as changed, and watches the
+ * directory that it created, if any.
+ */
+static void watch_event(Watch *w, const struct inotify_event *ev)
+{
+    if (ev->mask & IN_Q_OVERFLOW) {
+        w->lost = true;
+        return;
+    }
+
+    size_t i = watch_find_dir(w, ev->wd);
+    if (i == w->ndirs || w->dirs[i].wd != ev->wd) {
+        return;
+    }
+
+    WatchDir *dir = &w->dirs[i];
+
+    if (dir->addon == NULL) {
+        // The addons directory itself went away.
+        if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+            w->lost = true;
+            return;
+        }
+
+        if (ev->len == 0 || ev->name[0] == '.') {
+            return;
+        }
+    }
+
+    const char *addon = dir->addon != NULL ? dir->addon : ev->name;
+    watch_mark_changed(w, addon);
+
+    if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)) && ev->len > 0) {
+        char child[OS_MAX_PATH];
+        int n = snprintf(child, ARRAY_SIZE(child), "%s%c%s", dir->path, OS_SEPARATOR, ev->name);
+
+        // Copied since adding may move the directories around.
+        char addon_name[OS_MAX_FILENAME];
+        snprintf(addon_name, ARRAY_SIZE(addon_name), "%s", addon);
+
+        if (n < 0 || (size_t)n >= ARRAY_SIZE(child) || watch_add(w, child, addon_name) != WATCH_OK) {
+            w->lost = true;
+        }
+    } else if (ev->mask & IN_IGNORED) {
+        watch_remove_dir(w, i);
+    }
+}
+
+int watch_create(Watch **out, const char *path)
+{
+    Watch *w = calloc(1, sizeof(*w));
+    if (w == NULL) {
+        return WATCH_ENOMEM;
+    }
+
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    w->root = strdup(path);
+    if (w->fd < 0 || w->root == NULL) {
+        int err = w->fd < 0 && errno == EMFILE ? WATCH_ELIMIT : w->root == NULL ? WATCH_ENOMEM : WATCH_EIO;
+        watch_free(w);
+        return err;
+    }
+
+    int err = watch_add(w, path, NULL);
+    if (err != WATCH_OK) {
+        watch_free(w);
+        return err;
+    }
+
+    *out = w;
+
+    return WATCH_OK;
+}
+
+void watch_free(Watch *w)
+{
+    if (w == NULL) {
+        return;
+    }
+
+    if (w->fd >= 0) {
+        close(w->fd);
+    }
+
+    for (size_t i = 0; i < w->ndirs; i++) {
+        free(w->dirs[i].path);
+        free(w->dirs[i].addon);
+    }
+    for (size_t i = 0; i < w->naddons; i++) {
+        free(w->addons[i].name);
+    }
+
+    free(w->dirs);
+    free(w->addons);
+    free(w->root);
+    free(w);
+}
+
+void watch_poll(Watch *w)
+{
+    // Aligned for the events that are read into it.
+    union {
+        char buf[64 * 1024];
+        struct inotify_event align;
+    } events;
+
+    for (;;) {
+        ssize_t n = read(w->fd, events.buf, sizeof(events.buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            if (n < 0 && errno != EAGAIN) {
+                w->lost = true;
+            }
+            break;
+        }
+
+        for (ssize_t off = 0; off < n;) {
+            const struct inotify_event *ev = (const struct inotify_event *)(const void *)(events.buf + off);
+            watch_event(w, ev);
+            off += (ssize_t)(sizeof(*ev) + ev->len);
+        }
+    }
+}
+
+bool watch_is_clean(const Watch *w, const char *name)
+{
+    if (w->lost) {
+        return false;
+    }
+
+    size_t i = watch_find_addon(w, name);
+    return i < w->naddons && strcmp(w->addons[i].name, name) == 0 && w->addons[i].clean;
+}
+
+void watch_mark_clean(Watch *w, const char *name)
+{
+    WatchAddon *addon = watch_addon(w, name);
+    if (addon != NULL) {
+        addon->clean = true;
+    }
+}
+
+#else
+
+int watch_create(Watch **out, const char *path)
+{
+    UNUSED(out);
+    UNUSED(path);
+
+    return WATCH_EUNSUPPORTED;
+}
+
+void watch_free(Watch *w)
+{
+    UNUSED(w);
+}
+
+void watch_poll(Watch *w)
+{
+    UNUSED(w);
+}
+
+bool watch_is_clean(const Watch *w, const char *name)
+{
+    UNUSED(w);
+    UNUSED(name);
+
+    return false;
+}
+
+void watch_mark_clean(Watch *w, const char *name)
+{
+    UNUSED(w);
+    UNUSED(name);
+}
+
+#endif
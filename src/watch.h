@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+
+/**
+ * Keeps track of which addon directories in an addons directory changed, so
+ * that checking the installed files only has to look at those.
+ *
+ * A directory is clean once it was marked clean and nothing in it was
+ * created, deleted, moved, written or had its attributes changed since.
+ * Directories whose name starts with a '.', such as the transaction directory
+ * and the content store, are not watched.
+ *
+ * Changes are collected by the kernel until watch_poll reads them, so a watch
+ * costs nothing while nothing asks for it. Only supported on Linux, with
+ * inotify. A file that is hard linked into many addons, see store.h, only
+ * changes the directory of the path it was changed through.
+ */
+
+enum {
+    WATCH_OK = 0,
+
+    WATCH_EUNSUPPORTED,
+    WATCH_ELIMIT, // The system limit on watched directories was reached.
+    WATCH_EIO,
+    WATCH_ENOMEM,
+};
+
+typedef struct Watch Watch;
+
+/**
+ * Starts watching every addon directory in the addons directory at path and
+ * everything in them. Every directory starts out not clean.
+ *
+ * On success returns WATCH_OK and stores the watch in out. On error returns
+ * one of the WATCH_E values.
+ */
+int watch_create(Watch **out, const char *path);
+
+/**
+ * Passing a NULL pointer will make this function return immediately with no
+ * action.
+ */
+void watch_free(Watch *w);
+
+/**
+ * Reads the changes since the last call and marks the directories they were
+ * in as not clean. Directories that were created are watched from now on.
+ */
+void watch_poll(Watch *w);
+
+/**
+ * Returns true if the addon directory called name was marked clean and did not
+ * change before the last watch_poll. Always false once the watch lost track of
+ * changes, for example because too many came in at once.
+ */
+bool watch_is_clean(const Watch *w, const char *name);
+
+/**
+ * Marks the addon directory called name clean, until watch_poll sees it
+ * change.
+ */
+void watch_mark_clean(Watch *w, const char *name);
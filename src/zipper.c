@@ -1,12 +1,36 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 
 #include <minizip/unzip.h>
 
 #include "osapi.h"
 #include "osstring.h"
+#include "threadpool.h"
 #include "wowpkg.h"
 #include "zipper.h"
 
+/**
+ * Least amount of entries extracted by a task. Archives with fewer entries than
+ * two chunks are extracted on the calling thread.
+ */
+#define ZIPPER_CHUNK_MIN 32
+
+/**
+ * A run of consecutive entries of an archive extracted by one task.
+ */
+typedef struct ZipperChunk {
+    const char *src;
+    const char *dest;
+    ZipperFilterFn filter;
+    void *filter_arg;
+    unz64_file_pos start;
+    size_t count;
+    ZipperStats stats;
+} ZipperChunk;
+
+static ThreadPool *pool = NULL;
+
 /**
  * Copies path to the given buffer removing '.', '..', and multiple sequential
  * separators. Also, converts separators to the OS native separator.
@@ -71,7 +95,34 @@ static int snclean_path(char *restrict buf, size_t n, const char *restrict path)
     return (int)result;
 }
 
-static int zipper_unzip_file(unzFile uf, const char *dest)
+/**
+ * Converts the MS-DOS date and time of an entry, which is local time with a
+ * resolution of two seconds, to seconds since the epoch. Returns 0 if it is
+ * not a valid time.
+ */
+static long long zipper_dos_time(unsigned long dos_date)
+{
+    struct tm t;
+    memset(&t, 0, sizeof(t));
+
+    t.tm_sec = (int)(dos_date & 0x1f) * 2;
+    t.tm_min = (int)((dos_date >> 5) & 0x3f);
+    t.tm_hour = (int)((dos_date >> 11) & 0x1f);
+    t.tm_mday = (int)((dos_date >> 16) & 0x1f);
+    t.tm_mon = (int)((dos_date >> 21) & 0x0f) - 1;
+    t.tm_year = (int)((dos_date >> 25) & 0x7f) + 80;
+    t.tm_isdst = -1;
+
+    time_t result = mktime(&t);
+
+    return result == (time_t)-1 ? 0 : (long long)result;
+}
+
+/**
+ * Extracts the current entry of uf unless filter is not NULL and returns false
+ * for it, then moves to the next entry.
+ */
+static int zipper_unzip_file(unzFile uf, const char *dest, ZipperFilterFn filter, void *filter_arg, ZipperStats *stats)
 {
     int err = ZIPPER_OK;
     unz_file_info64 finfo;
@@ -90,6 +141,11 @@ static int zipper_unzip_file(unzFile uf, const char *dest)
         goto cleanup;
     }
 
+    if (filter != NULL && !filter(filename, filter_arg)) {
+        err = ZIPPER_OK;
+        goto cleanup;
+    }
+
     err = unzOpenCurrentFile(uf);
     if (err != UNZ_OK) {
         return ZIPPER_ENOENT;
@@ -130,6 +186,20 @@ static int zipper_unzip_file(unzFile uf, const char *dest)
             err = ZIPPER_EREAD;
             goto cleanup;
         }
+
+        if (fclose(out_file) != 0) {
+            out_file = NULL;
+            err = ZIPPER_EWRITE;
+            goto cleanup;
+        }
+        out_file = NULL;
+
+        // Gives the file the same time as in the archive, so that it can be
+        // told apart from files that were changed after it was extracted.
+        os_set_mtime(new_path, zipper_dos_time(finfo.dosDate));
+
+        stats->files++;
+        stats->bytes += finfo.uncompressed_size;
     }
 
 cleanup:
@@ -150,10 +220,203 @@ cleanup:
     return err;
 }
 
+void zipper_set_threadpool(ThreadPool *p)
+{
+    pool = p;
+}
+
+/**
+ * Extracts up to count entries of uf starting at the current one.
+ */
+static int zipper_unzip_entries(unzFile uf, const char *dest, ZipperFilterFn filter, void *filter_arg, size_t count, ZipperStats *stats)
+{
+    int err = ZIPPER_OK;
+
+    for (size_t i = 0; i < count; i++) {
+        err = zipper_unzip_file(uf, dest, filter, filter_arg, stats);
+        if (err == ZIPPER_EEND_OF_LIST) {
+            err = ZIPPER_OK;
+            break;
+        } else if (err != ZIPPER_OK) {
+            break;
+        }
+    }
+
+    return err;
+}
+
+/**
+ * Task that extracts a chunk. Every chunk opens the archive on its own since
+ * an unzFile keeps the read position.
+ */
+static int zipper_unzip_chunk(void *arg)
+{
+    ZipperChunk *chunk = arg;
+
+    unzFile uf = unzOpen64(chunk->src);
+    if (uf == NULL) {
+        return ZIPPER_ENOENT;
+    }
+
+    int err = ZIPPER_ENOENT;
+    if (unzGoToFilePos64(uf, &chunk->start) == UNZ_OK) {
+        err = zipper_unzip_entries(uf, chunk->dest, chunk->filter, chunk->filter_arg, chunk->count, &chunk->stats);
+    }
+
+    unzClose(uf);
+    return err;
+}
+
+/**
+ * Splits the entries of uf into chunks and extracts them in parallel. uf is
+ * only used to find where each chunk starts.
+ */
+static int zipper_unzip_parallel(unzFile uf, const char *src, const char *dest, ZipperFilterFn filter, void *filter_arg, size_t nentries, ZipperStats *stats)
+{
+    int err = ZIPPER_OK;
+
+    size_t nchunks = nentries / ZIPPER_CHUNK_MIN;
+    if (nchunks > (size_t)threadpool_size(pool)) {
+        nchunks = (size_t)threadpool_size(pool);
+    }
+
+    size_t per_chunk = (nentries + nchunks - 1) / nchunks;
+
+    ZipperChunk *chunks = calloc(nchunks, sizeof(*chunks));
+    ThreadTask **tasks = calloc(nchunks, sizeof(*tasks));
+    int *results = calloc(nchunks, sizeof(*results));
+    if (chunks == NULL || tasks == NULL || results == NULL) {
+        err = zipper_unzip_entries(uf, dest, filter, filter_arg, nentries, stats);
+        goto cleanup;
+    }
+
+    // Walking the central directory is cheap compared to extracting, so the
+    // start of every chunk is found up front.
+    size_t n = 0;
+    for (size_t i = 0; i < nentries && n < nchunks; i++) {
+        if (i % per_chunk == 0) {
+            chunks[n].src = src;
+            chunks[n].dest = dest;
+            chunks[n].filter = filter;
+            chunks[n].filter_arg = filter_arg;
+            chunks[n].count = per_chunk;
+            if (unzGetFilePos64(uf, &chunks[n].start) != UNZ_OK) {
+                err = ZIPPER_ENOENT;
+                goto cleanup;
+            }
+            n++;
+        }
+
+        if (unzGoToNextFile(uf) != UNZ_OK) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        tasks[i] = threadpool_submit(pool, zipper_unzip_chunk, NULL, &chunks[i]);
+    }
+
+    threadpool_wait_all(tasks, n, results, ZIPPER_ENOENT);
+
+    for (size_t i = 0; i < n; i++) {
+        stats->files += chunks[i].stats.files;
+        stats->bytes += chunks[i].stats.bytes;
+
+        if (err == ZIPPER_OK && results[i] != ZIPPER_OK) {
+            err = results[i];
+        }
+    }
+
+cleanup:
+    free(chunks);
+    free(tasks);
+    free(results);
+
+    return err;
+}
+
+int zipper_list(const char *src, ZipperEntryFn fn, void *arg)
+{
+    int err = ZIPPER_OK;
+
+    unzFile uf = unzOpen64(src);
+    if (uf == NULL) {
+        return ZIPPER_ENOENT;
+    }
+
+    unz_global_info64 ufinfo;
+    if (unzGetGlobalInfo64(uf, &ufinfo) != UNZ_OK) {
+        err = ZIPPER_ENOENT;
+        goto cleanup;
+    }
+
+    if (ufinfo.number_entry == 0) {
+        goto cleanup;
+    }
+
+    if (unzGoToFirstFile(uf) != UNZ_OK) {
+        err = ZIPPER_ENOENT;
+        goto cleanup;
+    }
+
+    int next = UNZ_OK;
+    do {
+        unz_file_info64 finfo;
+        char raw_filename[OS_MAX_FILENAME];
+        char filename[OS_MAX_FILENAME];
+
+        if (unzGetCurrentFileInfo64(uf, &finfo, raw_filename, ARRAY_SIZE(raw_filename), NULL, 0, NULL, 0) != UNZ_OK) {
+            err = ZIPPER_ENOENT;
+            break;
+        }
+
+        int filename_len = snclean_path(filename, ARRAY_SIZE(filename), raw_filename);
+        if (filename_len >= (int)ARRAY_SIZE(filename)) {
+            err = ZIPPER_ENAMETOOLONG;
+            break;
+        }
+
+        // Same test as when extracting.
+        if (finfo.compressed_size == 0) {
+            continue;
+        }
+
+        ZipperEntry entry = {
+            .path = filename,
+            .size = (unsigned long long)finfo.uncompressed_size,
+            .crc = (unsigned long)finfo.crc,
+            .mtime = zipper_dos_time(finfo.dosDate),
+        };
+
+        err = fn(&entry, arg);
+    } while (err == ZIPPER_OK && (next = unzGoToNextFile(uf)) == UNZ_OK);
+
+    if (err == ZIPPER_OK && next != UNZ_END_OF_LIST_OF_FILE) {
+        err = ZIPPER_ENOENT;
+    }
+
+cleanup:
+    unzClose(uf);
+    return err;
+}
+
 int zipper_unzip(const char *src, const char *dest)
+{
+    ZipperStats stats;
+    return zipper_unzip_stats(src, dest, &stats);
+}
+
+int zipper_unzip_stats(const char *src, const char *dest, ZipperStats *stats)
+{
+    return zipper_unzip_filter(src, dest, NULL, NULL, stats);
+}
+
+int zipper_unzip_filter(const char *src, const char *dest, ZipperFilterFn filter, void *arg, ZipperStats *stats)
 {
     int err = ZIPPER_OK;
 
+    memset(stats, 0, sizeof(*stats));
+
     struct os_stat s;
     if (os_stat(dest, &s) != 0 || !S_ISDIR(s.st_mode)) {
         return ZIPPER_ENOENT;
@@ -171,14 +434,10 @@ int zipper_unzip(const char *src, const char *dest)
         goto cleanup;
     }
 
-    for (size_t i = 0; i < ufinfo.number_entry; i++) {
-        err = zipper_unzip_file(uf, dest);
-        if (err == ZIPPER_EEND_OF_LIST) {
-            err = ZIPPER_OK;
-            break;
-        } else if (err != ZIPPER_OK) {
-            break;
-        }
+    if (pool != NULL && ufinfo.number_entry >= 2 * ZIPPER_CHUNK_MIN) {
+        err = zipper_unzip_parallel(uf, src, dest, filter, arg, (size_t)ufinfo.number_entry, stats);
+    } else {
+        err = zipper_unzip_entries(uf, dest, filter, arg, (size_t)ufinfo.number_entry, stats);
     }
 
 cleanup:
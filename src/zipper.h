@@ -1,5 +1,10 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "threadpool.h"
+
 enum {
     ZIPPER_OK = 0,
 
@@ -17,3 +22,60 @@ enum {
  * On success returns ZIPPER_OK. On error returns one of the ZIPPER_E values.
  */
 int zipper_unzip(const char *src, const char *dest);
+
+/**
+ * Counts what was written to disk while unzipping. bytes is the uncompressed
+ * size of all files.
+ */
+typedef struct ZipperStats {
+    size_t files;
+    unsigned long long bytes;
+} ZipperStats;
+
+/**
+ * Same as zipper_unzip but also fills stats. stats is filled even if an error
+ * occurred part way through.
+ */
+int zipper_unzip_stats(const char *src, const char *dest, ZipperStats *stats);
+
+/**
+ * Returns true if the entry at path shall be extracted. path is relative to
+ * the root of the archive and uses native separators.
+ */
+typedef bool (*ZipperFilterFn)(const char *path, void *arg);
+
+/**
+ * Same as zipper_unzip_stats but only extracts the entries that filter returns
+ * true for. filter is passed arg and may be called from multiple threads at
+ * the same time.
+ */
+int zipper_unzip_filter(const char *src, const char *dest, ZipperFilterFn filter, void *arg, ZipperStats *stats);
+
+/**
+ * A file in an archive as recorded in its central directory. Directories are
+ * not entries.
+ */
+typedef struct ZipperEntry {
+    const char *path; // Relative to the root of the archive with native separators.
+    unsigned long long size; // Uncompressed size.
+    unsigned long crc; // CRC-32 of the uncompressed contents.
+    long long mtime; // Seconds since the epoch, extracted files are given this time.
+} ZipperEntry;
+
+typedef int (*ZipperEntryFn)(const ZipperEntry *entry, void *arg);
+
+/**
+ * Calls fn for every file in the archive at src without extracting anything,
+ * only the central directory at the end of the archive is read. Stops at the
+ * first call of fn that does not return 0.
+ *
+ * On success returns ZIPPER_OK. Otherwise returns one of the ZIPPER_E values
+ * or what fn returned.
+ */
+int zipper_list(const char *src, ZipperEntryFn fn, void *arg);
+
+/**
+ * Sets the pool that archives with many entries are extracted on. Entries are
+ * extracted on the calling thread if pool is NULL, which is the default.
+ */
+void zipper_set_threadpool(ThreadPool *pool);
@@ -1,10 +1,15 @@
 #include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include <cjson/cJSON.h>
 
 #include "addon.h"
+#include "manifest.h"
+#include "osapi.h"
 #include "osstring.h"
+#include "wowpkg.h"
 
 static void test_addon_dup(void)
 {
@@ -161,10 +166,101 @@ void test_addon_metadata_from_catalog(void)
     assert(addon->version == NULL);
     assert(addon->dirs != NULL);
     assert(list_isempty(addon->dirs));
+    assert(addon->deps == NULL);
+
+    assert(addon_fetch_catalog_meta(addon, "littlewigs") == ADDON_OK);
+    assert(strcmp(addon->name, "LittleWigs") == 0);
+    assert(addon->deps != NULL);
+    assert(strcmp(addon->deps->head->value, "BigWigs") == 0);
+    assert(addon->deps->head->next == NULL);
 
     addon_free(addon);
 }
 
+/**
+ * Returns an addon for the mock archive. The archive is copied since the addon
+ * deletes it when it is freed.
+ */
+static Addon *create_mock_zip_addon(const char *zip_path)
+{
+    FILE *src = fopen(WOWPKG_TEST_DIR "/mocks/mock_zip.zip", "rb");
+    assert(src != NULL);
+    FILE *dest = fopen(zip_path, "wb");
+    assert(dest != NULL);
+
+    char buf[BUFSIZ];
+    size_t n = 0;
+    while ((n = fread(buf, 1, ARRAY_SIZE(buf), src)) > 0) {
+        assert(fwrite(buf, 1, n, dest) == n);
+    }
+
+    fclose(src);
+    fclose(dest);
+
+    Addon *a = addon_create();
+    assert(a != NULL);
+
+    a->name = strdup("MockAddon");
+    a->version = strdup("v1.0.0");
+    a->_zip_path = strdup(zip_path);
+
+    return a;
+}
+
+static void test_addon_package_reuse(void)
+{
+    const char outdir[] = WOWPKG_TEST_TMPDIR "test_addon_package_reuse";
+    os_remove_all(outdir);
+    assert(os_mkdir(outdir, 0755) == 0);
+
+    Addon *installed = create_mock_zip_addon(WOWPKG_TEST_TMPDIR "test_addon_package_reuse/a.zip");
+    assert(addon_package(installed) == ADDON_OK);
+    assert(addon_extract(installed, outdir) == ADDON_OK);
+
+    // The manifest comes from the central directory.
+    size_t n = 0;
+    const ManifestFile **files = manifest_sort(installed->files, &n);
+    assert(n == 3);
+    assert(strcmp(files[0]->path, "mock_dir_a/mock_dir_a.txt") == 0);
+    assert(strcmp(files[2]->path, "mock_dir_c/mock_dir_c_a/mock_dir_c_a.txt") == 0);
+    assert(files[2]->size == 18);
+    free(files);
+
+    // A file that was changed after it was installed is extracted again.
+    FILE *f = fopen(WOWPKG_TEST_TMPDIR "test_addon_package_reuse/mock_dir_b/mock_dir_b.txt", "ab");
+    assert(f != NULL);
+    fclose(f);
+    assert(os_set_mtime(WOWPKG_TEST_TMPDIR "test_addon_package_reuse/mock_dir_b/mock_dir_b.txt", 0) == 0);
+
+    Addon *a = create_mock_zip_addon(WOWPKG_TEST_TMPDIR "test_addon_package_reuse/b.zip");
+    assert(addon_package_reuse(a, installed->files, outdir) == ADDON_OK);
+
+    char path_a[OS_MAX_PATH];
+    char path_b[OS_MAX_PATH];
+    snprintf(path_a, ARRAY_SIZE(path_a), "%s%cmock_dir_a%cmock_dir_a.txt", a->_package_path, OS_SEPARATOR, OS_SEPARATOR);
+    snprintf(path_b, ARRAY_SIZE(path_b), "%s%cmock_dir_b%cmock_dir_b.txt", a->_package_path, OS_SEPARATOR, OS_SEPARATOR);
+
+    OsFileInfo package_a;
+    OsFileInfo package_b;
+    OsFileInfo installed_a;
+    OsFileInfo installed_b;
+    assert(os_file_info(path_a, &package_a) == 0);
+    assert(os_file_info(path_b, &package_b) == 0);
+    assert(os_file_info(WOWPKG_TEST_TMPDIR "test_addon_package_reuse/mock_dir_a/mock_dir_a.txt", &installed_a) == 0);
+    assert(os_file_info(WOWPKG_TEST_TMPDIR "test_addon_package_reuse/mock_dir_b/mock_dir_b.txt", &installed_b) == 0);
+
+    // Linking only works if the temp directory is on the same drive.
+    if (package_b.dev == installed_b.dev) {
+        assert(package_a.ino == installed_a.ino);
+    }
+    assert(package_b.ino != installed_b.ino);
+    assert(package_b.size == 16);
+
+    addon_free(a);
+    addon_free(installed);
+    os_remove_all(outdir);
+}
+
 int main(void)
 {
     test_addon_dup();
@@ -173,6 +269,7 @@ int main(void)
     test_addon_from_json_overwrite();
     test_addon_to_json();
     test_addon_metadata_from_catalog();
+    test_addon_package_reuse();
 
     return 0;
 }
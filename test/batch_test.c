@@ -0,0 +1,103 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "batch.h"
+#include "wowpkg.h"
+
+static Batch *read_batch(const char *text)
+{
+    FILE *f = tmpfile();
+    assert(f != NULL);
+    assert(fwrite(text, 1, strlen(text), f) == strlen(text));
+    fseek(f, 0, SEEK_SET);
+
+    Batch *b = NULL;
+    size_t line = 0;
+    assert(batch_read(&b, f, &line) == BATCH_OK);
+    fclose(f);
+
+    return b;
+}
+
+static void assert_step(const BatchStep *step, size_t line, const char *args)
+{
+    char joined[256] = "";
+    for (int i = 0; i < step->argc; i++) {
+        size_t len = strlen(joined);
+        snprintf(&joined[len], ARRAY_SIZE(joined) - len, "%s%s", i == 0 ? "" : " ", step->argv[i]);
+    }
+
+    assert(strcmp(joined, args) == 0);
+    assert(step->line == line);
+}
+
+static void test_batch_read(void)
+{
+    Batch *b = read_batch("# Set up a new machine\r\n"
+                          "\n"
+                          "install  weakauras\tbigwigs # boss mods\r\n"
+                          "install BigWigs littlewigs\n"
+                          "remove plater\n"
+                          "list\n"
+                          "remove details\n"
+                          "search big wigs");
+
+    assert(b->nsteps == 5);
+    assert_step(&b->steps[0], 3, "install weakauras bigwigs littlewigs");
+    assert_step(&b->steps[1], 5, "remove plater");
+    assert_step(&b->steps[2], 6, "list");
+    assert_step(&b->steps[3], 7, "remove details");
+    assert_step(&b->steps[4], 8, "search big wigs");
+
+    batch_free(b);
+
+    // Only commands that work on addons are merged.
+    b = read_batch("search big\nsearch big\ninfo plater\ninfo plater\n");
+    assert(b->nsteps == 4);
+    assert_step(&b->steps[0], 1, "search big");
+    assert_step(&b->steps[3], 4, "info plater");
+    batch_free(b);
+
+    b = read_batch("");
+    assert(b->nsteps == 0);
+    batch_free(b);
+}
+
+static void test_batch_read_all(void)
+{
+    // Upgrading everything takes in upgrading some.
+    Batch *b = read_batch("upgrade bigwigs\nupgrade\nupgrade plater\nupdate plater\nupdate details\n");
+
+    assert(b->nsteps == 2);
+    assert_step(&b->steps[0], 1, "upgrade");
+    assert_step(&b->steps[1], 4, "update plater details");
+
+    batch_free(b);
+}
+
+static void test_batch_read_option(void)
+{
+    const char *text = "install bigwigs\n  --flavor classic install plater\n";
+
+    FILE *f = tmpfile();
+    assert(f != NULL);
+    assert(fwrite(text, 1, strlen(text), f) == strlen(text));
+    fseek(f, 0, SEEK_SET);
+
+    Batch *b = NULL;
+    size_t line = 0;
+    assert(batch_read(&b, f, &line) == BATCH_EOPTION);
+    assert(line == 2);
+
+    fclose(f);
+}
+
+int main(void)
+{
+    test_batch_read();
+    test_batch_read_all();
+    test_batch_read_option();
+
+    return 0;
+}
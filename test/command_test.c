@@ -6,9 +6,11 @@
 #include "addon.h"
 #include "command.h"
 #include "context.h"
+#include "manifest.h"
 #include "osapi.h"
 #include "osstring.h"
 #include "term.h"
+#include "test_util.h"
 #include "wowpkg.h"
 
 static void test_cmd_list(void)
@@ -87,11 +89,26 @@ static void test_cmd_search(void)
     assert(fread(actual, sizeof(*actual), (size_t)actual_len, stream) == (size_t)actual_len);
     actual[actual_len] = '\0';
 
-    // Should be sorted.
+    // All match by name, BigWigs_Voice also has it in its description.
     assert(strcmp(actual, "BigWigs\nBigWigs_Voice\nLittleWigs\n") == 0);
 
     fclose(stream);
     free(actual);
+
+    // Descriptions are searched too.
+    stream = tmpfile();
+    assert(stream != NULL);
+
+    const char *desc_argv[] = { "search", "text", "to", "speech" };
+    assert(cmd_search(NULL, ARRAY_SIZE(desc_argv), desc_argv, stream) == 0);
+
+    char line[OS_MAX_FILENAME];
+    fseek(stream, 0, SEEK_SET);
+    assert(fgets(line, ARRAY_SIZE(line), stream) != NULL);
+    assert(strcmp(line, "BigWigs_Voice\n") == 0);
+    assert(fgets(line, ARRAY_SIZE(line), stream) == NULL);
+
+    fclose(stream);
 }
 
 static void test_cmd_remove(void)
@@ -102,6 +119,10 @@ static void test_cmd_remove(void)
     ctx.state = appstate_create();
     ctx.config = config_create();
 
+    // Each directory is removed by a task on the pool.
+    ctx.pool = threadpool_create(2);
+    assert(ctx.pool != NULL);
+
     const char outdir[] = WOWPKG_TEST_TMPDIR "test_cmd_remove/";
     const char outdir_test_a[] = WOWPKG_TEST_TMPDIR "test_cmd_remove/test_a";
     const char outdir_test_b[] = WOWPKG_TEST_TMPDIR "test_cmd_remove/test_b";
@@ -167,6 +188,7 @@ static void test_cmd_remove(void)
 
     appstate_free(ctx.state);
     config_free(ctx.config);
+    threadpool_free(ctx.pool);
     os_remove_all(outdir);
 }
 
@@ -229,6 +251,7 @@ static void test_cmd_outdated(void)
 static void test_cmd_info(void)
 {
     Context ctx;
+    memset(&ctx, 0, sizeof(ctx));
     ctx.state = appstate_create();
 
     Addon *addon = addon_create();
@@ -298,6 +321,269 @@ static void test_cmd_info(void)
     free(actual);
 }
 
+static void test_cmd_info_fix_typos(void)
+{
+    Context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.state = appstate_create();
+
+    FILE *stream = tmpfile();
+    assert(stream != NULL);
+
+    // Only suggested.
+    const char *argv[] = { "info", "Platre" };
+    assert(cmd_info(&ctx, ARRAY_SIZE(argv), argv, stream) == 0);
+    assert(ftell(stream) == 0);
+
+    ctx.fix_typos = true;
+    assert(cmd_info(&ctx, ARRAY_SIZE(argv), argv, stream) == 0);
+
+    char line[OS_MAX_PATH];
+    fseek(stream, 0, SEEK_SET);
+    assert(fgets(line, ARRAY_SIZE(line), stream) != NULL);
+    assert(strstr(line, "Plater") != NULL);
+
+    appstate_free(ctx.state);
+    fclose(stream);
+}
+
+static void test_cmd_info_deps(void)
+{
+    Context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.state = appstate_create();
+
+    FILE *stream = tmpfile();
+    assert(stream != NULL);
+
+    const char *argv[] = { "info", "littlewigs" };
+    assert(cmd_info(&ctx, ARRAY_SIZE(argv), argv, stream) == 0);
+
+    char line[OS_MAX_PATH];
+    fseek(stream, 0, SEEK_SET);
+    bool found = false;
+    while (fgets(line, ARRAY_SIZE(line), stream) != NULL) {
+        if (strstr(line, "Depends on:") != NULL) {
+            assert(strstr(line, "BigWigs") != NULL);
+            found = true;
+        }
+    }
+    assert(found);
+
+    appstate_free(ctx.state);
+    fclose(stream);
+}
+
+/**
+ * Reads everything that was written to stream.
+ */
+static char *read_stream(FILE *stream)
+{
+    long len = ftell(stream);
+    assert(len >= 0);
+    fseek(stream, 0, SEEK_SET);
+
+    char *s = malloc((size_t)len + 1);
+    assert(s != NULL);
+    assert(fread(s, 1, (size_t)len, stream) == (size_t)len);
+    s[len] = '\0';
+
+    return s;
+}
+
+static void test_cmd_json(void)
+{
+    Addon *addon = addon_create();
+    addon_set_str(&addon->name, strdup("AddonOne"));
+    addon_set_str(&addon->version, strdup("v1.2.3"));
+    list_insert(addon->dirs, strdup("AddonOne"));
+
+    Addon *latest = addon_dup(addon);
+    addon_set_str(&latest->version, strdup("v1.2.5"));
+
+    Context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.json = true;
+    ctx.flavor = "Retail";
+    ctx.state = appstate_create();
+    list_insert(ctx.state->installed, addon);
+    list_insert(ctx.state->latest, latest);
+
+    // One object per line and nothing else.
+    FILE *stream = tmpfile();
+    const char *list_argv[] = { "list" };
+    assert(cmd_list(&ctx, ARRAY_SIZE(list_argv), list_argv, stream) == 0);
+    char *actual = read_stream(stream);
+    assert(strcmp(actual, "{\"flavor\":\"Retail\",\"name\":\"AddonOne\",\"version\":\"v1.2.3\",\"dirs\":[\"AddonOne\"]}\n") == 0);
+    free(actual);
+    fclose(stream);
+
+    stream = tmpfile();
+    const char *outdated_argv[] = { "outdated" };
+    assert(cmd_outdated(&ctx, ARRAY_SIZE(outdated_argv), outdated_argv, stream) == 0);
+    actual = read_stream(stream);
+    assert(strcmp(actual, "{\"flavor\":\"Retail\",\"name\":\"AddonOne\",\"installed\":\"v1.2.3\",\"latest\":\"v1.2.5\"}\n") == 0);
+    free(actual);
+    fclose(stream);
+
+    stream = tmpfile();
+    const char *info_argv[] = { "info", "littlewigs", "___not_found___" };
+    assert(cmd_info(&ctx, ARRAY_SIZE(info_argv), info_argv, stream) == 0);
+    actual = read_stream(stream);
+
+    char *second = strchr(actual, '\n');
+    assert(second != NULL);
+    *second++ = '\0';
+    assert(strstr(actual, "{\"name\":\"LittleWigs\",") == actual);
+    assert(strstr(actual, "\"deps\":[\"BigWigs\"],\"installed\":false,\"version\":null,\"zip\":null}") != NULL);
+    assert(strcmp(second, "{\"name\":\"___not_found___\",\"error\":\"could not find addon\"}\n") == 0);
+
+    free(actual);
+    fclose(stream);
+    appstate_free(ctx.state);
+}
+
+static void test_cmd_verify(void)
+{
+    Context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+
+    ctx.state = appstate_create();
+    ctx.config = config_create();
+    ctx.manifest_path = WOWPKG_TEST_TMPDIR "test_cmd_verify/manifest.wowpkg";
+
+    const char outdir[] = WOWPKG_TEST_TMPDIR "test_cmd_verify/addons";
+    char outdir_test_a_txt[] = WOWPKG_TEST_TMPDIR "test_cmd_verify/addons/test_a/test_a.txt";
+
+    os_remove_all(WOWPKG_TEST_TMPDIR "test_cmd_verify");
+    ctx.config->addons_path = strdup(outdir);
+    assert(os_mkdir_all(outdir_test_a_txt, 0755) == 0);
+
+    FILE *ftest_a = fopen(outdir_test_a_txt, "wb");
+    assert(ftest_a != NULL);
+    assert(fputs("test_a.txt\n", ftest_a) >= 0);
+    fclose(ftest_a);
+
+    Addon *installed = addon_create();
+    assert(installed != NULL);
+
+    installed->name = strdup("MockAddon");
+    list_insert(installed->dirs, strdup("test_a"));
+    installed->files = list_create();
+    list_set_free_fn(installed->files, (ListFreeFn)manifest_file_free);
+    assert(manifest_scan(installed->files, outdir) == MANIFEST_OK);
+    list_insert(ctx.state->installed, installed);
+
+    const char *argv[] = { "verify", "mockaddon" };
+    assert(cmd_verify(&ctx, ARRAY_SIZE(argv), argv, stdout) == 0);
+
+    ftest_a = fopen(outdir_test_a_txt, "wb");
+    assert(ftest_a != NULL);
+    assert(fputs("test_b.txt\n", ftest_a) >= 0);
+    fclose(ftest_a);
+
+    assert(cmd_verify(&ctx, ARRAY_SIZE(argv), argv, stdout) == -1);
+
+    assert(remove(outdir_test_a_txt) == 0);
+    assert(cmd_verify(&ctx, 1, argv, stdout) == -1);
+
+    appstate_free(ctx.state);
+    config_free(ctx.config);
+    os_remove_all(WOWPKG_TEST_TMPDIR "test_cmd_verify");
+}
+
+#define TEST_ADOPT_ADDONS WOWPKG_TEST_TMPDIR "test_cmd_adopt/addons"
+
+static int cmp_str(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+static int cmp_str_to_addon(const void *str, const void *addon)
+{
+    return strcmp(str, ((const Addon *)addon)->name);
+}
+
+static void test_cmd_adopt(void)
+{
+    Context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+
+    ctx.state = appstate_create();
+    ctx.config = config_create();
+
+    os_remove_all(WOWPKG_TEST_TMPDIR "test_cmd_adopt");
+    ctx.config->addons_path = strdup(TEST_ADOPT_ADDONS);
+
+    // Directories packaged together have the same version.
+    write_file(TEST_ADOPT_ADDONS "/BigWigs/BigWigs.toc", "## Title: BigWigs\n## Version: v1\n");
+    write_file(TEST_ADOPT_ADDONS "/BigWigs/Core.lua", "core");
+    write_file(TEST_ADOPT_ADDONS "/BigWigs_Core/BigWigs_Core.toc", "## Version: v1\n");
+    write_file(TEST_ADOPT_ADDONS "/BigWigs_Voice/BigWigs_Voice.toc", "## Version: v2\n");
+    write_file(TEST_ADOPT_ADDONS "/BigWigs_Other/BigWigs_Other.toc", "## Title: Other\n## Version: v3\n");
+
+    // Named after neither the catalog entry nor the repository.
+    write_file(TEST_ADOPT_ADDONS "/Nameplates/Nameplates.toc", "## X-Website: https://github.com/Tercioo/Plater-Nameplates\n");
+    write_file(TEST_ADOPT_ADDONS "/Unknown/Unknown.lua", "unknown");
+    write_file(TEST_ADOPT_ADDONS "/.wowpkg_txn/OmniCC/OmniCC.toc", "## Version: v4\n");
+
+    FILE *stream = tmpfile();
+    assert(stream != NULL);
+
+    const char *argv[] = { "adopt" };
+    assert(cmd_adopt(&ctx, ARRAY_SIZE(argv), argv, stream) == 0);
+
+    ListNode *node = list_search(ctx.state->installed, "BigWigs", cmp_str_to_addon);
+    assert(node != NULL);
+    Addon *a = node->value;
+    assert(strcmp(a->version, "v1") == 0);
+    assert(list_search(a->dirs, "BigWigs", cmp_str) != NULL);
+    assert(list_search(a->dirs, "BigWigs_Core", cmp_str) != NULL);
+    assert(list_search(a->dirs, "BigWigs_Voice", cmp_str) == NULL);
+
+    // Files are recorded so that they can be verified.
+    size_t nfiles = 0;
+    ListNode *file = NULL;
+    list_foreach(file, a->files)
+    {
+        assert(manifest_check(TEST_ADOPT_ADDONS, file->value) == MANIFEST_OK);
+        nfiles++;
+    }
+    assert(nfiles == 3);
+
+    node = list_search(ctx.state->installed, "BigWigs_Voice", cmp_str_to_addon);
+    assert(node != NULL);
+    assert(strcmp(((Addon *)node->value)->version, "v2") == 0);
+
+    node = list_search(ctx.state->installed, "Plater", cmp_str_to_addon);
+    assert(node != NULL);
+    assert(list_search(((Addon *)node->value)->dirs, "Nameplates", cmp_str) != NULL);
+
+    assert(list_search(ctx.state->installed, "OmniCC", cmp_str_to_addon) == NULL);
+
+    char out[1024];
+    size_t n = 0;
+    rewind(stream);
+    n = fread(out, 1, ARRAY_SIZE(out) - 1, stream);
+    out[n] = '\0';
+    assert(strstr(out, "Not in catalog: BigWigs_Other (Other)\n") != NULL);
+    assert(strstr(out, "Not in catalog: Unknown\n") != NULL);
+    assert(strstr(out, "Adopted 3 addons, 2 directories are not in the catalog\n") != NULL);
+
+    // Adopted directories are installed now.
+    rewind(stream);
+    assert(cmd_adopt(&ctx, ARRAY_SIZE(argv), argv, stream) == 0);
+    rewind(stream);
+    n = fread(out, 1, ARRAY_SIZE(out) - 1, stream);
+    out[n] = '\0';
+    assert(strstr(out, "Adopted 0 addons, 2 directories are not in the catalog\n") != NULL);
+
+    fclose(stream);
+    appstate_free(ctx.state);
+    config_free(ctx.config);
+    os_remove_all(WOWPKG_TEST_TMPDIR "test_cmd_adopt");
+}
+
 int main(void)
 {
     test_cmd_list();
@@ -305,6 +591,11 @@ int main(void)
     test_cmd_remove();
     test_cmd_outdated();
     test_cmd_info();
+    test_cmd_info_fix_typos();
+    test_cmd_info_deps();
+    test_cmd_json();
+    test_cmd_verify();
+    test_cmd_adopt();
 
     return 0;
 }
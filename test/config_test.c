@@ -4,7 +4,119 @@
 #include "config.h"
 #include "osstring.h"
 
+static void test_config_load_github_token(void)
+{
+    Config *cfg = config_create();
+    assert(config_load(cfg, WOWPKG_TEST_DIR "/config_test_inputs/github_token.ini") == 0);
+
+    assert(strcmp(cfg->addons_path, "/path/to/AddOns") == 0);
+    assert(strcmp(cfg->github_token, "test_token") == 0);
+
+    config_free(cfg);
+}
+
+static void test_config_load_no_github_token(void)
+{
+    Config *cfg = config_create();
+    assert(config_load(cfg, WOWPKG_TEST_DIR "/config_test_inputs/no_github_token.ini") == 0);
+
+    assert(strcmp(cfg->addons_path, "/path/to/AddOns") == 0);
+    assert(cfg->github_token == NULL);
+
+    config_free(cfg);
+}
+
+static void test_config_load_flavors(void)
+{
+    Config *cfg = config_create();
+    assert(config_load(cfg, WOWPKG_TEST_DIR "/config_test_inputs/flavors.ini") == 0);
+
+    assert(cfg->nflavors == 3);
+    assert(strcmp(cfg->flavors[0].name, "Retail") == 0);
+    assert(strcmp(cfg->flavors[1].name, "Classic") == 0);
+    assert(strcmp(cfg->flavors[2].name, "PTR") == 0);
+    assert(strcmp(cfg->flavors[1].addons_path, "/path/to/_classic_/AddOns") == 0);
+
+    // The first flavor is selected by default.
+    assert(strcmp(cfg->addons_path, "/path/to/_retail_/AddOns") == 0);
+
+    assert(config_find_flavor(cfg, "ptr") == &cfg->flavors[2]);
+    assert(config_find_flavor(cfg, "github") == NULL);
+
+    assert(config_select_flavor(cfg, "classic") == 0);
+    assert(strcmp(cfg->addons_path, "/path/to/_classic_/AddOns") == 0);
+    assert(config_select_flavor(cfg, "beta") != 0);
+    assert(strcmp(cfg->addons_path, "/path/to/_classic_/AddOns") == 0);
+
+    config_free(cfg);
+
+    // Flavor names end up in file names.
+    cfg = config_create();
+    assert(config_load(cfg, WOWPKG_TEST_DIR "/config_test_inputs/bad_flavor_name.ini") != 0);
+    config_free(cfg);
+}
+
+static void test_config_load_store(void)
+{
+    Config *cfg = config_create();
+    assert(config_load(cfg, WOWPKG_TEST_DIR "/config_test_inputs/store.ini") == 0);
+
+    // [Store] and [Update] are not flavors even though they are not [GitHub].
+    assert(cfg->nflavors == 1);
+    assert(cfg->store_enabled);
+    assert(strcmp(cfg->store_path, "/path/to/store") == 0);
+    assert(cfg->update_prefetch);
+
+    config_free(cfg);
+
+    cfg = config_create();
+    assert(config_load(cfg, WOWPKG_TEST_DIR "/config_test_inputs/flavors.ini") == 0);
+    assert(!cfg->store_enabled);
+    assert(cfg->store_path == NULL);
+    assert(!cfg->update_prefetch);
+    config_free(cfg);
+}
+
+#ifndef _WIN32
+static void test_config_load_env(void)
+{
+    Config *cfg = config_create();
+    assert(config_load(cfg, WOWPKG_TEST_DIR "/config_test_inputs/github_token.ini") == 0);
+
+    // GITHUB_TOKEN does not replace a token from the config file.
+    unsetenv("WOWPKG_GITHUB_TOKEN");
+    setenv("GITHUB_TOKEN", "generic_token", 1);
+    config_load_env(cfg);
+    assert(strcmp(cfg->github_token, "test_token") == 0);
+
+    setenv("WOWPKG_GITHUB_TOKEN", "env_token", 1);
+    config_load_env(cfg);
+    assert(strcmp(cfg->github_token, "env_token") == 0);
+
+    config_free(cfg);
+
+    cfg = config_create();
+    assert(config_load(cfg, WOWPKG_TEST_DIR "/config_test_inputs/no_github_token.ini") == 0);
+
+    unsetenv("WOWPKG_GITHUB_TOKEN");
+    config_load_env(cfg);
+    assert(strcmp(cfg->github_token, "generic_token") == 0);
+
+    unsetenv("GITHUB_TOKEN");
+    config_free(cfg);
+}
+#endif
+
 int main(void)
 {
+    test_config_load_github_token();
+    test_config_load_no_github_token();
+    test_config_load_flavors();
+    test_config_load_store();
+
+#ifndef _WIN32
+    test_config_load_env();
+#endif
+
     return 0;
 }
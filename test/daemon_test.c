@@ -0,0 +1,205 @@
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "daemon.h"
+#include "osapi.h"
+#include "wowpkg.h"
+
+#ifndef _WIN32
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+static char socket_path[64];
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_interrupt(void)
+{
+    interrupted = 1;
+}
+
+/**
+ * Prints each argument on a line of its own and returns their amount, except
+ * for "wait", which waits to be interrupted, and "stop".
+ */
+static int run(int argc, const char *argv[], void *arg)
+{
+    UNUSED(arg);
+
+    interrupted = 0;
+    assert(strcmp(argv[0], WOWPKG_NAME) == 0);
+
+    if (argc == 2 && strcmp(argv[1], "wait") == 0) {
+        while (!interrupted) {
+            os_sleep(0.01);
+        }
+        printf("interrupted\n");
+        return 100;
+    } else if (argc == 2 && strcmp(argv[1], "stop") == 0) {
+        daemon_stop();
+        return 0;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        printf("%s\n", argv[i]);
+    }
+
+    return argc;
+}
+
+static pid_t start_daemon(void)
+{
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        _exit(daemon_serve(socket_path, run, on_interrupt, NULL));
+    }
+
+    // Wait until it listens.
+    int status = 0;
+    int err = DAEMON_ENOENT;
+    for (int i = 0; i < 500 && err == DAEMON_ENOENT; i++) {
+        os_sleep(0.01);
+        err = daemon_call(socket_path, 1, (const char *[]) { "test" }, &status);
+    }
+    assert(err == DAEMON_OK);
+    assert(status == 1);
+
+    return pid;
+}
+
+static void stop_daemon(pid_t pid)
+{
+    int status = -1;
+    assert(daemon_call(socket_path, 2, (const char *[]) { "test", "stop" }, &status) == DAEMON_OK);
+    assert(status == 0);
+
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == DAEMON_OK);
+
+    struct os_stat s;
+    assert(os_stat(socket_path, &s) != 0);
+    assert(daemon_call(socket_path, 1, (const char *[]) { "test" }, &status) == DAEMON_ENOENT);
+}
+
+/**
+ * Runs argv on the daemon and checks that it printed expected to stdout.
+ *
+ * Returns the exit status of the command.
+ */
+static int call_capture(int argc, const char *argv[], const char *expected)
+{
+    FILE *out = tmpfile();
+    assert(out != NULL);
+
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    assert(dup2(fileno(out), STDOUT_FILENO) >= 0);
+
+    int status = -1;
+    int err = daemon_call(socket_path, argc, argv, &status);
+
+    assert(dup2(saved, STDOUT_FILENO) >= 0);
+    close(saved);
+    assert(err == DAEMON_OK);
+
+    char buf[256];
+    rewind(out);
+    size_t n = fread(buf, 1, ARRAY_SIZE(buf) - 1, out);
+    buf[n] = '\0';
+    fclose(out);
+
+    assert(strcmp(buf, expected) == 0);
+
+    return status;
+}
+
+static void on_alarm(int sig)
+{
+    UNUSED(sig);
+    daemon_interrupt();
+}
+
+static void test_daemon_call(void)
+{
+    int status = -1;
+    assert(daemon_call(socket_path, 1, (const char *[]) { "test" }, &status) == DAEMON_ENOENT);
+
+    pid_t pid = start_daemon();
+
+    // Output goes straight to the stdout of the client.
+    assert(call_capture(3, (const char *[]) { "test", "list", "two words" }, "list\ntwo words\n") == 3);
+    assert(call_capture(2, (const char *[]) { "test", "" }, "\n") == 2);
+
+    // Only one daemon at a time.
+    assert(daemon_serve(socket_path, run, on_interrupt, NULL) == DAEMON_ERUNNING);
+
+    signal(SIGALRM, on_alarm);
+    alarm(1);
+    assert(call_capture(2, (const char *[]) { "test", "wait" }, "interrupted\n") == 100);
+    signal(SIGALRM, SIG_DFL);
+
+    stop_daemon(pid);
+}
+
+static void test_daemon_stale_socket(void)
+{
+    // A daemon that was killed leaves its socket behind.
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, ARRAY_SIZE(addr.sun_path), "%s", socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    assert(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    close(fd);
+
+    int status = -1;
+    assert(daemon_call(socket_path, 1, (const char *[]) { "test" }, &status) == DAEMON_ENOENT);
+
+    pid_t pid = start_daemon();
+    assert(call_capture(2, (const char *[]) { "test", "again" }, "again\n") == 2);
+    stop_daemon(pid);
+}
+
+static void test_daemon_path_too_long(void)
+{
+    char path[256];
+    memset(path, 'a', ARRAY_SIZE(path) - 1);
+    path[ARRAY_SIZE(path) - 1] = '\0';
+
+    int status = -1;
+    assert(daemon_call(path, 1, (const char *[]) { "test" }, &status) == DAEMON_ENAMETOOLONG);
+    assert(daemon_serve(path, run, on_interrupt, NULL) == DAEMON_ENAMETOOLONG);
+}
+
+int main(void)
+{
+    // Sockets paths are short, so this is not in the test directory.
+    snprintf(socket_path, ARRAY_SIZE(socket_path), "/tmp/wowpkg_daemon_test_%ld.sock", (long)getpid());
+    unlink(socket_path);
+
+    test_daemon_call();
+    test_daemon_stale_socket();
+    test_daemon_path_too_long();
+
+    return 0;
+}
+
+#else
+
+int main(void)
+{
+    int status = 0;
+    assert(daemon_call("wowpkg.sock", 1, (const char *[]) { "test" }, &status) == DAEMON_EUNSUPPORTED);
+
+    return 0;
+}
+
+#endif
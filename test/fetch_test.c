@@ -0,0 +1,360 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "addon.h"
+#include "net.h"
+#include "osapi.h"
+#include "osstring.h"
+#include "wowpkg.h"
+
+/**
+ * These tests run against test/mock_github.c which CTest starts before and
+ * stops after this test. WOWPKG_MOCK_GITHUB_URL and WOWPKG_MOCK_GITHUB_TOKEN
+ * are set to match how it was started.
+ */
+
+static const char *const names[] = { "BigWigs", "LittleWigs", "Bartender4", "WeakAuras" };
+
+/**
+ * Fetches the metadata of all names against the given API and checks that
+ * every addon resolved to the mock release.
+ */
+static void fetch_ok(Addon **addons, size_t n, const char *api_url)
+{
+    int errs[ARRAY_SIZE(names)];
+
+    addon_set_github_api_url(api_url);
+
+    for (size_t i = 0; i < n; i++) {
+        addons[i] = addon_create();
+        addons[i]->name = strdup(names[i]);
+    }
+
+    assert(addon_fetch_all_meta_many(addons, n, errs) == ADDON_OK);
+
+    for (size_t i = 0; i < n; i++) {
+        assert(errs[i] == ADDON_OK);
+        assert(addons[i]->version != NULL);
+        assert(strstr(addons[i]->url, api_url) == addons[i]->url);
+        assert(strstr(addons[i]->url, ".zip") != NULL);
+    }
+}
+
+static void free_all(Addon **addons, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        addon_free(addons[i]);
+    }
+
+    addon_set_github_api_url(NULL);
+    addon_set_github_token(NULL);
+}
+
+static void test_fetch_meta_rest(void)
+{
+    Addon *addons[ARRAY_SIZE(names)];
+
+    NetStats before, after;
+    net_get_stats(&before);
+
+    fetch_ok(addons, ARRAY_SIZE(addons), WOWPKG_MOCK_GITHUB_URL);
+
+    // Without a token every addon is a REST request.
+    net_get_stats(&after);
+    assert(after.requests - before.requests == ARRAY_SIZE(addons));
+
+    assert(strcmp(addons[0]->version, "v1.0.0") == 0);
+    assert(strstr(addons[0]->url, "/download/") != NULL);
+    assert(strstr(addons[0]->url, "/BigWigs.zip") != NULL);
+
+    free_all(addons, ARRAY_SIZE(addons));
+}
+
+static void test_fetch_meta_graphql(void)
+{
+    Addon *addons[ARRAY_SIZE(names)];
+
+    NetStats before, after;
+    net_get_stats(&before);
+
+    addon_set_github_token(WOWPKG_MOCK_GITHUB_TOKEN);
+    fetch_ok(addons, ARRAY_SIZE(addons), WOWPKG_MOCK_GITHUB_URL);
+
+    // The mock only answers GraphQL when the token was sent, so a single
+    // request means the header reached the server.
+    net_get_stats(&after);
+    assert(after.requests - before.requests == 1);
+
+    free_all(addons, ARRAY_SIZE(addons));
+}
+
+static void test_fetch_meta_bad_token(void)
+{
+    Addon *addons[ARRAY_SIZE(names)];
+    int errs[ARRAY_SIZE(names)];
+
+    addon_set_github_token("not_the_token");
+    addon_set_github_api_url(WOWPKG_MOCK_GITHUB_URL);
+
+    for (size_t i = 0; i < ARRAY_SIZE(addons); i++) {
+        addons[i] = addon_create();
+        addons[i]->name = strdup(names[i]);
+    }
+
+    assert(addon_fetch_all_meta_many(addons, ARRAY_SIZE(addons), errs) == ADDON_OK);
+
+    for (size_t i = 0; i < ARRAY_SIZE(addons); i++) {
+        assert(errs[i] != ADDON_OK);
+    }
+
+    free_all(addons, ARRAY_SIZE(addons));
+}
+
+static void test_fetch_meta_rate_limited(void)
+{
+    Addon *addons[ARRAY_SIZE(names)];
+
+    // Every request is rejected once with Retry-After and then succeeds.
+    fetch_ok(addons, ARRAY_SIZE(addons), WOWPKG_MOCK_GITHUB_URL "/_fault/ratelimit=1");
+    free_all(addons, ARRAY_SIZE(addons));
+}
+
+static void test_fetch_meta_server_error(void)
+{
+    Addon *addons[ARRAY_SIZE(names)];
+
+    fetch_ok(addons, ARRAY_SIZE(addons), WOWPKG_MOCK_GITHUB_URL "/_fault/error=2");
+    free_all(addons, ARRAY_SIZE(addons));
+}
+
+static void test_fetch_meta_latency(void)
+{
+    Addon *addons[ARRAY_SIZE(names)];
+
+    double start = os_monotonic();
+    fetch_ok(addons, ARRAY_SIZE(addons), WOWPKG_MOCK_GITHUB_URL "/_fault/latency=300");
+    double elapsed = os_monotonic() - start;
+
+    // Requests are made concurrently, one after the other would take 1.2s.
+    assert(elapsed < 0.3 * (double)ARRAY_SIZE(addons));
+
+    free_all(addons, ARRAY_SIZE(addons));
+}
+
+/**
+ * Downloads and extracts the first addon, then checks that the generated .toc
+ * file is in the package.
+ */
+static void fetch_zip_ok(const char *api_url)
+{
+    Addon *addons[1];
+    fetch_ok(addons, ARRAY_SIZE(addons), api_url);
+
+    assert(addon_fetch_zip(addons[0]) == ADDON_OK);
+    assert(addons[0]->_zip_path != NULL);
+    assert(addon_package(addons[0]) == ADDON_OK);
+
+    char toc_path[OS_MAX_PATH];
+    snprintf(toc_path, ARRAY_SIZE(toc_path), "%s%cBigWigs%cBigWigs.toc", addons[0]->_package_path, OS_SEPARATOR, OS_SEPARATOR);
+
+    struct os_stat s;
+    assert(os_stat(toc_path, &s) == 0);
+    assert(S_ISREG(s.st_mode));
+
+    free_all(addons, ARRAY_SIZE(addons));
+}
+
+static void test_fetch_zip(void)
+{
+    fetch_zip_ok(WOWPKG_MOCK_GITHUB_URL);
+}
+
+static void test_fetch_zip_redirect(void)
+{
+    fetch_zip_ok(WOWPKG_MOCK_GITHUB_URL "/_fault/redirect,version=v-redirect");
+}
+
+static void test_fetch_zip_resume(void)
+{
+    NetStats before, after;
+    net_get_stats(&before);
+
+    // The first download is cut short after 1000 bytes and is resumed with a
+    // range request instead of being downloaded again.
+    fetch_zip_ok(WOWPKG_MOCK_GITHUB_URL "/_fault/truncate=1000,size=200000,version=v-resume");
+
+    net_get_stats(&after);
+    assert(after.decoded_bytes - before.decoded_bytes < 2 * 200000);
+}
+
+static void test_prefetch_zip(void)
+{
+    Addon *addons[1];
+    fetch_ok(addons, ARRAY_SIZE(addons), WOWPKG_MOCK_GITHUB_URL "/_fault/version=v-prefetch");
+    addon_remove_archive(addons[0]);
+
+    NetStats before, after;
+    net_get_stats(&before);
+    assert(addon_prefetch_zip(addons[0]) == ADDON_OK);
+    assert(addon_prefetch_zip(addons[0]) == ADDON_OK);
+    net_get_stats(&after);
+    assert(after.requests - before.requests == 1);
+
+    // The prefetched archive is used without downloading it again.
+    assert(addon_fetch_zip(addons[0]) == ADDON_OK);
+    assert(addon_package(addons[0]) == ADDON_OK);
+    net_get_stats(&before);
+    assert(before.requests == after.requests);
+
+    addon_remove_archive(addons[0]);
+    free_all(addons, ARRAY_SIZE(addons));
+}
+
+static void test_prefetch_zip_planted(void)
+{
+    const char *path = WOWPKG_TEST_TMPDIR "test_fetch_planted";
+    os_remove_all(path);
+    addon_set_download_path(path);
+
+    Addon *addons[1];
+    fetch_ok(addons, ARRAY_SIZE(addons), WOWPKG_MOCK_GITHUB_URL "/_fault/version=v-planted");
+    assert(addon_prefetch_zip(addons[0]) == ADDON_OK);
+
+    char zippath[OS_MAX_PATH];
+    snprintf(zippath, ARRAY_SIZE(zippath), "%s%c%s_%s.zip", path, OS_SEPARATOR, addons[0]->name, addons[0]->version);
+
+    // A file that is not an archive is downloaded again.
+    FILE *f = fopen(zippath, "wb");
+    assert(f != NULL);
+    fputs("not a zip", f);
+    fclose(f);
+
+    NetStats before, after;
+    net_get_stats(&before);
+    assert(addon_prefetch_zip(addons[0]) == ADDON_OK);
+    net_get_stats(&after);
+    assert(after.requests - before.requests == 1);
+    assert(addon_fetch_zip(addons[0]) == ADDON_OK);
+    assert(addon_package(addons[0]) == ADDON_OK);
+    addon_cleanup_files(addons[0]);
+
+#ifndef _WIN32
+    // Neither is a link, and the file it points to is not written through it.
+    const char *target = WOWPKG_TEST_TMPDIR "test_fetch_planted_target";
+    f = fopen(target, "wb");
+    assert(f != NULL);
+    fputs("target", f);
+    fclose(f);
+
+    remove(zippath);
+    assert(symlink(target, zippath) == 0);
+    char part_path[OS_MAX_PATH + sizeof(".prefetch.part")];
+    snprintf(part_path, ARRAY_SIZE(part_path), "%s.prefetch.part", zippath);
+    assert(symlink(target, part_path) == 0);
+
+    assert(addon_prefetch_zip(addons[0]) != ADDON_OK);
+    struct os_stat s;
+    assert(os_stat(target, &s) == 0 && s.st_size == 6);
+
+    remove(part_path);
+    assert(addon_prefetch_zip(addons[0]) == ADDON_OK);
+    assert(os_lstat(zippath, &s) == 0 && S_ISREG(s.st_mode));
+    assert(os_stat(target, &s) == 0 && s.st_size == 6);
+    remove(target);
+#endif
+
+    free_all(addons, ARRAY_SIZE(addons));
+    addon_set_download_path(NULL);
+    os_remove_all(path);
+}
+
+static void test_fetch_zip_sha256(void)
+{
+    Addon *addons[1];
+    fetch_ok(addons, ARRAY_SIZE(addons), WOWPKG_MOCK_GITHUB_URL "/_fault/truncate=1000,size=200000,version=v-sha256");
+    addon_remove_archive(addons[0]);
+
+    long long size = 0;
+    char sha256[SHA256_HEX_SIZE];
+    assert(addon_archive_sha256(addons[0], &size, sha256) == ADDON_OK);
+    assert(size > 0);
+
+    // A resumed download is hashed from its first byte.
+    addon_remove_archive(addons[0]);
+    assert(addon_fetch_zip_sha256(addons[0], size, sha256) == ADDON_OK);
+    assert(addon_package(addons[0]) == ADDON_OK);
+    addon_keep_archive(addons[0]);
+    addon_cleanup_files(addons[0]);
+
+    // The kept archive is used without downloading it again.
+    NetStats before, after;
+    net_get_stats(&before);
+    assert(addon_fetch_zip_sha256(addons[0], size, sha256) == ADDON_OK);
+    net_get_stats(&after);
+    assert(after.requests == before.requests);
+    addon_keep_archive(addons[0]);
+
+    // One that does not match is downloaded again and then deleted.
+    char other[SHA256_HEX_SIZE];
+    memcpy(other, sha256, sizeof(other));
+    other[0] = other[0] == '0' ? '1' : '0';
+    assert(addon_fetch_zip_sha256(addons[0], size, other) == ADDON_EHASH);
+    assert(addons[0]->_zip_path == NULL);
+    net_get_stats(&before);
+    assert(before.requests > after.requests);
+    assert(addon_archive_sha256(addons[0], &size, other) == ADDON_OK);
+    assert(strcmp(other, sha256) == 0);
+
+    addon_remove_archive(addons[0]);
+    free_all(addons, ARRAY_SIZE(addons));
+}
+
+static void test_fetch_zip_download_path(void)
+{
+    const char *path = WOWPKG_TEST_TMPDIR "test_fetch_downloads";
+    os_remove_all(path);
+    addon_set_download_path(path);
+
+    Addon *addons[1];
+    fetch_ok(addons, ARRAY_SIZE(addons), WOWPKG_MOCK_GITHUB_URL "/_fault/version=v-download-path");
+    assert(addon_fetch_zip(addons[0]) == ADDON_OK);
+    assert(strncmp(addons[0]->_zip_path, path, strlen(path)) == 0);
+    addon_cleanup_files(addons[0]);
+
+#ifndef _WIN32
+    // Archives are not downloaded to or taken from a directory that other
+    // users can write to.
+    assert(chmod(path, 0777) == 0);
+    assert(addon_fetch_zip(addons[0]) == ADDON_EINTERNAL);
+    assert(addon_prefetch_zip(addons[0]) == ADDON_EINTERNAL);
+    assert(chmod(path, 0700) == 0);
+#endif
+
+    free_all(addons, ARRAY_SIZE(addons));
+    addon_set_download_path(NULL);
+    os_remove_all(path);
+}
+
+int main(void)
+{
+    assert(net_init() == NET_OK);
+
+    test_fetch_meta_rest();
+    test_fetch_meta_graphql();
+    test_fetch_meta_bad_token();
+    test_fetch_meta_rate_limited();
+    test_fetch_meta_server_error();
+    test_fetch_meta_latency();
+    test_fetch_zip();
+    test_fetch_zip_redirect();
+    test_fetch_zip_resume();
+    test_prefetch_zip();
+    test_prefetch_zip_planted();
+    test_fetch_zip_sha256();
+    test_fetch_zip_download_path();
+
+    net_cleanup();
+
+    return 0;
+}
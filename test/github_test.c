@@ -0,0 +1,154 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include <cjson/cJSON.h>
+
+#include "github.h"
+#include "osstring.h"
+#include "wowpkg.h"
+
+static void test_github_repo_from_url(void)
+{
+    GitHubRepo repo;
+
+    assert(github_repo_from_url(&repo, "https://api.github.com/repos/WeakAuras/WeakAuras2/releases/latest") == 0);
+    assert(strcmp(repo.owner, "WeakAuras") == 0);
+    assert(strcmp(repo.name, "WeakAuras2") == 0);
+
+    assert(github_repo_from_url(&repo, "http://127.0.0.1:8080/repos/a-b/c_d.e/releases/latest") == 0);
+    assert(strcmp(repo.owner, "a-b") == 0);
+    assert(strcmp(repo.name, "c_d.e") == 0);
+
+    assert(github_repo_from_url(&repo, "https://api.github.com/repos/owner/releases/latest") != 0);
+    assert(github_repo_from_url(&repo, "https://api.github.com/repos//repo/releases/latest") != 0);
+    assert(github_repo_from_url(&repo, "https://api.github.com/repos/own\"er/repo/releases/latest") != 0);
+    assert(github_repo_from_url(&repo, "https://api.github.com/repos/owner/repo/releases") != 0);
+    assert(github_repo_from_url(&repo, "https://example.com/owner/repo") != 0);
+}
+
+static void test_github_repo_from_web_url(void)
+{
+    GitHubRepo repo;
+
+    assert(github_repo_from_web_url(&repo, "https://github.com/BigWigsMods/BigWigs") == 0);
+    assert(strcmp(repo.owner, "BigWigsMods") == 0);
+    assert(strcmp(repo.name, "BigWigs") == 0);
+
+    assert(github_repo_from_web_url(&repo, "https://www.GitHub.com/WeakAuras/WeakAuras2.git") == 0);
+    assert(strcmp(repo.owner, "WeakAuras") == 0);
+    assert(strcmp(repo.name, "WeakAuras2") == 0);
+
+    assert(github_repo_from_web_url(&repo, "github.com/a-b/c_d.e/issues?q=1") == 0);
+    assert(strcmp(repo.owner, "a-b") == 0);
+    assert(strcmp(repo.name, "c_d.e") == 0);
+
+    assert(github_repo_from_web_url(&repo, "https://github.com/owner") != 0);
+    assert(github_repo_from_web_url(&repo, "https://github.com/owner/") != 0);
+    assert(github_repo_from_web_url(&repo, "https://github.com/owner/.git") != 0);
+    assert(github_repo_from_web_url(&repo, "https://github.com/owner/re po") != 0);
+    assert(github_repo_from_web_url(&repo, "https://notgithub.com/owner/repo") != 0);
+    assert(github_repo_from_web_url(&repo, "https://example.com/owner/repo") != 0);
+}
+
+static void test_sngithub_graphql_url(void)
+{
+    char url[256];
+
+    assert(sngithub_graphql_url(url, ARRAY_SIZE(url), "https://api.github.com/repos/a/b/releases/latest") > 0);
+    assert(strcmp(url, "https://api.github.com/graphql") == 0);
+
+    assert(sngithub_graphql_url(url, ARRAY_SIZE(url), "http://127.0.0.1:8080/repos/a/b/releases/latest") > 0);
+    assert(strcmp(url, "http://127.0.0.1:8080/graphql") == 0);
+
+    assert(sngithub_graphql_url(url, ARRAY_SIZE(url), "https://example.com/a/b") < 0);
+}
+
+static void test_sngithub_rebase_url(void)
+{
+    char url[256];
+
+    assert(sngithub_rebase_url(url, ARRAY_SIZE(url), "https://api.github.com/repos/a/b/releases/latest", "http://127.0.0.1:8080") > 0);
+    assert(strcmp(url, "http://127.0.0.1:8080/repos/a/b/releases/latest") == 0);
+
+    assert(sngithub_rebase_url(url, ARRAY_SIZE(url), "https://api.github.com/repos/a/b/releases/latest", "http://127.0.0.1:8080/_fault/latency=10/") > 0);
+    assert(strcmp(url, "http://127.0.0.1:8080/_fault/latency=10/repos/a/b/releases/latest") == 0);
+
+    assert(sngithub_rebase_url(url, ARRAY_SIZE(url), "https://example.com/a/b", "http://127.0.0.1:8080") < 0);
+}
+
+static void test_sngithub_auth_header(void)
+{
+    char header[GITHUB_MAX_AUTH_HEADER];
+
+    assert(sngithub_auth_header(header, ARRAY_SIZE(header), "ghp_abc") > 0);
+    assert(strcmp(header, "Authorization: Bearer ghp_abc") == 0);
+}
+
+static void test_github_graphql_latest_releases_body(void)
+{
+    GitHubRepo repos[2] = {
+        { .owner = "WeakAuras", .name = "WeakAuras2" },
+        { .owner = "BigWigsMods", .name = "BigWigs" },
+    };
+
+    char *body = github_graphql_latest_releases_body(repos, ARRAY_SIZE(repos));
+    assert(body != NULL);
+
+    cJSON *json = cJSON_Parse(body);
+    assert(json != NULL);
+
+    cJSON *query = cJSON_GetObjectItemCaseSensitive(json, "query");
+    assert(cJSON_IsString(query));
+    assert(strstr(query->valuestring, "r0:repository(owner:\"WeakAuras\",name:\"WeakAuras2\")") != NULL);
+    assert(strstr(query->valuestring, "r1:repository(owner:\"BigWigsMods\",name:\"BigWigs\")") != NULL);
+
+    cJSON_Delete(json);
+    free(body);
+
+    assert(github_graphql_latest_releases_body(repos, GITHUB_GRAPHQL_MAX_BATCH + 1) == NULL);
+}
+
+static void test_github_graphql_parse_latest_releases(void)
+{
+    const char *resp = "{\"data\":{"
+                       "\"r0\":{\"latestRelease\":{\"tagName\":\"v1.0.0\",\"releaseAssets\":{\"nodes\":["
+                       "{\"contentType\":\"text/plain\",\"downloadUrl\":\"https://example.com/notes.txt\"},"
+                       "{\"contentType\":\"application/zip\",\"downloadUrl\":\"https://example.com/a.zip\"}"
+                       "]}}},"
+                       "\"r1\":{\"latestRelease\":null},"
+                       "\"r2\":null,"
+                       "\"r3\":{\"latestRelease\":{\"tagName\":\"v2\",\"releaseAssets\":{\"nodes\":[]}}}"
+                       "}}";
+
+    cJSON *metas[5];
+    assert(github_graphql_parse_latest_releases(resp, metas, ARRAY_SIZE(metas)) == 0);
+
+    assert(metas[0] != NULL);
+    assert(strcmp(cJSON_GetObjectItemCaseSensitive(metas[0], "version")->valuestring, "v1.0.0") == 0);
+    assert(strcmp(cJSON_GetObjectItemCaseSensitive(metas[0], "url")->valuestring, "https://example.com/a.zip") == 0);
+
+    // No release, no repository, no .zip asset, and missing from response.
+    assert(metas[1] == NULL);
+    assert(metas[2] == NULL);
+    assert(metas[3] == NULL);
+    assert(metas[4] == NULL);
+
+    cJSON_Delete(metas[0]);
+
+    assert(github_graphql_parse_latest_releases("{\"errors\":[]}", metas, 1) != 0);
+    assert(metas[0] == NULL);
+    assert(github_graphql_parse_latest_releases("not json", metas, 1) != 0);
+}
+
+int main(void)
+{
+    test_github_repo_from_url();
+    test_github_repo_from_web_url();
+    test_sngithub_graphql_url();
+    test_sngithub_rebase_url();
+    test_sngithub_auth_header();
+    test_github_graphql_latest_releases_body();
+    test_github_graphql_parse_latest_releases();
+
+    return 0;
+}
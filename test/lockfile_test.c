@@ -0,0 +1,99 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lockfile.h"
+#include "test_util.h"
+#include "wowpkg.h"
+
+#define TEST_LOCKFILE WOWPKG_TEST_TMPDIR "test_lockfile.lock"
+
+#define HASH_A "9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08"
+#define HASH_B "60303AE22B998861BCE3B28F33EEC1BE758A213C86C93C076DBE9F558C11C752"
+
+static void test_lockfile_save_load(void)
+{
+    Lockfile *lock = lockfile_create();
+    assert(lock != NULL);
+
+    assert(lockfile_add(lock, "LittleWigs", "v2.1", "https://example.com/LittleWigs-v2.1.zip", 2048, HASH_B) == LOCKFILE_OK);
+    assert(lockfile_add(lock, "BigWigs", "v350", "https://example.com/BigWigs-v350.zip", 123456789012LL, HASH_A) == LOCKFILE_OK);
+    assert(lockfile_add(lock, "bigwigs", "v351", "https://example.com/BigWigs-v351.zip", 1, HASH_A) == LOCKFILE_EEXIST);
+    assert(lockfile_add(lock, "Plater", "v1", "https://example.com/Plater.zip", 1, "abc") == LOCKFILE_EPARSE);
+    assert(lock->n == 2);
+
+    assert(lockfile_save(lock, TEST_LOCKFILE) == LOCKFILE_OK);
+    lockfile_free(lock);
+
+    // One addon per line, sorted by name.
+    FILE *f = fopen(TEST_LOCKFILE, "rb");
+    assert(f != NULL);
+    char line[512];
+    assert(fgets(line, sizeof(line), f) != NULL && strcmp(line, "{\n") == 0);
+    assert(fgets(line, sizeof(line), f) != NULL && strcmp(line, "\"addons\": [\n") == 0);
+    assert(fgets(line, sizeof(line), f) != NULL && strstr(line, "\"name\":\"BigWigs\"") != NULL);
+    assert(fgets(line, sizeof(line), f) != NULL && strstr(line, "\"name\":\"LittleWigs\"") != NULL);
+    fclose(f);
+
+    lock = NULL;
+    assert(lockfile_load(&lock, TEST_LOCKFILE) == LOCKFILE_OK);
+    assert(lock->n == 2);
+
+    const LockEntry *e = lockfile_find(lock, "littlewigs");
+    assert(e != NULL);
+    assert(strcmp(e->name, "LittleWigs") == 0);
+    assert(strcmp(e->version, "v2.1") == 0);
+    assert(strcmp(e->url, "https://example.com/LittleWigs-v2.1.zip") == 0);
+    assert(e->size == 2048);
+
+    char lower[] = HASH_B;
+    for (char *c = lower; *c != '\0'; c++) {
+        *c = (char)(*c >= 'A' && *c <= 'Z' ? *c - 'A' + 'a' : *c);
+    }
+    assert(strcmp(e->sha256, lower) == 0);
+
+    e = lockfile_find(lock, "BigWigs");
+    assert(e != NULL && e->size == 123456789012LL);
+    assert(lockfile_find(lock, "Plater") == NULL);
+
+    lockfile_free(lock);
+    remove(TEST_LOCKFILE);
+}
+
+static void test_lockfile_load_errors(void)
+{
+    Lockfile *lock = NULL;
+
+    remove(TEST_LOCKFILE);
+    assert(lockfile_load(&lock, TEST_LOCKFILE) == LOCKFILE_ENOENT);
+
+    write_file(TEST_LOCKFILE, "{\"addons\": {}}");
+    assert(lockfile_load(&lock, TEST_LOCKFILE) == LOCKFILE_EPARSE);
+
+    write_file(TEST_LOCKFILE, "not json");
+    assert(lockfile_load(&lock, TEST_LOCKFILE) == LOCKFILE_EPARSE);
+
+    // Every field is needed.
+    write_file(TEST_LOCKFILE, "{\"addons\": [{\"name\":\"BigWigs\",\"version\":\"v1\",\"url\":\"u\",\"sha256\":\"" HASH_A "\"}]}");
+    assert(lockfile_load(&lock, TEST_LOCKFILE) == LOCKFILE_EPARSE);
+
+    write_file(TEST_LOCKFILE, "{\"addons\": ["
+                              "{\"name\":\"BigWigs\",\"version\":\"v1\",\"url\":\"u\",\"size\":1,\"sha256\":\"" HASH_A "\"},"
+                              "{\"name\":\"BIGWIGS\",\"version\":\"v2\",\"url\":\"u\",\"size\":1,\"sha256\":\"" HASH_A "\"}]}");
+    assert(lockfile_load(&lock, TEST_LOCKFILE) == LOCKFILE_EEXIST);
+
+    write_file(TEST_LOCKFILE, "{\"addons\": []}");
+    assert(lockfile_load(&lock, TEST_LOCKFILE) == LOCKFILE_OK);
+    assert(lock->n == 0);
+    lockfile_free(lock);
+
+    remove(TEST_LOCKFILE);
+}
+
+int main(void)
+{
+    test_lockfile_save_load();
+    test_lockfile_load_errors();
+
+    return 0;
+}
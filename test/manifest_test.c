@@ -0,0 +1,200 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "addon.h"
+#include "appstate.h"
+#include "manifest.h"
+#include "osapi.h"
+#include "test_util.h"
+#include "wowpkg.h"
+
+#define TEST_ROOT WOWPKG_TEST_TMPDIR "test_manifest"
+#define TEST_ADDONS TEST_ROOT "/addons"
+#define TEST_MANIFEST TEST_ROOT "/manifest.wowpkg"
+
+static const ManifestFile *find_file(const List *files, const char *path)
+{
+    ListNode *node = NULL;
+    list_foreach(node, files)
+    {
+        const ManifestFile *f = node->value;
+        if (strcmp(f->path, path) == 0) {
+            return f;
+        }
+    }
+
+    return NULL;
+}
+
+static Addon *create_addon(const char *name)
+{
+    Addon *a = addon_create();
+    assert(a != NULL);
+
+    a->name = strdup(name);
+    a->files = list_create();
+    assert(a->files != NULL);
+    list_set_free_fn(a->files, (ListFreeFn)manifest_file_free);
+
+    return a;
+}
+
+static void test_manifest_scan(void)
+{
+    os_remove_all(TEST_ROOT);
+
+    write_file(TEST_ADDONS "/A/A.toc", "a");
+    write_file(TEST_ADDONS "/A/Libs/LibStub.lua", "libstub");
+
+    Addon *a = create_addon("A");
+    assert(manifest_scan(a->files, TEST_ADDONS) == MANIFEST_OK);
+
+    // Paths always use '/' and the CRC is the one zip archives use.
+    const ManifestFile *toc = find_file(a->files, "A/A.toc");
+    assert(toc != NULL);
+    assert(toc->size == 1);
+    assert(toc->crc == 0xe8b7be43);
+    assert(find_file(a->files, "A/Libs/LibStub.lua") != NULL);
+    assert(find_file(a->files, "A/Libs") == NULL);
+
+    assert(manifest_check(TEST_ADDONS, toc) == MANIFEST_OK);
+
+    // Only the files of one directory, still relative to the root.
+    write_file(TEST_ADDONS "/B/B.toc", "b");
+    List *files = list_create();
+    assert(files != NULL);
+    list_set_free_fn(files, (ListFreeFn)manifest_file_free);
+    assert(manifest_scan_dir(files, TEST_ADDONS, "A/Libs") == MANIFEST_OK);
+    assert(find_file(files, "A/Libs/LibStub.lua") != NULL);
+    assert(find_file(files, "A/A.toc") == NULL);
+    assert(find_file(files, "B/B.toc") == NULL);
+    list_free(files);
+
+    // Same size, other contents.
+    write_file(TEST_ADDONS "/A/A.toc", "b");
+    assert(manifest_check(TEST_ADDONS, toc) == MANIFEST_ECHANGED);
+
+    write_file(TEST_ADDONS "/A/A.toc", "aa");
+    assert(manifest_check(TEST_ADDONS, toc) == MANIFEST_ECHANGED);
+
+    assert(remove(TEST_ADDONS "/A/A.toc") == 0);
+    assert(manifest_check(TEST_ADDONS, toc) == MANIFEST_ENOENT);
+
+    addon_free(a);
+    os_remove_all(TEST_ROOT);
+}
+
+static void test_manifest_save_load(void)
+{
+    os_remove_all(TEST_ROOT);
+
+    char root[] = TEST_ROOT "/";
+    assert(os_mkdir_all(root, 0755) == 0);
+
+    AppState *state = appstate_create();
+    assert(state != NULL);
+
+    Addon *a = create_addon("A");
+    list_insert(a->files, manifest_file_create("A/A.toc", 1, 0xe8b7be43, 1685371440));
+    list_insert(a->files, manifest_file_create("A/Libs/Lib Stub.lua", 7, 0x12345678, -1));
+    list_insert(state->installed, a);
+
+    Addon *b = create_addon("B");
+    list_insert(b->files, manifest_file_create("B/B.toc", 1, 0x71beeff9, 0));
+    list_insert(state->installed, b);
+
+    assert(manifest_save(state, TEST_MANIFEST) == MANIFEST_OK);
+    appstate_free(state);
+
+    // Addons that are not installed are skipped.
+    state = appstate_create();
+    assert(state != NULL);
+
+    a = addon_create();
+    a->name = strdup("a");
+    list_insert(state->installed, a);
+
+    Addon *c = addon_create();
+    c->name = strdup("C");
+    list_insert(state->installed, c);
+
+    assert(manifest_load(state, TEST_MANIFEST) == MANIFEST_OK);
+
+    assert(a->files != NULL);
+    assert(c->files == NULL);
+
+    const ManifestFile *f = find_file(a->files, "A/Libs/Lib Stub.lua");
+    assert(f != NULL);
+    assert(f->size == 7);
+    assert(f->crc == 0x12345678);
+    assert(f->mtime == -1);
+
+    f = find_file(a->files, "A/A.toc");
+    assert(f != NULL);
+    assert(f->mtime == 1685371440);
+
+    // Saving again keeps A, which was loaded, and drops B.
+    assert(manifest_save(state, TEST_MANIFEST) == MANIFEST_OK);
+    appstate_free(state);
+
+    state = appstate_create();
+    assert(state != NULL);
+
+    a = addon_create();
+    a->name = strdup("A");
+    list_insert(state->installed, a);
+
+    b = addon_create();
+    b->name = strdup("B");
+    list_insert(state->installed, b);
+
+    assert(manifest_load(state, TEST_MANIFEST) == MANIFEST_OK);
+    assert(find_file(a->files, "A/A.toc") != NULL);
+    assert(b->files == NULL);
+
+    assert(manifest_load(state, TEST_ROOT "/missing.wowpkg") == MANIFEST_ENOENT);
+
+    appstate_free(state);
+
+    os_remove_all(TEST_ROOT);
+}
+
+static void test_manifest_remove(void)
+{
+    os_remove_all(TEST_ROOT);
+
+    write_file(TEST_ADDONS "/A/A.toc", "a");
+    write_file(TEST_ADDONS "/A/Libs/LibStub/LibStub.lua", "libstub");
+    write_file(TEST_ADDONS "/A_Options/A_Options.toc", "a");
+    write_file(TEST_ADDONS "/B/B.toc", "b");
+
+    Addon *a = create_addon("A");
+    assert(manifest_scan(a->files, TEST_ADDONS) == MANIFEST_OK);
+
+    // Only the files below A are deleted, not the ones of A_Options.
+    assert(manifest_remove(TEST_ADDONS, a->files, "A") == MANIFEST_OK);
+
+    struct os_stat s;
+    assert(os_stat(TEST_ADDONS "/A", &s) != 0);
+    assert(os_stat(TEST_ADDONS "/A_Options/A_Options.toc", &s) == 0);
+    assert(manifest_remove(TEST_ADDONS, a->files, "A") == MANIFEST_ENOENT);
+
+    // Files that are not in the manifest are kept.
+    write_file(TEST_ADDONS "/B/Extra/extra.txt", "extra");
+    assert(manifest_remove(TEST_ADDONS, a->files, "B") == MANIFEST_EIO);
+    assert(os_stat(TEST_ADDONS "/B/B.toc", &s) != 0);
+    assert(os_stat(TEST_ADDONS "/B/Extra/extra.txt", &s) == 0);
+
+    addon_free(a);
+    os_remove_all(TEST_ROOT);
+}
+
+int main(void)
+{
+    test_manifest_scan();
+    test_manifest_save_load();
+    test_manifest_remove();
+
+    return 0;
+}
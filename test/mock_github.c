@@ -0,0 +1,932 @@
+/**
+ * Local stand-in for the parts of the GitHub API that the program uses. Only
+ * used by tests and benchmarks so that the network path can be exercised
+ * without access to api.github.com.
+ *
+ * Usage:
+ *   mock_github [--port PORT] [--token TOKEN] [--rate-limit N] [--daemon]
+ *   mock_github --stop [--port PORT]
+ *
+ * Serves:
+ *   GET  /repos/{owner}/{repo}/releases/latest  Release JSON with one .zip asset.
+ *   POST /graphql                               Batched latest release query.
+ *   GET  /download/{owner}/{repo}.zip           Generated zip, supports Range.
+ *   GET  /redirect/{owner}/{repo}.zip           302 to the download above.
+ *   GET  /__shutdown                            Stops the server.
+ *
+ * Faults are injected by prefixing any path with '/_fault/<spec>', where spec
+ * is a comma separated list of:
+ *   latency=MS      Wait MS milliseconds before responding.
+ *   ratelimit=N     The first N requests of a path get a 403 rate limit.
+ *   error=N         The first N requests of a path get a 500.
+ *   truncate=BYTES  The first download of a path is cut after BYTES bytes.
+ *   redirect        Release assets point to the redirect endpoint.
+ *   size=BYTES      Pads the file in generated zips to BYTES bytes.
+ *   version=TAG     Release tag, defaults to v1.0.0.
+ *
+ * Urls in responses keep the prefix so faults also apply to the downloads.
+ * Because the prefix comes before '/repos/' a whole run can be pointed at a
+ * faulty server by using 'http://127.0.0.1:PORT/_fault/<spec>' as the API url.
+ *
+ * When started with a token, requests that send an Authorization header with
+ * any other token get a 401. GraphQL requests always need the token.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(*(arr)))
+
+// SIGPIPE is ignored instead on systems without it.
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define MOCK_DEFAULT_PORT 18734
+#define MOCK_DEFAULT_RATE_LIMIT 5000L
+#define MOCK_DEFAULT_VERSION "v1.0.0"
+#define MOCK_FAULT_PREFIX "/_fault/"
+
+#define MOCK_MAX_REQUEST (64 * 1024)
+#define MOCK_MAX_NAME 128
+#define MOCK_MAX_PATHS 4096
+
+typedef struct MockFaults {
+    long latency_ms;
+    long ratelimit;
+    long errors;
+    long truncate; // -1 when downloads are not truncated.
+    bool redirect;
+    long size;
+    char version[64];
+} MockFaults;
+
+typedef struct MockRequest {
+    char method[16];
+    char path[1024];
+    char host[256];
+    char authorization[512];
+    char range[128];
+    char if_range[128];
+    char *body;
+    size_t body_len;
+} MockRequest;
+
+typedef struct MockPathCount {
+    char path[1024];
+    long count;
+} MockPathCount;
+
+static const char *server_token = NULL;
+static long rate_limit = MOCK_DEFAULT_RATE_LIMIT;
+static long rate_remaining = MOCK_DEFAULT_RATE_LIMIT;
+static long long rate_reset = 0;
+
+static int listen_fd = -1;
+static volatile sig_atomic_t stopping = 0;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static MockPathCount path_counts[MOCK_MAX_PATHS];
+static size_t npath_counts = 0;
+
+static uint32_t crc_table[256];
+
+static void crc32_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32_of(const unsigned char *data, size_t len)
+{
+    uint32_t c = 0xFFFFFFFFU;
+    for (size_t i = 0; i < len; i++) {
+        c = crc_table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    }
+
+    return c ^ 0xFFFFFFFFU;
+}
+
+static void sleep_ms(long ms)
+{
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+/**
+ * Returns how many times path has been requested, including this request.
+ */
+static long count_request(const char *path)
+{
+    long result = 1;
+
+    pthread_mutex_lock(&lock);
+
+    size_t i = 0;
+    for (; i < npath_counts; i++) {
+        if (strcmp(path_counts[i].path, path) == 0) {
+            result = ++path_counts[i].count;
+            break;
+        }
+    }
+
+    if (i == npath_counts && npath_counts < MOCK_MAX_PATHS) {
+        snprintf(path_counts[i].path, ARRAY_SIZE(path_counts[i].path), "%s", path);
+        path_counts[i].count = 1;
+        npath_counts++;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return result;
+}
+
+static int send_all(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+
+        p += n;
+        len -= (size_t)n;
+    }
+
+    return 0;
+}
+
+/**
+ * Sends a complete response. extra_headers shall be empty or end with "\r\n".
+ * Only body_sent bytes of the body are sent, the connection is closed after.
+ */
+static void send_response(int fd, int status, const char *reason, const char *extra_headers, const void *body, size_t body_len, size_t body_sent)
+{
+    char head[2048];
+    int n = snprintf(head, ARRAY_SIZE(head),
+        "HTTP/1.1 %d %s\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: close\r\n"
+        "%s"
+        "\r\n",
+        status, reason, body_len, extra_headers);
+
+    if (n < 0 || (size_t)n >= ARRAY_SIZE(head)) {
+        return;
+    }
+
+    if (send_all(fd, head, (size_t)n) == 0 && body_sent > 0) {
+        send_all(fd, body, body_sent);
+    }
+}
+
+static void send_text(int fd, int status, const char *reason, const char *extra_headers, const char *body)
+{
+    send_response(fd, status, reason, extra_headers, body, strlen(body), strlen(body));
+}
+
+static void parse_faults(MockFaults *f, const char *spec, size_t len)
+{
+    char buf[512];
+    snprintf(buf, ARRAY_SIZE(buf), "%.*s", (int)len, spec);
+
+    char *save = NULL;
+    for (char *tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(tok, '=');
+        if (value != NULL) {
+            *value++ = '\0';
+        }
+
+        if (strcmp(tok, "redirect") == 0) {
+            f->redirect = true;
+        } else if (value == NULL) {
+            continue;
+        } else if (strcmp(tok, "latency") == 0) {
+            f->latency_ms = strtol(value, NULL, 10);
+        } else if (strcmp(tok, "ratelimit") == 0) {
+            f->ratelimit = strtol(value, NULL, 10);
+        } else if (strcmp(tok, "error") == 0) {
+            f->errors = strtol(value, NULL, 10);
+        } else if (strcmp(tok, "truncate") == 0) {
+            f->truncate = strtol(value, NULL, 10);
+        } else if (strcmp(tok, "size") == 0) {
+            f->size = strtol(value, NULL, 10);
+        } else if (strcmp(tok, "version") == 0) {
+            snprintf(f->version, ARRAY_SIZE(f->version), "%s", value);
+        }
+    }
+}
+
+/**
+ * Copies a '/'-terminated path segment. Returns a pointer past the segment, or
+ * NULL if it is empty or too long.
+ */
+static const char *copy_segment(char *dst, size_t n, const char *src, const char *terminators)
+{
+    size_t len = strcspn(src, terminators);
+    if (len == 0 || len >= n) {
+        return NULL;
+    }
+
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+
+    return &src[len];
+}
+
+/**
+ * Appends little endian integers to a buffer.
+ */
+static unsigned char *put16(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)(v & 0xFF);
+    p[1] = (unsigned char)((v >> 8) & 0xFF);
+    return p + 2;
+}
+
+static unsigned char *put32(unsigned char *p, uint32_t v)
+{
+    p = put16(p, v & 0xFFFF);
+    return put16(p, v >> 16);
+}
+
+/**
+ * Builds a zip without compression that holds the directory '<repo>/' and the
+ * file '<repo>/<repo>.toc'. The file is padded to at least pad bytes.
+ */
+static unsigned char *build_zip(const char *repo, const char *version, long pad, size_t *out_len)
+{
+    char dir_name[MOCK_MAX_NAME + 2];
+    char file_name[2 * MOCK_MAX_NAME + 8];
+    snprintf(dir_name, ARRAY_SIZE(dir_name), "%s/", repo);
+    snprintf(file_name, ARRAY_SIZE(file_name), "%s/%s.toc", repo, repo);
+
+    char header[512];
+    int header_len = snprintf(header, ARRAY_SIZE(header), "## Interface: 100200\n## Title: %s\n## Version: %s\n", repo, version);
+
+    size_t data_len = (size_t)header_len;
+    if (pad > header_len) {
+        data_len = (size_t)pad;
+    }
+
+    const char *names[2] = { dir_name, file_name };
+    size_t sizes[2] = { 0, data_len };
+
+    size_t cap = 22;
+    for (size_t i = 0; i < 2; i++) {
+        cap += 30 + 46 + 2 * strlen(names[i]) + sizes[i];
+    }
+
+    unsigned char *zip = malloc(cap);
+    unsigned char *data = malloc(data_len);
+    if (zip == NULL || data == NULL) {
+        free(zip);
+        free(data);
+        return NULL;
+    }
+
+    memcpy(data, header, (size_t)header_len);
+    for (size_t i = (size_t)header_len; i < data_len; i++) {
+        data[i] = (i % 64 == 63) ? '\n' : (unsigned char)('#' + i % 32);
+    }
+
+    uint32_t crcs[2] = { 0, crc32_of(data, data_len) };
+    uint32_t offsets[2];
+
+    unsigned char *p = zip;
+    for (size_t i = 0; i < 2; i++) {
+        offsets[i] = (uint32_t)(p - zip);
+
+        p = put32(p, 0x04034b50);
+        p = put16(p, 20); // Version needed.
+        p = put16(p, 0); // Flags.
+        p = put16(p, 0); // Stored.
+        p = put16(p, 0); // Time.
+        p = put16(p, 0x21); // Date, 1980-01-01.
+        p = put32(p, crcs[i]);
+        p = put32(p, (uint32_t)sizes[i]);
+        p = put32(p, (uint32_t)sizes[i]);
+        p = put16(p, (uint32_t)strlen(names[i]));
+        p = put16(p, 0);
+        memcpy(p, names[i], strlen(names[i]));
+        p += strlen(names[i]);
+
+        if (sizes[i] > 0) {
+            memcpy(p, data, sizes[i]);
+            p += sizes[i];
+        }
+    }
+
+    uint32_t cd_start = (uint32_t)(p - zip);
+    for (size_t i = 0; i < 2; i++) {
+        p = put32(p, 0x02014b50);
+        p = put16(p, 20); // Version made by.
+        p = put16(p, 20); // Version needed.
+        p = put16(p, 0);
+        p = put16(p, 0);
+        p = put16(p, 0);
+        p = put16(p, 0x21);
+        p = put32(p, crcs[i]);
+        p = put32(p, (uint32_t)sizes[i]);
+        p = put32(p, (uint32_t)sizes[i]);
+        p = put16(p, (uint32_t)strlen(names[i]));
+        p = put16(p, 0); // Extra.
+        p = put16(p, 0); // Comment.
+        p = put16(p, 0); // Disk.
+        p = put16(p, 0); // Internal attributes.
+        p = put32(p, sizes[i] == 0 ? 0x10 : 0); // External attributes, 0x10 is a directory.
+        p = put32(p, offsets[i]);
+        memcpy(p, names[i], strlen(names[i]));
+        p += strlen(names[i]);
+    }
+
+    uint32_t cd_size = (uint32_t)(p - zip) - cd_start;
+    p = put32(p, 0x06054b50);
+    p = put16(p, 0);
+    p = put16(p, 0);
+    p = put16(p, 2);
+    p = put16(p, 2);
+    p = put32(p, cd_size);
+    p = put32(p, cd_start);
+    p = put16(p, 0);
+
+    free(data);
+    *out_len = (size_t)(p - zip);
+
+    return zip;
+}
+
+/**
+ * Builds the headers that every API response has. Returns false if the budget
+ * is used up.
+ */
+static bool ratelimit_headers(char *s, size_t n)
+{
+    pthread_mutex_lock(&lock);
+
+    long long now = (long long)time(NULL);
+    if (rate_reset <= now) {
+        rate_reset = now + 3600;
+        rate_remaining = rate_limit;
+    }
+
+    bool ok = rate_remaining > 0;
+    if (ok) {
+        rate_remaining--;
+    }
+
+    snprintf(s, n, "X-RateLimit-Limit: %ld\r\nX-RateLimit-Remaining: %ld\r\nX-RateLimit-Reset: %lld\r\n", rate_limit, rate_remaining, rate_reset);
+
+    pthread_mutex_unlock(&lock);
+
+    return ok;
+}
+
+static void handle_release(int fd, const MockRequest *req, const char *prefix, const MockFaults *f, const char *rest, const char *extra)
+{
+    char owner[MOCK_MAX_NAME];
+    char repo[MOCK_MAX_NAME];
+
+    const char *p = copy_segment(owner, ARRAY_SIZE(owner), rest, "/");
+    if (p != NULL && *p == '/') {
+        p = copy_segment(repo, ARRAY_SIZE(repo), p + 1, "/");
+    }
+
+    if (p == NULL || strcmp(p, "/releases/latest") != 0) {
+        send_text(fd, 404, "Not Found", extra, "{\"message\":\"Not Found\"}");
+        return;
+    }
+
+    char body[2048];
+    snprintf(body, ARRAY_SIZE(body),
+        "{\"tag_name\":\"%s\",\"name\":\"%s %s\",\"assets\":["
+        "{\"name\":\"%s-%s.zip\",\"content_type\":\"application/zip\","
+        "\"browser_download_url\":\"http://%s%s/%s/%s/%s.zip\"}]}",
+        f->version, repo, f->version,
+        repo, f->version,
+        req->host, prefix, f->redirect ? "redirect" : "download", owner, repo);
+
+    send_text(fd, 200, "OK", extra, body);
+}
+
+/**
+ * Reads a GraphQL string value that follows key in the query, for example the
+ * 'x' in 'owner:\"x\"'. Quotes are escaped since the query is inside JSON.
+ */
+static const char *graphql_value(char *dst, size_t n, const char *src, const char *key)
+{
+    const char *p = strstr(src, key);
+    if (p == NULL) {
+        return NULL;
+    }
+
+    p += strlen(key);
+    while (*p == '\\' || *p == '"') {
+        p++;
+    }
+
+    return copy_segment(dst, n, p, "\\\"");
+}
+
+static void handle_graphql(int fd, const MockRequest *req, const char *prefix, const MockFaults *f, const char *extra)
+{
+    if (req->body == NULL) {
+        send_text(fd, 400, "Bad Request", extra, "{\"message\":\"Problems parsing JSON\"}");
+        return;
+    }
+
+    size_t cap = 64;
+    char *out = malloc(cap);
+    if (out == NULL) {
+        return;
+    }
+
+    size_t len = (size_t)snprintf(out, cap, "{\"data\":{");
+    bool first = true;
+
+    const char *p = req->body;
+    while ((p = strstr(p, ":repository(")) != NULL) {
+        // The alias is the word before ':'.
+        const char *alias_end = p;
+        const char *alias = p;
+        while (alias > req->body && (alias[-1] == '_' || (alias[-1] >= '0' && alias[-1] <= '9') || (alias[-1] >= 'a' && alias[-1] <= 'z') || (alias[-1] >= 'A' && alias[-1] <= 'Z'))) {
+            alias--;
+        }
+
+        char owner[MOCK_MAX_NAME];
+        char repo[MOCK_MAX_NAME];
+        const char *next = graphql_value(owner, ARRAY_SIZE(owner), p, "owner:");
+        next = next == NULL ? NULL : graphql_value(repo, ARRAY_SIZE(repo), next, "name:");
+        if (next == NULL) {
+            break;
+        }
+        p = next;
+
+        char item[2048];
+        int n = snprintf(item, ARRAY_SIZE(item),
+            "%s\"%.*s\":{\"latestRelease\":{\"tagName\":\"%s\",\"releaseAssets\":{\"nodes\":["
+            "{\"contentType\":\"application/zip\",\"downloadUrl\":\"http://%s%s/%s/%s/%s.zip\"}]}}}",
+            first ? "" : ",", (int)(alias_end - alias), alias, f->version,
+            req->host, prefix, f->redirect ? "redirect" : "download", owner, repo);
+        first = false;
+
+        if (n < 0) {
+            break;
+        }
+
+        if (len + (size_t)n + 8 > cap) {
+            cap = (len + (size_t)n + 8) * 2;
+            char *tmp = realloc(out, cap);
+            if (tmp == NULL) {
+                free(out);
+                return;
+            }
+            out = tmp;
+        }
+
+        memcpy(&out[len], item, (size_t)n);
+        len += (size_t)n;
+    }
+
+    snprintf(&out[len], cap - len, "}}");
+
+    send_text(fd, 200, "OK", extra, out);
+    free(out);
+}
+
+static void handle_download(int fd, const MockRequest *req, const char *prefix, const MockFaults *f, const char *rest, bool redirect, long count)
+{
+    char owner[MOCK_MAX_NAME];
+    char repo[MOCK_MAX_NAME];
+
+    const char *p = copy_segment(owner, ARRAY_SIZE(owner), rest, "/");
+    if (p != NULL && *p == '/') {
+        p = copy_segment(repo, ARRAY_SIZE(repo), p + 1, ".");
+    }
+
+    if (p == NULL || strcmp(p, ".zip") != 0) {
+        send_text(fd, 404, "Not Found", "", "Not Found");
+        return;
+    }
+
+    if (redirect) {
+        char location[1024];
+        snprintf(location, ARRAY_SIZE(location), "Location: http://%s%s/download/%s/%s.zip\r\n", req->host, prefix, owner, repo);
+        send_text(fd, 302, "Found", location, "");
+        return;
+    }
+
+    size_t zip_len = 0;
+    unsigned char *zip = build_zip(repo, f->version, f->size, &zip_len);
+    if (zip == NULL) {
+        send_text(fd, 500, "Internal Server Error", "", "");
+        return;
+    }
+
+    char etag[256];
+    snprintf(etag, ARRAY_SIZE(etag), "\"%s-%s-%ld\"", repo, f->version, f->size);
+
+    char headers[1024];
+    int hn = snprintf(headers, ARRAY_SIZE(headers),
+        "Content-Type: application/zip\r\n"
+        "ETag: %s\r\n"
+        "Last-Modified: Mon, 01 Jan 2024 00:00:00 GMT\r\n"
+        "Accept-Ranges: bytes\r\n",
+        etag);
+
+    size_t start = 0;
+    int status = 200;
+    const char *reason = "OK";
+    if (strncmp(req->range, "bytes=", 6) == 0 && (req->if_range[0] == '\0' || strcmp(req->if_range, etag) == 0)) {
+        start = (size_t)strtoull(&req->range[6], NULL, 10);
+        if (start >= zip_len) {
+            char range_headers[128];
+            snprintf(range_headers, ARRAY_SIZE(range_headers), "Content-Range: bytes */%zu\r\n", zip_len);
+            send_text(fd, 416, "Range Not Satisfiable", range_headers, "");
+            free(zip);
+            return;
+        }
+
+        status = 206;
+        reason = "Partial Content";
+        snprintf(&headers[hn], ARRAY_SIZE(headers) - (size_t)hn, "Content-Range: bytes %zu-%zu/%zu\r\n", start, zip_len - 1, zip_len);
+    }
+
+    size_t body_len = zip_len - start;
+    size_t body_sent = body_len;
+    if (f->truncate >= 0 && count == 1 && (size_t)f->truncate < body_len) {
+        body_sent = (size_t)f->truncate;
+    }
+
+    send_response(fd, status, reason, headers, &zip[start], body_len, body_sent);
+    free(zip);
+}
+
+/**
+ * Reads the request line, the headers of interest, and the body.
+ */
+static int read_request(int fd, MockRequest *req)
+{
+    char *buf = malloc(MOCK_MAX_REQUEST + 1);
+    if (buf == NULL) {
+        return -1;
+    }
+
+    size_t len = 0;
+    char *end = NULL;
+    while (end == NULL) {
+        if (len == MOCK_MAX_REQUEST) {
+            free(buf);
+            return -1;
+        }
+
+        ssize_t n = recv(fd, &buf[len], MOCK_MAX_REQUEST - len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            free(buf);
+            return -1;
+        }
+
+        len += (size_t)n;
+        buf[len] = '\0';
+        end = strstr(buf, "\r\n\r\n");
+    }
+
+    *end = '\0';
+    char *body = end + 4;
+    size_t body_have = len - (size_t)(body - buf);
+
+    char *save = NULL;
+    char *line = strtok_r(buf, "\r\n", &save);
+    if (line == NULL || sscanf(line, "%15s %1023s", req->method, req->path) != 2) {
+        free(buf);
+        return -1;
+    }
+
+    size_t content_length = 0;
+    while ((line = strtok_r(NULL, "\r\n", &save)) != NULL) {
+        char *value = strchr(line, ':');
+        if (value == NULL) {
+            continue;
+        }
+
+        *value++ = '\0';
+        while (*value == ' ') {
+            value++;
+        }
+
+        if (strcasecmp(line, "Host") == 0) {
+            snprintf(req->host, ARRAY_SIZE(req->host), "%s", value);
+        } else if (strcasecmp(line, "Authorization") == 0) {
+            snprintf(req->authorization, ARRAY_SIZE(req->authorization), "%s", value);
+        } else if (strcasecmp(line, "Range") == 0) {
+            snprintf(req->range, ARRAY_SIZE(req->range), "%s", value);
+        } else if (strcasecmp(line, "If-Range") == 0) {
+            snprintf(req->if_range, ARRAY_SIZE(req->if_range), "%s", value);
+        } else if (strcasecmp(line, "Content-Length") == 0) {
+            content_length = (size_t)strtoull(value, NULL, 10);
+        }
+    }
+
+    if (content_length > MOCK_MAX_REQUEST) {
+        free(buf);
+        return -1;
+    }
+
+    if (content_length > 0) {
+        req->body = malloc(content_length + 1);
+        if (req->body == NULL) {
+            free(buf);
+            return -1;
+        }
+
+        size_t have = body_have < content_length ? body_have : content_length;
+        memcpy(req->body, body, have);
+        while (have < content_length) {
+            ssize_t n = recv(fd, &req->body[have], content_length - have, 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                free(buf);
+                return -1;
+            }
+            have += (size_t)n;
+        }
+
+        req->body[content_length] = '\0';
+        req->body_len = content_length;
+    }
+
+    free(buf);
+
+    return 0;
+}
+
+static void handle_connection(int fd)
+{
+    MockRequest req;
+    memset(&req, 0, sizeof(req));
+
+    if (read_request(fd, &req) != 0) {
+        return;
+    }
+
+    MockFaults faults;
+    memset(&faults, 0, sizeof(faults));
+    faults.truncate = -1;
+    snprintf(faults.version, ARRAY_SIZE(faults.version), "%s", MOCK_DEFAULT_VERSION);
+
+    // Split '/_fault/<spec>/rest' into the prefix, which is repeated in urls of
+    // responses, and the path that is routed.
+    char prefix[512] = "";
+    const char *path = req.path;
+    if (strncmp(path, MOCK_FAULT_PREFIX, strlen(MOCK_FAULT_PREFIX)) == 0) {
+        const char *spec = &path[strlen(MOCK_FAULT_PREFIX)];
+        size_t spec_len = strcspn(spec, "/");
+        parse_faults(&faults, spec, spec_len);
+
+        snprintf(prefix, ARRAY_SIZE(prefix), "%.*s", (int)(&spec[spec_len] - path), path);
+        path = &spec[spec_len];
+    }
+
+    long count = count_request(req.path);
+
+    if (strcmp(path, "/__shutdown") == 0) {
+        send_text(fd, 200, "OK", "", "");
+        stopping = 1;
+        shutdown(listen_fd, SHUT_RDWR);
+        goto cleanup;
+    }
+
+    if (faults.latency_ms > 0) {
+        sleep_ms(faults.latency_ms);
+    }
+
+    bool is_api = strncmp(path, "/repos/", 7) == 0 || strcmp(path, "/graphql") == 0;
+
+    char extra[512] = "";
+    if (is_api) {
+        char expected[512];
+        snprintf(expected, ARRAY_SIZE(expected), "Bearer %s", server_token != NULL ? server_token : "");
+
+        bool authenticated = server_token != NULL && strcmp(req.authorization, expected) == 0;
+        if ((req.authorization[0] != '\0' && !authenticated) || (strcmp(path, "/graphql") == 0 && !authenticated)) {
+            send_text(fd, 401, "Unauthorized", "", "{\"message\":\"Bad credentials\"}");
+            goto cleanup;
+        }
+
+        if (!ratelimit_headers(extra, ARRAY_SIZE(extra))) {
+            send_text(fd, 403, "Forbidden", extra, "{\"message\":\"API rate limit exceeded\"}");
+            goto cleanup;
+        }
+    }
+
+    if (count <= faults.ratelimit) {
+        char headers[256];
+        snprintf(headers, ARRAY_SIZE(headers), "X-RateLimit-Remaining: 0\r\nX-RateLimit-Reset: %lld\r\nRetry-After: 1\r\n", (long long)time(NULL) + 1);
+        send_text(fd, 403, "Forbidden", headers, "{\"message\":\"API rate limit exceeded\"}");
+        goto cleanup;
+    }
+
+    if (count <= faults.errors) {
+        send_text(fd, 500, "Internal Server Error", extra, "{\"message\":\"Server Error\"}");
+        goto cleanup;
+    }
+
+    if (strcmp(req.method, "GET") == 0 && strncmp(path, "/repos/", 7) == 0) {
+        handle_release(fd, &req, prefix, &faults, &path[7], extra);
+    } else if (strcmp(req.method, "POST") == 0 && strcmp(path, "/graphql") == 0) {
+        handle_graphql(fd, &req, prefix, &faults, extra);
+    } else if (strcmp(req.method, "GET") == 0 && strncmp(path, "/download/", 10) == 0) {
+        handle_download(fd, &req, prefix, &faults, &path[10], false, count);
+    } else if (strcmp(req.method, "GET") == 0 && strncmp(path, "/redirect/", 10) == 0) {
+        handle_download(fd, &req, prefix, &faults, &path[10], true, count);
+    } else {
+        send_text(fd, 404, "Not Found", "", "{\"message\":\"Not Found\"}");
+    }
+
+cleanup:
+    free(req.body);
+}
+
+static void *connection_thread(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+
+    handle_connection(fd);
+
+    shutdown(fd, SHUT_WR);
+    close(fd);
+
+    return NULL;
+}
+
+static int connect_local(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int stop_server(int port)
+{
+    int fd = connect_local(port);
+    if (fd < 0) {
+        fprintf(stderr, "mock_github: no server on port %d\n", port);
+        return 1;
+    }
+
+    const char req[] = "GET /__shutdown HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    send_all(fd, req, strlen(req));
+
+    char buf[256];
+    while (recv(fd, buf, sizeof(buf), 0) > 0) {
+    }
+
+    close(fd);
+
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: mock_github [--port PORT] [--token TOKEN] [--rate-limit N] [--daemon]\n");
+    fprintf(stderr, "       mock_github --stop [--port PORT]\n");
+}
+
+int main(int argc, char **argv)
+{
+    int port = MOCK_DEFAULT_PORT;
+    bool daemonize = false;
+    bool stop = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--token") == 0 && i + 1 < argc) {
+            server_token = argv[++i];
+        } else if (strcmp(argv[i], "--rate-limit") == 0 && i + 1 < argc) {
+            rate_limit = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--daemon") == 0) {
+            daemonize = true;
+        } else if (strcmp(argv[i], "--stop") == 0) {
+            stop = true;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (stop) {
+        return stop_server(port);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    crc32_init();
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("mock_github: socket");
+        return 1;
+    }
+
+    int yes = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, 128) != 0) {
+        perror("mock_github: bind");
+        return 1;
+    }
+
+    // The socket is listening before the parent exits, so whoever started the
+    // server can make requests right away.
+    if (daemonize) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("mock_github: fork");
+            return 1;
+        }
+        if (pid > 0) {
+            return 0;
+        }
+
+        // Whoever started the server may wait for its output pipes to close,
+        // so none of them can stay open.
+        setsid();
+        if (freopen("/dev/null", "r", stdin) == NULL
+            || freopen("/dev/null", "w", stdout) == NULL
+            || freopen("/dev/null", "w", stderr) == NULL) {
+            return 1;
+        }
+    }
+
+    while (!stopping) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, connection_thread, (void *)(intptr_t)fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    close(listen_fd);
+
+    return 0;
+}
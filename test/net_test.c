@@ -0,0 +1,89 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "net.h"
+#include "osapi.h"
+#include "wowpkg.h"
+
+static void test_net_get_refused(void)
+{
+    assert(net_init() == NET_OK);
+
+    NetRequest req;
+    memset(&req, 0, sizeof(req));
+
+    // Nothing should be listening on port 1.
+    req.url = "http://127.0.0.1:1/";
+    assert(net_get(&req) == NET_ETRANSFER);
+    assert(req.res.status == 0);
+
+    NetStats stats;
+    net_get_stats(&stats);
+    // Failed transfers are retried.
+    assert(stats.requests >= 1);
+    assert(stats.decoded_bytes == 0);
+
+    net_request_reset(&req);
+    assert(req.res.data == NULL);
+    assert(req.err == NET_OK);
+
+    net_cleanup();
+}
+
+static void test_net_get_many_empty(void)
+{
+    assert(net_init() == NET_OK);
+    assert(net_get_many(NULL, 0) == NET_OK);
+    net_cleanup();
+}
+
+static void test_net_init_nested(void)
+{
+    assert(net_init() == NET_OK);
+    assert(net_init() == NET_OK);
+    net_cleanup();
+
+    NetRequest req;
+    memset(&req, 0, sizeof(req));
+    req.url = "http://127.0.0.1:1/";
+    assert(net_get(&req) == NET_ETRANSFER);
+    net_request_reset(&req);
+
+    net_cleanup();
+}
+
+static void test_net_download_refused(void)
+{
+    assert(net_init() == NET_OK);
+
+    char path[OS_MAX_PATH];
+    snprintf(path, ARRAY_SIZE(path), "%s%cnet_test_download.zip", os_tempdir(), OS_SEPARATOR);
+
+    NetRequest req;
+    memset(&req, 0, sizeof(req));
+    req.url = "http://127.0.0.1:1/";
+    assert(net_download(&req, path) == NET_ETRANSFER);
+    assert(req.res.status == 0);
+
+    // Nothing was received so nothing is moved into place.
+    struct stat st;
+    assert(os_stat(path, &st) != 0);
+
+    char part_path[OS_MAX_PATH + sizeof(".part")];
+    snprintf(part_path, ARRAY_SIZE(part_path), "%s.part", path);
+    remove(part_path);
+
+    net_request_reset(&req);
+    net_cleanup();
+}
+
+int main(void)
+{
+    test_net_get_refused();
+    test_net_get_many_empty();
+    test_net_init_nested();
+    test_net_download_refused();
+
+    return 0;
+}
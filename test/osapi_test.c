@@ -330,6 +330,237 @@ static void test_os_rename_file_replace(void)
     remove(newpath);
 }
 
+static void test_os_clone_tree(void)
+{
+    char oldpath[] = WOWPKG_TEST_TMPDIR "test_os_clone_tree_XXXXXX";
+    char txt_data[] = "test text data";
+
+    assert(os_mkdtemp(oldpath) != NULL);
+
+    char old_txt_path[OS_MAX_PATH];
+    int n = snprintf(old_txt_path, ARRAY_SIZE(old_txt_path), "%s%csub%ctest.txt", oldpath, OS_SEPARATOR, OS_SEPARATOR);
+    assert(n > 0 && (size_t)n < ARRAY_SIZE(old_txt_path));
+    assert(os_mkdir_all(old_txt_path, 0755) == 0);
+
+    FILE *ftxt = fopen(old_txt_path, "wb");
+    assert(ftxt != NULL);
+    assert(fwrite(txt_data, sizeof(*txt_data), ARRAY_SIZE(txt_data), ftxt) == ARRAY_SIZE(txt_data));
+    fclose(ftxt);
+
+    char newpath[OS_MAX_PATH];
+    n = snprintf(newpath, ARRAY_SIZE(newpath), "%s_clone", oldpath);
+    assert(n > 0 && (size_t)n < ARRAY_SIZE(newpath));
+
+    char new_txt_path[OS_MAX_PATH];
+    n = snprintf(new_txt_path, ARRAY_SIZE(new_txt_path), "%s%csub%ctest.txt", newpath, OS_SEPARATOR, OS_SEPARATOR);
+    assert(n > 0 && (size_t)n < ARRAY_SIZE(new_txt_path));
+
+    assert(os_clone_tree(oldpath, newpath) == 0);
+
+    // Unlike a rename both trees exist afterwards.
+    struct os_stat s;
+    assert(os_stat(old_txt_path, &s) == 0);
+    assert(os_stat(new_txt_path, &s) == 0);
+    assert(S_ISREG(s.st_mode));
+
+    ftxt = fopen(new_txt_path, "rb");
+    assert(ftxt != NULL);
+
+    char buf[BUFSIZ];
+    assert(fread(buf, sizeof(*buf), ARRAY_SIZE(buf), ftxt) == ARRAY_SIZE(txt_data));
+    assert(strcmp(buf, txt_data) == 0);
+    fclose(ftxt);
+
+    // New path shall not exist.
+    assert(os_clone_tree(oldpath, newpath) != 0);
+
+    os_remove_all(oldpath);
+    os_remove_all(newpath);
+}
+
+static void test_os_link(void)
+{
+    char dir[] = WOWPKG_TEST_TMPDIR "test_os_link_XXXXXX";
+    assert(os_mkdtemp(dir) != NULL);
+
+    char a[OS_MAX_PATH];
+    char b[OS_MAX_PATH];
+    char c[OS_MAX_PATH];
+    snprintf(a, ARRAY_SIZE(a), "%s%ca.txt", dir, OS_SEPARATOR);
+    snprintf(b, ARRAY_SIZE(b), "%s%cb.txt", dir, OS_SEPARATOR);
+    snprintf(c, ARRAY_SIZE(c), "%s%cc.txt", dir, OS_SEPARATOR);
+
+    FILE *f = fopen(a, "wb");
+    assert(f != NULL);
+    assert(fwrite("abc", 1, 3, f) == 3);
+    fclose(f);
+
+    f = fopen(c, "wb");
+    assert(f != NULL);
+    assert(fwrite("abc", 1, 3, f) == 3);
+    fclose(f);
+
+    OsFileInfo info_a;
+    assert(os_file_info(a, &info_a) == 0);
+    assert(info_a.size == 3);
+    assert(info_a.nlink == 1);
+
+    assert(os_link(a, b) == 0);
+    assert(os_link(a, b) != 0);
+
+    OsFileInfo info_b;
+    OsFileInfo info_c;
+    assert(os_file_info(a, &info_a) == 0);
+    assert(os_file_info(b, &info_b) == 0);
+    assert(os_file_info(c, &info_c) == 0);
+    assert(info_a.nlink == 2 && info_b.nlink == 2);
+    assert(info_a.dev == info_b.dev && info_a.ino == info_b.ino);
+
+    // Same contents is not the same file.
+    assert(info_a.dev != info_c.dev || info_a.ino != info_c.ino);
+
+    os_remove_all(dir);
+}
+
+static void test_os_set_mtime(void)
+{
+    char dir[] = WOWPKG_TEST_TMPDIR "test_os_set_mtime_XXXXXX";
+    assert(os_mkdtemp(dir) != NULL);
+
+    char a[OS_MAX_PATH];
+    snprintf(a, ARRAY_SIZE(a), "%s%ca.txt", dir, OS_SEPARATOR);
+
+    FILE *f = fopen(a, "wb");
+    assert(f != NULL);
+    fclose(f);
+
+    assert(os_set_mtime(a, 1685371440) == 0);
+
+    struct os_stat s;
+    assert(os_stat(a, &s) == 0);
+    assert(s.st_mtime == 1685371440);
+
+    assert(os_remove_all(dir) == 0);
+}
+
+static void test_os_lock_file(void)
+{
+    const char *path = WOWPKG_TEST_TMPDIR "test_os_lock_file.lock";
+    remove(path);
+
+    OsFileLock lock;
+    assert(os_lock_file(path, &lock) == 0);
+
+    OsFileLock other;
+    errno = 0;
+    assert(os_lock_file(path, &other) != 0);
+    assert(errno == EWOULDBLOCK);
+
+    os_unlock_file(lock);
+    assert(os_lock_file(path, &other) == 0);
+    os_unlock_file(other);
+
+    remove(path);
+}
+
+static void test_os_monotonic(void)
+{
+    double start = os_monotonic();
+    double end = os_monotonic();
+
+    assert(start > 0.0);
+    assert(end >= start);
+}
+
+static void test_os_sleep(void)
+{
+    double start = os_monotonic();
+    os_sleep(0.01);
+
+    assert(os_monotonic() - start >= 0.01);
+}
+
+static void test_os_mkdir_private(void)
+{
+    const char *path = WOWPKG_TEST_TMPDIR "test_osapi_private";
+    os_remove_all(path);
+
+    assert(os_mkdir_private(path) == 0);
+    assert(os_mkdir_private(path) == 0);
+
+#ifndef _WIN32
+    // Another user could read it or put files in it.
+    assert(chmod(path, 0755) == 0);
+    errno = 0;
+    assert(os_mkdir_private(path) == -1 && errno == EPERM);
+    assert(chmod(path, 0700) == 0);
+
+    // A link is not followed, even to a private directory.
+    const char *link_path = WOWPKG_TEST_TMPDIR "test_osapi_private_link";
+    remove(link_path);
+    assert(symlink(path, link_path) == 0);
+    errno = 0;
+    assert(os_mkdir_private(link_path) == -1 && errno == EPERM);
+    remove(link_path);
+#endif
+
+    os_remove_all(path);
+}
+
+static void test_os_fopen_nofollow(void)
+{
+    const char *path = WOWPKG_TEST_TMPDIR "test_osapi_nofollow";
+    remove(path);
+
+    FILE *f = os_fopen_nofollow(path, "wb");
+    assert(f != NULL);
+    assert(fputs("abc", f) >= 0);
+    fclose(f);
+
+    f = os_fopen_nofollow(path, "ab");
+    assert(f != NULL);
+    assert(fputs("def", f) >= 0);
+    fclose(f);
+
+    struct os_stat s;
+    assert(os_stat(path, &s) == 0 && s.st_size == 6);
+
+#ifndef _WIN32
+    const char *link_path = WOWPKG_TEST_TMPDIR "test_osapi_nofollow_link";
+    remove(link_path);
+    assert(symlink(path, link_path) == 0);
+    assert(os_fopen_nofollow(link_path, "wb") == NULL);
+    assert(os_fopen_nofollow(link_path, "rb") == NULL);
+    assert(os_stat(path, &s) == 0 && s.st_size == 6);
+    remove(link_path);
+#endif
+
+    remove(path);
+}
+
+#ifndef _WIN32
+static void test_os_spawn_background(void)
+{
+    const char *path = WOWPKG_TEST_TMPDIR "test_osapi_spawn";
+    remove(path);
+
+    char script[OS_MAX_PATH];
+    snprintf(script, ARRAY_SIZE(script), "echo spawned > %s", path);
+    assert(os_spawn_background("/bin/sh", (const char *[]) { "sh", "-c", script, NULL }) == 0);
+
+    // Returns before the program is done.
+    struct os_stat s;
+    for (int i = 0; i < 500 && (os_stat(path, &s) != 0 || s.st_size == 0); i++) {
+        os_sleep(0.01);
+    }
+    assert(os_stat(path, &s) == 0 && s.st_size == strlen("spawned\n"));
+
+    assert(os_spawn_background(WOWPKG_TEST_TMPDIR "does_not_exist", (const char *[]) { "x", NULL }) == -1);
+
+    remove(path);
+}
+#endif
+
 int main(void)
 {
     test_os_mkdir();
@@ -343,6 +574,18 @@ int main(void)
     test_os_rename_dir();
     test_os_rename_file();
     test_os_rename_file_replace();
+    test_os_clone_tree();
+    test_os_link();
+    test_os_set_mtime();
+    test_os_lock_file();
+    test_os_mkdir_private();
+    test_os_fopen_nofollow();
+    test_os_monotonic();
+    test_os_sleep();
+
+#ifndef _WIN32
+    test_os_spawn_background();
+#endif
 
 #ifdef _WIN32
     test_os_mkdir_all_win32();
@@ -0,0 +1,184 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "osapi.h"
+#include "search.h"
+#include "test_util.h"
+#include "wowpkg.h"
+
+#define TEST_ROOT WOWPKG_TEST_TMPDIR "test_search"
+#define TEST_CATALOG TEST_ROOT "/catalog"
+#define TEST_INDEX TEST_ROOT "/search.wowpkg"
+
+static void write_catalog(void)
+{
+    os_remove_all(TEST_ROOT);
+
+    write_file(TEST_CATALOG "/Alpha.ini", "[Addon]\nname = Alpha\ndesc = Boss timers for raids.\n");
+    write_file(TEST_CATALOG "/BossMods.ini", "[Addon]\nname = BossMods\ndesc = Warnings.\n");
+    write_file(TEST_CATALOG "/Raid_Frames.ini", "[Addon]\nname = Raid_Frames\ndesc = Replaces the raid frames with boss aware frames.\n");
+    write_file(TEST_CATALOG "/notes.txt", "Not an addon.");
+}
+
+/**
+ * Checks that query finds the names in expected, a NULL terminated list, in
+ * that order.
+ */
+static void assert_query(const SearchIndex *idx, const char *query, const char **expected)
+{
+    SearchResult *results = NULL;
+    size_t n = 0;
+    assert(search_query(idx, query, &results, &n) == SEARCH_OK);
+
+    size_t i = 0;
+    for (; expected[i] != NULL; i++) {
+        assert(i < n);
+        assert(strcmp(results[i].name, expected[i]) == 0);
+    }
+    assert(i == n);
+
+    free(results);
+}
+
+static void test_search_query(void)
+{
+    write_catalog();
+
+    SearchIndex *idx = NULL;
+    assert(search_index_build(&idx, TEST_CATALOG) == SEARCH_OK);
+    assert(search_index_size(idx) == 3);
+
+    // The name match comes before the description matches, and the shorter
+    // description before the longer one.
+    assert_query(idx, "boss", (const char *[]) { "BossMods", "Alpha", "Raid_Frames", NULL });
+    assert_query(idx, "BOSS", (const char *[]) { "BossMods", "Alpha", "Raid_Frames", NULL });
+
+    // Every word has to match, in any order.
+    assert_query(idx, "frames raid", (const char *[]) { "Raid_Frames", NULL });
+    assert_query(idx, "raid", (const char *[]) { "Raid_Frames", "Alpha", NULL });
+    assert_query(idx, "boss warnings", (const char *[]) { "BossMods", NULL });
+    assert_query(idx, "boss nothing", (const char *[]) { NULL });
+
+    // Short words only match the start of a word.
+    assert_query(idx, "ra", (const char *[]) { "Raid_Frames", "Alpha", NULL });
+    assert_query(idx, "ss", (const char *[]) { NULL });
+    assert_query(idx, "w", (const char *[]) { "BossMods", "Raid_Frames", NULL });
+
+    assert_query(idx, "", (const char *[]) { NULL });
+    assert_query(idx, "zzz", (const char *[]) { NULL });
+
+    search_index_free(idx);
+    os_remove_all(TEST_ROOT);
+}
+
+static void test_search_suggest(void)
+{
+    write_catalog();
+    write_file(TEST_CATALOG "/BossMod.ini", "[Addon]\nname = BossMod\ndesc = Less.\n");
+    write_file(TEST_CATALOG "/BossModsPlus.ini", "[Addon]\nname = BossModsPlus\ndesc = More.\n");
+
+    SearchIndex *idx = NULL;
+    assert(search_index_build(&idx, TEST_CATALOG) == SEARCH_OK);
+
+    SearchSuggestion s[4];
+
+    // Missing, extra, wrong and swapped characters.
+    assert(search_suggest(idx, "bosmods", s, 1) == 1);
+    assert(strcmp(s[0].name, "BossMods") == 0 && s[0].typos == 1);
+    assert(search_suggest(idx, "bossmodss", s, 1) == 1);
+    assert(strcmp(s[0].name, "BossMods") == 0 && s[0].typos == 1);
+    assert(search_suggest(idx, "bassmods", s, 1) == 1);
+    assert(strcmp(s[0].name, "BossMods") == 0 && s[0].typos == 1);
+    assert(search_suggest(idx, "bsosmdos", s, 1) == 1);
+    assert(strcmp(s[0].name, "BossMods") == 0 && s[0].typos == 2);
+
+    // Closest first, then by name.
+    assert(search_suggest(idx, "bosmod", s, ARRAY_SIZE(s)) == 2);
+    assert(strcmp(s[0].name, "BossMod") == 0 && s[0].typos == 1);
+    assert(strcmp(s[1].name, "BossMods") == 0 && s[1].typos == 2);
+    assert(search_suggest(idx, "BossModsPl", s, ARRAY_SIZE(s)) == 2);
+    assert(strcmp(s[0].name, "BossMods") == 0 && s[0].typos == 2);
+    assert(strcmp(s[1].name, "BossModsPlus") == 0 && s[1].typos == 2);
+
+    // Only as many as asked for.
+    assert(search_suggest(idx, "bosmod", s, 1) == 1);
+    assert(strcmp(s[0].name, "BossMod") == 0);
+
+    assert(search_suggest(idx, "alpha", s, ARRAY_SIZE(s)) == 1);
+    assert(s[0].typos == 0);
+
+    // Short names only get one typo.
+    assert(search_suggest(idx, "alha", s, ARRAY_SIZE(s)) == 1);
+    assert(search_suggest(idx, "ahl", s, ARRAY_SIZE(s)) == 0);
+    assert(search_suggest(idx, "nothing", s, ARRAY_SIZE(s)) == 0);
+
+    search_index_free(idx);
+    os_remove_all(TEST_ROOT);
+}
+
+static void test_search_index_save_load(void)
+{
+    write_catalog();
+    assert(os_set_mtime(TEST_CATALOG, 1000) == 0);
+
+    SearchIndex *idx = NULL;
+    assert(search_index_load(&idx, TEST_INDEX, TEST_CATALOG) == SEARCH_ENOENT);
+    assert(idx == NULL);
+
+    assert(search_index_open(&idx, TEST_INDEX, TEST_CATALOG) == SEARCH_OK);
+    search_index_free(idx);
+
+    // Saved by open.
+    assert(search_index_load(&idx, TEST_INDEX, TEST_CATALOG) == SEARCH_OK);
+    assert(search_index_size(idx) == 3);
+    assert_query(idx, "boss", (const char *[]) { "BossMods", "Alpha", "Raid_Frames", NULL });
+
+    SearchSuggestion s;
+    assert(search_suggest(idx, "raidframes", &s, 1) == 1);
+    assert(strcmp(s.name, "Raid_Frames") == 0);
+    search_index_free(idx);
+
+    // The catalog changed.
+    write_file(TEST_CATALOG "/Zeta.ini", "[Addon]\nname = Zeta\ndesc = Boss.\n");
+    assert(os_set_mtime(TEST_CATALOG, 2000) == 0);
+    assert(search_index_load(&idx, TEST_INDEX, TEST_CATALOG) == SEARCH_ESTALE);
+
+    assert(search_index_open(&idx, TEST_INDEX, TEST_CATALOG) == SEARCH_OK);
+    assert(search_index_size(idx) == 4);
+    search_index_free(idx);
+
+    assert(search_index_load(&idx, TEST_INDEX, TEST_CATALOG) == SEARCH_OK);
+    assert(search_index_size(idx) == 4);
+    search_index_free(idx);
+
+    // A file was edited in place, which leaves the directory as it was.
+    write_file(TEST_CATALOG "/Zeta.ini", "[Addon]\nname = Zeta\ndesc = Raid boss.\n");
+    assert(os_set_mtime(TEST_CATALOG, 2000) == 0);
+    assert(search_index_load(&idx, TEST_INDEX, TEST_CATALOG) == SEARCH_ESTALE);
+
+    assert(search_index_open(&idx, TEST_INDEX, TEST_CATALOG) == SEARCH_OK);
+    assert_query(idx, "raid", (const char *[]) { "Raid_Frames", "Zeta", "Alpha", NULL });
+    search_index_free(idx);
+
+    // Damaged files are not used.
+    write_file(TEST_INDEX, "wowpkg search 2\n12345");
+    assert(search_index_load(&idx, TEST_INDEX, TEST_CATALOG) == SEARCH_EPARSE);
+    assert(idx == NULL);
+
+    assert(search_index_open(&idx, TEST_INDEX, TEST_CATALOG) == SEARCH_OK);
+    assert(search_index_size(idx) == 4);
+    search_index_free(idx);
+
+    os_remove_all(TEST_ROOT);
+}
+
+int main(void)
+{
+    test_search_query();
+    test_search_suggest();
+    test_search_index_save_load();
+
+    return 0;
+}
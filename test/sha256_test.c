@@ -0,0 +1,99 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "osapi.h"
+#include "sha256.h"
+#include "wowpkg.h"
+
+static void hash_hex(const char *data, size_t n, char hex[SHA256_HEX_SIZE])
+{
+    Sha256 ctx;
+    unsigned char digest[SHA256_DIGEST_SIZE];
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, n);
+    sha256_final(&ctx, digest);
+    sha256_hex(digest, hex);
+}
+
+static void test_sha256_vectors(void)
+{
+    char hex[SHA256_HEX_SIZE];
+
+    hash_hex("", 0, hex);
+    assert(strcmp(hex, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855") == 0);
+
+    hash_hex("abc", 3, hex);
+    assert(strcmp(hex, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") == 0);
+
+    // Two blocks once padded.
+    const char *two = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    hash_hex(two, strlen(two), hex);
+    assert(strcmp(hex, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1") == 0);
+}
+
+static void test_sha256_update_split(void)
+{
+    char data[1000];
+    for (size_t i = 0; i < ARRAY_SIZE(data); i++) {
+        data[i] = (char)('a' + i % 26);
+    }
+
+    char whole[SHA256_HEX_SIZE];
+    hash_hex(data, ARRAY_SIZE(data), whole);
+
+    // Any split of the input gives the same digest.
+    size_t splits[] = { 1, 55, 56, 63, 64, 65, 500 };
+    for (size_t i = 0; i < ARRAY_SIZE(splits); i++) {
+        Sha256 ctx;
+        unsigned char digest[SHA256_DIGEST_SIZE];
+        char hex[SHA256_HEX_SIZE];
+
+        sha256_init(&ctx);
+        for (size_t off = 0; off < ARRAY_SIZE(data); off += splits[i]) {
+            size_t n = ARRAY_SIZE(data) - off < splits[i] ? ARRAY_SIZE(data) - off : splits[i];
+            sha256_update(&ctx, data + off, n);
+        }
+        sha256_final(&ctx, digest);
+        sha256_hex(digest, hex);
+
+        assert(strcmp(hex, whole) == 0);
+    }
+}
+
+static void test_sha256_file(void)
+{
+    char path[] = WOWPKG_TEST_TMPDIR "test_sha256_XXXXXX";
+    FILE *f = os_mkstemp(path);
+    assert(f != NULL);
+    assert(fwrite("abc", 1, 3, f) == 3);
+    fclose(f);
+
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    char hex[SHA256_HEX_SIZE];
+    assert(sha256_file(path, digest) == 0);
+    sha256_hex(digest, hex);
+    assert(strcmp(hex, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") == 0);
+
+    // Only what is left to read is hashed.
+    f = fopen(path, "rb");
+    assert(f != NULL);
+    assert(fgetc(f) == 'a');
+    assert(sha256_stream(f, digest) == 0);
+    fclose(f);
+    sha256_hex(digest, hex);
+    assert(strcmp(hex, "1e0bbd6c686ba050b8eb03ffeedc64fdc9d80947fce821abbe5d6dc8d252c5ac") == 0);
+
+    remove(path);
+    assert(sha256_file(path, digest) != 0);
+}
+
+int main(void)
+{
+    test_sha256_vectors();
+    test_sha256_update_split();
+    test_sha256_file();
+
+    return 0;
+}
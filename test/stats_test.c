@@ -0,0 +1,151 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <cjson/cJSON.h>
+
+#include "osapi.h"
+#include "osstring.h"
+#include "stats.h"
+#include "wowpkg.h"
+
+/**
+ * Prints the stats to a temporary file and returns its contents.
+ */
+static char *print_to_str(void)
+{
+    FILE *f = tmpfile();
+    assert(f != NULL);
+
+    stats_print(f);
+
+    long size = ftell(f);
+    assert(size >= 0);
+    rewind(f);
+
+    char *s = calloc((size_t)size + 1, 1);
+    assert(s != NULL);
+    assert(fread(s, 1, (size_t)size, f) == (size_t)size);
+
+    fclose(f);
+
+    return s;
+}
+
+static void test_stats_disabled(void)
+{
+    StatsTimer timer;
+    stats_start(&timer, STATS_DOWNLOAD, "BigWigs");
+    stats_stop(&timer);
+    stats_add_files("BigWigs", 10, 1);
+
+    char *s = print_to_str();
+    assert(strcmp(s, "") == 0);
+    free(s);
+}
+
+static void test_stats_print(void)
+{
+    stats_enable(true);
+    assert(stats_enabled());
+
+    StatsTimer timer;
+    stats_start(&timer, STATS_PACKAGE, "BigWigs");
+    os_sleep(0.01);
+    stats_stop(&timer);
+
+    stats_start(&timer, STATS_SAVE, NULL);
+    stats_stop(&timer);
+
+    stats_add_files("BigWigs", 12, 3);
+    stats_add_files("WeakAuras", 5, 1);
+
+    char *s = print_to_str();
+
+    // Rows are sorted by name, work that is not tied to an addon is shared.
+    const char *shared = strstr(s, "(shared)");
+    const char *bigwigs = strstr(s, "BigWigs");
+    const char *weakauras = strstr(s, "WeakAuras");
+    const char *total = strstr(s, "Total");
+    assert(shared != NULL && bigwigs != NULL && weakauras != NULL && total != NULL);
+    assert(shared < bigwigs && bigwigs < weakauras && weakauras < total);
+
+    // Total row ends with the sum of the files written and moved.
+    assert(strstr(total, " 17      4\n") != NULL);
+
+    free(s);
+
+    stats_reset();
+
+    s = print_to_str();
+    assert(strcmp(s, "") == 0);
+    free(s);
+
+    stats_enable(false);
+}
+
+static void test_stats_trace(void)
+{
+    const char *path = WOWPKG_TEST_TMPDIR "stats_trace.json";
+
+    assert(stats_trace_open(path) == 0);
+
+    // Spans are written even if stats are not enabled.
+    StatsTimer timer;
+    stats_start(&timer, STATS_DOWNLOAD, "Big\"Wigs");
+    stats_stop(&timer);
+
+    double start = os_monotonic();
+    stats_trace_span("command", "upgrade", start);
+
+    assert(stats_trace_close() == 0);
+
+    FILE *f = fopen(path, "rb");
+    assert(f != NULL);
+
+    char buf[4096] = { 0 };
+    size_t n = fread(buf, 1, ARRAY_SIZE(buf) - 1, f);
+    assert(n > 0 && n < ARRAY_SIZE(buf) - 1);
+    fclose(f);
+    remove(path);
+
+    cJSON *json = cJSON_Parse(buf);
+    assert(json != NULL);
+    assert(cJSON_IsArray(json));
+
+    // Process and thread name metadata and the two spans.
+    assert(cJSON_GetArraySize(json) == 4);
+
+    cJSON *thread = cJSON_GetArrayItem(json, 1);
+    assert(strcmp(cJSON_GetObjectItemCaseSensitive(thread, "name")->valuestring, "thread_name") == 0);
+    assert(cJSON_GetObjectItemCaseSensitive(thread, "tid")->valueint == 1);
+
+    cJSON *span = cJSON_GetArrayItem(json, 2);
+    assert(strcmp(cJSON_GetObjectItemCaseSensitive(span, "name")->valuestring, "download Big\"Wigs") == 0);
+    assert(strcmp(cJSON_GetObjectItemCaseSensitive(span, "ph")->valuestring, "X") == 0);
+    assert(cJSON_GetObjectItemCaseSensitive(span, "dur")->valuedouble >= 0);
+
+    cJSON *args = cJSON_GetObjectItemCaseSensitive(span, "args");
+    assert(strcmp(cJSON_GetObjectItemCaseSensitive(args, "addon")->valuestring, "Big\"Wigs") == 0);
+
+    assert(cJSON_GetObjectItemCaseSensitive(span, "tid")->valueint == 1);
+
+    span = cJSON_GetArrayItem(json, 3);
+    assert(strcmp(cJSON_GetObjectItemCaseSensitive(span, "name")->valuestring, "command upgrade") == 0);
+
+    cJSON_Delete(json);
+
+    // Nothing was recorded for the table.
+    char *s = print_to_str();
+    assert(strcmp(s, "") == 0);
+    free(s);
+}
+
+int main(void)
+{
+    test_stats_disabled();
+    test_stats_print();
+    test_stats_trace();
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "osapi.h"
+#include "store.h"
+#include "test_util.h"
+#include "wowpkg.h"
+
+#define TEST_ROOT WOWPKG_TEST_TMPDIR "test_store"
+#define TEST_STORE TEST_ROOT "/addons/" STORE_DIR_NAME
+#define TEST_ADDONS TEST_ROOT "/addons"
+#define TEST_PACKAGE TEST_ROOT "/package"
+
+static bool same_file(const char *a, const char *b)
+{
+    OsFileInfo info_a;
+    OsFileInfo info_b;
+    assert(os_file_info(a, &info_a) == 0);
+    assert(os_file_info(b, &info_b) == 0);
+
+    return info_a.dev == info_b.dev && info_a.ino == info_b.ino;
+}
+
+static void test_store_import(void)
+{
+    os_remove_all(TEST_ROOT);
+
+    // Two addons that embed the same library.
+    write_file(TEST_PACKAGE "/A/A/A.toc", "a");
+    write_file(TEST_PACKAGE "/A/A/Libs/LibStub.lua", "libstub");
+    write_file(TEST_PACKAGE "/B/B/B.toc", "b");
+    write_file(TEST_PACKAGE "/B/B/Libs/LibStub.lua", "libstub");
+
+    char addons[] = TEST_ADDONS "/";
+    assert(os_mkdir_all(addons, 0755) == 0);
+
+    assert(store_import(TEST_STORE, TEST_PACKAGE "/A/A", TEST_ADDONS "/A") == STORE_OK);
+    assert(store_import(TEST_STORE, TEST_PACKAGE "/B/B", TEST_ADDONS "/B") == STORE_OK);
+
+    assert(file_equals(TEST_ADDONS "/A/A.toc", "a"));
+    assert(file_equals(TEST_ADDONS "/B/B.toc", "b"));
+    assert(file_equals(TEST_ADDONS "/B/Libs/LibStub.lua", "libstub"));
+    assert(same_file(TEST_ADDONS "/A/Libs/LibStub.lua", TEST_ADDONS "/B/Libs/LibStub.lua"));
+    assert(!same_file(TEST_ADDONS "/A/A.toc", TEST_ADDONS "/B/B.toc"));
+
+    // Everything was moved out of the package.
+    struct os_stat s;
+    assert(os_stat(TEST_PACKAGE "/A/A", &s) != 0);
+
+    StoreUsage usage;
+    assert(store_usage(TEST_STORE, &usage) == STORE_OK);
+    assert(usage.objects == 3);
+    assert(usage.links == 4);
+    assert(usage.saved == strlen("libstub"));
+    assert(usage.unused == 0);
+
+    // Removing B leaves its unique file unused.
+    assert(os_remove_all(TEST_ADDONS "/B") == 0);
+    assert(store_usage(TEST_STORE, &usage) == STORE_OK);
+    assert(usage.unused == 1);
+    assert(usage.saved == 0);
+
+    size_t removed = 0;
+    assert(store_prune(TEST_STORE, &removed) == STORE_OK);
+    assert(removed == 1);
+    assert(store_usage(TEST_STORE, &usage) == STORE_OK);
+    assert(usage.objects == 2);
+    assert(usage.unused == 0);
+
+    os_remove_all(TEST_ROOT);
+}
+
+static void test_store_dedupe(void)
+{
+    os_remove_all(TEST_ROOT);
+
+    write_file(TEST_ADDONS "/A/Sounds/alert.ogg", "sound");
+    write_file(TEST_ADDONS "/B/Sounds/alert.ogg", "sound");
+    write_file(TEST_ADDONS "/C/C.toc", "c");
+
+    assert(store_dedupe(TEST_STORE, TEST_ADDONS "/A") == STORE_OK);
+    assert(!same_file(TEST_ADDONS "/A/Sounds/alert.ogg", TEST_ADDONS "/B/Sounds/alert.ogg"));
+
+    assert(store_dedupe(TEST_STORE, TEST_ADDONS "/B") == STORE_OK);
+    assert(same_file(TEST_ADDONS "/A/Sounds/alert.ogg", TEST_ADDONS "/B/Sounds/alert.ogg"));
+    assert(file_equals(TEST_ADDONS "/B/Sounds/alert.ogg", "sound"));
+
+    // Running again changes nothing.
+    assert(store_dedupe(TEST_STORE, TEST_ADDONS "/B") == STORE_OK);
+
+    StoreUsage usage;
+    assert(store_usage(TEST_STORE, &usage) == STORE_OK);
+    assert(usage.objects == 1);
+    assert(usage.links == 2);
+    assert(usage.saved == strlen("sound"));
+
+    // A store that was never created is empty.
+    assert(store_usage(TEST_ROOT "/missing", &usage) == STORE_OK);
+    assert(usage.objects == 0);
+
+    os_remove_all(TEST_ROOT);
+}
+
+static void test_store_edited_object(void)
+{
+    os_remove_all(TEST_ROOT);
+
+    write_file(TEST_ADDONS "/A/Sounds/alert.ogg", "sound");
+    assert(store_dedupe(TEST_STORE, TEST_ADDONS "/A") == STORE_OK);
+
+#ifndef _WIN32
+    // Objects and the files that link to them are read only.
+    struct os_stat s;
+    assert(os_stat(TEST_ADDONS "/A/Sounds/alert.ogg", &s) == 0);
+    assert((s.st_mode & 0777) == 0444);
+    assert(chmod(TEST_ADDONS "/A/Sounds/alert.ogg", 0644) == 0);
+#endif
+
+    // Edited through its link without changing its size, so only its
+    // contents tell that it no longer matches its name.
+    write_file(TEST_ADDONS "/A/Sounds/alert.ogg", "SOUND");
+
+    write_file(TEST_ADDONS "/B/Sounds/alert.ogg", "sound");
+    assert(store_dedupe(TEST_STORE, TEST_ADDONS "/B") == STORE_OK);
+    assert(!same_file(TEST_ADDONS "/A/Sounds/alert.ogg", TEST_ADDONS "/B/Sounds/alert.ogg"));
+    assert(file_equals(TEST_ADDONS "/A/Sounds/alert.ogg", "SOUND"));
+    assert(file_equals(TEST_ADDONS "/B/Sounds/alert.ogg", "sound"));
+
+    // The edited object was replaced by the file that was added.
+    write_file(TEST_ADDONS "/C/Sounds/alert.ogg", "sound");
+    assert(store_dedupe(TEST_STORE, TEST_ADDONS "/C") == STORE_OK);
+    assert(same_file(TEST_ADDONS "/B/Sounds/alert.ogg", TEST_ADDONS "/C/Sounds/alert.ogg"));
+
+    os_remove_all(TEST_ROOT);
+}
+
+int main(void)
+{
+    test_store_import();
+    test_store_dedupe();
+    test_store_edited_object();
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "osapi.h"
+#include "wowpkg.h"
+
+/**
+ * Helpers shared by the tests. They are static inline so that a test that does
+ * not use one of them does not warn about it.
+ */
+
+/**
+ * Writes contents to the file at path, creating the directories above it.
+ */
+static inline void write_file(const char *path, const char *contents)
+{
+    char tmp[OS_MAX_PATH];
+    snprintf(tmp, ARRAY_SIZE(tmp), "%s", path);
+    assert(os_mkdir_all(tmp, 0755) == 0);
+
+    FILE *f = fopen(path, "wb");
+    assert(f != NULL);
+    assert(fwrite(contents, sizeof(*contents), strlen(contents), f) == strlen(contents));
+    fclose(f);
+}
+
+/**
+ * Returns true if the file at path has exactly contents, which shall be
+ * shorter than 64 bytes.
+ */
+static inline bool file_equals(const char *path, const char *contents)
+{
+    char buf[64] = { 0 };
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return false;
+    }
+
+    size_t n = fread(buf, sizeof(*buf), ARRAY_SIZE(buf) - 1, f);
+    fclose(f);
+
+    return n == strlen(contents) && strcmp(buf, contents) == 0;
+}
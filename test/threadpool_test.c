@@ -0,0 +1,226 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "osapi.h"
+#include "threadpool.h"
+#include "wowpkg.h"
+
+typedef struct Counter {
+    OsMutex lock;
+    int calls;
+    int done_calls;
+    int done_sum;
+} Counter;
+
+typedef struct Job {
+    Counter *counter;
+    ThreadPool *pool;
+    int value;
+    int worker_id;
+} Job;
+
+static int job_square(void *arg)
+{
+    Job *job = arg;
+
+    os_mutex_lock(&job->counter->lock);
+    job->counter->calls++;
+    os_mutex_unlock(&job->counter->lock);
+
+    job->worker_id = threadpool_worker_id();
+
+    return job->value * job->value;
+}
+
+static void job_done(void *arg, int result)
+{
+    Job *job = arg;
+
+    os_mutex_lock(&job->counter->lock);
+    job->counter->done_calls++;
+    job->counter->done_sum += result;
+    os_mutex_unlock(&job->counter->lock);
+}
+
+/**
+ * Submits a square job and waits for it from inside a task.
+ */
+static int job_nested(void *arg)
+{
+    Job *job = arg;
+
+    Job inner = *job;
+    inner.value = job->value + 1;
+
+    int result = 0;
+    assert(threadpool_wait(threadpool_submit(job->pool, job_square, NULL, &inner), &result) == THREADPOOL_OK);
+
+    return result;
+}
+
+static void test_threadpool_null_pool(void)
+{
+    Counter counter;
+    memset(&counter, 0, sizeof(counter));
+    assert(os_mutex_init(&counter.lock) == 0);
+
+    Job job = { .counter = &counter, .value = 7, .worker_id = -1 };
+
+    // Runs right away on the calling thread.
+    ThreadTask *task = threadpool_submit(NULL, job_square, job_done, &job);
+    assert(counter.calls == 1);
+    assert(counter.done_sum == 49);
+    assert(job.worker_id == 0);
+
+    int result = 0;
+    assert(threadpool_wait(task, &result) == THREADPOOL_OK);
+    assert(result == 49);
+
+    assert(threadpool_size(NULL) == 1);
+    assert(!threadpool_canceled(NULL));
+
+    os_mutex_destroy(&counter.lock);
+}
+
+static void test_threadpool_submit(void)
+{
+    Counter counter;
+    memset(&counter, 0, sizeof(counter));
+    assert(os_mutex_init(&counter.lock) == 0);
+
+    ThreadPool *pool = threadpool_create(4);
+    assert(pool != NULL);
+    assert(threadpool_size(pool) == 4);
+
+    Job jobs[100];
+    ThreadTask *tasks[ARRAY_SIZE(jobs)];
+    int results[ARRAY_SIZE(jobs)];
+
+    int expect_sum = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(jobs); i++) {
+        jobs[i].counter = &counter;
+        jobs[i].value = (int)i;
+        jobs[i].worker_id = -1;
+        expect_sum += (int)(i * i);
+
+        tasks[i] = threadpool_submit(pool, job_square, job_done, &jobs[i]);
+        assert(tasks[i] != NULL);
+    }
+
+    assert(threadpool_wait_all(tasks, ARRAY_SIZE(tasks), results, -1) == THREADPOOL_OK);
+
+    for (size_t i = 0; i < ARRAY_SIZE(jobs); i++) {
+        assert(results[i] == (int)(i * i));
+        assert(tasks[i] == NULL);
+
+        // Either a worker or this thread while it was waiting.
+        assert(jobs[i].worker_id >= 0 && jobs[i].worker_id <= 4);
+    }
+
+    assert(counter.calls == (int)ARRAY_SIZE(jobs));
+    assert(counter.done_calls == (int)ARRAY_SIZE(jobs));
+    assert(counter.done_sum == expect_sum);
+
+    threadpool_free(pool);
+    os_mutex_destroy(&counter.lock);
+}
+
+static void test_threadpool_nested_wait(void)
+{
+    Counter counter;
+    memset(&counter, 0, sizeof(counter));
+    assert(os_mutex_init(&counter.lock) == 0);
+
+    // Every worker waits on a task that is queued behind it, which only works
+    // because waiting runs queued tasks.
+    ThreadPool *pool = threadpool_create(1);
+    assert(pool != NULL);
+
+    Job jobs[8];
+    ThreadTask *tasks[ARRAY_SIZE(jobs)];
+    int results[ARRAY_SIZE(jobs)];
+
+    for (size_t i = 0; i < ARRAY_SIZE(jobs); i++) {
+        jobs[i].counter = &counter;
+        jobs[i].pool = pool;
+        jobs[i].value = (int)i;
+
+        tasks[i] = threadpool_submit(pool, job_nested, NULL, &jobs[i]);
+    }
+
+    assert(threadpool_wait_all(tasks, ARRAY_SIZE(tasks), results, -1) == THREADPOOL_OK);
+
+    for (size_t i = 0; i < ARRAY_SIZE(jobs); i++) {
+        assert(results[i] == (int)((i + 1) * (i + 1)));
+    }
+
+    threadpool_free(pool);
+    os_mutex_destroy(&counter.lock);
+}
+
+static void test_threadpool_cancel(void)
+{
+    Counter counter;
+    memset(&counter, 0, sizeof(counter));
+    assert(os_mutex_init(&counter.lock) == 0);
+
+    ThreadPool *pool = threadpool_create(2);
+    assert(pool != NULL);
+
+    threadpool_cancel(pool);
+    assert(threadpool_canceled(pool));
+
+    Job job = { .counter = &counter, .value = 3 };
+
+    int result = 42;
+    assert(threadpool_wait(threadpool_submit(pool, job_square, job_done, &job), &result) == THREADPOOL_ECANCELED);
+    assert(result == 42);
+
+    Job jobs[4];
+    ThreadTask *tasks[ARRAY_SIZE(jobs)];
+    int results[ARRAY_SIZE(jobs)];
+    for (size_t i = 0; i < ARRAY_SIZE(jobs); i++) {
+        jobs[i] = job;
+        tasks[i] = threadpool_submit(pool, job_square, job_done, &jobs[i]);
+    }
+
+    assert(threadpool_wait_all(tasks, ARRAY_SIZE(tasks), results, -1) == THREADPOOL_ECANCELED);
+    for (size_t i = 0; i < ARRAY_SIZE(jobs); i++) {
+        assert(results[i] == -1);
+    }
+
+    assert(counter.calls == 0);
+    assert(counter.done_calls == 0);
+
+    threadpool_free(pool);
+    os_mutex_destroy(&counter.lock);
+}
+
+static void test_threadpool_create_default(void)
+{
+    ThreadPool *pool = threadpool_create(0);
+    assert(pool != NULL);
+    assert(threadpool_size(pool) == os_cpu_count() || threadpool_size(pool) == THREADPOOL_MAX_THREADS);
+    threadpool_free(pool);
+
+    pool = threadpool_create(THREADPOOL_MAX_THREADS + 1);
+    assert(pool != NULL);
+    assert(threadpool_size(pool) == THREADPOOL_MAX_THREADS);
+    threadpool_free(pool);
+
+    // Nothing was submitted.
+    threadpool_free(NULL);
+}
+
+int main(void)
+{
+    test_threadpool_null_pool();
+    test_threadpool_submit();
+    test_threadpool_nested_wait();
+    test_threadpool_cancel();
+    test_threadpool_create_default();
+
+    return 0;
+}
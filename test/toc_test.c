@@ -0,0 +1,73 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "osapi.h"
+#include "test_util.h"
+#include "toc.h"
+#include "wowpkg.h"
+
+#define TEST_ADDONS WOWPKG_TEST_TMPDIR "test_toc"
+
+static void test_toc_load(void)
+{
+    os_remove_all(TEST_ADDONS);
+
+    write_file(TEST_ADDONS "/BigWigs/BigWigs.toc",
+        "\xEF\xBB\xBF## Interface: 110002\r\n"
+        "## Title:  |cffff7d0aBigWigs|r [|cffeda55fCore|r]  \r\n"
+        "## Title-deDE: BigWigs Kern\r\n"
+        "## Version: v350.1\r\n"
+        "# A comment\r\n"
+        "\r\n"
+        "## X-Website: https://github.com/BigWigsMods/BigWigs\r\n"
+        "## x-license: All Rights Reserved\r\n"
+        "Core.lua\r\n"
+        "## X-After: ignored\r\n");
+
+    Toc *toc = NULL;
+    assert(toc_load(&toc, TEST_ADDONS, "BigWigs") == TOC_OK);
+    assert(strcmp(toc->title, "BigWigs [Core]") == 0);
+    assert(strcmp(toc->version, "v350.1") == 0);
+    assert(strcmp(toc_field(toc, "X-Website"), "https://github.com/BigWigsMods/BigWigs") == 0);
+    assert(strcmp(toc_field(toc, "X-License"), "All Rights Reserved") == 0);
+    assert(toc_field(toc, "X-After") == NULL);
+    assert(toc_field(toc, "Interface") == NULL);
+    toc_free(toc);
+}
+
+static void test_toc_load_flavor(void)
+{
+    os_remove_all(TEST_ADDONS);
+
+    // Without a .toc named after the directory the first flavor is used.
+    write_file(TEST_ADDONS "/Plater/Plater_Vanilla.toc", "## Title: Plater Vanilla\n");
+    write_file(TEST_ADDONS "/Plater/Plater-Mainline.toc", "## Title: Plater\n## Version: @project-version@\n");
+    write_file(TEST_ADDONS "/Plater/Other.toc", "## Title: Other\n");
+
+    Toc *toc = NULL;
+    assert(toc_load(&toc, TEST_ADDONS, "Plater") == TOC_OK);
+    assert(strcmp(toc->title, "Plater") == 0);
+    assert(toc->version == NULL);
+    toc_free(toc);
+
+    write_file(TEST_ADDONS "/Empty/Other.toc", "## Title: Other\n");
+    assert(toc_load(&toc, TEST_ADDONS, "Empty") == TOC_ENOENT);
+    assert(toc_load(&toc, TEST_ADDONS, "Missing") == TOC_ENOENT);
+
+    // A title that is nothing but escapes is no title.
+    write_file(TEST_ADDONS "/Icon/Icon.toc", "## Title: |TInterface\\Icons\\Icon:16|t|r\n");
+    assert(toc_load(&toc, TEST_ADDONS, "Icon") == TOC_OK);
+    assert(toc->title == NULL);
+    toc_free(toc);
+
+    os_remove_all(TEST_ADDONS);
+}
+
+int main(void)
+{
+    test_toc_load();
+    test_toc_load_flavor();
+
+    return 0;
+}
@@ -0,0 +1,328 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "list.h"
+#include "osapi.h"
+#include "test_util.h"
+#include "transaction.h"
+#include "wowpkg.h"
+
+#define TEST_ADDONS WOWPKG_TEST_TMPDIR "test_transaction/addons"
+#define TEST_PACKAGE WOWPKG_TEST_TMPDIR "test_transaction/package"
+#define TEST_STATE WOWPKG_TEST_TMPDIR "test_transaction/saved.wowpkg"
+
+static bool exists(const char *path)
+{
+    struct os_stat s;
+    return os_stat(path, &s) == 0;
+}
+
+/**
+ * Creates an addons directory with an old version of addon 'A' in OldA and a
+ * directory of another addon.
+ */
+static void setup_addons(void)
+{
+    os_remove_all(WOWPKG_TEST_TMPDIR "test_transaction");
+
+    write_file(TEST_ADDONS "/OldA/A.toc", "old");
+    write_file(TEST_ADDONS "/Other/Other.toc", "other");
+}
+
+/**
+ * Creates a package for an addon at TEST_PACKAGE/name with a file in each
+ * directory in dirs.
+ */
+static void setup_package(const char *name, const char **dirs, size_t ndirs, const char *contents)
+{
+    for (size_t i = 0; i < ndirs; i++) {
+        char path[OS_MAX_PATH];
+        snprintf(path, ARRAY_SIZE(path), "%s/%s/%s/%s.toc", TEST_PACKAGE, name, dirs[i], dirs[i]);
+        write_file(path, contents);
+    }
+}
+
+static int swap(Transaction *t, const char *name, const char *old_dir, List *new_dirs)
+{
+    char package[OS_MAX_PATH];
+    snprintf(package, ARRAY_SIZE(package), "%s/%s", TEST_PACKAGE, name);
+
+    int err = transaction_stage(t, name, package);
+    if (err != TRANSACTION_OK) {
+        return err;
+    }
+
+    List *old_dirs = list_create();
+    assert(old_dirs != NULL);
+    if (old_dir != NULL) {
+        list_insert(old_dirs, strdup(old_dir));
+    }
+    list_set_free_fn(old_dirs, free);
+
+    err = transaction_swap(t, name, old_dirs, new_dirs);
+    list_free(old_dirs);
+
+    return err;
+}
+
+static void test_transaction_commit(void)
+{
+    setup_addons();
+
+    const char *dirs[] = { "OldA", "NewA" };
+    setup_package("A", dirs, ARRAY_SIZE(dirs), "new");
+
+    Transaction *t = NULL;
+    assert(transaction_begin(&t, TEST_ADDONS) == TRANSACTION_OK);
+    assert(transaction_pending(TEST_ADDONS));
+
+    // Only one transaction at a time.
+    Transaction *other = NULL;
+    assert(transaction_begin(&other, TEST_ADDONS) == TRANSACTION_EPENDING);
+    assert(other == NULL);
+
+    List *new_dirs = list_create();
+    list_set_free_fn(new_dirs, free);
+
+    assert(swap(t, "A", "OldA", new_dirs) == TRANSACTION_OK);
+    transaction_free(t);
+
+    size_t n = 0;
+    ListNode *node = NULL;
+    list_foreach(node, new_dirs)
+    {
+        assert(strcmp(node->value, "OldA") == 0 || strcmp(node->value, "NewA") == 0);
+        n++;
+    }
+    assert(n == 2);
+    list_free(new_dirs);
+
+    assert(file_equals(TEST_ADDONS "/OldA/OldA.toc", "new"));
+    assert(file_equals(TEST_ADDONS "/NewA/NewA.toc", "new"));
+    assert(!exists(TEST_ADDONS "/OldA/A.toc"));
+    assert(file_equals(TEST_ADDONS "/Other/Other.toc", "other"));
+
+    assert(transaction_commit(TEST_ADDONS) == TRANSACTION_OK);
+    assert(!transaction_pending(TEST_ADDONS));
+    assert(!exists(TEST_ADDONS "/" TRANSACTION_DIR_NAME));
+
+    // Nothing left to undo.
+    assert(transaction_rollback(TEST_ADDONS) == TRANSACTION_OK);
+    assert(file_equals(TEST_ADDONS "/OldA/OldA.toc", "new"));
+
+    os_remove_all(WOWPKG_TEST_TMPDIR "test_transaction");
+}
+
+static void test_transaction_rollback(void)
+{
+    setup_addons();
+
+    const char *dirs_a[] = { "OldA", "NewA" };
+    setup_package("A", dirs_a, ARRAY_SIZE(dirs_a), "new");
+
+    // B is not installed but has a directory that is in the way.
+    const char *dirs_b[] = { "Other" };
+    setup_package("B", dirs_b, ARRAY_SIZE(dirs_b), "b");
+
+    Transaction *t = NULL;
+    assert(transaction_begin(&t, TEST_ADDONS) == TRANSACTION_OK);
+
+    List *new_dirs = list_create();
+    list_set_free_fn(new_dirs, free);
+
+    assert(swap(t, "A", "OldA", new_dirs) == TRANSACTION_OK);
+    assert(swap(t, "B", NULL, new_dirs) == TRANSACTION_OK);
+    assert(file_equals(TEST_ADDONS "/Other/Other.toc", "b"));
+
+    // Stopping here leaves the transaction on disk.
+    transaction_free(t);
+    list_free(new_dirs);
+    assert(transaction_pending(TEST_ADDONS));
+
+    bool committed = true;
+    assert(transaction_recover(TEST_ADDONS, &committed) == TRANSACTION_OK);
+    assert(!committed);
+    assert(!transaction_pending(TEST_ADDONS));
+
+    assert(file_equals(TEST_ADDONS "/OldA/A.toc", "old"));
+    assert(!exists(TEST_ADDONS "/OldA/OldA.toc"));
+    assert(!exists(TEST_ADDONS "/NewA"));
+    assert(file_equals(TEST_ADDONS "/Other/Other.toc", "other"));
+
+    assert(transaction_rollback(TEST_ADDONS) == TRANSACTION_OK);
+    assert(file_equals(TEST_ADDONS "/OldA/A.toc", "old"));
+
+    os_remove_all(WOWPKG_TEST_TMPDIR "test_transaction");
+}
+
+static void test_transaction_recover_prepared(void)
+{
+    setup_addons();
+
+    const char *dirs[] = { "OldA" };
+    setup_package("A", dirs, ARRAY_SIZE(dirs), "new");
+
+    Transaction *t = NULL;
+    assert(transaction_begin(&t, TEST_ADDONS) == TRANSACTION_OK);
+
+    List *new_dirs = list_create();
+    list_set_free_fn(new_dirs, free);
+
+    assert(swap(t, "A", "OldA", new_dirs) == TRANSACTION_OK);
+    transaction_free(t);
+    list_free(new_dirs);
+
+    // Stopping before the new state was renamed into place keeps the old
+    // addon.
+    write_file(TEST_STATE ".tmp", "new state");
+    assert(transaction_prepare(TEST_ADDONS, TEST_STATE ".tmp") == TRANSACTION_OK);
+
+    bool committed = true;
+    assert(transaction_recover(TEST_ADDONS, &committed) == TRANSACTION_OK);
+    assert(!committed);
+    assert(!transaction_pending(TEST_ADDONS));
+    assert(file_equals(TEST_ADDONS "/OldA/A.toc", "old"));
+    assert(!exists(TEST_STATE ".tmp"));
+
+    os_remove_all(WOWPKG_TEST_TMPDIR "test_transaction");
+}
+
+static void test_transaction_recover_committed(void)
+{
+    setup_addons();
+
+    const char *dirs[] = { "OldA" };
+    setup_package("A", dirs, ARRAY_SIZE(dirs), "new");
+
+    Transaction *t = NULL;
+    assert(transaction_begin(&t, TEST_ADDONS) == TRANSACTION_OK);
+
+    List *new_dirs = list_create();
+    list_set_free_fn(new_dirs, free);
+
+    assert(swap(t, "A", "OldA", new_dirs) == TRANSACTION_OK);
+    transaction_free(t);
+    list_free(new_dirs);
+
+    // Once the new state was renamed into place the new addon is kept.
+    write_file(TEST_STATE ".tmp", "new state");
+    assert(transaction_prepare(TEST_ADDONS, TEST_STATE ".tmp") == TRANSACTION_OK);
+    assert(os_rename(TEST_STATE ".tmp", TEST_STATE) == 0);
+
+    bool committed = false;
+    assert(transaction_recover(TEST_ADDONS, &committed) == TRANSACTION_OK);
+    assert(committed);
+    assert(!transaction_pending(TEST_ADDONS));
+    assert(file_equals(TEST_ADDONS "/OldA/OldA.toc", "new"));
+    assert(file_equals(TEST_STATE, "new state"));
+
+    os_remove_all(WOWPKG_TEST_TMPDIR "test_transaction");
+}
+
+static void test_transaction_lock(void)
+{
+    setup_addons();
+
+    TransactionLock *lock = NULL;
+    assert(transaction_lock(&lock, TEST_ADDONS) == TRANSACTION_OK);
+    assert(lock != NULL);
+
+    TransactionLock *other = NULL;
+    assert(transaction_lock(&other, TEST_ADDONS) == TRANSACTION_ELOCKED);
+    assert(other == NULL);
+
+    transaction_unlock(lock);
+    assert(transaction_lock(&other, TEST_ADDONS) == TRANSACTION_OK);
+    transaction_unlock(other);
+
+    os_remove_all(WOWPKG_TEST_TMPDIR "test_transaction");
+}
+
+static void test_transaction_stage_clone(void)
+{
+    setup_addons();
+
+    const char *classic = WOWPKG_TEST_TMPDIR "test_transaction/classic";
+    write_file(WOWPKG_TEST_TMPDIR "test_transaction/classic/OldA/A.toc", "old classic");
+
+    const char *dirs[] = { "OldA" };
+    setup_package("A", dirs, ARRAY_SIZE(dirs), "new");
+
+    Transaction *retail_txn = NULL;
+    Transaction *classic_txn = NULL;
+    assert(transaction_begin(&retail_txn, TEST_ADDONS) == TRANSACTION_OK);
+    assert(transaction_begin(&classic_txn, classic) == TRANSACTION_OK);
+
+    // Unzipped once, staged in both.
+    assert(transaction_stage(retail_txn, "A", TEST_PACKAGE "/A") == TRANSACTION_OK);
+    assert(transaction_stage_clone(classic_txn, "A", retail_txn) == TRANSACTION_OK);
+
+    List *old_dirs = list_create();
+    list_set_free_fn(old_dirs, free);
+    list_insert(old_dirs, strdup("OldA"));
+
+    List *new_dirs = list_create();
+    list_set_free_fn(new_dirs, free);
+
+    assert(transaction_swap(retail_txn, "A", old_dirs, new_dirs) == TRANSACTION_OK);
+    assert(transaction_swap(classic_txn, "A", old_dirs, new_dirs) == TRANSACTION_OK);
+
+    transaction_free(retail_txn);
+    transaction_free(classic_txn);
+    list_free(old_dirs);
+    list_free(new_dirs);
+
+    assert(transaction_commit(TEST_ADDONS) == TRANSACTION_OK);
+    assert(transaction_commit(classic) == TRANSACTION_OK);
+
+    assert(file_equals(TEST_ADDONS "/OldA/OldA.toc", "new"));
+    assert(file_equals(WOWPKG_TEST_TMPDIR "test_transaction/classic/OldA/OldA.toc", "new"));
+    assert(!exists(WOWPKG_TEST_TMPDIR "test_transaction/classic/OldA/A.toc"));
+
+    os_remove_all(WOWPKG_TEST_TMPDIR "test_transaction");
+}
+
+static void test_transaction_remove(void)
+{
+    setup_addons();
+
+    List *old_dirs = list_create();
+    list_set_free_fn(old_dirs, free);
+    list_insert(old_dirs, strdup("Other"));
+
+    // Removed, then put back by a rollback.
+    Transaction *t = NULL;
+    assert(transaction_begin(&t, TEST_ADDONS) == TRANSACTION_OK);
+    assert(transaction_remove(t, "Other", old_dirs) == TRANSACTION_OK);
+    transaction_free(t);
+    assert(!exists(TEST_ADDONS "/Other"));
+
+    assert(transaction_rollback(TEST_ADDONS) == TRANSACTION_OK);
+    assert(file_equals(TEST_ADDONS "/Other/Other.toc", "other"));
+
+    // Removed for good by a commit.
+    assert(transaction_begin(&t, TEST_ADDONS) == TRANSACTION_OK);
+    assert(transaction_remove(t, "Other", old_dirs) == TRANSACTION_OK);
+    transaction_free(t);
+    assert(transaction_commit(TEST_ADDONS) == TRANSACTION_OK);
+    assert(!exists(TEST_ADDONS "/Other"));
+    assert(file_equals(TEST_ADDONS "/OldA/A.toc", "old"));
+
+    list_free(old_dirs);
+    os_remove_all(WOWPKG_TEST_TMPDIR "test_transaction");
+}
+
+int main(void)
+{
+    test_transaction_commit();
+    test_transaction_rollback();
+    test_transaction_recover_prepared();
+    test_transaction_recover_committed();
+    test_transaction_lock();
+    test_transaction_stage_clone();
+    test_transaction_remove();
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "osapi.h"
+#include "test_util.h"
+#include "watch.h"
+#include "wowpkg.h"
+
+#define TEST_ADDONS WOWPKG_TEST_TMPDIR "test_watch/addons"
+
+#ifdef __linux__
+
+static Watch *create_watch(void)
+{
+    os_remove_all(WOWPKG_TEST_TMPDIR "test_watch");
+
+    write_file(TEST_ADDONS "/A/A.toc", "a");
+    write_file(TEST_ADDONS "/A/Libs/LibStub/LibStub.lua", "libstub");
+    write_file(TEST_ADDONS "/B/B.toc", "b");
+    write_file(TEST_ADDONS "/.wowpkg_txn/A/A.toc", "a");
+
+    Watch *w = NULL;
+    assert(watch_create(&w, TEST_ADDONS) == WATCH_OK);
+
+    // Nothing is clean until it was checked.
+    assert(!watch_is_clean(w, "A"));
+    assert(!watch_is_clean(w, "B"));
+
+    watch_mark_clean(w, "A");
+    watch_mark_clean(w, "B");
+    watch_poll(w);
+    assert(watch_is_clean(w, "A"));
+    assert(watch_is_clean(w, "B"));
+
+    return w;
+}
+
+static void test_watch_modify(void)
+{
+    Watch *w = create_watch();
+
+    // A change deep inside of an addon only makes that addon unclean.
+    write_file(TEST_ADDONS "/A/Libs/LibStub/LibStub.lua", "changed");
+    assert(watch_is_clean(w, "A"));
+    watch_poll(w);
+    assert(!watch_is_clean(w, "A"));
+    assert(watch_is_clean(w, "B"));
+
+    watch_mark_clean(w, "A");
+    watch_poll(w);
+    assert(watch_is_clean(w, "A"));
+
+    // So does changing the attributes of a file.
+    assert(os_set_mtime(TEST_ADDONS "/B/B.toc", 0) == 0);
+    watch_poll(w);
+    assert(watch_is_clean(w, "A"));
+    assert(!watch_is_clean(w, "B"));
+
+    watch_free(w);
+}
+
+static void test_watch_new_dir(void)
+{
+    Watch *w = create_watch();
+
+    // Directories created later are watched as well.
+    write_file(TEST_ADDONS "/A/Media/Icons/icon.tga", "icon");
+    watch_poll(w);
+    assert(!watch_is_clean(w, "A"));
+
+    watch_mark_clean(w, "A");
+    watch_poll(w);
+    assert(watch_is_clean(w, "A"));
+
+    write_file(TEST_ADDONS "/A/Media/Icons/icon.tga", "changed");
+    watch_poll(w);
+    assert(!watch_is_clean(w, "A"));
+
+    // And so are new addons.
+    write_file(TEST_ADDONS "/C/C.toc", "c");
+    watch_poll(w);
+    assert(!watch_is_clean(w, "C"));
+    watch_mark_clean(w, "C");
+    write_file(TEST_ADDONS "/C/C.lua", "c");
+    watch_poll(w);
+    assert(!watch_is_clean(w, "C"));
+    assert(watch_is_clean(w, "B"));
+
+    watch_free(w);
+}
+
+static void test_watch_dot_dirs(void)
+{
+    Watch *w = create_watch();
+
+    // Backups of a transaction do not change any addon.
+    write_file(TEST_ADDONS "/.wowpkg_txn/A/A.toc", "changed");
+    write_file(TEST_ADDONS "/.wowpkg_txn/B/B.toc", "b");
+    watch_poll(w);
+    assert(watch_is_clean(w, "A"));
+    assert(watch_is_clean(w, "B"));
+
+    watch_free(w);
+}
+
+static void test_watch_remove(void)
+{
+    Watch *w = create_watch();
+
+    assert(os_remove_all(TEST_ADDONS "/A") == 0);
+    watch_poll(w);
+    assert(!watch_is_clean(w, "A"));
+    assert(watch_is_clean(w, "B"));
+
+    // Moved in its place.
+    assert(os_rename(TEST_ADDONS "/B", TEST_ADDONS "/A") == 0);
+    watch_poll(w);
+    assert(!watch_is_clean(w, "A"));
+    assert(!watch_is_clean(w, "B"));
+
+    watch_mark_clean(w, "A");
+    write_file(TEST_ADDONS "/A/B.toc", "changed");
+    watch_poll(w);
+    assert(!watch_is_clean(w, "A"));
+
+    // Without the addons directory nothing can be clean anymore.
+    watch_mark_clean(w, "A");
+    assert(os_remove_all(TEST_ADDONS) == 0);
+    watch_poll(w);
+    watch_mark_clean(w, "A");
+    assert(!watch_is_clean(w, "A"));
+
+    watch_free(w);
+}
+
+int main(void)
+{
+    test_watch_modify();
+    test_watch_new_dir();
+    test_watch_dot_dirs();
+    test_watch_remove();
+
+    os_remove_all(WOWPKG_TEST_TMPDIR "test_watch");
+
+    return 0;
+}
+
+#else
+
+int main(void)
+{
+    Watch *w = NULL;
+    assert(watch_create(&w, TEST_ADDONS) == WATCH_EUNSUPPORTED);
+
+    return 0;
+}
+
+#endif
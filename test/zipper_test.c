@@ -1,5 +1,8 @@
 #include <assert.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
 
 #include "osapi.h"
 #include "osstring.h"
@@ -82,6 +85,85 @@ static void test_zipper_unzip(const char *outpath)
     assert(os_remove_all(outpath) == 0);
 }
 
+static void test_zipper_unzip_stats(const char *outpath)
+{
+    ZipperStats stats;
+
+    assert(os_mkdir(outpath, 0755) == 0);
+
+    assert(zipper_unzip_stats(WOWPKG_TEST_DIR "/mocks/mock_zip.zip", outpath, &stats) == ZIPPER_OK);
+
+    // Directory entries are not counted as files.
+    assert(stats.files == 3);
+    assert(stats.bytes == 50);
+
+    assert(os_remove_all(outpath) == 0);
+}
+
+static bool filter_dir_b(const char *path, void *arg)
+{
+    UNUSED(arg);
+
+    char expected[OS_MAX_PATH];
+    snprintf(expected, ARRAY_SIZE(expected), "mock_dir_b%cmock_dir_b.txt", OS_SEPARATOR);
+
+    return strcmp(path, expected) == 0;
+}
+
+static void test_zipper_unzip_filter(const char *outpath)
+{
+    ZipperStats stats;
+    struct os_stat s;
+
+    assert(os_mkdir(outpath, 0755) == 0);
+
+    assert(zipper_unzip_filter(WOWPKG_TEST_DIR "/mocks/mock_zip.zip", outpath, filter_dir_b, NULL, &stats) == ZIPPER_OK);
+
+    assert(stats.files == 1);
+    assert(stats.bytes == 16);
+    assert(os_stat(WOWPKG_TEST_TMPDIR "test_tmp/mock_dir_b/mock_dir_b.txt", &s) == 0);
+    assert(os_stat(WOWPKG_TEST_TMPDIR "test_tmp/mock_dir_a/mock_dir_a.txt", &s) != 0);
+
+    assert(os_remove_all(outpath) == 0);
+}
+
+static int count_entry(const ZipperEntry *entry, void *arg)
+{
+    size_t *n = arg;
+
+    char expected[OS_MAX_PATH];
+    snprintf(expected, ARRAY_SIZE(expected), "mock_dir_c%cmock_dir_c_a%cmock_dir_c_a.txt", OS_SEPARATOR, OS_SEPARATOR);
+    if (strcmp(entry->path, expected) == 0) {
+        assert(entry->size == 18);
+        assert(entry->mtime > 0);
+    }
+
+    (*n)++;
+
+    return ZIPPER_OK;
+}
+
+static void test_zipper_list(const char *outpath)
+{
+    // Directory entries are not listed.
+    size_t n = 0;
+    assert(zipper_list(WOWPKG_TEST_DIR "/mocks/mock_zip.zip", count_entry, &n) == ZIPPER_OK);
+    assert(n == 3);
+
+    assert(zipper_list(WOWPKG_TEST_DIR "/mocks/missing.zip", count_entry, &n) == ZIPPER_ENOENT);
+
+    // Extracted files get the time of their entry.
+    ZipperStats stats;
+    assert(os_mkdir(outpath, 0755) == 0);
+    assert(zipper_unzip_stats(WOWPKG_TEST_DIR "/mocks/mock_zip.zip", outpath, &stats) == ZIPPER_OK);
+
+    struct os_stat s;
+    assert(os_stat(WOWPKG_TEST_TMPDIR "test_tmp/mock_dir_a/mock_dir_a.txt", &s) == 0);
+    assert(s.st_mtime > 0 && s.st_mtime < time(NULL) - 24 * 60 * 60);
+
+    assert(os_remove_all(outpath) == 0);
+}
+
 int main(void)
 {
     // Ensure previous runs don't affect this run.
@@ -89,6 +171,9 @@ int main(void)
 
     test_zipper_unzip(WOWPKG_TEST_TMPDIR "test_tmp");
     test_zipper_unzip(WOWPKG_TEST_TMPDIR "test_tmp/");
+    test_zipper_unzip_stats(WOWPKG_TEST_TMPDIR "test_tmp");
+    test_zipper_unzip_filter(WOWPKG_TEST_TMPDIR "test_tmp");
+    test_zipper_list(WOWPKG_TEST_TMPDIR "test_tmp");
 
     return 0;
 }